@@ -0,0 +1,58 @@
+#include "BinaryStream.h"
+#include <stdexcept>
+
+
+namespace c40kl
+{
+
+
+void BinaryWriter::WriteString(const std::string& str)
+{
+	Write((uint64_t)str.size());
+	m_Bytes.append(str);
+}
+
+
+BinaryReader::BinaryReader(const char* data, size_t size) :
+	m_Data(data),
+	m_Size(size),
+	m_Position(0)
+{
+}
+
+
+BinaryReader::BinaryReader(const std::string& bytes) :
+	BinaryReader(bytes.data(), bytes.size())
+{
+}
+
+
+std::string BinaryReader::ReadString()
+{
+	const size_t size = ReadSize(1);
+	return std::string(Advance(size), size);
+}
+
+
+size_t BinaryReader::ReadSize(size_t minElementBytes)
+{
+	const uint64_t size = Read<uint64_t>();
+	if (minElementBytes > 0 && size > GetNumBytesLeft() / minElementBytes)
+		throw std::runtime_error("Invalid data: array size is larger than the data left.");
+
+	return (size_t)size;
+}
+
+
+const char* BinaryReader::Advance(size_t numBytes)
+{
+	if (numBytes > GetNumBytesLeft())
+		throw std::runtime_error("Invalid data: unexpected end of data.");
+
+	const char* pBytes = m_Data + m_Position;
+	m_Position += numBytes;
+	return pBytes;
+}
+
+
+} // namespace c40kl
@@ -0,0 +1,162 @@
+#pragma once
+
+
+#include "Utility.h"
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// Writes values into a growing buffer of bytes, for serialising objects.
+/// Values are stored exactly as they are laid out in memory, so are in the
+/// machine's byte order (little-endian on every platform we build for),
+/// hence writers should always use fixed-size types (int32_t rather than
+/// int, uint64_t rather than size_t, etc.)
+/// </summary>
+class C40KL_API BinaryWriter
+{
+public:
+	/// <summary>
+	/// Append a value of a plain type (such as a number) to the buffer.
+	/// </summary>
+	template<typename T>
+	void Write(const T& value)
+	{
+		static_assert(std::is_trivially_copyable<T>::value,
+			"Can only write plain values.");
+		m_Bytes.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+
+	/// <summary>
+	/// Append an array of plain values, preceded by its size.
+	/// </summary>
+	template<typename T>
+	void WriteArray(const std::vector<T>& values)
+	{
+		static_assert(std::is_trivially_copyable<T>::value,
+			"Can only write arrays of plain values.");
+		Write((uint64_t)values.size());
+		if (!values.empty())
+			m_Bytes.append(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+	}
+
+
+	/// <summary>
+	/// Append a string, preceded by its size.
+	/// </summary>
+	void WriteString(const std::string& str);
+
+
+	/// <summary>
+	/// Get the bytes written so far.
+	/// </summary>
+	inline const std::string& GetBytes() const
+	{
+		return m_Bytes;
+	}
+
+
+private:
+	std::string m_Bytes;
+};
+
+
+/// <summary>
+/// Reads back values written by a BinaryWriter, in the same order.
+/// Throws std::runtime_error if reading past the end of the data,
+/// so truncated or corrupt data is never read out of bounds.
+/// NOTE: the reader does not copy the data, so it must outlive the reader.
+/// </summary>
+class C40KL_API BinaryReader
+{
+public:
+	/// <summary>
+	/// Create a reader positioned at the start of the given data.
+	/// </summary>
+	/// <param name="data">The data to read.</param>
+	/// <param name="size">The number of bytes of data.</param>
+	BinaryReader(const char* data, size_t size);
+
+
+	/// <summary>
+	/// Create a reader positioned at the start of the given bytes.
+	/// </summary>
+	explicit BinaryReader(const std::string& bytes);
+
+
+	/// <summary>
+	/// Read a value of a plain type (see BinaryWriter::Write()).
+	/// </summary>
+	template<typename T>
+	T Read()
+	{
+		static_assert(std::is_trivially_copyable<T>::value,
+			"Can only read plain values.");
+		T value;
+		std::memcpy(&value, Advance(sizeof(T)), sizeof(T));
+		return value;
+	}
+
+
+	/// <summary>
+	/// Read an array of plain values (see BinaryWriter::WriteArray()).
+	/// </summary>
+	template<typename T>
+	std::vector<T> ReadArray()
+	{
+		static_assert(std::is_trivially_copyable<T>::value,
+			"Can only read arrays of plain values.");
+		const size_t size = ReadSize(sizeof(T));
+		std::vector<T> values(size);
+		if (size > 0)
+			std::memcpy(values.data(), Advance(size * sizeof(T)), size * sizeof(T));
+		return values;
+	}
+
+
+	/// <summary>
+	/// Read a string (see BinaryWriter::WriteString()).
+	/// </summary>
+	std::string ReadString();
+
+
+	/// <summary>
+	/// Read the size of an array whose elements take up at least the given
+	/// number of bytes each, and check that there is enough data left for it
+	/// (so that corrupt sizes don't cause huge allocations.)
+	/// </summary>
+	/// <param name="minElementBytes">The minimum number of bytes in each element.</param>
+	size_t ReadSize(size_t minElementBytes);
+
+
+	/// <summary>
+	/// Get the number of bytes not yet read.
+	/// </summary>
+	inline size_t GetNumBytesLeft() const
+	{
+		return m_Size - m_Position;
+	}
+
+
+private:
+	//Move past the given number of bytes, and return a pointer to
+	// the first of them (throwing if there aren't enough left.)
+	const char* Advance(size_t numBytes);
+
+
+private:
+	const char* const m_Data;
+	const size_t m_Size;
+	size_t m_Position;
+};
+
+
+} // namespace c40kl
@@ -2,6 +2,8 @@
 #include <algorithm>
 #include <cmath>
 #include <sstream>
+#include <stdexcept>
+#include <boost/functional/hash.hpp>
 
 
 namespace c40kl
@@ -10,7 +12,8 @@ namespace c40kl
 
 BoardState::BoardState(int boardSize, float scale) :
 	m_Size(boardSize),
-	m_Scale(scale)
+	m_Scale(scale),
+	m_pStorage(std::make_shared<Storage>())
 {
 	C40KL_ASSERT_PRECONDITION(boardSize > 0, "Board size must be strictly positive.");
 	C40KL_ASSERT_PRECONDITION(scale > 0, "Scale must be strictly positive.");
@@ -22,9 +25,7 @@ bool BoardState::IsOccupied(Position pos) const
 	C40KL_ASSERT_PRECONDITION(pos.first >= 0 && pos.second >= 0 && pos.first < m_Size && pos.second < m_Size,
 		"Coordinates must be valid.");
 
-	auto iter = std::find(m_Positions.begin(), m_Positions.end(), pos);
-
-	return (iter != m_Positions.end());
+	return (FindIndex(pos) != m_pStorage->positions.size());
 }
 
 
@@ -34,24 +35,26 @@ void BoardState::SetUnitOnSquare(Position pos, Unit unit, int team)
 		"Coordinates must be valid.");
 	C40KL_ASSERT_PRECONDITION(team == 0 || team == 1, "Team must be 0 or 1.");
 
-	auto iter = std::find(m_Positions.begin(), m_Positions.end(), pos);
-	
-	if (iter == m_Positions.end())
+	const size_t i = FindIndex(pos);
+	auto pUnit = std::make_shared<const Unit>(std::move(unit));
+	Storage& storage = GetMutableStorage();
+
+	if (i == storage.positions.size())
 	{
 		//Previously unoccupied position
 
-		m_Units.push_back(unit);
-		m_Positions.push_back(pos);
-		m_Teams.push_back(team);
+		storage.units.push_back(std::move(pUnit));
+		storage.positions.push_back(pos);
+		storage.teams.push_back(team);
 	}
 	else
 	{
-		//Override existing info
-
-		const size_t i = std::distance(m_Positions.begin(), iter);
+		//Override existing info (note that we replace the
+		// pointer rather than writing through it, because
+		// the old unit may be shared with other boards).
 
-		m_Teams[i] = team;
-		m_Units[i] = unit;
+		storage.teams[i] = team;
+		storage.units[i] = std::move(pUnit);
 	}
 }
 
@@ -61,13 +64,11 @@ const Unit& BoardState::GetUnitOnSquare(Position pos) const
 	//Automatically checks x,y are valid
 	C40KL_ASSERT_PRECONDITION(IsOccupied(pos), "Must be an occupied square.");
 
-	auto iter = std::find(m_Positions.begin(), m_Positions.end(), pos);
-	
-	C40KL_ASSERT_INVARIANT(iter != m_Positions.end(), "Must be able to find position.");
+	const size_t i = FindIndex(pos);
 
-	const size_t i = std::distance(m_Positions.begin(), iter);
+	C40KL_ASSERT_INVARIANT(i < m_pStorage->positions.size(), "Must be able to find position.");
 
-	return m_Units[i];
+	return *m_pStorage->units[i];
 }
 
 
@@ -76,32 +77,33 @@ int BoardState::GetTeamOnSquare(Position pos) const
 	//Automatically checks x,y are valid
 	C40KL_ASSERT_PRECONDITION(IsOccupied(pos), "Must be an occupied square.");
 
-	auto iter = std::find(m_Positions.begin(), m_Positions.end(), pos);
+	const size_t i = FindIndex(pos);
 
-	C40KL_ASSERT_INVARIANT(iter != m_Positions.end(), "Must be able to find position.");
+	C40KL_ASSERT_INVARIANT(i < m_pStorage->positions.size(), "Must be able to find position.");
 
-	const size_t i = std::distance(m_Positions.begin(), iter);
-
-	return m_Teams[i];
+	return m_pStorage->teams[i];
 }
 
 
 PositionArray BoardState::GetAllUnits(int team) const
 {
 	C40KL_ASSERT_PRECONDITION(team == 0 || team == 1, "Team must be 0 or 1.");
-	C40KL_ASSERT_INVARIANT(m_Positions.size() == m_Teams.size(),
+	C40KL_ASSERT_INVARIANT(m_pStorage->positions.size() == m_pStorage->teams.size(),
 		"Position/team/unit arrays must be same size.");
 
+	const auto& positions = m_pStorage->positions;
+	const auto& teams = m_pStorage->teams;
+
 	PositionArray arr;
 
 	//Reserve for worst case to prevent lots of allocations
-	arr.reserve(m_Positions.size());
+	arr.reserve(positions.size());
 
-	for (size_t i = 0; i < m_Positions.size(); i++)
+	for (size_t i = 0; i < positions.size(); i++)
 	{
-		if (m_Teams[i] == team)
+		if (teams[i] == team)
 		{
-			arr.push_back(m_Positions[i]);
+			arr.push_back(positions[i]);
 		}
 	}
 
@@ -112,19 +114,22 @@ PositionArray BoardState::GetAllUnits(int team) const
 UnitArray BoardState::GetAllUnitStats(int team) const
 {
 	C40KL_ASSERT_PRECONDITION(team == 0 || team == 1, "Team must be 0 or 1.");
-	C40KL_ASSERT_INVARIANT(m_Units.size() == m_Teams.size(),
+	C40KL_ASSERT_INVARIANT(m_pStorage->units.size() == m_pStorage->teams.size(),
 		"Position/team/unit arrays must be same size.");
 
+	const auto& units = m_pStorage->units;
+	const auto& teams = m_pStorage->teams;
+
 	UnitArray arr;
 
 	//Reserve for worst case to prevent lots of allocations
-	arr.reserve(m_Units.size());
+	arr.reserve(units.size());
 
-	for (size_t i = 0; i < m_Units.size(); i++)
+	for (size_t i = 0; i < units.size(); i++)
 	{
-		if (m_Teams[i] == team)
+		if (teams[i] == team)
 		{
-			arr.push_back(m_Units[i]);
+			arr.push_back(*units[i]);
 		}
 	}
 
@@ -137,34 +142,38 @@ void BoardState::ClearSquare(Position pos)
 	//Automatically checks pos is valid
 	C40KL_ASSERT_PRECONDITION(IsOccupied(pos), "Must be an occupied square.");
 
-	auto iter = std::find(m_Positions.begin(), m_Positions.end(), pos);
+	const size_t i = FindIndex(pos);
 
-	C40KL_ASSERT_INVARIANT(iter != m_Positions.end(), "Must be able to find position.");
+	C40KL_ASSERT_INVARIANT(i < m_pStorage->positions.size(), "Must be able to find position.");
 
-	const size_t i = std::distance(m_Positions.begin(), iter);
+	Storage& storage = GetMutableStorage();
 
 	//Erase using 'swap and pop':
 
-	std::swap(m_Positions[i], m_Positions.back());
-	m_Positions.pop_back();
+	std::swap(storage.positions[i], storage.positions.back());
+	storage.positions.pop_back();
 
-	std::swap(m_Teams[i], m_Teams.back());
-	m_Teams.pop_back();
+	std::swap(storage.teams[i], storage.teams.back());
+	storage.teams.pop_back();
 
-	std::swap(m_Units[i], m_Units.back());
-	m_Units.pop_back();
+	std::swap(storage.units[i], storage.units.back());
+	storage.units.pop_back();
 }
 
 
 bool BoardState::HasAdjacentEnemy(Position pos, int team) const
 {
 	C40KL_ASSERT_PRECONDITION(team == 0 || team == 1, "Invalid team value.");
-	for (size_t i = 0; i < m_Positions.size(); i++)
+
+	const auto& positions = m_pStorage->positions;
+	const auto& teams = m_pStorage->teams;
+
+	for (size_t i = 0; i < positions.size(); i++)
 	{
-		if (m_Teams[i] != team &&
-			std::abs(m_Positions[i].first - pos.first) <= 1
-			&& std::abs(m_Positions[i].second - pos.second) <= 1
-			&& m_Positions[i] != pos)
+		if (teams[i] != team &&
+			std::abs(positions[i].first - pos.first) <= 1
+			&& std::abs(positions[i].second - pos.second) <= 1
+			&& positions[i] != pos)
 		{
 			return true;
 		}
@@ -215,7 +224,7 @@ float BoardState::GetDistance(Position a, Position b) const
 {
 	const auto dx = a.first - b.first;
 	const auto dy = a.second - b.second;
-	return m_Scale * std::sqrtf(static_cast<float>(dx * dx + dy * dy));
+	return m_Scale * std::sqrt(static_cast<float>(dx * dx + dy * dy));
 }
 
 
@@ -223,7 +232,7 @@ std::pair<size_t, size_t> BoardState::GetUnitCounts() const
 {
 	std::pair<size_t, size_t> result = std::make_pair(0U, 0U);
 
-	for (auto team : m_Teams)
+	for (auto team : m_pStorage->teams)
 	{
 		switch (team)
 		{
@@ -240,6 +249,168 @@ std::pair<size_t, size_t> BoardState::GetUnitCounts() const
 }
 
 
+size_t BoardState::GetHash() const
+{
+	size_t seed = 0;
+	boost::hash_combine(seed, m_Size);
+	boost::hash_combine(seed, m_Scale);
+
+	const auto& storage = *m_pStorage;
+	for (size_t i = 0; i < storage.positions.size(); i++)
+	{
+		const Unit& unit = *storage.units[i];
+
+		boost::hash_combine(seed, storage.positions[i].first);
+		boost::hash_combine(seed, storage.positions[i].second);
+		boost::hash_combine(seed, storage.teams[i]);
+
+		//Only hash the unit statistics which change during
+		// a game, and the name to tell the rest apart. This
+		// is still consistent with equality.
+		boost::hash_combine(seed, unit.name);
+		boost::hash_combine(seed, unit.count);
+		boost::hash_combine(seed, unit.total_w);
+		boost::hash_combine(seed, unit.modelsLostThisPhase);
+
+		const int flags = (unit.movedThisTurn ? 1 : 0)
+			| (unit.firedThisTurn ? 2 : 0)
+			| (unit.attemptedChargeThisTurn ? 4 : 0)
+			| (unit.successfulChargeThisTurn ? 8 : 0)
+			| (unit.foughtThisTurn ? 16 : 0)
+			| (unit.movedOutOfCombatThisTurn ? 32 : 0);
+		boost::hash_combine(seed, flags);
+	}
+
+	return seed;
+}
+
+
+size_t BoardState::GetMemoryUsage() const
+{
+	return sizeof(Storage)
+		+ m_pStorage->units.capacity() * sizeof(UnitPtr)
+		+ m_pStorage->positions.capacity() * sizeof(Position)
+		+ m_pStorage->teams.capacity() * sizeof(int);
+}
+
+
+void BoardState::WriteUnit(const Unit& unit, BinaryWriter& writer)
+{
+	//Every number is written as an int32, and every flag as a byte
+	writer.WriteString(unit.name);
+
+	for (int value : { unit.count, unit.movement, unit.ws, unit.bs, unit.t, unit.w,
+		unit.total_w, unit.a, unit.ld, unit.sv, unit.inv, unit.rg_range, unit.rg_s,
+		unit.rg_ap, unit.rg_dmg, unit.rg_shots, unit.ml_s, unit.ml_ap, unit.ml_dmg,
+		unit.modelsLostThisPhase })
+	{
+		writer.Write((int32_t)value);
+	}
+
+	for (bool flag : { unit.rg_is_rapid, unit.rg_is_heavy, unit.movedThisTurn,
+		unit.firedThisTurn, unit.attemptedChargeThisTurn, unit.successfulChargeThisTurn,
+		unit.foughtThisTurn, unit.movedOutOfCombatThisTurn })
+	{
+		writer.Write((uint8_t)flag);
+	}
+}
+
+
+Unit BoardState::ReadUnit(BinaryReader& reader)
+{
+	Unit unit;
+	unit.name = reader.ReadString();
+
+	for (int* pValue : { &unit.count, &unit.movement, &unit.ws, &unit.bs, &unit.t, &unit.w,
+		&unit.total_w, &unit.a, &unit.ld, &unit.sv, &unit.inv, &unit.rg_range, &unit.rg_s,
+		&unit.rg_ap, &unit.rg_dmg, &unit.rg_shots, &unit.ml_s, &unit.ml_ap, &unit.ml_dmg,
+		&unit.modelsLostThisPhase })
+	{
+		*pValue = reader.Read<int32_t>();
+	}
+
+	for (bool* pFlag : { &unit.rg_is_rapid, &unit.rg_is_heavy, &unit.movedThisTurn,
+		&unit.firedThisTurn, &unit.attemptedChargeThisTurn, &unit.successfulChargeThisTurn,
+		&unit.foughtThisTurn, &unit.movedOutOfCombatThisTurn })
+	{
+		*pFlag = (reader.Read<uint8_t>() != 0);
+	}
+
+	return unit;
+}
+
+
+void BoardState::Write(BinaryWriter& writer) const
+{
+	Write(writer, [](const UnitPtr& pUnit, BinaryWriter& unitWriter)
+	{
+		WriteUnit(*pUnit, unitWriter);
+	});
+}
+
+
+void BoardState::Write(BinaryWriter& writer, const UnitWriter& writeUnit) const
+{
+	writer.Write((int32_t)m_Size);
+	writer.Write(m_Scale);
+	writer.Write((uint64_t)m_pStorage->units.size());
+
+	for (size_t i = 0; i < m_pStorage->units.size(); i++)
+	{
+		writer.Write((int32_t)m_pStorage->positions[i].first);
+		writer.Write((int32_t)m_pStorage->positions[i].second);
+		writer.Write((int32_t)m_pStorage->teams[i]);
+		writeUnit(m_pStorage->units[i], writer);
+	}
+}
+
+
+BoardState BoardState::Read(BinaryReader& reader)
+{
+	return Read(reader, [](BinaryReader& unitReader)
+	{
+		return std::make_shared<const Unit>(ReadUnit(unitReader));
+	});
+}
+
+
+BoardState BoardState::Read(BinaryReader& reader, const UnitReader& readUnit)
+{
+	const int size = reader.Read<int32_t>();
+	const float scale = reader.Read<float>();
+	if (size <= 0 || !(scale > 0.0f))
+		throw std::runtime_error("Invalid data: bad board size or scale.");
+
+	BoardState board(size, scale);
+	Storage& storage = *board.m_pStorage;
+
+	//(Each unit takes at least 12 bytes for its position and team)
+	const size_t numUnits = reader.ReadSize(12);
+	storage.units.reserve(numUnits);
+	storage.positions.reserve(numUnits);
+	storage.teams.reserve(numUnits);
+
+	for (size_t i = 0; i < numUnits; i++)
+	{
+		const int x = reader.Read<int32_t>();
+		const int y = reader.Read<int32_t>();
+		const int team = reader.Read<int32_t>();
+		if (x < 0 || y < 0 || x >= size || y >= size || (team != 0 && team != 1)
+			|| board.IsOccupied(Position(x, y)))
+		{
+			throw std::runtime_error("Invalid data: bad unit position or team.");
+		}
+
+		//(The square is free, so this is what SetUnitOnSquare() would do)
+		storage.units.push_back(readUnit(reader));
+		storage.positions.push_back(Position(x, y));
+		storage.teams.push_back(team);
+	}
+
+	return board;
+}
+
+
 std::string BoardState::ToString() const
 {
 	std::stringstream m;
@@ -247,11 +418,12 @@ std::string BoardState::ToString() const
 	m << "Board State ( size = " << m_Size
 		<< ", scale = " << m_Scale << ", units = [  ";
 
-	for (size_t i = 0; i < m_Positions.size(); i++)
+	const auto& storage = *m_pStorage;
+	for (size_t i = 0; i < storage.positions.size(); i++)
 	{
-		m << '"' << m_Units[i].name << '"'
-			<< " at (" << m_Positions[i].first << ','
-			<< m_Positions[i].second << ")  ";
+		m << '"' << storage.units[i]->name << '"'
+			<< " at (" << storage.positions[i].first << ','
+			<< storage.positions[i].second << ")  ";
 	}
 
 	m << "] )";
@@ -260,6 +432,56 @@ std::string BoardState::ToString() const
 }
 
 
+bool BoardState::operator == (const BoardState& other) const
+{
+	if (m_Size != other.m_Size || m_Scale != other.m_Scale)
+		return false;
+
+	//Boards which share storage are trivially equal
+	if (m_pStorage == other.m_pStorage)
+		return true;
+
+	const auto& a = *m_pStorage;
+	const auto& b = *other.m_pStorage;
+
+	if (a.positions != b.positions || a.teams != b.teams)
+		return false;
+
+	C40KL_ASSERT_INVARIANT(a.units.size() == b.units.size(),
+		"Position/team/unit arrays must be same size.");
+
+	for (size_t i = 0; i < a.units.size(); i++)
+	{
+		//Compare by pointer first, as most units will be shared
+		if (a.units[i] != b.units[i] && *a.units[i] != *b.units[i])
+			return false;
+	}
+
+	return true;
+}
+
+
+BoardState::Storage& BoardState::GetMutableStorage()
+{
+	//If anyone else can see this storage, we need
+	// our own copy before we can write to it. Note
+	// that this only copies pointers to the units.
+	if (m_pStorage.use_count() > 1)
+	{
+		m_pStorage = std::make_shared<Storage>(*m_pStorage);
+	}
+	return *m_pStorage;
+}
+
+
+size_t BoardState::FindIndex(Position pos) const
+{
+	const auto& positions = m_pStorage->positions;
+	auto iter = std::find(positions.begin(), positions.end(), pos);
+	return std::distance(positions.begin(), iter);
+}
+
+
 } // namespace c40kl
 
 
@@ -3,7 +3,10 @@
 
 #include "Utility.h"
 #include "Unit.h"
+#include "BinaryStream.h"
 #include <map>
+#include <memory>
+#include <functional>
 
 
 namespace c40kl
@@ -14,10 +17,37 @@ namespace c40kl
 /// The board state represents units and their teams
 /// on a fixed-sized square grid. This is not an
 /// immutable data structure and can be modified.
+/// NOTE: copies of a board state share their unit
+/// storage (copy-on-write). Copying a board is thus
+/// very cheap, and modifying a copy only duplicates
+/// the small position/team/pointer arrays - the unit
+/// statistics which were not changed remain shared
+/// with the board it was copied from. This matters
+/// because every node in a search tree stores a board.
 /// </summary>
 class C40KL_API BoardState
 {
 public:
+	/// <summary>
+	/// The statistics of a unit on a board, which are immutable
+	/// and may be shared between several boards.
+	/// </summary>
+	typedef std::shared_ptr<const Unit> UnitPtr;
+
+
+	/// <summary>
+	/// Writes each unit on a board in place of its statistics (see Write().)
+	/// </summary>
+	typedef std::function<void(const UnitPtr& pUnit, BinaryWriter& writer)> UnitWriter;
+
+
+	/// <summary>
+	/// Reads back each unit written by a UnitWriter (see Read()). Should throw
+	/// std::runtime_error if the data is invalid.
+	/// </summary>
+	typedef std::function<UnitPtr(BinaryReader& reader)> UnitReader;
+
+
 	/// <summary>
 	/// Initialise the board state with a particular size.
 	/// </summary>
@@ -130,15 +160,81 @@ public:
 	std::pair<size_t, size_t> GetUnitCounts() const;
 
 
+	/// <summary>
+	/// Compute a hash of this board, which is consistent
+	/// with the equality operator (i.e. equal boards have
+	/// equal hashes).
+	/// </summary>
+	/// <returns>A hash of the board's size, scale and units.</returns>
+	size_t GetHash() const;
+
+
+	/// <summary>
+	/// Estimate the number of bytes of memory used by this board's unit
+	/// storage. The storage may be shared with other boards (until one of
+	/// them is modified) so adding this up over several boards can be an
+	/// overestimate. The unit statistics themselves are always shared, so
+	/// aren't counted.
+	/// </summary>
+	size_t GetMemoryUsage() const;
+
+
+	/// <summary>
+	/// Write this board, including the statistics of every
+	/// unit on it, so that it can be read back by Read().
+	/// </summary>
+	/// <param name="writer">The writer to append the board to.</param>
+	void Write(BinaryWriter& writer) const;
+
+
+	/// <summary>
+	/// Write this board, with each unit written by the given function
+	/// rather than with its statistics (e.g. as an index into a table of
+	/// units written elsewhere), so that it can be read back by the
+	/// corresponding Read().
+	/// </summary>
+	/// <param name="writer">The writer to append the board to.</param>
+	/// <param name="writeUnit">The function to write each unit.</param>
+	void Write(BinaryWriter& writer, const UnitWriter& writeUnit) const;
+
+
+	/// <summary>
+	/// Read a board written by Write().
+	/// Throws std::runtime_error if the data is invalid.
+	/// </summary>
+	/// <param name="reader">The reader to read the board from.</param>
+	static BoardState Read(BinaryReader& reader);
+
+
+	/// <summary>
+	/// Read a board written by Write() with a UnitWriter. The units
+	/// returned by readUnit are placed on the board without copying.
+	/// Throws std::runtime_error if the data is invalid.
+	/// </summary>
+	/// <param name="reader">The reader to read the board from.</param>
+	/// <param name="readUnit">The function to read each unit.</param>
+	static BoardState Read(BinaryReader& reader, const UnitReader& readUnit);
+
+
+	/// <summary>
+	/// Write a unit's statistics, as Write() does for each unit on the board.
+	/// </summary>
+	/// <param name="unit">The unit to write.</param>
+	/// <param name="writer">The writer to append the unit to.</param>
+	static void WriteUnit(const Unit& unit, BinaryWriter& writer);
+
+
+	/// <summary>
+	/// Read a unit written by WriteUnit().
+	/// </summary>
+	/// <param name="reader">The reader to read the unit from.</param>
+	static Unit ReadUnit(BinaryReader& reader);
+
+
 	std::string ToString() const;
 
 
-	inline bool operator == (const BoardState& other) const
-	{
-		return (m_Size == other.m_Size && m_Scale == other.m_Scale
-			&& m_Units == other.m_Units && m_Positions == other.m_Positions
-			&& m_Teams == other.m_Teams);
-	}
+	bool operator == (const BoardState& other) const;
 
 
 	inline int GetSize() const
@@ -153,14 +249,43 @@ public:
 	}
 
 
+private:
+	//The unit storage, which may be shared between
+	// several boards. Units are themselves immutable
+	// and shared, so that cloning the storage does
+	// not involve copying any unit statistics.
+	struct Storage
+	{
+		//All of these arrays should be the same size
+		std::vector<UnitPtr> units;
+		PositionArray positions;
+		IntArray teams; // 0 or 1
+	};
+
+
+	/// <summary>
+	/// Get the storage for writing, cloning it
+	/// first if it is shared with any other board.
+	/// </summary>
+	Storage& GetMutableStorage();
+
+
+	/// <summary>
+	/// Find the index of the given position in the
+	/// storage arrays, or return the size of the
+	/// arrays if it isn't there.
+	/// </summary>
+	size_t FindIndex(Position pos) const;
+
+
 private:
 	int m_Size;
 	float m_Scale;
 
-	//All of these arrays should be the same size
-	UnitArray m_Units;
-	PositionArray m_Positions;
-	IntArray m_Teams; // 0 or 1
+	//Never null, but may be shared with other boards,
+	// hence all modifications should go through
+	// GetMutableStorage().
+	std::shared_ptr<Storage> m_pStorage;
 };
 
 
@@ -0,0 +1,106 @@
+#include "EvaluationCache.h"
+#include <algorithm>
+
+
+namespace c40kl
+{
+
+
+//Get the number of shards to actually use, which is at most the
+// maximum size, so that every shard holds at least one evaluation
+// and together they never hold more than the maximum.
+static size_t GetNumShards(size_t maxSize, size_t numShards)
+{
+	return std::max(std::min(numShards, maxSize), (size_t)1);
+}
+
+
+EvaluationCache::EvaluationCache(size_t maxSize, size_t numShards) :
+	m_MaxShardSize(std::max(maxSize / GetNumShards(maxSize, numShards), (size_t)1)),
+	m_NumShards(GetNumShards(maxSize, numShards)),
+	m_pShards(new Shard[GetNumShards(maxSize, numShards)])
+{
+	C40KL_ASSERT_PRECONDITION(maxSize > 0, "Cache size must be positive.");
+	C40KL_ASSERT_PRECONDITION(numShards > 0, "Need at least one shard.");
+}
+
+
+EvaluationCache::~EvaluationCache()
+{
+}
+
+
+bool EvaluationCache::LookUp(const GameState& state, size_t hash, float& outValue,
+	std::vector<float>& outPolicy) const
+{
+	const Shard& shard = GetShard(hash);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	auto range = shard.table.equal_range(hash);
+	for (auto iter = range.first; iter != range.second; ++iter)
+	{
+		if (iter->second.state.IsEquivalentTo(state))
+		{
+			outValue = iter->second.value;
+			outPolicy = iter->second.policy;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void EvaluationCache::Insert(const GameState& state, size_t hash, float value,
+	const std::vector<float>& policy)
+{
+	Shard& shard = GetShard(hash);
+	std::lock_guard<std::mutex> lock(shard.mutex);
+
+	auto range = shard.table.equal_range(hash);
+	for (auto iter = range.first; iter != range.second; ++iter)
+	{
+		if (iter->second.state.IsEquivalentTo(state))
+		{
+			iter->second.value = value;
+			iter->second.policy = policy;
+			return;
+		}
+	}
+
+	if (shard.table.size() >= m_MaxShardSize)
+		shard.table.clear();
+
+	shard.table.emplace(hash, Entry{ state, value, policy });
+}
+
+
+size_t EvaluationCache::GetSize() const
+{
+	size_t size = 0;
+	for (size_t i = 0; i < m_NumShards; i++)
+	{
+		std::lock_guard<std::mutex> lock(m_pShards[i].mutex);
+		size += m_pShards[i].table.size();
+	}
+	return size;
+}
+
+
+void EvaluationCache::Clear()
+{
+	for (size_t i = 0; i < m_NumShards; i++)
+	{
+		std::lock_guard<std::mutex> lock(m_pShards[i].mutex);
+		m_pShards[i].table.clear();
+	}
+}
+
+
+EvaluationCache::Shard& EvaluationCache::GetShard(size_t hash) const
+{
+	return m_pShards[hash % m_NumShards];
+}
+
+
+} // namespace c40kl
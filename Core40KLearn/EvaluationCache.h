@@ -0,0 +1,105 @@
+#pragma once
+
+
+#include "GameState.h"
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <boost/noncopyable.hpp>
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// A bounded table of leaf evaluations (value estimate and prior
+/// policy) keyed by the hash of their game state, so that states
+/// which come up again (in another game, or in a later round of the
+/// search) don't have to be evaluated again. The table is split into
+/// shards by hash, each with its own lock, so that lookups and
+/// insertions from many threads at once rarely wait for each other.
+/// When a shard fills up it is cleared, which is crude but cheap.
+/// NOTE: LookUp() and Insert() are safe to call from several threads at once.
+/// </summary>
+class C40KL_API EvaluationCache :
+	public boost::noncopyable
+{
+public:
+	/// <summary>
+	/// Create a new, empty cache.
+	/// </summary>
+	/// <param name="maxSize">The maximum number of evaluations to remember. Must be > 0.</param>
+	/// <param name="numShards">The number of independently locked parts of the table. Must be > 0.
+	/// If more than maxSize, only maxSize shards are used.</param>
+	EvaluationCache(size_t maxSize, size_t numShards = 16);
+
+
+	~EvaluationCache();
+
+
+	/// <summary>
+	/// Look up the evaluation of a state (see GameState::IsEquivalentTo()).
+	/// </summary>
+	/// <param name="state">The state to look up.</param>
+	/// <param name="hash">The state's hash, from GameState::GetHash().</param>
+	/// <param name="outValue">If found, set to the value estimate, as it was inserted.</param>
+	/// <param name="outPolicy">If found, set to the prior policy, as it was inserted.</param>
+	/// <returns>True if the state was found, false if not (and the outputs are unchanged.)</returns>
+	bool LookUp(const GameState& state, size_t hash, float& outValue,
+		std::vector<float>& outPolicy) const;
+
+
+	/// <summary>
+	/// Remember the evaluation of a state, replacing any existing evaluation.
+	/// </summary>
+	/// <param name="state">The state which was evaluated.</param>
+	/// <param name="hash">The state's hash, from GameState::GetHash().</param>
+	/// <param name="value">The value estimate.</param>
+	/// <param name="policy">The prior policy over the state's commands.</param>
+	void Insert(const GameState& state, size_t hash, float value,
+		const std::vector<float>& policy);
+
+
+	/// <summary>
+	/// Get the number of evaluations currently remembered.
+	/// </summary>
+	size_t GetSize() const;
+
+
+	/// <summary>
+	/// Forget all evaluations.
+	/// </summary>
+	void Clear();
+
+
+private:
+	struct Entry
+	{
+		GameState state;
+		float value;
+		std::vector<float> policy;
+	};
+
+
+	struct Shard
+	{
+		std::unordered_multimap<size_t, Entry> table;
+		mutable std::mutex mutex;
+	};
+
+
+	//Get the shard a hash belongs in
+	Shard& GetShard(size_t hash) const;
+
+
+private:
+	const size_t m_MaxShardSize;
+
+	//(Mutexes can't be moved, so the shards can't live in a vector)
+	const size_t m_NumShards;
+	std::unique_ptr<Shard[]> m_pShards;
+};
+
+
+} // namespace c40kl
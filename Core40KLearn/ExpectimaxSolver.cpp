@@ -0,0 +1,142 @@
+#include "ExpectimaxSolver.h"
+#include <algorithm>
+#include <limits>
+
+
+namespace c40kl
+{
+
+
+ExpectimaxSolver::ExpectimaxSolver(size_t nodeBudget, size_t maxTableSize) :
+	m_NodeBudget(nodeBudget),
+	m_MaxTableSize(maxTableSize)
+{
+	C40KL_ASSERT_PRECONDITION(nodeBudget > 0, "Node budget must be positive.");
+	C40KL_ASSERT_PRECONDITION(maxTableSize > 0, "Table size must be positive.");
+}
+
+
+bool ExpectimaxSolver::Solve(const GameState& state, int team, float& outValue)
+{
+	C40KL_ASSERT_PRECONDITION(team == 0 || team == 1, "Need valid team value.");
+
+	size_t budget = m_NodeBudget;
+	float value = 0.0f;
+
+	if (!SolveRecursive(state, budget, value))
+		return false;
+
+	//Internally all values are with respect to team 0
+	outValue = (team == 0) ? value : (-value);
+	return true;
+}
+
+
+size_t ExpectimaxSolver::GetTableSize() const
+{
+	std::lock_guard<std::mutex> lock(m_TableMutex);
+	return m_Table.size();
+}
+
+
+void ExpectimaxSolver::ClearTable()
+{
+	std::lock_guard<std::mutex> lock(m_TableMutex);
+	m_Table.clear();
+}
+
+
+bool ExpectimaxSolver::SolveRecursive(const GameState& state, size_t& budget, float& outValue)
+{
+	//Terminal states don't need remembering
+	if (state.IsFinished())
+	{
+		outValue = (float)state.GetGameValue(0);
+		return true;
+	}
+
+	const size_t hash = state.GetHash();
+
+	if (LookUp(state, hash, outValue))
+		return true;
+
+	//Charge the budget for every state we actually have to expand
+	if (budget == 0)
+		return false;
+	budget--;
+
+	//Team 0 maximises and team 1 minimises the value
+	const bool bMaximising = (state.GetActingTeam() == 0);
+	float bestValue = bMaximising ? -std::numeric_limits<float>::infinity()
+		: std::numeric_limits<float>::infinity();
+
+	std::vector<GameState> results;
+	std::vector<float> probs;
+
+	for (const auto& pCmd : state.GetCommands())
+	{
+		results.clear();
+		probs.clear();
+		pCmd->Apply(state, results, probs);
+
+		C40KL_ASSERT_INVARIANT(results.size() == probs.size(),
+			"Invalid distribution.");
+
+		//Take the expectation over the outcomes of the action
+		float actionValue = 0.0f;
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			float resultValue = 0.0f;
+			if (!SolveRecursive(results[i], budget, resultValue))
+				return false;
+
+			actionValue += probs[i] * resultValue;
+		}
+
+		bestValue = bMaximising ? std::max(bestValue, actionValue)
+			: std::min(bestValue, actionValue);
+	}
+
+	C40KL_ASSERT_INVARIANT(bestValue >= -1.0f - 1.0e-4f && bestValue <= 1.0f + 1.0e-4f,
+		"Unfinished games should always have available actions, and values must be in [-1, 1].");
+
+	Remember(state, hash, bestValue);
+
+	outValue = bestValue;
+	return true;
+}
+
+
+bool ExpectimaxSolver::LookUp(const GameState& state, size_t hash, float& outValue) const
+{
+	std::lock_guard<std::mutex> lock(m_TableMutex);
+
+	auto range = m_Table.equal_range(hash);
+	for (auto iter = range.first; iter != range.second; ++iter)
+	{
+		//Note that state equality doesn't include the turn number or
+		// the turn limit, both of which change the value of the game
+		if (iter->second.first.IsEquivalentTo(state))
+		{
+			outValue = iter->second.second;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void ExpectimaxSolver::Remember(const GameState& state, size_t hash, float value)
+{
+	std::lock_guard<std::mutex> lock(m_TableMutex);
+
+	//Crude but cheap way of bounding memory usage
+	if (m_Table.size() >= m_MaxTableSize)
+		m_Table.clear();
+
+	m_Table.emplace(hash, std::make_pair(state, value));
+}
+
+
+} // namespace c40kl
@@ -0,0 +1,108 @@
+#pragma once
+
+
+#include "GameState.h"
+#include <unordered_map>
+#include <mutex>
+#include <boost/noncopyable.hpp>
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// The expectimax solver computes the exact value of small
+/// games, by enumerating every action and every outcome of
+/// every action until the game finishes. Each team picks
+/// the best action for itself, and chance outcomes are
+/// averaged using the exact distributions returned by the
+/// commands. Solved states are memoised in a table keyed
+/// by their hash, which persists between calls, so repeated
+/// queries in the same endgame are cheap.
+/// Since the size of the game tree explodes very quickly,
+/// each query is given a budget of nodes it may visit, and
+/// gives up if it runs out.
+/// NOTE: Solve() is safe to call from several threads at
+/// once; the memo table is shared between them.
+/// </summary>
+class C40KL_API ExpectimaxSolver :
+	public boost::noncopyable
+{
+public:
+	/// <summary>
+	/// Create a new solver.
+	/// </summary>
+	/// <param name="nodeBudget">
+	/// The maximum number of (non-memoised) states a single call to
+	/// Solve() may visit before giving up. Must be > 0.
+	/// </param>
+	/// <param name="maxTableSize">
+	/// The maximum number of solved states to remember. When the table
+	/// fills up, it is cleared. Must be > 0.
+	/// </param>
+	ExpectimaxSolver(size_t nodeBudget, size_t maxTableSize = 1000000);
+
+
+	/// <summary>
+	/// Attempt to compute the exact value of the given state.
+	/// </summary>
+	/// <param name="state">The state to solve.</param>
+	/// <param name="team">The team with respect to which the value is computed (0 or 1).</param>
+	/// <param name="outValue">
+	/// If successful, is set to the expected game value (between -1 and 1)
+	/// for the given team, assuming optimal play from both sides. Otherwise
+	/// it is left unchanged.
+	/// </param>
+	/// <returns>True if the state was solved within budget, false if not.</returns>
+	bool Solve(const GameState& state, int team, float& outValue);
+
+
+	/// <summary>
+	/// Get the number of solved states currently remembered.
+	/// </summary>
+	size_t GetTableSize() const;
+
+
+	/// <summary>
+	/// Forget all solved states.
+	/// </summary>
+	void ClearTable();
+
+
+private:
+	/// <summary>
+	/// Recursively compute the value of the given state
+	/// with respect to team 0, decrementing the budget
+	/// for each state visited. If the budget runs out,
+	/// returns false, and outValue is meaningless.
+	/// </summary>
+	bool SolveRecursive(const GameState& state, size_t& budget, float& outValue);
+
+
+	/// <summary>
+	/// Look the state up in the memo table.
+	/// </summary>
+	/// <returns>True if found (and outValue was written) false if not.</returns>
+	bool LookUp(const GameState& state, size_t hash, float& outValue) const;
+
+
+	/// <summary>
+	/// Record a solved state in the memo table.
+	/// </summary>
+	void Remember(const GameState& state, size_t hash, float value);
+
+
+private:
+	const size_t m_NodeBudget, m_MaxTableSize;
+
+	//Maps state hashes to (state, value with respect to
+	// team 0) pairs. The states are kept to resolve hash
+	// collisions (which is cheap because boards share
+	// their unit storage).
+	std::unordered_multimap<size_t, std::pair<GameState, float>> m_Table;
+	mutable std::mutex m_TableMutex;
+};
+
+
+} // namespace c40kl
@@ -0,0 +1,352 @@
+#include "ExpectiminimaxSearch.h"
+#include <algorithm>
+#include <numeric>
+
+
+namespace c40kl
+{
+
+
+//The bounds of the game value
+static const float VALUE_LOWER = -1.0f, VALUE_UPPER = 1.0f;
+
+
+ExpectiminimaxSearch::ExpectiminimaxSearch(int maxDepth, int timeLimitMs) :
+	m_MaxDepth(maxDepth),
+	m_TimeLimit(timeLimitMs),
+	m_bTimedOut(false),
+	m_bIgnoreDeadline(false),
+	m_LastValue(0.0f),
+	m_LastDepth(0),
+	m_NodeCount(0)
+{
+	C40KL_ASSERT_PRECONDITION(maxDepth > 0, "Max depth must be positive.");
+	C40KL_ASSERT_PRECONDITION(timeLimitMs > 0, "Time limit must be positive.");
+}
+
+
+size_t ExpectiminimaxSearch::Search(const GameState& state)
+{
+	C40KL_ASSERT_PRECONDITION(!state.IsFinished(), "Cannot search from finished states.");
+
+	m_Deadline = std::chrono::steady_clock::now() + m_TimeLimit;
+	m_bTimedOut = false;
+	m_NodeCount = 0;
+
+	const int team = state.GetActingTeam();
+	const auto cmds = state.GetCommands();
+
+	C40KL_ASSERT_INVARIANT(!cmds.empty(), "Unfinished games should have actions.");
+
+	//Nothing to decide, so don't waste any time
+	if (cmds.size() == 1)
+	{
+		m_LastValue = EvaluateHeuristic(state, team);
+		m_LastDepth = 0;
+		return 0;
+	}
+
+	std::vector<size_t> order(cmds.size());
+	std::iota(order.begin(), order.end(), 0);
+
+	size_t bestIdx = 0;
+	float bestValue = 0.0f;
+
+	for (int depth = 1; depth <= m_MaxDepth; depth++)
+	{
+		//Always complete the first iteration so that we
+		// have a sensible action to return
+		m_bIgnoreDeadline = (depth == 1);
+
+		size_t iterBestIdx = 0;
+		float iterBestValue = 0.0f;
+		if (!SearchRoot(state, cmds, order, depth, iterBestIdx, iterBestValue))
+			break;
+
+		bestIdx = iterBestIdx;
+		bestValue = iterBestValue;
+		m_LastDepth = depth;
+
+		//Search the best action first on the next iteration,
+		// to tighten the window as early as possible
+		auto iter = std::find(order.begin(), order.end(), bestIdx);
+		std::rotate(order.begin(), iter, iter + 1);
+
+		//The heuristic never returns +/-1, so this value must
+		// come from the actual game result, and searching any
+		// deeper can't change it.
+		if (bestValue <= VALUE_LOWER || bestValue >= VALUE_UPPER)
+			break;
+	}
+
+	m_bIgnoreDeadline = false;
+	m_LastValue = (team == 0) ? bestValue : (-bestValue);
+
+	return bestIdx;
+}
+
+
+float ExpectiminimaxSearch::EvaluateHeuristic(const GameState& state, int team)
+{
+	C40KL_ASSERT_PRECONDITION(team == 0 || team == 1, "Need valid team value.");
+
+	if (state.IsFinished())
+		return (float)state.GetGameValue(team);
+
+	const auto& board = state.GetBoardState();
+
+	int allyWounds = 0, enemyWounds = 0;
+	for (const auto& unit : board.GetAllUnitStats(team))
+		allyWounds += unit.total_w;
+	for (const auto& unit : board.GetAllUnitStats(1 - team))
+		enemyWounds += unit.total_w;
+
+	if (allyWounds + enemyWounds == 0)
+		return 0.0f;
+
+	return (float)(allyWounds - enemyWounds) / (float)(allyWounds + enemyWounds);
+}
+
+
+bool ExpectiminimaxSearch::SearchRoot(const GameState& state, const GameCommandArray& cmds,
+	const std::vector<size_t>& order, int depth,
+	size_t& outBestIdx, float& outBestValue)
+{
+	const bool bMaximising = (state.GetActingTeam() == 0);
+
+	float alpha = VALUE_LOWER, beta = VALUE_UPPER;
+	bool bFirst = true;
+
+	for (size_t idx : order)
+	{
+		const float value = SearchCommand(state, cmds[idx], depth - 1, alpha, beta);
+
+		if (m_bTimedOut)
+			return false;
+
+		//Ties keep the earlier action, which after the first
+		// iteration is the previous best action
+		if (bFirst || (bMaximising ? (value > outBestValue) : (value < outBestValue)))
+		{
+			outBestIdx = idx;
+			outBestValue = value;
+			bFirst = false;
+		}
+
+		if (bMaximising)
+			alpha = std::max(alpha, value);
+		else
+			beta = std::min(beta, value);
+	}
+
+	return true;
+}
+
+
+float ExpectiminimaxSearch::SearchDecision(const GameState& state, int depth,
+	float alpha, float beta, bool probeOnly)
+{
+	m_NodeCount++;
+
+	if (state.IsFinished())
+		return (float)state.GetGameValue(0);
+
+	if (depth == 0)
+		return EvaluateHeuristic(state, 0);
+
+	//The value returned here is meaningless, but
+	// the caller will check the timeout flag
+	if (IsOutOfTime())
+		return 0.0f;
+
+	const bool bMaximising = (state.GetActingTeam() == 0);
+	float bestValue = bMaximising ? VALUE_LOWER : VALUE_UPPER;
+
+	const auto cmds = state.GetCommands();
+	const size_t numCmds = probeOnly ? std::min<size_t>(cmds.size(), 1) : cmds.size();
+
+	for (size_t i = 0; i < numCmds; i++)
+	{
+		const float value = SearchCommand(state, cmds[i], depth - 1, alpha, beta);
+
+		if (m_bTimedOut)
+			return 0.0f;
+
+		if (bMaximising)
+		{
+			bestValue = std::max(bestValue, value);
+			alpha = std::max(alpha, value);
+		}
+		else
+		{
+			bestValue = std::min(bestValue, value);
+			beta = std::min(beta, value);
+		}
+
+		if (alpha >= beta)
+			break;
+	}
+
+	return bestValue;
+}
+
+
+float ExpectiminimaxSearch::SearchChance(const std::vector<GameState>& states,
+	const std::vector<float>& probs, int depth, float alpha, float beta)
+{
+	C40KL_ASSERT_INVARIANT(states.size() == probs.size() && !states.empty(),
+		"Invalid distribution.");
+
+	const size_t n = states.size();
+
+	//No chance involved, so this is just a decision node
+	if (n == 1)
+		return SearchDecision(states.front(), depth, alpha, beta);
+
+	//Bounds on the value of each outcome, which are tightened
+	// by probing, and then used to compute the windows
+	std::vector<float> lower(n, VALUE_LOWER), upper(n, VALUE_UPPER);
+
+	//Star2 probing is only valid if every outcome is a
+	// decision for the same team, because then probing
+	// the first action gives the same kind of bound for
+	// all of them.
+	bool bCanProbe = (depth > 0);
+	for (size_t i = 0; i < n && bCanProbe; i++)
+	{
+		bCanProbe = !states[i].IsFinished()
+			&& states[i].GetActingTeam() == states.front().GetActingTeam();
+	}
+
+	if (bCanProbe)
+	{
+		const bool bMaximising = (states.front().GetActingTeam() == 0);
+
+		for (size_t i = 0; i < n; i++)
+		{
+			if (probs[i] <= 0.0f)
+				continue;
+
+			if (bMaximising)
+			{
+				//The first action of a max node gives a lower bound
+				// on its value, so we may be able to fail high.
+				float rest = 0.0f;
+				for (size_t j = 0; j < n; j++)
+					if (j != i) rest += probs[j] * lower[j];
+
+				const float childBeta = (beta - rest) / probs[i];
+
+				float probe = VALUE_LOWER;
+				if (childBeta > VALUE_LOWER)
+				{
+					//Searching with alpha at the lower bound ensures the
+					// result is exact or a lower bound; both are valid
+					// lower bounds for the outcome.
+					probe = SearchDecision(states[i], depth, VALUE_LOWER,
+						std::min(childBeta, VALUE_UPPER), true);
+					if (m_bTimedOut)
+						return 0.0f;
+				}
+
+				lower[i] = probe;
+
+				if (probe >= childBeta)
+					return rest + probs[i] * probe;
+			}
+			else
+			{
+				//Symmetrically, min nodes give an upper bound, so we
+				// may be able to fail low.
+				float rest = 0.0f;
+				for (size_t j = 0; j < n; j++)
+					if (j != i) rest += probs[j] * upper[j];
+
+				const float childAlpha = (alpha - rest) / probs[i];
+
+				float probe = VALUE_UPPER;
+				if (childAlpha < VALUE_UPPER)
+				{
+					probe = SearchDecision(states[i], depth,
+						std::max(childAlpha, VALUE_LOWER), VALUE_UPPER, true);
+					if (m_bTimedOut)
+						return 0.0f;
+				}
+
+				upper[i] = probe;
+
+				if (probe <= childAlpha)
+					return rest + probs[i] * probe;
+			}
+		}
+	}
+
+	//Star1: search each outcome in turn, with a window chosen
+	// such that if the outcome falls outside it, the expected
+	// value is guaranteed to fall outside [alpha, beta].
+	float restLower = 0.0f, restUpper = 0.0f;
+	for (size_t i = 0; i < n; i++)
+	{
+		restLower += probs[i] * lower[i];
+		restUpper += probs[i] * upper[i];
+	}
+
+	float known = 0.0f;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		restLower -= probs[i] * lower[i];
+		restUpper -= probs[i] * upper[i];
+
+		if (probs[i] <= 0.0f)
+			continue;
+
+		const float childAlpha = (alpha - known - restUpper) / probs[i];
+		const float childBeta = (beta - known - restLower) / probs[i];
+
+		float value = 0.0f;
+		if (lower[i] >= childBeta)
+			value = lower[i];
+		else if (upper[i] <= childAlpha)
+			value = upper[i];
+		else
+		{
+			value = SearchDecision(states[i], depth,
+				std::max(childAlpha, lower[i]), std::min(childBeta, upper[i]));
+			if (m_bTimedOut)
+				return 0.0f;
+		}
+
+		if (value <= childAlpha)
+			return known + probs[i] * value + restUpper;
+		if (value >= childBeta)
+			return known + probs[i] * value + restLower;
+
+		known += probs[i] * value;
+	}
+
+	return known;
+}
+
+
+float ExpectiminimaxSearch::SearchCommand(const GameState& state, const GameCommandPtr& pCmd,
+	int depth, float alpha, float beta)
+{
+	std::vector<GameState> results;
+	std::vector<float> probs;
+	pCmd->Apply(state, results, probs);
+
+	return SearchChance(results, probs, depth, alpha, beta);
+}
+
+
+bool ExpectiminimaxSearch::IsOutOfTime()
+{
+	if (!m_bTimedOut && !m_bIgnoreDeadline)
+		m_bTimedOut = (std::chrono::steady_clock::now() >= m_Deadline);
+
+	return m_bTimedOut;
+}
+
+
+} // namespace c40kl
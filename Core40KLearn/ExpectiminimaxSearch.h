@@ -0,0 +1,152 @@
+#pragma once
+
+
+#include "GameState.h"
+#include <chrono>
+#include <boost/noncopyable.hpp>
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// A depth-limited alpha-beta search over the game tree, which
+/// handles the chance outcomes of actions using the Star1 and
+/// Star2 pruning rules (Ballard, 1983). These work because the
+/// commands give the exact probability of each outcome, and
+/// game values are bounded in [-1, 1]. Star2 additionally
+/// "probes" each outcome with just its first action, to cheaply
+/// obtain a bound on its value before searching it properly.
+/// Depth is counted in actions (not turns), and states at the
+/// depth limit are scored by a heuristic. Searches are run with
+/// iterative deepening until either the maximum depth or the
+/// time limit is reached, searching the previous iteration's
+/// best action first.
+/// This requires no neural network, so it makes a cheap
+/// baseline opponent.
+/// </summary>
+class C40KL_API ExpectiminimaxSearch :
+	public boost::noncopyable
+{
+public:
+	/// <summary>
+	/// Create a new search engine.
+	/// </summary>
+	/// <param name="maxDepth">The maximum number of actions to look ahead. Must be > 0.</param>
+	/// <param name="timeLimitMs">
+	/// The time budget for each call to Search(), in milliseconds. Must be > 0.
+	/// Note that a depth-1 search is always completed, even if it takes longer.
+	/// </param>
+	ExpectiminimaxSearch(int maxDepth, int timeLimitMs);
+
+
+	/// <summary>
+	/// Search for the best action in the given state.
+	/// PRECONDITION: !state.IsFinished()
+	/// </summary>
+	/// <param name="state">The state to search from.</param>
+	/// <returns>The index of the best action, in the array returned by state.GetCommands().</returns>
+	size_t Search(const GameState& state);
+
+
+	/// <summary>
+	/// Get the value estimate of the best action found by the last
+	/// call to Search(), with respect to the team which was acting
+	/// in that state.
+	/// </summary>
+	inline float GetLastValue() const
+	{
+		return m_LastValue;
+	}
+
+
+	/// <summary>
+	/// Get the depth of the deepest search which was completed by
+	/// the last call to Search(). This is zero if there was only
+	/// one action, because no search was necessary.
+	/// </summary>
+	inline int GetLastDepth() const
+	{
+		return m_LastDepth;
+	}
+
+
+	/// <summary>
+	/// Get the number of states visited by the last call to Search()
+	/// (including those of any incomplete iteration).
+	/// </summary>
+	inline size_t GetLastNodeCount() const
+	{
+		return m_NodeCount;
+	}
+
+
+	/// <summary>
+	/// The heuristic used to score non-terminal states at the depth
+	/// limit: the difference between the total wounds remaining for
+	/// each team, as a fraction of the total wounds remaining on the
+	/// board. This lies strictly between -1 and 1 for unfinished games.
+	/// </summary>
+	/// <param name="state">The state to evaluate.</param>
+	/// <param name="team">The team with respect to which the value is computed.</param>
+	static float EvaluateHeuristic(const GameState& state, int team);
+
+
+private:
+	/// <summary>
+	/// Search all actions from the root at the given depth, in the order
+	/// given, writing out the best action's index and its value (w.r.t.
+	/// team 0.) Returns false if the search ran out of time.
+	/// </summary>
+	bool SearchRoot(const GameState& state, const GameCommandArray& cmds,
+		const std::vector<size_t>& order, int depth,
+		size_t& outBestIdx, float& outBestValue);
+
+
+	/// <summary>
+	/// Compute the value (w.r.t. team 0) of a state in which a team
+	/// must choose an action, within the window [alpha, beta]. The
+	/// result is "fail-soft": if it is <= alpha it is an upper bound,
+	/// and if it is >= beta, it is a lower bound.
+	/// If probeOnly is set, only the first action is considered, which
+	/// gives a bound on the state's value rather than its exact value.
+	/// </summary>
+	float SearchDecision(const GameState& state, int depth, float alpha, float beta,
+		bool probeOnly = false);
+
+
+	/// <summary>
+	/// Compute the expected value (w.r.t. team 0) of the given
+	/// distribution of states, within the window [alpha, beta],
+	/// using Star1/Star2 pruning. Fail-soft, like SearchDecision().
+	/// </summary>
+	float SearchChance(const std::vector<GameState>& states, const std::vector<float>& probs,
+		int depth, float alpha, float beta);
+
+
+	/// <summary>
+	/// Apply the command to the state and search its outcomes.
+	/// </summary>
+	float SearchCommand(const GameState& state, const GameCommandPtr& pCmd,
+		int depth, float alpha, float beta);
+
+
+	/// <summary>
+	/// Check the clock, and set m_bTimedOut if the deadline has passed.
+	/// </summary>
+	bool IsOutOfTime();
+
+
+private:
+	const int m_MaxDepth;
+	const std::chrono::milliseconds m_TimeLimit;
+	std::chrono::steady_clock::time_point m_Deadline;
+	bool m_bTimedOut, m_bIgnoreDeadline;
+	float m_LastValue;
+	int m_LastDepth;
+	size_t m_NodeCount;
+};
+
+
+} // namespace c40kl
@@ -0,0 +1,323 @@
+#include "ExperienceFile.h"
+#include <cstring>
+#include <cmath>
+#include <stdexcept>
+
+
+namespace c40kl
+{
+
+
+static const char MAGIC[8] = { 'C', '4', '0', 'K', 'L', 'E', 'X', 'P' };
+
+
+//The layout of the file header. All fields are 4 bytes
+// wide so there is no padding.
+struct ExperienceFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t boardSize;
+	uint32_t numUnitFeatures;
+	uint32_t numPhases;
+	uint32_t reserved[2];
+};
+
+static_assert(sizeof(ExperienceFileHeader) == ExperienceFile::HEADER_SIZE,
+	"Header struct must match the file format.");
+
+
+//Create the header for a file of the given board size
+static ExperienceFileHeader MakeHeader(int boardSize)
+{
+	ExperienceFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = ExperienceFile::VERSION;
+	header.boardSize = (uint32_t)boardSize;
+	header.numUnitFeatures = (uint32_t)StateEncoder::NUM_UNIT_FEATURES;
+	header.numPhases = (uint32_t)StateEncoder::NUM_PHASES;
+	return header;
+}
+
+
+//Check the header was written by a compatible version of this code
+static bool IsValidHeader(const ExperienceFileHeader& header)
+{
+	return std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0
+		&& header.version == ExperienceFile::VERSION
+		&& header.boardSize > 0 && header.boardSize <= (uint32_t)ExperienceFile::MAX_BOARD_SIZE
+		&& header.numUnitFeatures == StateEncoder::NUM_UNIT_FEATURES
+		&& header.numPhases == StateEncoder::NUM_PHASES;
+}
+
+
+size_t ExperienceFile::GetRecordBytes(int boardSize)
+{
+	const size_t numPlanes = StateEncoder::GetBoardPlanesSize(boardSize);
+	const size_t numOther = StateEncoder::GetRecordSize(boardSize) - numPlanes;
+	return numPlanes * sizeof(uint16_t) + numOther * sizeof(float);
+}
+
+
+uint16_t ExperienceFile::FloatToHalf(float value)
+{
+	uint32_t bits = 0;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	const uint32_t sign = (bits >> 16) & 0x8000;
+	const uint32_t floatExp = (bits >> 23) & 0xff;
+	uint32_t mantissa = bits & 0x7fffff;
+
+	//Infinity and NaN (keeping NaNs as NaNs)
+	if (floatExp == 0xff)
+		return (uint16_t)(sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0));
+
+	const int exp = (int)floatExp - 127 + 15;
+
+	//Too large, so round to infinity
+	if (exp >= 31)
+		return (uint16_t)(sign | 0x7c00);
+
+	if (exp <= 0)
+	{
+		//Too small even for a subnormal, so round to zero
+		if (exp < -10)
+			return (uint16_t)sign;
+
+		//Subnormal; shift in the implicit leading bit
+		mantissa |= 0x800000;
+		const uint32_t shift = (uint32_t)(14 - exp);
+		uint32_t half = mantissa >> shift;
+		const uint32_t remainder = mantissa & ((1u << shift) - 1);
+		const uint32_t halfway = 1u << (shift - 1);
+
+		if (remainder > halfway || (remainder == halfway && (half & 1)))
+			half++;
+
+		return (uint16_t)(sign | half);
+	}
+
+	uint32_t half = sign | ((uint32_t)exp << 10) | (mantissa >> 13);
+	const uint32_t remainder = mantissa & 0x1fff;
+
+	//Round to nearest even (a carry into the exponent is still correct)
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+		half++;
+
+	return (uint16_t)half;
+}
+
+
+float ExperienceFile::HalfToFloat(uint16_t value)
+{
+	const uint32_t sign = ((uint32_t)value & 0x8000) << 16;
+	const uint32_t exp = ((uint32_t)value >> 10) & 0x1f;
+	const uint32_t mantissa = (uint32_t)value & 0x3ff;
+
+	if (exp == 0)
+	{
+		//Zero or subnormal
+		const float magnitude = std::ldexp((float)mantissa, -24);
+		return sign ? -magnitude : magnitude;
+	}
+
+	uint32_t bits = 0;
+	if (exp == 31)
+		bits = sign | 0x7f800000 | (mantissa << 13);
+	else
+		bits = sign | ((exp + 127 - 15) << 23) | (mantissa << 13);
+
+	float result = 0.0f;
+	std::memcpy(&result, &bits, sizeof(result));
+	return result;
+}
+
+
+ExperienceFileWriter::ExperienceFileWriter(const std::string& filename, int boardSize) :
+	m_BoardSize(boardSize),
+	m_NumRecords(0)
+{
+	C40KL_ASSERT_PRECONDITION(boardSize > 0 && boardSize <= ExperienceFile::MAX_BOARD_SIZE,
+		"Board size must be positive and at most MAX_BOARD_SIZE.");
+
+	const size_t recordBytes = ExperienceFile::GetRecordBytes(boardSize);
+
+	//If there is already a file here, check we can append to it
+	std::ifstream existing(filename, std::ios::binary | std::ios::ate);
+	const bool bAppending = existing.is_open() && existing.tellg() > 0;
+	if (bAppending)
+	{
+		const size_t fileSize = (size_t)existing.tellg();
+
+		ExperienceFileHeader header;
+		existing.seekg(0);
+		if (!existing.read(reinterpret_cast<char*>(&header), sizeof(header))
+			|| !IsValidHeader(header) || header.boardSize != (uint32_t)boardSize
+			|| (fileSize - sizeof(header)) % recordBytes != 0)
+		{
+			throw std::runtime_error("Cannot append to invalid experience file: " + filename);
+		}
+
+		m_NumRecords = (fileSize - sizeof(header)) / recordBytes;
+	}
+	existing.close();
+
+	m_File.open(filename, std::ios::binary | std::ios::app);
+	if (!m_File.is_open())
+		throw std::runtime_error("Could not open experience file: " + filename);
+
+	if (!bAppending)
+	{
+		const auto header = MakeHeader(boardSize);
+		m_File.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	}
+
+	m_RecordBuffer.resize(recordBytes);
+}
+
+
+void ExperienceFileWriter::Write(const float* records, size_t numRecords)
+{
+	C40KL_ASSERT_PRECONDITION(m_File.is_open(), "Cannot write to closed file.");
+
+	const size_t recordSize = StateEncoder::GetRecordSize(m_BoardSize);
+	const size_t numPlanes = StateEncoder::GetBoardPlanesSize(m_BoardSize);
+	const size_t numOther = recordSize - numPlanes;
+
+	for (size_t i = 0; i < numRecords; i++)
+	{
+		const float* pRecord = records + i * recordSize;
+		char* pOut = m_RecordBuffer.data();
+
+		for (size_t j = 0; j < numPlanes; j++)
+		{
+			const uint16_t half = ExperienceFile::FloatToHalf(pRecord[j]);
+			std::memcpy(pOut + j * sizeof(uint16_t), &half, sizeof(half));
+		}
+
+		std::memcpy(pOut + numPlanes * sizeof(uint16_t), pRecord + numPlanes,
+			numOther * sizeof(float));
+
+		m_File.write(pOut, m_RecordBuffer.size());
+	}
+
+	if (!m_File)
+		throw std::runtime_error("Failed to write to experience file.");
+
+	m_NumRecords += numRecords;
+}
+
+
+void ExperienceFileWriter::Close()
+{
+	if (m_File.is_open())
+	{
+		m_File.close();
+	}
+}
+
+
+ExperienceFileWriter::~ExperienceFileWriter()
+{
+	Close();
+}
+
+
+ExperienceFileReader::ExperienceFileReader(const std::string& filename) :
+	m_BoardSize(0),
+	m_NumRecords(0)
+{
+	try
+	{
+		m_Mapping = boost::interprocess::file_mapping(filename.c_str(),
+			boost::interprocess::read_only);
+		m_Region = boost::interprocess::mapped_region(m_Mapping,
+			boost::interprocess::read_only);
+	}
+	catch (const boost::interprocess::interprocess_exception& e)
+	{
+		throw std::runtime_error("Could not map experience file " + filename + ": " + e.what());
+	}
+
+	if (m_Region.get_size() < sizeof(ExperienceFileHeader))
+		throw std::runtime_error("Experience file is too small: " + filename);
+
+	ExperienceFileHeader header;
+	std::memcpy(&header, m_Region.get_address(), sizeof(header));
+
+	if (!IsValidHeader(header))
+		throw std::runtime_error("Invalid experience file header: " + filename);
+
+	m_BoardSize = (int)header.boardSize;
+
+	const size_t recordBytes = ExperienceFile::GetRecordBytes(m_BoardSize);
+	const size_t dataBytes = m_Region.get_size() - sizeof(header);
+
+	if (recordBytes == 0)
+		throw std::runtime_error("Invalid experience file header: " + filename);
+	if (dataBytes % recordBytes != 0)
+		throw std::runtime_error("Experience file has a partial record: " + filename);
+
+	m_NumRecords = dataBytes / recordBytes;
+}
+
+
+const char* ExperienceFileReader::GetRecordData(size_t idx) const
+{
+	C40KL_ASSERT_PRECONDITION(idx < m_NumRecords, "Record index out of range.");
+
+	return static_cast<const char*>(m_Region.get_address()) + sizeof(ExperienceFileHeader)
+		+ idx * ExperienceFile::GetRecordBytes(m_BoardSize);
+}
+
+
+void ExperienceFileReader::ReadRecord(size_t idx, float* out) const
+{
+	const size_t numPlanes = StateEncoder::GetBoardPlanesSize(m_BoardSize);
+	float* pPhase = out + numPlanes;
+	float* pPolicy = pPhase + StateEncoder::NUM_PHASES;
+	float* pValue = pPolicy + StateEncoder::GetPolicySize(m_BoardSize);
+
+	ReadRecord(idx, out, pPhase, pPolicy, pValue);
+}
+
+
+void ExperienceFileReader::ReadRecord(size_t idx, float* outPlanes, float* outPhase,
+	float* outPolicy, float* outValue) const
+{
+	const char* pData = GetRecordData(idx);
+
+	const size_t numPlanes = StateEncoder::GetBoardPlanesSize(m_BoardSize);
+	const size_t policySize = StateEncoder::GetPolicySize(m_BoardSize);
+
+	for (size_t j = 0; j < numPlanes; j++)
+	{
+		uint16_t half = 0;
+		std::memcpy(&half, pData + j * sizeof(uint16_t), sizeof(half));
+		outPlanes[j] = ExperienceFile::HalfToFloat(half);
+	}
+	pData += numPlanes * sizeof(uint16_t);
+
+	std::memcpy(outPhase, pData, StateEncoder::NUM_PHASES * sizeof(float));
+	pData += StateEncoder::NUM_PHASES * sizeof(float);
+
+	std::memcpy(outPolicy, pData, policySize * sizeof(float));
+	pData += policySize * sizeof(float);
+
+	std::memcpy(outValue, pData, sizeof(float));
+}
+
+
+void ExperienceFileReader::ReadRecords(const std::vector<size_t>& indices, float* out) const
+{
+	const size_t recordSize = StateEncoder::GetRecordSize(m_BoardSize);
+
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		ReadRecord(indices[i], out + i * recordSize);
+	}
+}
+
+
+} // namespace c40kl
@@ -0,0 +1,226 @@
+#pragma once
+
+
+#include "StateEncoder.h"
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <boost/noncopyable.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// Experience files store experience records (see StateEncoder) in
+/// a compact, fixed-size binary format, so that any record can be
+/// found directly from its index, and files can be memory-mapped.
+///
+/// A file starts with a header of HEADER_SIZE bytes:
+///   [magic "C40KLEXP"][version][board size][unit features][phases][reserved]
+/// where all but the magic string and the reserved bytes are uint32.
+/// This is followed by the records, each of which is laid out like the
+/// records from StateEncoder, except that the board planes are stored
+/// as IEEE half-precision floats (every unit statistic is a small
+/// integer, so this is lossless in practice.) Everything else is
+/// stored as float32. All values are in the machine's byte order
+/// (little-endian on every platform we build for.) Since the number
+/// of board plane values is always even, every float32 is aligned
+/// to 4 bytes.
+/// </summary>
+class C40KL_API ExperienceFile
+{
+public:
+	/// <summary>
+	/// The size of the file header, in bytes.
+	/// </summary>
+	static const size_t HEADER_SIZE = 32;
+
+
+	/// <summary>
+	/// The current version of the file format.
+	/// </summary>
+	static const uint32_t VERSION = 1;
+
+
+	/// <summary>
+	/// The largest board size a file may have, so that a corrupt
+	/// header can't make the record size overflow.
+	/// </summary>
+	static const int MAX_BOARD_SIZE = 1024;
+
+
+	/// <summary>
+	/// Get the size of a single stored record, in bytes, for the given board size.
+	/// </summary>
+	static size_t GetRecordBytes(int boardSize);
+
+
+	/// <summary>
+	/// Convert a float to the nearest IEEE half-precision float (rounding
+	/// ties to even.) Values too large to represent become infinite.
+	/// </summary>
+	static uint16_t FloatToHalf(float value);
+
+
+	/// <summary>
+	/// Convert an IEEE half-precision float to a float (this is exact.)
+	/// </summary>
+	static float HalfToFloat(uint16_t value);
+};
+
+
+/// <summary>
+/// Writes experience records to a file. If the file already exists,
+/// the records are appended to it.
+/// Throws std::runtime_error if the file cannot be opened or written,
+/// or if an existing file has a different format or board size.
+/// </summary>
+class C40KL_API ExperienceFileWriter :
+	public boost::noncopyable
+{
+public:
+	/// <summary>
+	/// Open the file for writing, writing a header if it is new.
+	/// PRECONDITION: 0 < boardSize <= ExperienceFile::MAX_BOARD_SIZE
+	/// </summary>
+	/// <param name="filename">The file to write to.</param>
+	/// <param name="boardSize">The board size of every record to be written.</param>
+	ExperienceFileWriter(const std::string& filename, int boardSize);
+
+
+	/// <summary>
+	/// Write records, in the format produced by StateEncoder.
+	/// </summary>
+	/// <param name="records">The records to write, one after the other.</param>
+	/// <param name="numRecords">The number of records to write.</param>
+	void Write(const float* records, size_t numRecords);
+
+
+	/// <summary>
+	/// Flush all written records and close the file. After this, no more
+	/// records may be written. This is called automatically on destruction.
+	/// </summary>
+	void Close();
+
+
+	/// <summary>
+	/// Get the board size of the records in this file.
+	/// </summary>
+	inline int GetBoardSize() const
+	{
+		return m_BoardSize;
+	}
+
+
+	/// <summary>
+	/// Get the number of records written so far (including any which were
+	/// already in the file when it was opened.)
+	/// </summary>
+	inline size_t GetNumRecords() const
+	{
+		return m_NumRecords;
+	}
+
+
+	~ExperienceFileWriter();
+
+
+private:
+	const int m_BoardSize;
+	std::ofstream m_File;
+	size_t m_NumRecords;
+
+	//Space for converting each record into its stored form
+	std::vector<char> m_RecordBuffer;
+};
+
+
+/// <summary>
+/// Reads experience records from a file, by memory-mapping it, so
+/// that reading a record only touches the pages it is stored on.
+/// Throws std::runtime_error if the file cannot be opened, or is
+/// not a valid experience file.
+/// NOTE: reading is safe from several threads at once.
+/// </summary>
+class C40KL_API ExperienceFileReader :
+	public boost::noncopyable
+{
+public:
+	/// <summary>
+	/// Open and map the given file.
+	/// </summary>
+	/// <param name="filename">The file to read.</param>
+	explicit ExperienceFileReader(const std::string& filename);
+
+
+	/// <summary>
+	/// Get the board size of the records in this file.
+	/// </summary>
+	inline int GetBoardSize() const
+	{
+		return m_BoardSize;
+	}
+
+
+	/// <summary>
+	/// Get the number of records in this file.
+	/// </summary>
+	inline size_t GetNumRecords() const
+	{
+		return m_NumRecords;
+	}
+
+
+	/// <summary>
+	/// Get a pointer to the stored form of a record (see ExperienceFile),
+	/// which remains valid for the lifetime of the reader.
+	/// PRECONDITION: idx < GetNumRecords()
+	/// </summary>
+	const char* GetRecordData(size_t idx) const;
+
+
+	/// <summary>
+	/// Read a record, converting it back into the format produced by
+	/// StateEncoder.
+	/// PRECONDITION: idx < GetNumRecords()
+	/// </summary>
+	/// <param name="idx">The index of the record to read.</param>
+	/// <param name="out">The output array, of size StateEncoder::GetRecordSize().</param>
+	void ReadRecord(size_t idx, float* out) const;
+
+
+	/// <summary>
+	/// Read a record, writing each of its parts to a separate array.
+	/// PRECONDITION: idx < GetNumRecords()
+	/// </summary>
+	/// <param name="idx">The index of the record to read.</param>
+	/// <param name="outPlanes">The board planes output, of size StateEncoder::GetBoardPlanesSize().</param>
+	/// <param name="outPhase">The phase vector output, of size StateEncoder::NUM_PHASES.</param>
+	/// <param name="outPolicy">The policy output, of size StateEncoder::GetPolicySize().</param>
+	/// <param name="outValue">The value output.</param>
+	void ReadRecord(size_t idx, float* outPlanes, float* outPhase,
+		float* outPolicy, float* outValue) const;
+
+
+	/// <summary>
+	/// Read several records, one after the other, into the output array.
+	/// PRECONDITION: every index is < GetNumRecords()
+	/// </summary>
+	/// <param name="indices">The indices of the records to read, in order.</param>
+	/// <param name="out">The output array, of size indices.size() * StateEncoder::GetRecordSize().</param>
+	void ReadRecords(const std::vector<size_t>& indices, float* out) const;
+
+
+private:
+	boost::interprocess::file_mapping m_Mapping;
+	boost::interprocess::mapped_region m_Region;
+	int m_BoardSize;
+	size_t m_NumRecords;
+};
+
+
+} // namespace c40kl
@@ -0,0 +1,113 @@
+#include "ExperienceSampler.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+
+namespace c40kl
+{
+
+
+ExperienceSampler::ExperienceSampler() :
+	m_NumRecords(0),
+	m_HalfLife(0.0f),
+	m_RandEng(std::random_device()())
+{
+}
+
+
+void ExperienceSampler::AddFile(const std::string& filename)
+{
+	std::unique_ptr<ExperienceFileReader> pReader(new ExperienceFileReader(filename));
+
+	if (!m_pReaders.empty() && pReader->GetBoardSize() != GetBoardSize())
+		throw std::runtime_error("Experience file has a different board size: " + filename);
+
+	m_FileStarts.push_back(m_NumRecords);
+	m_NumRecords += pReader->GetNumRecords();
+	m_pReaders.push_back(std::move(pReader));
+}
+
+
+void ExperienceSampler::SetRecencyHalfLife(float halfLife)
+{
+	C40KL_ASSERT_PRECONDITION(halfLife >= 0.0f, "Half life must be non-negative.");
+
+	m_HalfLife = halfLife;
+}
+
+
+void ExperienceSampler::Sample(size_t n, float* outPlanes, float* outPhases,
+	float* outPolicies, float* outValues)
+{
+	const auto indices = SampleIndices(n);
+
+	const int boardSize = GetBoardSize();
+	const size_t numPlanes = StateEncoder::GetBoardPlanesSize(boardSize);
+	const size_t policySize = StateEncoder::GetPolicySize(boardSize);
+
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t fileIdx = 0, recordIdx = 0;
+		FindRecord(indices[i], fileIdx, recordIdx);
+
+		m_pReaders[fileIdx]->ReadRecord(recordIdx,
+			outPlanes + i * numPlanes,
+			outPhases + i * StateEncoder::NUM_PHASES,
+			outPolicies + i * policySize,
+			outValues + i);
+	}
+}
+
+
+std::vector<size_t> ExperienceSampler::SampleIndices(size_t n)
+{
+	C40KL_ASSERT_PRECONDITION(m_NumRecords > 0, "Need records to sample from.");
+
+	std::vector<size_t> indices;
+	indices.reserve(n);
+
+	if (m_HalfLife <= 0.0f)
+	{
+		std::uniform_int_distribution<size_t> dist(0, m_NumRecords - 1);
+		for (size_t i = 0; i < n; i++)
+			indices.push_back(dist(m_RandEng));
+	}
+	else
+	{
+		//The age of a record (the number of records added after it)
+		// follows a geometric distribution, truncated to the number
+		// of records. This is the floor of an exponential variable,
+		// which we draw by inverting its CDF.
+		const double rate = std::log(2.0) / m_HalfLife;
+		const double maxCdf = 1.0 - std::exp(-rate * (double)m_NumRecords);
+		std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+		for (size_t i = 0; i < n; i++)
+		{
+			const double age = -std::log1p(-dist(m_RandEng) * maxCdf) / rate;
+			const size_t ageIdx = std::min((size_t)age, m_NumRecords - 1);
+			indices.push_back(m_NumRecords - 1 - ageIdx);
+		}
+	}
+
+	return indices;
+}
+
+
+void ExperienceSampler::FindRecord(size_t idx, size_t& outFileIdx, size_t& outRecordIdx) const
+{
+	C40KL_ASSERT_INVARIANT(idx < m_NumRecords, "Record index out of range.");
+
+	//Find the last file starting at or before the index (empty
+	// files share their start with the next file, so skip them)
+	auto iter = std::upper_bound(m_FileStarts.begin(), m_FileStarts.end(), idx);
+	outFileIdx = (size_t)std::distance(m_FileStarts.begin(), iter) - 1;
+	outRecordIdx = idx - m_FileStarts[outFileIdx];
+
+	C40KL_ASSERT_INVARIANT(outRecordIdx < m_pReaders[outFileIdx]->GetNumRecords(),
+		"Record must lie within its file.");
+}
+
+
+} // namespace c40kl
@@ -0,0 +1,123 @@
+#pragma once
+
+
+#include "ExperienceFile.h"
+#include <random>
+#include <memory>
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// Draws random samples of experience records from a set of
+/// experience files, for training. Every file is memory-mapped,
+/// and an index of where each file's records start is kept, so
+/// drawing a sample only reads the records which were chosen.
+/// Records are drawn with replacement, either uniformly or with
+/// recency weighting, where the weight of a record halves with
+/// every "half life" records which were added after it. Records
+/// are ordered by the order in which their files were added, so
+/// files should be added oldest first.
+/// </summary>
+class C40KL_API ExperienceSampler :
+	public boost::noncopyable
+{
+public:
+	/// <summary>
+	/// Create a new sampler, with no files, which samples uniformly.
+	/// </summary>
+	ExperienceSampler();
+
+
+	/// <summary>
+	/// Map a new experience file, after all of the existing ones.
+	/// Throws std::runtime_error if the file is not a valid experience
+	/// file, or its board size differs from the existing files.
+	/// </summary>
+	/// <param name="filename">The file to add.</param>
+	void AddFile(const std::string& filename);
+
+
+	/// <summary>
+	/// Set the recency weighting.
+	/// PRECONDITION: halfLife >= 0
+	/// </summary>
+	/// <param name="halfLife">
+	/// The number of records over which a record's weight halves (relative
+	/// to the most recent record.) Zero means uniform sampling.
+	/// </param>
+	void SetRecencyHalfLife(float halfLife);
+
+
+	/// <summary>
+	/// Draw a sample of records, writing each part of the records into
+	/// a separate array.
+	/// PRECONDITION: GetNumRecords() > 0
+	/// </summary>
+	/// <param name="n">The number of records to draw.</param>
+	/// <param name="outPlanes">Board planes output, of size n * StateEncoder::GetBoardPlanesSize().</param>
+	/// <param name="outPhases">Phase vectors output, of size n * StateEncoder::NUM_PHASES.</param>
+	/// <param name="outPolicies">Policies output, of size n * StateEncoder::GetPolicySize().</param>
+	/// <param name="outValues">Values output, of size n.</param>
+	void Sample(size_t n, float* outPlanes, float* outPhases,
+		float* outPolicies, float* outValues);
+
+
+	/// <summary>
+	/// Draw the indices of a sample of records (where records are numbered
+	/// in the order their files were added.)
+	/// PRECONDITION: GetNumRecords() > 0
+	/// </summary>
+	/// <param name="n">The number of indices to draw.</param>
+	std::vector<size_t> SampleIndices(size_t n);
+
+
+	/// <summary>
+	/// Get the total number of records in all files.
+	/// </summary>
+	inline size_t GetNumRecords() const
+	{
+		return m_NumRecords;
+	}
+
+
+	/// <summary>
+	/// Get the number of files added so far.
+	/// </summary>
+	inline size_t GetNumFiles() const
+	{
+		return m_pReaders.size();
+	}
+
+
+	/// <summary>
+	/// Get the board size of all records, or zero if no files have been added.
+	/// </summary>
+	inline int GetBoardSize() const
+	{
+		return m_pReaders.empty() ? 0 : m_pReaders.front()->GetBoardSize();
+	}
+
+
+private:
+	/// <summary>
+	/// Find which file a record is in, and its index within that file.
+	/// </summary>
+	void FindRecord(size_t idx, size_t& outFileIdx, size_t& outRecordIdx) const;
+
+
+private:
+	std::vector<std::unique_ptr<ExperienceFileReader>> m_pReaders;
+
+	//The index of the first record in each file
+	std::vector<size_t> m_FileStarts;
+
+	size_t m_NumRecords;
+	float m_HalfLife;
+	std::mt19937 m_RandEng;
+};
+
+
+} // namespace c40kl
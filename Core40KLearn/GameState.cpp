@@ -6,6 +6,8 @@
 #include "EndPhaseCommand.h"
 #include <functional>
 #include <sstream>
+#include <stdexcept>
+#include <boost/functional/hash.hpp>
 
 
 namespace c40kl
@@ -104,7 +106,9 @@ int GameState::GetGameValue(int team) const
 	const bool bAlliesFinished = (team == 0) ? (counts.first == 0) : (counts.second == 0);
 	const bool bEnemiesFinished = (team == 1) ? (counts.first == 0) : (counts.second == 0);
 
-	C40KL_ASSERT_INVARIANT(bAlliesFinished || bEnemiesFinished, "At least one team must have no units!");
+	C40KL_ASSERT_INVARIANT(bAlliesFinished || bEnemiesFinished
+		|| (HasTurnLimit() && m_TurnNumber >= m_TurnLimit),
+		"At least one team must have no units, unless the turn limit was reached!");
 
 	if (bAlliesFinished && !bEnemiesFinished)
 		return -1; //Loss
@@ -126,6 +130,81 @@ int GameState::GetTurnLimit() const
 }
 
 
+bool GameState::IsEquivalentTo(const GameState& other) const
+{
+	if (!(*this == other) || m_TurnNumber != other.m_TurnNumber
+		|| HasTurnLimit() != other.HasTurnLimit())
+		return false;
+
+	return !HasTurnLimit() || m_TurnLimit == other.m_TurnLimit;
+}
+
+
+size_t GameState::GetHash() const
+{
+	size_t seed = m_Board.GetHash();
+	boost::hash_combine(seed, m_InternalTeam);
+	boost::hash_combine(seed, m_ActingTeam);
+	boost::hash_combine(seed, static_cast<int>(m_Phase));
+	boost::hash_combine(seed, m_TurnNumber);
+
+	//Any negative limit means there's no limit, so they must all hash the same
+	boost::hash_combine(seed, HasTurnLimit() ? m_TurnLimit : -1);
+	return seed;
+}
+
+
+void GameState::Write(BinaryWriter& writer) const
+{
+	Write(writer, [](const BoardState::UnitPtr& pUnit, BinaryWriter& unitWriter)
+	{
+		BoardState::WriteUnit(*pUnit, unitWriter);
+	});
+}
+
+
+void GameState::Write(BinaryWriter& writer, const BoardState::UnitWriter& writeUnit) const
+{
+	writer.Write((int32_t)m_InternalTeam);
+	writer.Write((int32_t)m_ActingTeam);
+	writer.Write((int32_t)m_Phase);
+	writer.Write((int32_t)m_TurnLimit);
+	writer.Write((int32_t)m_TurnNumber);
+	m_Board.Write(writer, writeUnit);
+}
+
+
+GameState GameState::Read(BinaryReader& reader)
+{
+	return Read(reader, [](BinaryReader& unitReader)
+	{
+		return std::make_shared<const Unit>(BoardState::ReadUnit(unitReader));
+	});
+}
+
+
+GameState GameState::Read(BinaryReader& reader, const BoardState::UnitReader& readUnit)
+{
+	const int internalTeam = reader.Read<int32_t>();
+	const int actingTeam = reader.Read<int32_t>();
+	const int phase = reader.Read<int32_t>();
+	const int turnLimit = reader.Read<int32_t>();
+	const int turnNumber = reader.Read<int32_t>();
+
+	//Check everything the constructor requires:
+	if ((internalTeam != 0 && internalTeam != 1) || (actingTeam != 0 && actingTeam != 1)
+		|| phase < (int)Phase::MOVEMENT || phase > (int)Phase::FIGHT
+		|| (actingTeam != internalTeam && phase != (int)Phase::FIGHT)
+		|| turnLimit == 0 || turnNumber < 0)
+	{
+		throw std::runtime_error("Invalid data: bad game state.");
+	}
+
+	const BoardState board = BoardState::Read(reader, readUnit);
+	return GameState(internalTeam, actingTeam, (Phase)phase, board, turnLimit, turnNumber);
+}
+
+
 std::string GameState::ToString() const
 {
 	std::stringstream m;
@@ -138,6 +138,62 @@ public:
 	}
 
 
+	/// <summary>
+	/// Determine whether this state is equal to another and at the
+	/// same point in the game (turn number and limit), so that the
+	/// two have the same value. Unlike operator==, this distinguishes
+	/// states which only differ in their turn number or limit.
+	/// Equivalent states have equal hashes.
+	/// </summary>
+	/// <param name="other">The state to compare with.</param>
+	/// <returns>True if the states are equivalent, false if not.</returns>
+	bool IsEquivalentTo(const GameState& other) const;
+
+
+	/// <summary>
+	/// Compute a hash of this game state (including its
+	/// turn number and limit, so states which compare
+	/// equal but are at different points in the game
+	/// will usually have different hashes).
+	/// </summary>
+	/// <returns>The hash value.</returns>
+	size_t GetHash() const;
+
+
+	/// <summary>
+	/// Write this state (including its board) so
+	/// that it can be read back by Read().
+	/// </summary>
+	/// <param name="writer">The writer to append the state to.</param>
+	void Write(BinaryWriter& writer) const;
+
+
+	/// <summary>
+	/// Write this state, with the units on its board written by
+	/// the given function (see BoardState::Write().)
+	/// </summary>
+	/// <param name="writer">The writer to append the state to.</param>
+	/// <param name="writeUnit">The function to write each unit.</param>
+	void Write(BinaryWriter& writer, const BoardState::UnitWriter& writeUnit) const;
+
+
+	/// <summary>
+	/// Read a state written by Write().
+	/// Throws std::runtime_error if the data is invalid.
+	/// </summary>
+	/// <param name="reader">The reader to read the state from.</param>
+	static GameState Read(BinaryReader& reader);
+
+
+	/// <summary>
+	/// Read a state written by Write() with a UnitWriter.
+	/// Throws std::runtime_error if the data is invalid.
+	/// </summary>
+	/// <param name="reader">The reader to read the state from.</param>
+	/// <param name="readUnit">The function to read each unit.</param>
+	static GameState Read(BinaryReader& reader, const BoardState::UnitReader& readUnit);
+
+
 	std::string ToString() const;
 	inline bool operator == (const GameState& other) const
 	{
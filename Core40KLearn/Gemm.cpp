@@ -0,0 +1,237 @@
+#include "Gemm.h"
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define C40KL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+//MSVC allows AVX2 intrinsics in any function
+#define C40KL_TARGET_AVX2
+#else
+#define C40KL_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#endif
+
+
+namespace c40kl
+{
+
+
+//The blocks of B which are multiplied at once are BLOCK_K rows
+// by BLOCK_N columns (256KB), which fits in a typical L2 cache.
+static const size_t BLOCK_N = 256;
+static const size_t BLOCK_K = 256;
+
+
+//Initialise each row of C to the bias
+static void FillBias(size_t m, size_t n, const float* bias, float* c)
+{
+	for (size_t i = 0; i < m; i++)
+	{
+		if (bias != nullptr)
+			std::copy(bias, bias + n, c + i * n);
+		else
+			std::fill(c + i * n, c + (i + 1) * n, 0.0f);
+	}
+}
+
+
+//Add A[i0:i1, k0:k1] * B[k0:k1, j0:j1] to C[i0:i1, j0:j1]
+static void MultiplyBlockScalar(size_t n, size_t k, const float* a, const float* b, float* c,
+	size_t i0, size_t i1, size_t j0, size_t j1, size_t k0, size_t k1)
+{
+	for (size_t i = i0; i < i1; i++)
+	{
+		float* cRow = c + i * n;
+		for (size_t kk = k0; kk < k1; kk++)
+		{
+			const float aik = a[i * k + kk];
+			const float* bRow = b + kk * n;
+			for (size_t j = j0; j < j1; j++)
+				cRow[j] += aik * bRow[j];
+		}
+	}
+}
+
+
+void Gemm::MultiplyScalar(size_t m, size_t n, size_t k, const float* a,
+	const float* b, const float* bias, float* c)
+{
+	FillBias(m, n, bias, c);
+
+	for (size_t j0 = 0; j0 < n; j0 += BLOCK_N)
+	{
+		const size_t j1 = std::min(j0 + BLOCK_N, n);
+		for (size_t k0 = 0; k0 < k; k0 += BLOCK_K)
+		{
+			const size_t k1 = std::min(k0 + BLOCK_K, k);
+			MultiplyBlockScalar(n, k, a, b, c, 0, m, j0, j1, k0, k1);
+		}
+	}
+}
+
+
+#ifdef C40KL_X86
+
+
+//Add the product of 4 rows of A by 16 columns of B to C, keeping
+// the 4x16 block of C in eight registers for the whole loop.
+C40KL_TARGET_AVX2 static void MicroKernel4x16(size_t n, size_t k, const float* a,
+	const float* b, float* c, size_t i, size_t j, size_t k0, size_t k1)
+{
+	float* c0 = c + i * n + j;
+	float* c1 = c0 + n;
+	float* c2 = c1 + n;
+	float* c3 = c2 + n;
+
+	__m256 acc00 = _mm256_loadu_ps(c0), acc01 = _mm256_loadu_ps(c0 + 8);
+	__m256 acc10 = _mm256_loadu_ps(c1), acc11 = _mm256_loadu_ps(c1 + 8);
+	__m256 acc20 = _mm256_loadu_ps(c2), acc21 = _mm256_loadu_ps(c2 + 8);
+	__m256 acc30 = _mm256_loadu_ps(c3), acc31 = _mm256_loadu_ps(c3 + 8);
+
+	const float* a0 = a + i * k;
+	const float* a1 = a0 + k;
+	const float* a2 = a1 + k;
+	const float* a3 = a2 + k;
+
+	for (size_t kk = k0; kk < k1; kk++)
+	{
+		const __m256 b0 = _mm256_loadu_ps(b + kk * n + j);
+		const __m256 b1 = _mm256_loadu_ps(b + kk * n + j + 8);
+
+		__m256 ai = _mm256_broadcast_ss(a0 + kk);
+		acc00 = _mm256_fmadd_ps(ai, b0, acc00);
+		acc01 = _mm256_fmadd_ps(ai, b1, acc01);
+
+		ai = _mm256_broadcast_ss(a1 + kk);
+		acc10 = _mm256_fmadd_ps(ai, b0, acc10);
+		acc11 = _mm256_fmadd_ps(ai, b1, acc11);
+
+		ai = _mm256_broadcast_ss(a2 + kk);
+		acc20 = _mm256_fmadd_ps(ai, b0, acc20);
+		acc21 = _mm256_fmadd_ps(ai, b1, acc21);
+
+		ai = _mm256_broadcast_ss(a3 + kk);
+		acc30 = _mm256_fmadd_ps(ai, b0, acc30);
+		acc31 = _mm256_fmadd_ps(ai, b1, acc31);
+	}
+
+	_mm256_storeu_ps(c0, acc00); _mm256_storeu_ps(c0 + 8, acc01);
+	_mm256_storeu_ps(c1, acc10); _mm256_storeu_ps(c1 + 8, acc11);
+	_mm256_storeu_ps(c2, acc20); _mm256_storeu_ps(c2 + 8, acc21);
+	_mm256_storeu_ps(c3, acc30); _mm256_storeu_ps(c3 + 8, acc31);
+}
+
+
+//Add the product of 1 row of A by 8 columns of B to C
+C40KL_TARGET_AVX2 static void MicroKernel1x8(size_t n, size_t k, const float* a,
+	const float* b, float* c, size_t i, size_t j, size_t k0, size_t k1)
+{
+	__m256 acc = _mm256_loadu_ps(c + i * n + j);
+	for (size_t kk = k0; kk < k1; kk++)
+	{
+		acc = _mm256_fmadd_ps(_mm256_broadcast_ss(a + i * k + kk),
+			_mm256_loadu_ps(b + kk * n + j), acc);
+	}
+	_mm256_storeu_ps(c + i * n + j, acc);
+}
+
+
+C40KL_TARGET_AVX2 static void MultiplyAVX2(size_t m, size_t n, size_t k, const float* a,
+	const float* b, const float* bias, float* c)
+{
+	FillBias(m, n, bias, c);
+
+	for (size_t j0 = 0; j0 < n; j0 += BLOCK_N)
+	{
+		const size_t j1 = std::min(j0 + BLOCK_N, n);
+		const size_t j16 = j0 + (j1 - j0) / 16 * 16;
+		const size_t j8 = j0 + (j1 - j0) / 8 * 8;
+
+		for (size_t k0 = 0; k0 < k; k0 += BLOCK_K)
+		{
+			const size_t k1 = std::min(k0 + BLOCK_K, k);
+
+			//Blocks of 4 rows, then the leftover rows one at a time
+			size_t i = 0;
+			for (; i + 4 <= m; i += 4)
+			{
+				for (size_t j = j0; j < j16; j += 16)
+					MicroKernel4x16(n, k, a, b, c, i, j, k0, k1);
+
+				for (size_t j = j16; j < j8; j += 8)
+				{
+					for (size_t r = i; r < i + 4; r++)
+						MicroKernel1x8(n, k, a, b, c, r, j, k0, k1);
+				}
+
+				MultiplyBlockScalar(n, k, a, b, c, i, i + 4, j8, j1, k0, k1);
+			}
+
+			for (; i < m; i++)
+			{
+				for (size_t j = j0; j < j8; j += 8)
+					MicroKernel1x8(n, k, a, b, c, i, j, k0, k1);
+
+				MultiplyBlockScalar(n, k, a, b, c, i, i + 1, j8, j1, k0, k1);
+			}
+		}
+	}
+}
+
+
+static bool DetectAVX2()
+{
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+
+	//Need AVX, FMA and OS support for saving the AVX registers
+	__cpuid(info, 1);
+	const bool bFMA = (info[2] & (1 << 12)) != 0;
+	const bool bOSXSAVE = (info[2] & (1 << 27)) != 0;
+	const bool bAVX = (info[2] & (1 << 28)) != 0;
+	if (!bFMA || !bOSXSAVE || !bAVX || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+
+
+#endif // C40KL_X86
+
+
+bool Gemm::HasAVX2()
+{
+#ifdef C40KL_X86
+	static const bool bHasAVX2 = DetectAVX2();
+	return bHasAVX2;
+#else
+	return false;
+#endif
+}
+
+
+void Gemm::Multiply(size_t m, size_t n, size_t k, const float* a,
+	const float* b, const float* bias, float* c)
+{
+#ifdef C40KL_X86
+	if (HasAVX2())
+	{
+		MultiplyAVX2(m, n, k, a, b, bias, c);
+		return;
+	}
+#endif
+
+	MultiplyScalar(m, n, k, a, b, bias, c);
+}
+
+
+} // namespace c40kl
@@ -0,0 +1,51 @@
+#pragma once
+
+
+#include "Utility.h"
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// Single precision matrix multiplication, for running the neural
+/// network on the CPU. All matrices are dense and row-major. The work
+/// is blocked so that the parts of B being used stay in cache, and on
+/// x86 CPUs which support them, AVX2 and FMA instructions are used
+/// (chosen at runtime, so the library still runs on older CPUs.)
+/// </summary>
+class C40KL_API Gemm
+{
+public:
+	/// <summary>
+	/// Compute C = A * B + bias, where the bias is added to every row of C.
+	/// Uses the fastest implementation supported by this CPU.
+	/// </summary>
+	/// <param name="m">The number of rows of A and C.</param>
+	/// <param name="n">The number of columns of B and C.</param>
+	/// <param name="k">The number of columns of A, and rows of B.</param>
+	/// <param name="a">The m by k matrix A.</param>
+	/// <param name="b">The k by n matrix B.</param>
+	/// <param name="bias">The bias vector of size n, or nullptr for no bias.</param>
+	/// <param name="c">The m by n output matrix C.</param>
+	static void Multiply(size_t m, size_t n, size_t k, const float* a,
+		const float* b, const float* bias, float* c);
+
+
+	/// <summary>
+	/// The same as Multiply(), but never uses SIMD instructions
+	/// explicitly (although the compiler may still vectorise it.)
+	/// </summary>
+	static void MultiplyScalar(size_t m, size_t n, size_t k, const float* a,
+		const float* b, const float* bias, float* c);
+
+
+	/// <summary>
+	/// Determine whether Multiply() uses AVX2 instructions on this CPU.
+	/// </summary>
+	static bool HasAVX2();
+};
+
+
+} // namespace c40kl
@@ -0,0 +1,527 @@
+#include "InferenceServer.h"
+#include "StateSerialiser.h"
+#include "StateEncoder.h"
+#include <atomic>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/interprocess_condition.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+
+namespace c40kl
+{
+
+
+namespace bip = boost::interprocess;
+typedef bip::scoped_lock<bip::interprocess_mutex> ChannelLock;
+
+
+//The bytes at the start of the shared memory, identifying it
+static const char MAGIC[8] = { 'C', '4', '0', 'K', 'L', 'I', 'N', 'F' };
+
+//The version of the shared memory layout, so that workers
+// from a different build refuse to connect
+static const uint32_t CHANNEL_VERSION = 1;
+
+
+//What a worker is doing
+enum class WorkerStatus : uint32_t
+{
+	UNCONNECTED,
+	IDLE,
+	REQUESTED, //Waiting for the server to answer
+	ANSWERED,
+	REJECTED, //The server couldn't read the request
+	DISCONNECTED
+};
+
+
+//The shared state of each worker
+struct WorkerSlot
+{
+	bip::interprocess_condition answered;
+	WorkerStatus status;
+	uint32_t numStates;
+	uint64_t numRequestBytes;
+};
+
+
+struct InferenceChannel
+{
+	//Written last by the server, once everything else is ready
+	char magic[8];
+
+	uint32_t version;
+	uint32_t numWorkers;
+	int32_t boardSize;
+	uint64_t maxStatesPerRequest;
+	uint64_t maxRequestBytes;
+
+	//Everything below (and the worker slots) is guarded by the mutex
+	bip::interprocess_mutex mutex;
+	bip::interprocess_condition requested; //When a request arrives, or a worker disconnects
+	bool shutdown;
+
+	//The ring buffer of workers waiting for answers
+	uint64_t ringHead; //The next to take
+	uint64_t ringTail; //The next free
+};
+
+
+//Where each part of the shared memory is, after the channel itself:
+//  [channel][worker slots][ring buffer][request areas][response areas]
+// Each worker's response area holds the values of the states it sent,
+// followed by their policy arrays.
+struct ChannelLayout
+{
+	size_t slotsOffset;
+	size_t ringOffset;
+	size_t requestsOffset;
+	size_t requestStride;
+	size_t responsesOffset;
+	size_t responseStride;
+	size_t totalSize;
+};
+
+
+//Round up to a multiple of the cache line size, so that
+// areas written by different processes don't share a line
+static size_t AlignUp(size_t numBytes)
+{
+	const size_t alignment = 64;
+	return (numBytes + alignment - 1) / alignment * alignment;
+}
+
+
+static ChannelLayout GetLayout(size_t numWorkers, int boardSize, size_t maxStatesPerRequest,
+	size_t maxRequestBytes)
+{
+	const size_t responseFloats = maxStatesPerRequest * (1 + StateEncoder::GetPolicySize(boardSize));
+
+	ChannelLayout layout;
+	layout.slotsOffset = AlignUp(sizeof(InferenceChannel));
+	layout.ringOffset = AlignUp(layout.slotsOffset + numWorkers * sizeof(WorkerSlot));
+	layout.requestsOffset = AlignUp(layout.ringOffset + numWorkers * sizeof(uint32_t));
+	layout.requestStride = AlignUp(maxRequestBytes);
+	layout.responsesOffset = layout.requestsOffset + numWorkers * layout.requestStride;
+	layout.responseStride = AlignUp(responseFloats * sizeof(float));
+	layout.totalSize = layout.responsesOffset + numWorkers * layout.responseStride;
+	return layout;
+}
+
+
+static ChannelLayout GetLayout(const InferenceChannel& channel)
+{
+	return GetLayout(channel.numWorkers, channel.boardSize,
+		(size_t)channel.maxStatesPerRequest, (size_t)channel.maxRequestBytes);
+}
+
+
+static WorkerSlot& GetSlot(InferenceChannel& channel, size_t workerIdx)
+{
+	char* pBase = reinterpret_cast<char*>(&channel);
+	return reinterpret_cast<WorkerSlot*>(pBase + GetLayout(channel).slotsOffset)[workerIdx];
+}
+
+
+static uint32_t* GetRing(InferenceChannel& channel)
+{
+	char* pBase = reinterpret_cast<char*>(&channel);
+	return reinterpret_cast<uint32_t*>(pBase + GetLayout(channel).ringOffset);
+}
+
+
+static char* GetRequestArea(InferenceChannel& channel, size_t workerIdx)
+{
+	const auto layout = GetLayout(channel);
+	char* pBase = reinterpret_cast<char*>(&channel);
+	return pBase + layout.requestsOffset + workerIdx * layout.requestStride;
+}
+
+
+static float* GetResponseArea(InferenceChannel& channel, size_t workerIdx)
+{
+	const auto layout = GetLayout(channel);
+	char* pBase = reinterpret_cast<char*>(&channel);
+	return reinterpret_cast<float*>(pBase + layout.responsesOffset + workerIdx * layout.responseStride);
+}
+
+
+//Check if every worker has disconnected (with the mutex held)
+static bool AllDisconnected(InferenceChannel& channel)
+{
+	for (size_t i = 0; i < channel.numWorkers; i++)
+	{
+		if (GetSlot(channel, i).status != WorkerStatus::DISCONNECTED)
+			return false;
+	}
+	return true;
+}
+
+
+//Decode a worker's request, checking that it has the number of states
+// it claims, with the server's board size. Returns false if it doesn't.
+static bool ReadRequest(InferenceChannel& channel, const WorkerSlot& slot, size_t workerIdx,
+	int boardSize, std::vector<GameState>& outStates)
+{
+	if (slot.numRequestBytes > channel.maxRequestBytes || slot.numStates > channel.maxStatesPerRequest)
+		return false;
+
+	try
+	{
+		outStates = StateSerialiser::Decode(GetRequestArea(channel, workerIdx),
+			(size_t)slot.numRequestBytes);
+	}
+	catch (const std::runtime_error&)
+	{
+		return false;
+	}
+
+	if (outStates.size() != slot.numStates)
+		return false;
+
+	for (const auto& state : outStates)
+	{
+		if (state.GetBoardState().GetSize() != boardSize)
+			return false;
+	}
+	return true;
+}
+
+
+InferenceServer::InferenceServer(const std::string& name, size_t numWorkers, int boardSize,
+	size_t maxStatesPerRequest, size_t maxRequestBytes) :
+	m_Name(name),
+	m_NumWorkers(numWorkers),
+	m_BoardSize(boardSize),
+	m_pChannel(nullptr)
+{
+	//(Checked in every build, since the requests are spread over the workers)
+	if (numWorkers == 0 || numWorkers > UINT32_MAX)
+		throw std::runtime_error("Must have a valid number of workers.");
+	C40KL_ASSERT_PRECONDITION(boardSize > 0, "Board size must be strictly positive.");
+	C40KL_ASSERT_PRECONDITION(maxStatesPerRequest > 0 && maxRequestBytes > 0,
+		"Requests must be allowed at least one state.");
+
+	const auto layout = GetLayout(numWorkers, boardSize, maxStatesPerRequest, maxRequestBytes);
+
+	try
+	{
+		m_Memory = bip::shared_memory_object(bip::create_only, name.c_str(), bip::read_write);
+	}
+	catch (const bip::interprocess_exception& e)
+	{
+		throw std::runtime_error("Could not create shared memory '" + name + "': " + e.what());
+	}
+
+	try
+	{
+		m_Memory.truncate((bip::offset_t)layout.totalSize);
+		m_Region = bip::mapped_region(m_Memory, bip::read_write);
+	}
+	catch (const bip::interprocess_exception& e)
+	{
+		bip::shared_memory_object::remove(name.c_str());
+		throw std::runtime_error("Could not map shared memory '" + name + "': " + e.what());
+	}
+
+	//(The new memory is all zeros, so the magic isn't there yet)
+	m_pChannel = new (m_Region.get_address()) InferenceChannel();
+	m_pChannel->version = CHANNEL_VERSION;
+	m_pChannel->numWorkers = (uint32_t)numWorkers;
+	m_pChannel->boardSize = (int32_t)boardSize;
+	m_pChannel->maxStatesPerRequest = maxStatesPerRequest;
+	m_pChannel->maxRequestBytes = maxRequestBytes;
+	m_pChannel->shutdown = false;
+	m_pChannel->ringHead = m_pChannel->ringTail = 0;
+
+	for (size_t i = 0; i < numWorkers; i++)
+	{
+		WorkerSlot* pSlot = new (&GetSlot(*m_pChannel, i)) WorkerSlot();
+		pSlot->status = WorkerStatus::UNCONNECTED;
+	}
+
+	std::atomic_thread_fence(std::memory_order_release);
+	std::memcpy(m_pChannel->magic, MAGIC, sizeof(MAGIC));
+}
+
+
+InferenceServer::~InferenceServer()
+{
+	//Workers keep their own mapping of the memory, so
+	// they can still see that the server shut down.
+	Shutdown();
+	bip::shared_memory_object::remove(m_Name.c_str());
+}
+
+
+bool InferenceServer::WaitForRequests(size_t timeoutMilliseconds, std::vector<GameState>& outStates)
+{
+	C40KL_ASSERT_PRECONDITION(!IsWaitingToRespond(), "Must respond to the last batch of requests first.");
+
+	InferenceChannel& channel = *m_pChannel;
+	outStates.clear();
+
+	std::vector<uint32_t> takenWorkers;
+	{
+		ChannelLock lock(channel.mutex);
+
+		const auto deadline = boost::posix_time::microsec_clock::universal_time()
+			+ boost::posix_time::milliseconds(timeoutMilliseconds);
+
+		while (channel.ringHead == channel.ringTail && !AllDisconnected(channel))
+		{
+			if (!channel.requested.timed_wait(lock, deadline))
+				break;
+		}
+
+		//Take every request waiting
+		const uint32_t* pRing = GetRing(channel);
+		for (; channel.ringHead != channel.ringTail; channel.ringHead++)
+		{
+			const uint32_t workerIdx = pRing[channel.ringHead % m_NumWorkers];
+			if (workerIdx >= m_NumWorkers)
+			{
+				//There's no telling which workers are waiting, so
+				// stop them all rather than leave any waiting forever
+				channel.shutdown = true;
+				for (size_t i = 0; i < m_NumWorkers; i++)
+					GetSlot(channel, i).answered.notify_all();
+				throw std::runtime_error("Invalid data: the queue of requests is corrupt.");
+			}
+
+			//(Ignore a worker which isn't waiting, so isn't answered twice)
+			if (GetSlot(channel, workerIdx).status == WorkerStatus::REQUESTED)
+				takenWorkers.push_back(workerIdx);
+		}
+	}
+
+	//The requests belong to the server until it answers them, so they
+	// can be read without holding the mutex. Only the ones which can be
+	// read go in the batch; the others are answered with an error.
+	std::vector<uint32_t> rejectedWorkers;
+	for (uint32_t workerIdx : takenWorkers)
+	{
+		const WorkerSlot& slot = GetSlot(channel, workerIdx);
+		std::vector<GameState> states;
+		if (!ReadRequest(channel, slot, workerIdx, m_BoardSize, states))
+		{
+			rejectedWorkers.push_back(workerIdx);
+			continue;
+		}
+
+		m_BatchWorkers.push_back(workerIdx);
+		m_BatchSizes.push_back(states.size());
+		outStates.insert(outStates.end(),
+			std::make_move_iterator(states.begin()), std::make_move_iterator(states.end()));
+	}
+
+	if (!rejectedWorkers.empty())
+	{
+		ChannelLock lock(channel.mutex);
+		for (uint32_t workerIdx : rejectedWorkers)
+		{
+			WorkerSlot& slot = GetSlot(channel, workerIdx);
+			slot.status = WorkerStatus::REJECTED;
+			slot.answered.notify_one();
+		}
+	}
+
+	return !m_BatchWorkers.empty();
+}
+
+
+void InferenceServer::Respond(const float* values, const float* policyArrays)
+{
+	C40KL_ASSERT_PRECONDITION(IsWaitingToRespond(), "Must have a batch of requests to respond to.");
+
+	InferenceChannel& channel = *m_pChannel;
+	const size_t policySize = StateEncoder::GetPolicySize(m_BoardSize);
+
+	//Write the answers before telling the workers about them
+	size_t stateIdx = 0;
+	for (size_t i = 0; i < m_BatchWorkers.size(); i++)
+	{
+		const size_t numStates = m_BatchSizes[i];
+		float* pResponse = GetResponseArea(channel, m_BatchWorkers[i]);
+
+		std::memcpy(pResponse, values + stateIdx, numStates * sizeof(float));
+		std::memcpy(pResponse + numStates, policyArrays + stateIdx * policySize,
+			numStates * policySize * sizeof(float));
+
+		stateIdx += numStates;
+	}
+
+	{
+		ChannelLock lock(channel.mutex);
+		for (uint32_t workerIdx : m_BatchWorkers)
+		{
+			WorkerSlot& slot = GetSlot(channel, workerIdx);
+			slot.status = WorkerStatus::ANSWERED;
+			slot.answered.notify_one();
+		}
+	}
+
+	m_BatchWorkers.clear();
+	m_BatchSizes.clear();
+}
+
+
+void InferenceServer::Shutdown()
+{
+	InferenceChannel& channel = *m_pChannel;
+	ChannelLock lock(channel.mutex);
+
+	channel.shutdown = true;
+	for (size_t i = 0; i < m_NumWorkers; i++)
+		GetSlot(channel, i).answered.notify_all();
+	channel.requested.notify_all();
+}
+
+
+size_t InferenceServer::GetBatchSize() const
+{
+	size_t batchSize = 0;
+	for (size_t numStates : m_BatchSizes)
+		batchSize += numStates;
+	return batchSize;
+}
+
+
+bool InferenceServer::AllWorkersFinished() const
+{
+	ChannelLock lock(m_pChannel->mutex);
+	return AllDisconnected(*m_pChannel);
+}
+
+
+InferenceClient::InferenceClient(const std::string& name, size_t workerIdx) :
+	m_WorkerIdx(workerIdx),
+	m_BoardSize(0),
+	m_bConnected(false),
+	m_pChannel(nullptr)
+{
+	try
+	{
+		m_Memory = bip::shared_memory_object(bip::open_only, name.c_str(), bip::read_write);
+		m_Region = bip::mapped_region(m_Memory, bip::read_write);
+	}
+	catch (const bip::interprocess_exception& e)
+	{
+		throw std::runtime_error("Could not open shared memory '" + name + "': " + e.what());
+	}
+
+	m_pChannel = static_cast<InferenceChannel*>(m_Region.get_address());
+	InferenceChannel& channel = *m_pChannel;
+
+	if (m_Region.get_size() < sizeof(InferenceChannel)
+		|| std::memcmp(channel.magic, MAGIC, sizeof(MAGIC)) != 0)
+	{
+		throw std::runtime_error("Shared memory '" + name + "' is not an inference server (or it isn't ready yet).");
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	if (channel.version != CHANNEL_VERSION || m_Region.get_size() < GetLayout(channel).totalSize)
+		throw std::runtime_error("Inference server '" + name + "' is from a different version.");
+	if (workerIdx >= channel.numWorkers)
+		throw std::runtime_error("Worker index is out of range for the inference server.");
+
+	ChannelLock lock(channel.mutex);
+	WorkerSlot& slot = GetSlot(channel, workerIdx);
+	if (channel.shutdown)
+		throw std::runtime_error("The inference server has shut down.");
+	if (slot.status != WorkerStatus::UNCONNECTED)
+		throw std::runtime_error("A worker with the same index has already connected.");
+
+	slot.status = WorkerStatus::IDLE;
+	m_BoardSize = channel.boardSize;
+	m_bConnected = true;
+}
+
+
+InferenceClient::~InferenceClient()
+{
+	Disconnect();
+}
+
+
+void InferenceClient::Predict(const std::vector<GameState>& states, float* outValues, float* outPolicyArrays)
+{
+	if (!m_bConnected)
+		throw std::runtime_error("Not connected to the inference server.");
+	if (states.empty())
+		return;
+
+	InferenceChannel& channel = *m_pChannel;
+	if (states.size() > channel.maxStatesPerRequest)
+		throw std::runtime_error("Too many states to send to the inference server at once.");
+
+	for (const auto& state : states)
+	{
+		if (state.GetBoardState().GetSize() != m_BoardSize)
+			throw std::runtime_error("States must have the same board size as the inference server.");
+	}
+
+	const std::string bytes = StateSerialiser::Encode(states);
+	if (bytes.size() > channel.maxRequestBytes)
+		throw std::runtime_error("States are too large to send to the inference server at once.");
+
+	//The request area is ours until the request is sent
+	std::memcpy(GetRequestArea(channel, m_WorkerIdx), bytes.data(), bytes.size());
+
+	{
+		ChannelLock lock(channel.mutex);
+		if (channel.shutdown)
+			throw std::runtime_error("The inference server has shut down.");
+
+		WorkerSlot& slot = GetSlot(channel, m_WorkerIdx);
+		slot.numStates = (uint32_t)states.size();
+		slot.numRequestBytes = bytes.size();
+		slot.status = WorkerStatus::REQUESTED;
+
+		GetRing(channel)[channel.ringTail % channel.numWorkers] = (uint32_t)m_WorkerIdx;
+		channel.ringTail++;
+		channel.requested.notify_one();
+
+		while (slot.status != WorkerStatus::ANSWERED && slot.status != WorkerStatus::REJECTED
+			&& !channel.shutdown)
+		{
+			slot.answered.wait(lock);
+		}
+
+		const WorkerStatus status = slot.status;
+		if (status == WorkerStatus::ANSWERED || status == WorkerStatus::REJECTED)
+			slot.status = WorkerStatus::IDLE;
+
+		if (status == WorkerStatus::REJECTED)
+			throw std::runtime_error("The inference server could not read the request.");
+		if (status != WorkerStatus::ANSWERED)
+			throw std::runtime_error("The inference server has shut down.");
+	}
+
+	//(The response area is ours again, until the next request)
+	const size_t policySize = StateEncoder::GetPolicySize(m_BoardSize);
+	const float* pResponse = GetResponseArea(channel, m_WorkerIdx);
+	std::memcpy(outValues, pResponse, states.size() * sizeof(float));
+	std::memcpy(outPolicyArrays, pResponse + states.size(), states.size() * policySize * sizeof(float));
+}
+
+
+void InferenceClient::Disconnect()
+{
+	if (!m_bConnected)
+		return;
+
+	InferenceChannel& channel = *m_pChannel;
+	ChannelLock lock(channel.mutex);
+
+	GetSlot(channel, m_WorkerIdx).status = WorkerStatus::DISCONNECTED;
+	channel.requested.notify_all();
+	m_bConnected = false;
+}
+
+
+} // namespace c40kl
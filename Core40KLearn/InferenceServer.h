@@ -0,0 +1,211 @@
+#pragma once
+
+
+#include "GameState.h"
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <boost/noncopyable.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+
+namespace c40kl
+{
+
+
+//The layout of the start of the shared memory (see InferenceServer.cpp)
+struct InferenceChannel;
+
+
+/// <summary>
+/// Evaluates leaf states for several self-play worker processes (see
+/// InferenceClient) with one process's network, so that the leaves of
+/// every worker's games are evaluated in large batches, without any
+/// networking. The server and its workers talk through a named block
+/// of shared memory, holding:
+/// - For each worker, an area for the states it wants evaluated (encoded
+///   by StateSerialiser), and an area for the values and policy arrays
+///   answering them.
+/// - A ring buffer of the workers waiting for answers, in the order they
+///   asked. Each worker asks for one batch at a time, so it never fills.
+/// - A mutex and conditions (which work between processes) to wake the
+///   server when requests arrive, and each worker when it is answered.
+/// The shared memory is created by the server, so it must be created
+/// before any workers, and is removed when the server is destroyed.
+/// </summary>
+class C40KL_API InferenceServer :
+	public boost::noncopyable
+{
+public:
+	/// <summary>
+	/// Create the shared memory for the given number of workers.
+	/// Throws std::runtime_error if it cannot be created (e.g. if
+	/// shared memory with the same name already exists, or there
+	/// are no workers.)
+	/// </summary>
+	/// <param name="name">The name of the shared memory, which workers connect to.</param>
+	/// <param name="numWorkers">The number of workers. Must be > 0.</param>
+	/// <param name="boardSize">The board size of every state (and of the network.)</param>
+	/// <param name="maxStatesPerRequest">The most states a worker may send at once.</param>
+	/// <param name="maxRequestBytes">The most bytes of encoded states a worker may send at once.</param>
+	InferenceServer(const std::string& name, size_t numWorkers, int boardSize,
+		size_t maxStatesPerRequest, size_t maxRequestBytes);
+
+
+	/// <summary>
+	/// Shuts down (see Shutdown()) and removes the shared memory.
+	/// </summary>
+	~InferenceServer();
+
+
+	/// <summary>
+	/// Wait for workers to send states, then take every request waiting
+	/// and return all of their states as one batch. Returns early (with
+	/// no states) if every worker has finished (see AllWorkersFinished().)
+	/// Requests which can't be read (e.g. corrupt states) are left out of
+	/// the batch, and answered with an error instead, so the worker's
+	/// InferenceClient::Predict() throws. Throws std::runtime_error (after
+	/// shutting down) if the queue of requests itself is corrupt.
+	/// PRECONDITION: !IsWaitingToRespond()
+	/// </summary>
+	/// <param name="timeoutMilliseconds">The longest time to wait for a request.</param>
+	/// <param name="outStates">The output array of states, to evaluate and pass to Respond().</param>
+	/// <returns>True if there were any requests, false if it timed out or every worker finished.</returns>
+	bool WaitForRequests(size_t timeoutMilliseconds, std::vector<GameState>& outStates);
+
+
+	/// <summary>
+	/// Answer the batch from the last call to WaitForRequests(),
+	/// sending each worker the results for its states.
+	/// PRECONDITION: IsWaitingToRespond()
+	/// </summary>
+	/// <param name="values">The value of each state in the batch.</param>
+	/// <param name="policyArrays">The policy array of each state in the batch
+	/// (see StateEncoder::GetPolicySize()), one after the other.</param>
+	void Respond(const float* values, const float* policyArrays);
+
+
+	/// <summary>
+	/// Tell every worker to stop, so that any request they are
+	/// waiting on (and any later request) throws.
+	/// </summary>
+	void Shutdown();
+
+
+	/// <summary>
+	/// Check if WaitForRequests() returned a batch which
+	/// hasn't been answered with Respond() yet.
+	/// </summary>
+	inline bool IsWaitingToRespond() const
+	{
+		return !m_BatchWorkers.empty();
+	}
+
+
+	/// <summary>
+	/// Get the number of states in the batch waiting for Respond().
+	/// </summary>
+	size_t GetBatchSize() const;
+
+
+	/// <summary>
+	/// Check if every worker has connected, and then disconnected.
+	/// </summary>
+	bool AllWorkersFinished() const;
+
+
+	inline size_t GetNumWorkers() const
+	{
+		return m_NumWorkers;
+	}
+
+
+	inline int GetBoardSize() const
+	{
+		return m_BoardSize;
+	}
+
+
+private:
+	const std::string m_Name;
+	const size_t m_NumWorkers;
+	const int m_BoardSize;
+
+	boost::interprocess::shared_memory_object m_Memory;
+	boost::interprocess::mapped_region m_Region;
+	InferenceChannel* m_pChannel;
+
+	//The workers whose requests make up the batch being evaluated,
+	// and the number of states each of them sent.
+	std::vector<uint32_t> m_BatchWorkers;
+	std::vector<size_t> m_BatchSizes;
+};
+
+
+/// <summary>
+/// Connects a self-play worker process to an InferenceServer,
+/// to evaluate states with the server's network.
+/// NOTE: if the server process dies without shutting down, any
+/// worker waiting for an answer will wait forever.
+/// </summary>
+class C40KL_API InferenceClient :
+	public boost::noncopyable
+{
+public:
+	/// <summary>
+	/// Connect to a server as one of its workers.
+	/// Throws std::runtime_error if there is no such server, or the
+	/// worker index is out of range or already taken.
+	/// </summary>
+	/// <param name="name">The name the server was created with.</param>
+	/// <param name="workerIdx">The index of this worker, less than the number of workers.</param>
+	InferenceClient(const std::string& name, size_t workerIdx);
+
+
+	/// <summary>
+	/// Disconnects from the server (see Disconnect().)
+	/// </summary>
+	~InferenceClient();
+
+
+	/// <summary>
+	/// Evaluate some states with the server's network, waiting for the
+	/// answer. This gives the same outputs as NeuralNetwork::Predict().
+	/// Throws std::runtime_error if there are too many states (or they
+	/// are too large) to send, they have the wrong board size, the
+	/// server can't read them, the server shuts down, or this client
+	/// has disconnected.
+	/// </summary>
+	/// <param name="states">The states to evaluate.</param>
+	/// <param name="outValues">The output values, one per state.</param>
+	/// <param name="outPolicyArrays">The output policy arrays, one after
+	/// the other (see StateEncoder::GetPolicySize().)</param>
+	void Predict(const std::vector<GameState>& states, float* outValues, float* outPolicyArrays);
+
+
+	/// <summary>
+	/// Tell the server that this worker has finished, so it can stop
+	/// once every worker has. Does nothing if already disconnected.
+	/// </summary>
+	void Disconnect();
+
+
+	inline int GetBoardSize() const
+	{
+		return m_BoardSize;
+	}
+
+
+private:
+	const size_t m_WorkerIdx;
+	int m_BoardSize;
+	bool m_bConnected;
+
+	boost::interprocess::shared_memory_object m_Memory;
+	boost::interprocess::mapped_region m_Region;
+	InferenceChannel* m_pChannel;
+};
+
+
+} // namespace c40kl
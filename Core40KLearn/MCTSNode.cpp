@@ -1,10 +1,23 @@
 #include "MCTSNode.h"
+#include <tuple>
+#include <stdexcept>
 
 
 namespace c40kl
 {
 
 
+//Add to an atomic float (which has no fetch_add until C++20)
+static void AtomicAdd(std::atomic<float>& sum, float value)
+{
+	float expected = sum.load();
+	while (!sum.compare_exchange_weak(expected, expected + value))
+	{
+		//expected now holds the latest sum, so try again
+	}
+}
+
+
 MCTSNodePtr MCTSNode::CreateRootNode(const GameState& state)
 {
 	//I would like to use make_shared here, but I'm going to
@@ -27,9 +40,11 @@ MCTSNode::MCTSNode(const GameState& state, MCTSNode* pParent, float weightFromPa
 	m_State(state),
 	m_pParent(pParent),
 	m_bExpanded(false),
+	m_bClaimed(false),
 	m_NumEstimates(0),
-	m_ValueSum(0),
-	m_WeightSum(0),
+	m_ValueSum(0.0f),
+	m_WeightSum(0.0f),
+	m_NumVirtualLosses(0),
 	m_bInitialisedActions(false),
 	m_WeightFromParent(weightFromParent)
 {
@@ -65,11 +80,11 @@ void MCTSNode::Expand(const std::vector<float>& priorActionDistribution)
 	C40KL_ASSERT_INVARIANT(!GetMyActions().empty(),
 		"Unfinished game states should always have available actions.");
 
-	m_bExpanded = true;
-	m_ActionPrior = priorActionDistribution;
-
-	m_pChildren.reserve(actions.size());
-	m_Weights.reserve(actions.size());
+	//Build everything first, so the node is left a leaf if this throws
+	std::vector<MCTSNodeArray> pChildren;
+	std::vector<std::vector<float>> weights;
+	pChildren.reserve(actions.size());
+	weights.reserve(actions.size());
 
 	//Now create child nodes:
 	for (const auto& pCmd : actions)
@@ -91,9 +106,30 @@ void MCTSNode::Expand(const std::vector<float>& priorActionDistribution)
 		}
 
 		//Now save the info
-		m_Weights.push_back(std::move(probs));
-		m_pChildren.push_back(std::move(children));
+		weights.push_back(std::move(probs));
+		pChildren.push_back(std::move(children));
 	}
+
+	m_ActionPrior = priorActionDistribution;
+	m_Weights.swap(weights);
+	m_pChildren.swap(pChildren);
+
+	//Only now can other threads see the children
+	m_bExpanded = true;
+}
+
+
+bool MCTSNode::ClaimExpansion()
+{
+	C40KL_ASSERT_PRECONDITION(!IsTerminal(), "Cannot expand terminal nodes.");
+
+	return !m_bClaimed.exchange(true);
+}
+
+
+void MCTSNode::CancelExpansion()
+{
+	m_bClaimed = false;
 }
 
 
@@ -108,9 +144,10 @@ void MCTSNode::AddValueStatistic(float value)
 		// multiply by weight of edge
 		// from parent to pNode
 
-		//Update value
-		pNode->m_ValueSum += value * weight;
-		pNode->m_WeightSum += weight;
+		//Update value (atomically, since other threads
+		// may be adding to the same nodes)
+		AtomicAdd(pNode->m_ValueSum, value * weight);
+		AtomicAdd(pNode->m_WeightSum, weight);
 		pNode->m_NumEstimates++;
 
 		//Update weight
@@ -129,10 +166,15 @@ float MCTSNode::GetValueEstimate() const
 {
 	if (m_NumEstimates > 0)
 	{
-		C40KL_ASSERT_INVARIANT(m_WeightSum > 0.0f,
+		const float weightSum = m_WeightSum;
+
+		C40KL_ASSERT_INVARIANT(weightSum > 0.0f,
 			"Weight sum must be strictly positive if received any samples.");
 
-		return m_ValueSum / m_WeightSum;
+		//Note: if another thread is adding a sample, the value sum
+		// may already include it while the weight sum doesn't yet
+		// (or vice versa), so the estimate is slightly off until then.
+		return m_ValueSum / weightSum;
 	}
 	else
 	{
@@ -148,6 +190,26 @@ size_t MCTSNode::GetNumValueSamples() const
 }
 
 
+void MCTSNode::AddVirtualLoss()
+{
+	m_NumVirtualLosses++;
+}
+
+
+void MCTSNode::RemoveVirtualLoss()
+{
+	C40KL_ASSERT_PRECONDITION(m_NumVirtualLosses > 0, "No virtual loss to remove.");
+
+	m_NumVirtualLosses--;
+}
+
+
+size_t MCTSNode::GetNumVirtualLosses() const
+{
+	return m_NumVirtualLosses;
+}
+
+
 void MCTSNode::Detach()
 {
 	C40KL_ASSERT_PRECONDITION(!IsRoot(), "Cannot detach root.");
@@ -192,6 +254,22 @@ std::vector<int> MCTSNode::GetActionVisitCounts() const
 }
 
 
+std::vector<int> MCTSNode::GetActionVirtualLosses() const
+{
+	C40KL_ASSERT_PRECONDITION(!IsLeaf(), "Cannot get action virtual losses of leaf node.");
+
+	std::vector<int> virtualLosses(m_pChildren.size(), 0);
+	for (size_t i = 0; i < m_pChildren.size(); i++)
+	{
+		for (const auto& pChild : m_pChildren[i])
+		{
+			virtualLosses[i] += (int)pChild->GetNumVirtualLosses();
+		}
+	}
+	return virtualLosses;
+}
+
+
 std::vector<float> MCTSNode::GetActionValueEstimates() const
 {
 	C40KL_ASSERT_PRECONDITION(!IsLeaf(), "Cannot get action visit counts of leaf node.");
@@ -293,6 +371,128 @@ size_t MCTSNode::GetDepth() const
 }
 
 
+size_t MCTSNode::GetMemoryUsage() const
+{
+	size_t numBytes = sizeof(MCTSNode) + m_State.GetBoardState().GetMemoryUsage()
+		+ m_ActionPrior.capacity() * sizeof(float)
+		+ m_pActions.capacity() * sizeof(GameCommandPtr)
+		+ m_pChildren.capacity() * sizeof(MCTSNodeArray)
+		+ m_Weights.capacity() * sizeof(std::vector<float>);
+
+	for (const auto& children : m_pChildren)
+		numBytes += children.capacity() * sizeof(MCTSNodePtr);
+
+	for (const auto& weights : m_Weights)
+		numBytes += weights.capacity() * sizeof(float);
+
+	return numBytes;
+}
+
+
+void MCTSNode::Write(BinaryWriter& writer) const
+{
+	//Write the nodes in depth-first order, without recursion (since
+	// trees can be deep.) Each child's weight is written by its parent.
+	std::vector<const MCTSNode*> pNodes = { this };
+	while (!pNodes.empty())
+	{
+		const MCTSNode* pNode = pNodes.back();
+		pNodes.pop_back();
+
+		pNode->m_State.Write(writer);
+		writer.Write((uint64_t)pNode->m_NumEstimates);
+		writer.Write(pNode->m_ValueSum.load());
+		writer.Write(pNode->m_WeightSum.load());
+		writer.Write((uint8_t)pNode->m_bExpanded);
+
+		if (pNode->m_bExpanded)
+		{
+			writer.WriteArray(pNode->m_ActionPrior);
+			for (const auto& weights : pNode->m_Weights)
+				writer.WriteArray(weights);
+
+			//In reverse, so that the first child is written next
+			for (auto iter = pNode->m_pChildren.rbegin(); iter != pNode->m_pChildren.rend(); ++iter)
+			{
+				for (auto childIter = iter->rbegin(); childIter != iter->rend(); ++childIter)
+					pNodes.push_back(childIter->get());
+			}
+		}
+	}
+}
+
+
+MCTSNodePtr MCTSNode::Read(BinaryReader& reader)
+{
+	MCTSNodePtr pRoot = ReadNode(reader, nullptr, 0.0f);
+
+	//The children which still need to be read, as (parent, action
+	// index, child index), in reverse order (so the next child to
+	// read is at the back.)
+	std::vector<std::tuple<MCTSNode*, size_t, size_t>> slots;
+	auto addSlots = [&slots](MCTSNode* pNode)
+	{
+		for (size_t i = pNode->m_pChildren.size(); i-- > 0; )
+		{
+			for (size_t j = pNode->m_pChildren[i].size(); j-- > 0; )
+				slots.emplace_back(pNode, i, j);
+		}
+	};
+
+	addSlots(pRoot.get());
+	while (!slots.empty())
+	{
+		MCTSNode* pParent;
+		size_t actionIdx, childIdx;
+		std::tie(pParent, actionIdx, childIdx) = slots.back();
+		slots.pop_back();
+
+		auto& pChild = pParent->m_pChildren[actionIdx][childIdx];
+		pChild = ReadNode(reader, pParent, pParent->m_Weights[actionIdx][childIdx]);
+		addSlots(pChild.get());
+	}
+
+	return pRoot;
+}
+
+
+MCTSNodePtr MCTSNode::ReadNode(BinaryReader& reader, MCTSNode* pParent, float weightFromParent)
+{
+	MCTSNodePtr pNode(new MCTSNode(GameState::Read(reader), pParent, weightFromParent));
+
+	pNode->m_NumEstimates = (size_t)reader.Read<uint64_t>();
+	pNode->m_ValueSum = reader.Read<float>();
+	pNode->m_WeightSum = reader.Read<float>();
+	const bool bExpanded = (reader.Read<uint8_t>() != 0);
+
+	if (bExpanded)
+	{
+		//Note: the actions aren't checked against the priors, since
+		// that would mean generating every node's actions here. The
+		// format's version should change if the game rules do.
+		pNode->m_ActionPrior = reader.ReadArray<float>();
+		if (pNode->IsTerminal() || pNode->m_ActionPrior.empty())
+			throw std::runtime_error("Invalid data: bad expanded node.");
+
+		const size_t numActions = pNode->m_ActionPrior.size();
+		pNode->m_Weights.reserve(numActions);
+		pNode->m_pChildren.resize(numActions);
+		for (size_t i = 0; i < numActions; i++)
+		{
+			pNode->m_Weights.push_back(reader.ReadArray<float>());
+			if (pNode->m_Weights.back().empty())
+				throw std::runtime_error("Invalid data: action with no results.");
+
+			pNode->m_pChildren[i].resize(pNode->m_Weights.back().size());
+		}
+
+		pNode->m_bExpanded = true;
+	}
+
+	return pNode;
+}
+
+
 const GameCommandArray& MCTSNode::GetMyActions() const
 {
 	if (!m_bInitialisedActions)
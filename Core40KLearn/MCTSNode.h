@@ -3,6 +3,7 @@
 
 #include "Utility.h"
 #include "GameState.h"
+#include <atomic>
 
 
 namespace c40kl
@@ -20,7 +21,12 @@ typedef std::vector<MCTSNodePtr> MCTSNodeArray;
 /// This represents a STATE NODE in the MCTS tree,
 /// which has a set of actions it can perform, and
 /// each action has a distribution of resulting states.
-/// 
+/// Thread safety: several threads may search one tree at once (see
+/// TreeParallelSearch). The value statistics and virtual losses are
+/// atomic, so may be updated by any thread, and a node's children and
+/// priors are only visible to other threads once it is fully expanded.
+/// Only the thread which claimed a leaf (see ClaimExpansion()) may get
+/// its actions or expand it. Everything else must be done by one thread.
 /// </summary>
 class C40KL_API MCTSNode
 {
@@ -79,13 +85,31 @@ public:
 
 	/// <summary>
 	/// Expand this leaf node, by giving it a prior action distribution,
-	/// and letting it generate child nodes.
+	/// and letting it generate child nodes. If this throws, the node is
+	/// left unchanged.
 	/// PRECONDITION: IsLeaf()
 	/// POSTCONDITION: !IsLeaf()
 	/// </summary>
 	void Expand(const std::vector<float>& priorActionDistribution);
 
 
+	/// <summary>
+	/// Claim this leaf for expansion, when several threads are searching
+	/// the tree, so that only one of them evaluates and expands it. Returns
+	/// true for the first caller, and false for the rest (until the claim
+	/// is given up with CancelExpansion().)
+	/// PRECONDITION: !IsTerminal()
+	/// </summary>
+	bool ClaimExpansion();
+
+
+	/// <summary>
+	/// Give up a claim made by ClaimExpansion() without expanding the
+	/// node (e.g. because its evaluation failed), so it can be claimed again.
+	/// </summary>
+	void CancelExpansion();
+
+
 	/// <summary>
 	/// Add a value estimate for this state to this node.
 	/// This AUTOMATICALLY backpropagates this value to
@@ -117,6 +141,30 @@ public:
 	size_t GetNumValueSamples() const;
 
 
+	/// <summary>
+	/// Add a "virtual loss" to this node, which a thread searching the
+	/// tree does to each node on its path until the leaf's value is
+	/// backpropagated, so that other threads are discouraged from taking
+	/// the same path meanwhile. Unlike AddValueStatistic(), this isn't
+	/// backpropagated, and doesn't change GetValueEstimate() (the tree
+	/// policy decides what it is worth; see UCB1PolicyStrategy.)
+	/// </summary>
+	void AddVirtualLoss();
+
+
+	/// <summary>
+	/// Remove a virtual loss added by AddVirtualLoss().
+	/// PRECONDITION: GetNumVirtualLosses() > 0
+	/// </summary>
+	void RemoveVirtualLoss();
+
+
+	/// <summary>
+	/// Return the number of virtual losses on this node.
+	/// </summary>
+	size_t GetNumVirtualLosses() const;
+
+
 	/// <summary>
 	/// Remove this node's parent pointer, making it a
 	/// root node. This means values will no longer be
@@ -162,6 +210,14 @@ public:
 	std::vector<int> GetActionVisitCounts() const;
 
 
+	/// <summary>
+	/// Return the number of virtual losses on each action (the
+	/// total over the states resulting from it; see AddVirtualLoss().)
+	/// PRECONDITION: !IsLeaf().
+	/// </summary>
+	std::vector<int> GetActionVirtualLosses() const;
+
+
 	/// <summary>
 	/// Return the estimated values for each action, which
 	/// are computed using an aggregation of value estimates
@@ -214,6 +270,42 @@ public:
 	size_t GetDepth() const;
 
 
+	/// <summary>
+	/// Estimate the number of bytes of memory used by this node,
+	/// not including its children (but including the arrays which
+	/// point to them, and its state's board storage; see
+	/// BoardState::GetMemoryUsage()).
+	/// </summary>
+	size_t GetMemoryUsage() const;
+
+
+	/// <summary>
+	/// Write the subtree rooted at this node: the state, statistics,
+	/// action priors and chance weights of every node in it, so that
+	/// it can be read back by Read(). Each node's actions aren't
+	/// written, since they are generated again from its state.
+	/// </summary>
+	/// <param name="writer">The writer to append the subtree to.</param>
+	void Write(BinaryWriter& writer) const;
+
+
+	/// <summary>
+	/// Read a subtree written by Write(), as a new tree whose
+	/// root is the node Write() was called on (so has no parent.)
+	/// Throws std::runtime_error if the data is invalid.
+	/// </summary>
+	/// <param name="reader">The reader to read the subtree from.</param>
+	static MCTSNodePtr Read(BinaryReader& reader);
+
+
+private:
+	/// <summary>
+	/// Read a single node written by Write() (without its children, which
+	/// are left null, though the arrays which hold them are allocated.)
+	/// </summary>
+	static MCTSNodePtr ReadNode(BinaryReader& reader, MCTSNode* pParent, float weightFromParent);
+
+
 private:
 	const GameCommandArray& GetMyActions() const;
 
@@ -230,21 +322,32 @@ private:
 	//True if and only if this node is not a leaf
 	// node (if this state is terminal then this
 	// cannot be true; this is made true by calling
-	// Expand()).
-	bool m_bExpanded;
+	// Expand()). This is set last when expanding, so
+	// another thread which sees it set also sees the
+	// children and priors.
+	std::atomic<bool> m_bExpanded;
+
+	//True once a thread has claimed this leaf to expand it
+	std::atomic<bool> m_bClaimed;
 
 	//The action prior is set when expanded
 	std::vector<float> m_ActionPrior;
 
 	//This is the number of value samples we have
 	// received for this node
-	size_t m_NumEstimates;
+	std::atomic<size_t> m_NumEstimates;
 
 	//This is the sum of the values*weights, and
 	// just the sum of the weights, respectively.
 	// m_ValueSum / m_WeightSum gives us the estimate
 	// of this node's value, provided m_WeightSum > 0.
-	float m_ValueSum, m_WeightSum;
+	// (The sums are added to before the count, so they
+	// are nonzero once the count is.)
+	std::atomic<float> m_ValueSum, m_WeightSum;
+
+	//The number of threads whose path currently goes
+	// through this node (see AddVirtualLoss()).
+	std::atomic<size_t> m_NumVirtualLosses;
 
 	//This is the list of actions we can take from
 	// this node, which is initialised lazily:
@@ -0,0 +1,471 @@
+#include "NeuralNetwork.h"
+#include "StateEncoder.h"
+#include "Gemm.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+
+namespace c40kl
+{
+
+
+static const char MAGIC[8] = { 'C', '4', '0', 'K', 'L', 'N', 'E', 'T' };
+
+
+//Apply an activation function to each row of a matrix
+static void Activate(NeuralNetwork::Activation activation, size_t rows, size_t cols, float* data)
+{
+	switch (activation)
+	{
+	case NeuralNetwork::Activation::LINEAR:
+		break;
+	case NeuralNetwork::Activation::RELU:
+		for (size_t i = 0; i < rows * cols; i++)
+			data[i] = std::max(data[i], 0.0f);
+		break;
+	case NeuralNetwork::Activation::TANH:
+		for (size_t i = 0; i < rows * cols; i++)
+			data[i] = std::tanh(data[i]);
+		break;
+	case NeuralNetwork::Activation::SOFTMAX:
+		for (size_t i = 0; i < rows; i++)
+		{
+			float* row = data + i * cols;
+			const float maxVal = *std::max_element(row, row + cols);
+
+			float total = 0.0f;
+			for (size_t j = 0; j < cols; j++)
+			{
+				row[j] = std::exp(row[j] - maxVal);
+				total += row[j];
+			}
+			for (size_t j = 0; j < cols; j++)
+				row[j] /= total;
+		}
+		break;
+	}
+}
+
+
+//Check that a layer's description is self-consistent
+static void ValidateLayer(const NeuralNetwork::Layer& layer, bool bIsConv)
+{
+	const size_t k = layer.kernelSize;
+	const size_t n = layer.outSize;
+	const bool bHasBatchNorm = !layer.bnGamma.empty();
+
+	if (k == 0 || layer.inSize == 0 || n == 0 || (!bIsConv && k != 1))
+		throw std::runtime_error("Invalid network layer shape.");
+
+	if (layer.weights.size() != k * k * layer.inSize * n || layer.bias.size() != n)
+		throw std::runtime_error("Network layer weights have the wrong size.");
+
+	if (bHasBatchNorm && (layer.bnGamma.size() != n || layer.bnBeta.size() != n
+		|| layer.bnMean.size() != n || layer.bnVariance.size() != n))
+	{
+		throw std::runtime_error("Network layer batch normalisation has the wrong size.");
+	}
+
+	if (!bHasBatchNorm && (!layer.bnBeta.empty() || !layer.bnMean.empty()
+		|| !layer.bnVariance.empty()))
+	{
+		throw std::runtime_error("Network layer batch normalisation has the wrong size.");
+	}
+
+	if (bIsConv && layer.activation == NeuralNetwork::Activation::SOFTMAX)
+		throw std::runtime_error("Convolutional layers can't use softmax.");
+}
+
+
+//Read a little-endian value from a network file
+template<typename T>
+static T ReadValue(std::istream& file)
+{
+	T value;
+	file.read(reinterpret_cast<char*>(&value), sizeof(T));
+	if (!file)
+		throw std::runtime_error("Network file is truncated.");
+	return value;
+}
+
+
+static std::vector<float> ReadFloats(std::istream& file, size_t n)
+{
+	std::vector<float> values(n);
+	file.read(reinterpret_cast<char*>(values.data()), (std::streamsize)(n * sizeof(float)));
+	if (!file)
+		throw std::runtime_error("Network file is truncated.");
+	return values;
+}
+
+
+static std::vector<NeuralNetwork::Layer> ReadLayers(std::istream& file, size_t numLayers)
+{
+	std::vector<NeuralNetwork::Layer> layers(numLayers);
+	for (auto& layer : layers)
+	{
+		layer.kernelSize = ReadValue<uint32_t>(file);
+		layer.inSize = ReadValue<uint32_t>(file);
+		layer.outSize = ReadValue<uint32_t>(file);
+
+		const uint32_t activation = ReadValue<uint32_t>(file);
+		if (activation > (uint32_t)NeuralNetwork::Activation::SOFTMAX)
+			throw std::runtime_error("Network file has an unknown activation function.");
+		layer.activation = (NeuralNetwork::Activation)activation;
+
+		const bool bHasBatchNorm = ReadValue<uint32_t>(file) != 0;
+		layer.bnEpsilon = ReadValue<float>(file);
+
+		//Check the sizes are sensible before allocating anything
+		const uint64_t numWeights = (uint64_t)layer.kernelSize * layer.kernelSize
+			* layer.inSize * layer.outSize;
+		if (numWeights == 0 || numWeights > (1ull << 30))
+			throw std::runtime_error("Invalid network layer shape.");
+
+		layer.weights = ReadFloats(file, (size_t)numWeights);
+		layer.bias = ReadFloats(file, layer.outSize);
+
+		if (bHasBatchNorm)
+		{
+			layer.bnGamma = ReadFloats(file, layer.outSize);
+			layer.bnBeta = ReadFloats(file, layer.outSize);
+			layer.bnMean = ReadFloats(file, layer.outSize);
+			layer.bnVariance = ReadFloats(file, layer.outSize);
+		}
+	}
+
+	return layers;
+}
+
+
+NeuralNetwork::NeuralNetwork(int boardSize, const std::vector<Layer>& convLayers,
+	const std::vector<Layer>& denseLayers, const std::vector<Layer>& valueLayers,
+	const std::vector<Layer>& policyLayers, size_t numThreads) :
+	m_BoardSize(boardSize),
+	m_NumThreads(std::max<size_t>(numThreads, 1)),
+	m_ConvOutputSize(0),
+	m_ConvOutputChannels(0)
+{
+	Build(convLayers, denseLayers, valueLayers, policyLayers);
+
+	if (m_NumThreads > 1)
+		m_pWorkers = std::make_unique<WorkerPool>(m_NumThreads);
+}
+
+
+NeuralNetwork::NeuralNetwork(const std::string& filename, size_t numThreads) :
+	m_BoardSize(0),
+	m_NumThreads(std::max<size_t>(numThreads, 1)),
+	m_ConvOutputSize(0),
+	m_ConvOutputChannels(0)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Could not open network file: " + filename);
+
+	char magic[sizeof(MAGIC)];
+	file.read(magic, sizeof(magic));
+	if (!file || std::memcmp(magic, MAGIC, sizeof(MAGIC)) != 0)
+		throw std::runtime_error("Not a network file: " + filename);
+
+	if (ReadValue<uint32_t>(file) != FILE_VERSION)
+		throw std::runtime_error("Unsupported network file version: " + filename);
+
+	m_BoardSize = (int)ReadValue<uint32_t>(file);
+
+	const uint32_t numConv = ReadValue<uint32_t>(file);
+	const uint32_t numDense = ReadValue<uint32_t>(file);
+	const uint32_t numValue = ReadValue<uint32_t>(file);
+	const uint32_t numPolicy = ReadValue<uint32_t>(file);
+
+	const auto convLayers = ReadLayers(file, numConv);
+	const auto denseLayers = ReadLayers(file, numDense);
+	const auto valueLayers = ReadLayers(file, numValue);
+	const auto policyLayers = ReadLayers(file, numPolicy);
+
+	Build(convLayers, denseLayers, valueLayers, policyLayers);
+
+	if (m_NumThreads > 1)
+		m_pWorkers = std::make_unique<WorkerPool>(m_NumThreads);
+}
+
+
+NeuralNetwork::~NeuralNetwork()
+{
+}
+
+
+void NeuralNetwork::Build(const std::vector<Layer>& convLayers, const std::vector<Layer>& denseLayers,
+	const std::vector<Layer>& valueLayers, const std::vector<Layer>& policyLayers)
+{
+	if (m_BoardSize <= 0)
+		throw std::runtime_error("Network board size must be positive.");
+
+	if (valueLayers.empty() || policyLayers.empty())
+		throw std::runtime_error("Network must have a value head and a policy head.");
+
+	//The batch normalisation after the previous layer, as a
+	// scale and shift for each of its output channels, which
+	// is folded into the layers reading its output.
+	std::vector<float> bnScale, bnShift;
+
+	auto fuse = [&bnScale, &bnShift](const Layer& layer, size_t numFoldedRows)
+	{
+		FusedLayer fused{ layer.kernelSize, layer.inSize, layer.outSize,
+			layer.activation, layer.weights, layer.bias };
+
+		//Rows of the weight matrix are indexed by (kernel position,
+		// input channel), with the channel varying fastest, and the
+		// rows past numFoldedRows (the phase inputs) aren't normalised.
+		if (!bnScale.empty())
+		{
+			for (size_t r = 0; r < numFoldedRows; r++)
+			{
+				const size_t c = r % bnScale.size();
+				float* row = fused.weights.data() + r * fused.outSize;
+				for (size_t o = 0; o < fused.outSize; o++)
+				{
+					fused.bias[o] += row[o] * bnShift[c];
+					row[o] *= bnScale[c];
+				}
+			}
+		}
+
+		return fused;
+	};
+
+	auto setBatchNorm = [&bnScale, &bnShift](const Layer& layer)
+	{
+		bnScale.clear();
+		bnShift.clear();
+		for (size_t i = 0; i < layer.bnGamma.size(); i++)
+		{
+			const float scale = layer.bnGamma[i] / std::sqrt(layer.bnVariance[i] + layer.bnEpsilon);
+			bnScale.push_back(scale);
+			bnShift.push_back(layer.bnBeta[i] - layer.bnMean[i] * scale);
+		}
+	};
+
+	//Convolutional trunk
+	int size = m_BoardSize;
+	size_t channels = 2 * StateEncoder::NUM_UNIT_FEATURES;
+	for (const auto& layer : convLayers)
+	{
+		ValidateLayer(layer, true);
+
+		if (layer.inSize != channels || (int)layer.kernelSize > size)
+			throw std::runtime_error("Network convolutional layers don't fit together.");
+
+		m_ConvLayers.push_back(fuse(layer, layer.kernelSize * layer.kernelSize * channels));
+		setBatchNorm(layer);
+
+		size -= (int)layer.kernelSize - 1;
+		channels = layer.outSize;
+	}
+
+	m_ConvOutputSize = size;
+	m_ConvOutputChannels = channels;
+
+	//Dense trunk, starting from the flattened convolution
+	// output followed by the phase vector
+	size_t width = (size_t)size * size * channels + StateEncoder::NUM_PHASES;
+	size_t numFoldedRows = width - StateEncoder::NUM_PHASES;
+	for (const auto& layer : denseLayers)
+	{
+		ValidateLayer(layer, false);
+
+		if (layer.inSize != width)
+			throw std::runtime_error("Network dense layers don't fit together.");
+
+		m_DenseLayers.push_back(fuse(layer, numFoldedRows));
+		setBatchNorm(layer);
+
+		width = layer.outSize;
+		numFoldedRows = width;
+	}
+
+	//The two heads both read the trunk's output
+	const auto trunkScale = bnScale, trunkShift = bnShift;
+	auto buildHead = [&](const std::vector<Layer>& layers, std::vector<FusedLayer>& outLayers,
+		size_t outputSize)
+	{
+		bnScale = trunkScale;
+		bnShift = trunkShift;
+		size_t headWidth = width;
+		size_t headFoldedRows = numFoldedRows;
+
+		for (const auto& layer : layers)
+		{
+			ValidateLayer(layer, false);
+
+			if (layer.inSize != headWidth)
+				throw std::runtime_error("Network head layers don't fit together.");
+
+			outLayers.push_back(fuse(layer, headFoldedRows));
+			setBatchNorm(layer);
+
+			headWidth = layer.outSize;
+			headFoldedRows = headWidth;
+		}
+
+		if (headWidth != outputSize || !bnScale.empty())
+			throw std::runtime_error("Network head has the wrong output.");
+	};
+
+	buildHead(valueLayers, m_ValueLayers, 1);
+	buildHead(policyLayers, m_PolicyLayers, StateEncoder::GetPolicySize(m_BoardSize));
+}
+
+
+void NeuralNetwork::Predict(size_t n, const float* planes, const float* phases,
+	float* outValues, float* outPolicyArrays) const
+{
+	//Each job runs a contiguous chunk of the batch, and
+	// writes to separate parts of the outputs.
+	const size_t numJobs = std::max<size_t>(std::min(m_NumThreads, n), 1);
+	const size_t chunkSize = (n + numJobs - 1) / numJobs;
+
+	if (numJobs == 1)
+	{
+		PredictRange(0, n, planes, phases, outValues, outPolicyArrays);
+		return;
+	}
+
+	m_pWorkers->Run((n + chunkSize - 1) / chunkSize, [=](size_t chunk)
+	{
+		const size_t begin = chunk * chunkSize;
+		PredictRange(begin, std::min(begin + chunkSize, n), planes, phases,
+			outValues, outPolicyArrays);
+	});
+}
+
+
+void NeuralNetwork::Predict(const std::vector<GameState>& states, float* outValues,
+	float* outPolicyArrays) const
+{
+	C40KL_ASSERT_PRECONDITION(std::all_of(states.begin(), states.end(),
+		[this](const GameState& state) { return state.GetBoardState().GetSize() == m_BoardSize; }),
+		"States must have the same board size as the network.");
+
+	std::vector<float> planes(states.size() * StateEncoder::GetBoardPlanesSize(m_BoardSize)),
+		phases(states.size() * StateEncoder::NUM_PHASES);
+
+	StateEncoder::EncodeStates(states, planes.data(), phases.data(), m_pWorkers.get());
+
+	Predict(states.size(), planes.data(), phases.data(), outValues, outPolicyArrays);
+}
+
+
+void NeuralNetwork::Evaluate(const std::vector<GameState>& states, std::vector<float>& outValues,
+	std::vector<std::vector<float>>& outPolicies) const
+{
+	std::vector<float> values(states.size()),
+		policyArrays(states.size() * StateEncoder::GetPolicySize(m_BoardSize));
+
+	Predict(states, values.data(), policyArrays.data());
+
+	const auto policies = StateEncoder::DecodePolicies(states, policyArrays.data());
+
+	outValues.insert(outValues.end(), values.begin(), values.end());
+	outPolicies.insert(outPolicies.end(), policies.begin(), policies.end());
+}
+
+
+void NeuralNetwork::PredictRange(size_t begin, size_t end, const float* planes, const float* phases,
+	float* outValues, float* outPolicyArrays) const
+{
+	const size_t n = end - begin;
+	const size_t numPlanes = StateEncoder::GetBoardPlanesSize(m_BoardSize);
+	const size_t convOutputSize = (size_t)m_ConvOutputSize * m_ConvOutputSize * m_ConvOutputChannels;
+	const size_t trunkInputSize = convOutputSize + StateEncoder::NUM_PHASES;
+
+	std::vector<float> trunkInput(n * trunkInputSize);
+	std::vector<float> patches, bufferA, bufferB;
+
+	//Run the convolutions one state at a time, as a matrix
+	// multiplication of each patch of the input by the kernels.
+	for (size_t s = 0; s < n; s++)
+	{
+		const float* input = planes + (begin + s) * numPlanes;
+		size_t size = (size_t)m_BoardSize;
+		size_t channels = 2 * StateEncoder::NUM_UNIT_FEATURES;
+
+		for (const auto& layer : m_ConvLayers)
+		{
+			const size_t k = layer.kernelSize;
+			const size_t outSize = size - k + 1;
+			const size_t numPositions = outSize * outSize;
+			const size_t patchSize = k * k * channels;
+
+			//Each row of kernel inputs is contiguous in the input
+			patches.resize(numPositions * patchSize);
+			for (size_t i = 0; i < outSize; i++)
+			{
+				for (size_t j = 0; j < outSize; j++)
+				{
+					float* patch = patches.data() + (i * outSize + j) * patchSize;
+					for (size_t di = 0; di < k; di++)
+					{
+						const float* row = input + ((i + di) * size + j) * channels;
+						std::copy(row, row + k * channels, patch + di * k * channels);
+					}
+				}
+			}
+
+			bufferB.resize(numPositions * layer.outSize);
+			Gemm::Multiply(numPositions, layer.outSize, patchSize, patches.data(),
+				layer.weights.data(), layer.bias.data(), bufferB.data());
+			Activate(layer.activation, numPositions, layer.outSize, bufferB.data());
+
+			std::swap(bufferA, bufferB);
+			input = bufferA.data();
+			size = outSize;
+			channels = layer.outSize;
+		}
+
+		float* pTrunkInput = trunkInput.data() + s * trunkInputSize;
+		std::copy(input, input + convOutputSize, pTrunkInput);
+		std::copy(phases + (begin + s) * StateEncoder::NUM_PHASES,
+			phases + (begin + s + 1) * StateEncoder::NUM_PHASES,
+			pTrunkInput + convOutputSize);
+	}
+
+	//The dense layers can run on the whole chunk at once
+	std::vector<float> trunkBufferA, trunkBufferB;
+	const float* trunkOutput = RunDenseLayers(m_DenseLayers, n, trunkInput.data(),
+		trunkBufferA, trunkBufferB);
+
+	const float* values = RunDenseLayers(m_ValueLayers, n, trunkOutput, bufferA, bufferB);
+	std::copy(values, values + n, outValues + begin);
+
+	const size_t policySize = StateEncoder::GetPolicySize(m_BoardSize);
+	const float* policies = RunDenseLayers(m_PolicyLayers, n, trunkOutput, bufferA, bufferB);
+	std::copy(policies, policies + n * policySize, outPolicyArrays + begin * policySize);
+}
+
+
+const float* NeuralNetwork::RunDenseLayers(const std::vector<FusedLayer>& layers, size_t n,
+	const float* input, std::vector<float>& bufferA, std::vector<float>& bufferB)
+{
+	for (const auto& layer : layers)
+	{
+		//Don't write into the buffer holding the input
+		std::vector<float>& output = (input == bufferA.data()) ? bufferB : bufferA;
+
+		output.resize(n * layer.outSize);
+		Gemm::Multiply(n, layer.outSize, layer.inSize, input, layer.weights.data(),
+			layer.bias.data(), output.data());
+		Activate(layer.activation, n, layer.outSize, output.data());
+
+		input = output.data();
+	}
+
+	return input;
+}
+
+
+} // namespace c40kl
@@ -0,0 +1,239 @@
+#pragma once
+
+
+#include "GameState.h"
+#include <boost/noncopyable.hpp>
+#include <cstdint>
+#include <memory>
+
+
+namespace c40kl
+{
+
+
+class WorkerPool;
+
+
+/// <summary>
+/// Runs the value/policy network from pyai/nn_model.py on the CPU, so
+/// that self-play doesn't need Python. The network is made up of:
+/// - A trunk of "valid" convolutions over the board planes (see StateEncoder),
+/// - whose output is flattened and concatenated with the phase vector,
+/// - followed by a trunk of dense layers,
+/// - and two heads of dense layers: the value head, with one output, and
+///   the policy head, with StateEncoder::GetPolicySize() outputs.
+/// Any layer may be followed by batch normalisation (after its activation),
+/// which is folded into the weights of the layers reading its output when
+/// the network is created, so inference doesn't pay for it.
+/// The weights are loaded from a file exported by NNModel.export_weights().
+/// </summary>
+class C40KL_API NeuralNetwork :
+	public boost::noncopyable
+{
+public:
+	/// <summary>
+	/// The activation function applied to a layer's output.
+	/// </summary>
+	enum class Activation
+	{
+		LINEAR,
+		RELU,
+		TANH,
+		SOFTMAX
+	};
+
+
+	/// <summary>
+	/// The description of a single layer, in the same form as Keras stores it.
+	/// </summary>
+	struct Layer
+	{
+		/// <summary>
+		/// The width (and height) of a convolution's kernel, or 1 for a dense layer.
+		/// </summary>
+		size_t kernelSize;
+
+
+		/// <summary>
+		/// The number of input channels (or features, for a dense layer.)
+		/// </summary>
+		size_t inSize;
+
+
+		/// <summary>
+		/// The number of output channels (or features, for a dense layer.)
+		/// </summary>
+		size_t outSize;
+
+
+		/// <summary>
+		/// The activation function, applied before batch normalisation.
+		/// </summary>
+		Activation activation;
+
+
+		/// <summary>
+		/// The weights, of shape (kernelSize, kernelSize, inSize, outSize) in row-major order.
+		/// </summary>
+		std::vector<float> weights;
+
+
+		/// <summary>
+		/// The bias, of size outSize.
+		/// </summary>
+		std::vector<float> bias;
+
+
+		/// <summary>
+		/// The batch normalisation parameters, which are either all empty
+		/// (for no batch normalisation) or all of size outSize, and the
+		/// epsilon added to the variance.
+		/// </summary>
+		std::vector<float> bnGamma, bnBeta, bnMean, bnVariance;
+		float bnEpsilon;
+	};
+
+
+	/// <summary>
+	/// The version of the network file format.
+	/// </summary>
+	static const uint32_t FILE_VERSION = 1;
+
+
+	/// <summary>
+	/// Create a network from the description of each layer.
+	/// Throws std::runtime_error if the layers don't fit together.
+	/// </summary>
+	/// <param name="boardSize">The size of the board the network takes as input.</param>
+	/// <param name="convLayers">The convolutional trunk.</param>
+	/// <param name="denseLayers">The dense trunk.</param>
+	/// <param name="valueLayers">The value head.</param>
+	/// <param name="policyLayers">The policy head.</param>
+	/// <param name="numThreads">The number of threads to use for each batch.</param>
+	NeuralNetwork(int boardSize, const std::vector<Layer>& convLayers,
+		const std::vector<Layer>& denseLayers, const std::vector<Layer>& valueLayers,
+		const std::vector<Layer>& policyLayers, size_t numThreads = 1);
+
+
+	/// <summary>
+	/// Load a network from a file exported by NNModel.export_weights().
+	/// The file begins with a header of:
+	///   magic ("C40KLNET"), version, board size, and the number of
+	///   convolutional, dense, value head and policy head layers
+	/// (all 32 bit integers), followed by each layer, in order, as:
+	///   kernel size, input size, output size, activation, whether it
+	///   has batch normalisation (all 32 bit integers), the batch
+	///   normalisation epsilon (32 bit float), then the weights, the bias,
+	///   and the batch normalisation gamma, beta, mean and variance (if
+	///   any), as 32 bit floats.
+	/// All values are little-endian. Throws std::runtime_error if the file
+	/// can't be read or is invalid.
+	/// </summary>
+	/// <param name="filename">The file to load.</param>
+	/// <param name="numThreads">The number of threads to use for each batch.</param>
+	NeuralNetwork(const std::string& filename, size_t numThreads = 1);
+
+
+	~NeuralNetwork();
+
+
+	/// <summary>
+	/// Run the network on a batch of encoded states.
+	/// </summary>
+	/// <param name="n">The number of states.</param>
+	/// <param name="planes">The board planes, of size n * StateEncoder::GetBoardPlanesSize().</param>
+	/// <param name="phases">The phase vectors, of size n * StateEncoder::NUM_PHASES.</param>
+	/// <param name="outValues">The value output, of size n.</param>
+	/// <param name="outPolicyArrays">The policy output, of size n * StateEncoder::GetPolicySize().</param>
+	void Predict(size_t n, const float* planes, const float* phases,
+		float* outValues, float* outPolicyArrays) const;
+
+
+	/// <summary>
+	/// Encode a batch of states and run the network on them. The values are
+	/// with respect to each state's acting team, and the policy arrays can
+	/// be converted into distributions over actions with StateEncoder::DecodePolicy()
+	/// or SelfPlayManager::Update().
+	/// PRECONDITION: every state's board size is GetBoardSize().
+	/// </summary>
+	/// <param name="states">The states to evaluate.</param>
+	/// <param name="outValues">The value output, of size states.size().</param>
+	/// <param name="outPolicyArrays">The policy output, of size states.size() * StateEncoder::GetPolicySize().</param>
+	void Predict(const std::vector<GameState>& states, float* outValues,
+		float* outPolicyArrays) const;
+
+
+	/// <summary>
+	/// Evaluate a batch of states, giving distributions over each state's
+	/// actions. This has the form of a StateEvaluator (see SelfPlayManager.)
+	/// PRECONDITION: every state's board size is GetBoardSize(), and no state is finished.
+	/// </summary>
+	/// <param name="states">The states to evaluate.</param>
+	/// <param name="outValues">Each state's value is appended to this.</param>
+	/// <param name="outPolicies">Each state's distribution over its actions is appended to this.</param>
+	void Evaluate(const std::vector<GameState>& states, std::vector<float>& outValues,
+		std::vector<std::vector<float>>& outPolicies) const;
+
+
+	/// <summary>
+	/// Get the size of the board the network takes as input.
+	/// </summary>
+	inline int GetBoardSize() const
+	{
+		return m_BoardSize;
+	}
+
+
+private:
+	//A layer with any batch normalisation before it folded
+	// into its weights, and the weights reshaped into a
+	// (kernelSize * kernelSize * inSize, outSize) matrix.
+	struct FusedLayer
+	{
+		size_t kernelSize;
+		size_t inSize;
+		size_t outSize;
+		Activation activation;
+		std::vector<float> weights;
+		std::vector<float> bias;
+	};
+
+
+	//Run the network on states [begin, end) of a batch
+	void PredictRange(size_t begin, size_t end, const float* planes, const float* phases,
+		float* outValues, float* outPolicyArrays) const;
+
+
+	//Run a sequence of dense layers on a batch of inputs, using
+	// the two buffers for the outputs. Returns the final output,
+	// which is stored in one of the buffers.
+	static const float* RunDenseLayers(const std::vector<FusedLayer>& layers, size_t n,
+		const float* input, std::vector<float>& bufferA, std::vector<float>& bufferB);
+
+
+	//Check the layers fit together, and fold in batch normalisation
+	void Build(const std::vector<Layer>& convLayers, const std::vector<Layer>& denseLayers,
+		const std::vector<Layer>& valueLayers, const std::vector<Layer>& policyLayers);
+
+
+private:
+	int m_BoardSize;
+	size_t m_NumThreads;
+
+	//The threads which run each batch, kept between batches
+	// (null if there is only one thread, which is the caller's)
+	std::unique_ptr<WorkerPool> m_pWorkers;
+
+	//The size of the convolutional trunk's output, as a square
+	// of side m_ConvOutputSize with m_ConvOutputChannels channels
+	int m_ConvOutputSize;
+	size_t m_ConvOutputChannels;
+
+	std::vector<FusedLayer> m_ConvLayers;
+	std::vector<FusedLayer> m_DenseLayers;
+	std::vector<FusedLayer> m_ValueLayers;
+	std::vector<FusedLayer> m_PolicyLayers;
+};
+
+
+} // namespace c40kl
@@ -0,0 +1,123 @@
+#include "Perft.h"
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+
+namespace c40kl
+{
+
+
+bool PerftCounts::operator == (const PerftCounts& other) const
+{
+	return (numCommands == other.numCommands
+		&& numOutcomes == other.numOutcomes
+		&& numFinished == other.numFinished
+		&& probabilityMass == other.probabilityMass);
+}
+
+
+bool PerftCounts::operator != (const PerftCounts& other) const
+{
+	return !(*this == other);
+}
+
+
+//Add the counts for the subtree below a state, whose depth is
+// given by outCounts.size() - depthRemaining.
+static void CountRecursive(const GameState& state, int depthRemaining,
+	std::vector<PerftCounts>& outCounts)
+{
+	if (depthRemaining == 0 || state.IsFinished())
+		return;
+
+	PerftCounts& counts = outCounts[outCounts.size() - depthRemaining];
+
+	std::vector<GameState> results;
+	std::vector<float> probs;
+	for (const auto& pCmd : state.GetCommands())
+	{
+		results.clear();
+		probs.clear();
+		pCmd->Apply(state, results, probs);
+
+		C40KL_ASSERT_INVARIANT(results.size() == probs.size(), "Invalid distribution.");
+
+		counts.numCommands++;
+		counts.numOutcomes += results.size();
+		for (float prob : probs)
+			counts.probabilityMass += prob;
+
+		for (const auto& result : results)
+		{
+			if (result.IsFinished())
+				counts.numFinished++;
+			else
+				CountRecursive(result, depthRemaining - 1, outCounts);
+		}
+	}
+}
+
+
+std::vector<PerftCounts> Perft::Count(const GameState& state, int depth, size_t numThreads)
+{
+	C40KL_ASSERT_PRECONDITION(depth >= 0, "Depth must be nonnegative.");
+	C40KL_ASSERT_PRECONDITION(numThreads >= 1, "Need at least one thread.");
+
+	std::vector<PerftCounts> counts(depth);
+	if (depth == 0 || state.IsFinished())
+		return counts;
+
+	//Expand the first level here, so the subtrees can be shared out:
+	std::vector<GameState> subtrees;
+	std::vector<float> probs;
+	for (const auto& pCmd : state.GetCommands())
+	{
+		const size_t numBefore = subtrees.size();
+		pCmd->Apply(state, subtrees, probs);
+
+		counts.front().numCommands++;
+		counts.front().numOutcomes += subtrees.size() - numBefore;
+	}
+
+	for (float prob : probs)
+		counts.front().probabilityMass += prob;
+
+	for (const auto& subtree : subtrees)
+	{
+		if (subtree.IsFinished())
+			counts.front().numFinished++;
+	}
+
+	//Each subtree is counted separately, and then they're added
+	// up in order, so the probability mass doesn't depend on
+	// which thread finished first.
+	std::vector<std::vector<PerftCounts>> subtreeCounts(subtrees.size(),
+		std::vector<PerftCounts>(depth - 1));
+	{
+		boost::asio::thread_pool jobService(numThreads);
+		for (size_t i = 0; i < subtrees.size(); i++)
+		{
+			boost::asio::post(jobService, [i, depth, &subtrees, &subtreeCounts]()
+			{
+				CountRecursive(subtrees[i], depth - 1, subtreeCounts[i]);
+			});
+		}
+		jobService.join();
+	}
+
+	for (const auto& subtree : subtreeCounts)
+	{
+		for (size_t d = 0; d < subtree.size(); d++)
+		{
+			counts[d + 1].numCommands += subtree[d].numCommands;
+			counts[d + 1].numOutcomes += subtree[d].numOutcomes;
+			counts[d + 1].numFinished += subtree[d].numFinished;
+			counts[d + 1].probabilityMass += subtree[d].probabilityMass;
+		}
+	}
+
+	return counts;
+}
+
+
+} // namespace c40kl
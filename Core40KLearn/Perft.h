@@ -0,0 +1,78 @@
+#pragma once
+
+
+#include "GameState.h"
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// Counts of the part of the game tree at one depth (that is,
+/// after a given number of commands have been applied.)
+/// </summary>
+struct PerftCounts
+{
+	/// <summary>
+	/// The number of commands applied to the states at the previous depth.
+	/// </summary>
+	size_t numCommands = 0;
+
+
+	/// <summary>
+	/// The number of states the commands resulted in (one per chance
+	/// outcome), which are the nodes of the tree at this depth.
+	/// </summary>
+	size_t numOutcomes = 0;
+
+
+	/// <summary>
+	/// The number of those states in which the game is finished,
+	/// which aren't expanded any further.
+	/// </summary>
+	size_t numFinished = 0;
+
+
+	/// <summary>
+	/// The sum of the probabilities of the outcomes. Since each command's
+	/// outcome distribution sums to one, this should equal numCommands.
+	/// </summary>
+	double probabilityMass = 0.0;
+
+
+	bool operator == (const PerftCounts& other) const;
+	bool operator != (const PerftCounts& other) const;
+};
+
+
+/// <summary>
+/// "Perft" (as in chess engines) expands the whole game tree from a
+/// state to a fixed depth, using only GameState::GetCommands() and
+/// IGameCommand::Apply(), and counts what it finds at each depth.
+/// The counts depend only on the rules, so they can be compared
+/// before and after a change to the move generation or the board
+/// representation to check that the change is correct, and the time
+/// taken gives a measure of the raw speed of the game engine.
+/// </summary>
+class C40KL_API Perft
+{
+public:
+	/// <summary>
+	/// Expand the game tree from a state to a given depth. The
+	/// subtrees of the first commands are divided between threads.
+	/// The result is the same for any number of threads.
+	/// PRECONDITION: depth >= 0 and numThreads >= 1
+	/// </summary>
+	/// <param name="state">The root of the tree (depth 0.)</param>
+	/// <param name="depth">The number of commands to apply along each path.</param>
+	/// <param name="numThreads">The number of threads to use.</param>
+	/// <returns>
+	/// One entry per depth, from 1 to depth (so entry i is for depth i + 1.)
+	/// </returns>
+	static std::vector<PerftCounts> Count(const GameState& state, int depth,
+		size_t numThreads = 1);
+};
+
+
+} // namespace c40kl
@@ -0,0 +1,188 @@
+#include "ScenarioLoader.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+
+namespace c40kl
+{
+
+
+//A CSV table, as a header row and the rows after it
+struct CsvTable
+{
+	std::vector<std::string> header;
+	std::vector<std::vector<std::string>> rows;
+};
+
+
+//Split a line of a CSV file (without quoting) into its cells
+static std::vector<std::string> SplitLine(std::string line)
+{
+	//Files written on Windows have \r\n line endings
+	if (!line.empty() && line.back() == '\r')
+		line.pop_back();
+
+	std::vector<std::string> cells;
+	std::stringstream stream(line);
+	std::string cell;
+	while (std::getline(stream, cell, ','))
+		cells.push_back(cell);
+
+	//A trailing comma means a trailing empty cell
+	if (!line.empty() && line.back() == ',')
+		cells.emplace_back();
+
+	return cells;
+}
+
+
+static CsvTable LoadTable(const std::string& filename)
+{
+	std::ifstream file(filename);
+	if (!file)
+		throw std::runtime_error("Could not open " + filename + ".");
+
+	CsvTable table;
+	std::string line;
+	while (std::getline(file, line))
+	{
+		auto cells = SplitLine(line);
+
+		//Skip blank lines
+		if (cells.empty() || (cells.size() == 1 && cells.front().empty()))
+			continue;
+
+		if (table.header.empty())
+		{
+			table.header = std::move(cells);
+		}
+		else
+		{
+			if (cells.size() != table.header.size())
+			{
+				throw std::runtime_error("Row " + std::to_string(table.rows.size() + 1)
+					+ " of " + filename + " has the wrong number of columns.");
+			}
+			table.rows.push_back(std::move(cells));
+		}
+	}
+
+	if (table.header.empty())
+		throw std::runtime_error(filename + " is empty.");
+
+	return table;
+}
+
+
+//Find the index of the named column
+static size_t GetColumn(const CsvTable& table, const std::string& name,
+	const std::string& filename)
+{
+	auto iter = std::find(table.header.begin(), table.header.end(), name);
+	if (iter == table.header.end())
+		throw std::runtime_error(filename + " has no \"" + name + "\" column.");
+
+	return (size_t)std::distance(table.header.begin(), iter);
+}
+
+
+static int ParseInt(const std::string& cell, const std::string& filename)
+{
+	try
+	{
+		size_t length = 0;
+		const int value = std::stoi(cell, &length);
+		if (length == cell.size())
+			return value;
+	}
+	catch (const std::logic_error&)
+	{
+	}
+
+	throw std::runtime_error("\"" + cell + "\" in " + filename + " is not an integer.");
+}
+
+
+std::vector<Unit> ScenarioLoader::LoadUnits(const std::string& filename)
+{
+	const CsvTable table = LoadTable(filename);
+
+	//Each integer statistic, and where it goes in a unit
+	const std::pair<const char*, int Unit::*> intColumns[] = {
+		{ "count", &Unit::count }, { "movement", &Unit::movement },
+		{ "ws", &Unit::ws }, { "bs", &Unit::bs }, { "t", &Unit::t },
+		{ "w", &Unit::w }, { "a", &Unit::a }, { "ld", &Unit::ld },
+		{ "sv", &Unit::sv }, { "inv", &Unit::inv },
+		{ "rg_range", &Unit::rg_range }, { "rg_s", &Unit::rg_s },
+		{ "rg_ap", &Unit::rg_ap }, { "rg_dmg", &Unit::rg_dmg },
+		{ "rg_shots", &Unit::rg_shots }, { "ml_s", &Unit::ml_s },
+		{ "ml_ap", &Unit::ml_ap }, { "ml_dmg", &Unit::ml_dmg }
+	};
+	const std::pair<const char*, bool Unit::*> boolColumns[] = {
+		{ "rg_is_rapid", &Unit::rg_is_rapid }, { "rg_is_heavy", &Unit::rg_is_heavy }
+	};
+
+	const size_t nameColumn = GetColumn(table, "name", filename);
+
+	std::vector<Unit> units(table.rows.size());
+	for (size_t i = 0; i < table.rows.size(); i++)
+	{
+		const auto& row = table.rows[i];
+		Unit& unit = units[i];
+
+		unit.name = row[nameColumn];
+
+		for (const auto& column : intColumns)
+			unit.*column.second = ParseInt(row[GetColumn(table, column.first, filename)], filename);
+
+		for (const auto& column : boolColumns)
+			unit.*column.second = (ParseInt(row[GetColumn(table, column.first, filename)], filename) != 0);
+
+		unit.total_w = unit.w * unit.count;
+	}
+
+	return units;
+}
+
+
+GameState ScenarioLoader::LoadGameState(const std::vector<Unit>& units, const std::string& filename,
+	int boardSize, float boardScale, int turnLimit)
+{
+	const CsvTable table = LoadTable(filename);
+
+	const size_t nameColumn = GetColumn(table, "name", filename);
+	const size_t teamColumn = GetColumn(table, "team", filename);
+	const size_t xColumn = GetColumn(table, "x", filename);
+	const size_t yColumn = GetColumn(table, "y", filename);
+
+	BoardState board(boardSize, boardScale);
+
+	for (const auto& row : table.rows)
+	{
+		auto unitIter = std::find_if(units.begin(), units.end(),
+			[&row, nameColumn](const Unit& unit) { return unit.name == row[nameColumn]; });
+
+		if (unitIter == units.end())
+			throw std::runtime_error("Unknown unit \"" + row[nameColumn] + "\" in " + filename + ".");
+
+		const int team = ParseInt(row[teamColumn], filename);
+		const Position pos(ParseInt(row[xColumn], filename), ParseInt(row[yColumn], filename));
+
+		if (team != 0 && team != 1)
+			throw std::runtime_error("Invalid team in " + filename + ".");
+
+		if (pos.first < 0 || pos.first >= boardSize || pos.second < 0 || pos.second >= boardSize)
+			throw std::runtime_error("Unit placed off the board in " + filename + ".");
+
+		if (board.IsOccupied(pos))
+			throw std::runtime_error("Two units placed on the same square in " + filename + ".");
+
+		board.SetUnitOnSquare(pos, *unitIter, team);
+	}
+
+	return GameState(0, 0, Phase::MOVEMENT, board, turnLimit);
+}
+
+
+} // namespace c40kl
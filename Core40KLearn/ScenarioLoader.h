@@ -0,0 +1,49 @@
+#pragma once
+
+
+#include "GameState.h"
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// Loads unit statistics and starting positions from the CSV files
+/// in UnitData/, so that games can be set up without Python. This
+/// follows pyapp/game_util.py: a unit table (e.g. unit_stats.csv)
+/// has a header row naming its columns, then one unit per row, and
+/// a placement table (e.g. map_1.csv) has the columns name, team, x
+/// and y, where name refers to a unit in the unit table.
+/// All functions throw std::runtime_error if a file can't be read,
+/// or doesn't have the right columns.
+/// </summary>
+class C40KL_API ScenarioLoader
+{
+public:
+	/// <summary>
+	/// Load a table of unit statistics. Columns may be in any order,
+	/// and columns which aren't unit statistics are ignored. Each
+	/// unit's total wounds are set to its wounds times its count.
+	/// </summary>
+	/// <param name="filename">The CSV file to load.</param>
+	/// <returns>The units, in the same order as the file.</returns>
+	static std::vector<Unit> LoadUnits(const std::string& filename);
+
+
+	/// <summary>
+	/// Load unit placements and create the game they start, with team 0
+	/// to move in the movement phase.
+	/// </summary>
+	/// <param name="units">The units which may be placed, as returned by LoadUnits().</param>
+	/// <param name="filename">The CSV file of placements to load.</param>
+	/// <param name="boardSize">The size of the board.</param>
+	/// <param name="boardScale">The length of a board cell.</param>
+	/// <param name="turnLimit">The game's turn limit, or negative for none.</param>
+	/// <returns>The initial game state.</returns>
+	static GameState LoadGameState(const std::vector<Unit>& units, const std::string& filename,
+		int boardSize, float boardScale = 1.0f, int turnLimit = -1);
+};
+
+
+} // namespace c40kl
@@ -1,29 +1,55 @@
 #include "SelfPlayManager.h"
 #include "SelectRandomly.h"
+#include "StateEncoder.h"
+#include "WorkerPool.h"
 #include <algorithm>
 #include <numeric>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
 #include <boost/range/combine.hpp>
 #include <boost/range/algorithm/remove_if.hpp>
-#include <boost/asio/post.hpp>
-#include <boost/asio/thread_pool.hpp>
-#include <boost/bind.hpp>
 
 
 namespace c40kl
 {
 
 
+const size_t SelfPlayManager::NOT_DUPLICATE;
+const uint32_t SelfPlayManager::SNAPSHOT_VERSION;
+
+
+static const char SNAPSHOT_MAGIC[8] = { 'C', '4', '0', 'K', 'L', 'S', 'N', 'P' };
+
+
 SelfPlayManager::SelfPlayManager(float ucb1ExplorationParameter, float temperature,
 	size_t numSimulations, size_t numThreads) :
 	m_TreePolicy(ucb1ExplorationParameter, 0), //Always evaluate with respect to team 0
 	m_NumSimulations(numSimulations),
 	m_NumThreads(std::max(numThreads, (size_t)1)),
-	m_Temperature(temperature)
+	m_Temperature(temperature),
+	m_bEarlyStopping(false),
+	m_bShareIdenticalGames(false),
+	m_NumConcurrentGames(0),
+	m_NumGamesStarted(0),
+	m_TotalGames(0),
+	m_bRecordExperiences(false),
+	m_SolverMaxUnits(0),
+	m_SolverMaxTurnsRemaining(0),
+	m_CacheStats(),
+	m_Stats(),
+	m_bOutOfTime(false)
 {
 	C40KL_ASSERT_PRECONDITION(ucb1ExplorationParameter > 0,
 		"UCB1 exploration parameter must be > 0.");
 	C40KL_ASSERT_PRECONDITION(temperature >= 0,
 		"Temperature must be >= 0.");
+
+	m_pWorkers = std::make_unique<WorkerPool>(m_NumThreads);
 }
 
 
@@ -37,23 +63,311 @@ void SelfPlayManager::Reset(size_t numGames, const GameState& initialState)
 	C40KL_ASSERT_PRECONDITION(!initialState.IsFinished(),
 		"Cannot play finished initial state.");
 
-	m_pRoots.clear();
-	m_pRoots.resize(numGames, MCTSNodePtr());
+	Reset(std::vector<GameState>{ initialState }, numGames, numGames);
+}
+
+
+void SelfPlayManager::Reset(const std::vector<GameState>& initialStatePool,
+	size_t numConcurrentGames, size_t totalGames)
+{
+	C40KL_ASSERT_PRECONDITION(!initialStatePool.empty(),
+		"Need at least one initial state.");
+
+	C40KL_ASSERT_PRECONDITION(numConcurrentGames > 0 || totalGames == 0,
+		"Need to play at least one game at a time.");
+
+	C40KL_ASSERT_PRECONDITION(std::none_of(initialStatePool.begin(), initialStatePool.end(),
+		[](const GameState& state) { return state.IsFinished(); }),
+		"Cannot play finished initial state.");
 
+	m_pRoots.clear();
 	m_GameIDs.clear();
-	m_GameIDs.resize(numGames, 0);
 
 	m_GameValues.clear();
-	m_GameValues.resize(numGames);
+	m_GameValues.resize(totalGames);
+	m_TreeBytesAllocated.clear();
+	m_TreeBytesAllocated.resize(totalGames);
 
 	m_pSelectedLeaves.clear();
 	m_SelectedIndices.clear();
+	m_bLeafSolved.clear();
+	m_SolvedLeafValues.clear();
+	ClearCachedLeaves();
+	m_LeafDepths.clear();
+	m_LeafExpansions.clear();
+	m_LeafOutcomes.clear();
+	m_LeafBytes.clear();
+
+	m_bOutOfTime = false;
+
+	m_InitialStatePool = initialStatePool;
+	m_NumConcurrentGames = numConcurrentGames;
+	m_NumGamesStarted = 0;
+	m_TotalGames = totalGames;
+	m_FinishedGames.clear();
+
+	m_GameRecords.clear();
+	m_GameRecords.resize(totalGames);
+	m_FinishedRecords.clear();
+
+	StartNewGames();
+}
 
-	for (size_t i = 0; i < numGames; i++)
+
+void SelfPlayManager::EnableEndgameSolver(size_t maxUnits, int maxTurnsRemaining, size_t nodeBudget)
+{
+	C40KL_ASSERT_PRECONDITION(!IsWaiting(),
+		"Cannot change the solver while waiting for Update().");
+
+	m_pSolver = std::make_unique<ExpectimaxSolver>(nodeBudget);
+	m_SolverMaxUnits = maxUnits;
+	m_SolverMaxTurnsRemaining = maxTurnsRemaining;
+}
+
+
+void SelfPlayManager::EnableEvaluationCache(size_t maxSize, size_t numShards)
+{
+	C40KL_ASSERT_PRECONDITION(!IsWaiting(),
+		"Cannot change the cache while waiting for Update().");
+
+	m_pCache = std::make_unique<EvaluationCache>(maxSize, numShards);
+	m_CacheStats = EvaluationCacheStats();
+}
+
+
+void SelfPlayManager::ClearEvaluationCache()
+{
+	if (m_pCache)
+		m_pCache->Clear();
+}
+
+
+EvaluationCacheStats SelfPlayManager::GetEvaluationCacheStats() const
+{
+	EvaluationCacheStats stats = m_CacheStats;
+	stats.cacheSize = m_pCache ? m_pCache->GetSize() : 0;
+	return stats;
+}
+
+
+SelfPlayStats SelfPlayManager::GetStats() const
+{
+	return m_Stats;
+}
+
+
+void SelfPlayManager::ResetStats()
+{
+	m_Stats = SelfPlayStats();
+}
+
+
+void SelfPlayManager::EnableTracing(bool bEnabled)
+{
+	if (!bEnabled)
+		m_pTrace.reset();
+	else if (!m_pTrace)
+		m_pTrace = std::make_unique<TraceRecorder>();
+
+	m_SelectEndTime = TraceRecorder::Clock::time_point();
+}
+
+
+void SelfPlayManager::ClearTrace()
+{
+	if (m_pTrace)
+		m_pTrace->Clear();
+}
+
+
+void SelfPlayManager::WriteTrace(std::ostream& out) const
+{
+	if (m_pTrace)
+		m_pTrace->WriteJson(out);
+	else
+		TraceRecorder().WriteJson(out);
+}
+
+
+void SelfPlayManager::SaveSnapshot(std::ostream& out) const
+{
+	C40KL_ASSERT_PRECONDITION(!IsWaiting(),
+		"Cannot save a snapshot while waiting for Update().");
+
+	BinaryWriter writer;
+	writer.Write(SNAPSHOT_MAGIC);
+	writer.Write(SNAPSHOT_VERSION);
+
+	std::stringstream randEng;
+	randEng << m_RandEng;
+	writer.WriteString(randEng.str());
+
+	writer.Write((uint64_t)m_NumConcurrentGames);
+	writer.Write((uint64_t)m_NumGamesStarted);
+	writer.Write((uint64_t)m_TotalGames);
+
+	writer.Write((uint64_t)m_InitialStatePool.size());
+	for (const auto& state : m_InitialStatePool)
+		state.Write(writer);
+
+	writer.WriteArray(m_GameValues);
+	writer.WriteArray(std::vector<uint64_t>(m_TreeBytesAllocated.begin(), m_TreeBytesAllocated.end()));
+
+	writer.Write((uint64_t)m_FinishedGames.size());
+	for (const auto& game : m_FinishedGames)
+	{
+		writer.Write((uint64_t)game.first);
+		writer.Write(game.second);
+	}
+
+	writer.Write((uint64_t)m_GameRecords.size());
+	for (const auto& records : m_GameRecords)
+		writer.WriteArray(records);
+	writer.WriteArray(m_FinishedRecords);
+
+	//Write each distinct tree once, and then which tree each game uses
+	std::unordered_map<const MCTSNode*, size_t> treeIndices;
+	std::vector<uint64_t> gameTrees;
+	for (const auto& pRoot : m_pRoots)
+		gameTrees.push_back(treeIndices.emplace(pRoot.get(), treeIndices.size()).first->second);
+
+	std::vector<const MCTSNode*> pTrees(treeIndices.size());
+	for (const auto& entry : treeIndices)
+		pTrees[entry.second] = entry.first;
+
+	writer.Write((uint64_t)pTrees.size());
+	for (const MCTSNode* pTree : pTrees)
+		pTree->Write(writer);
+
+	std::vector<uint64_t> gameIDs(m_GameIDs.begin(), m_GameIDs.end());
+	writer.WriteArray(gameIDs);
+	writer.WriteArray(gameTrees);
+
+	const std::string& bytes = writer.GetBytes();
+	out.write(bytes.data(), bytes.size());
+}
+
+
+void SelfPlayManager::LoadSnapshot(std::istream& in)
+{
+	C40KL_ASSERT_PRECONDITION(!IsWaiting(),
+		"Cannot load a snapshot while waiting for Update().");
+
+	std::stringstream contents;
+	contents << in.rdbuf();
+	const std::string bytes = contents.str();
+
+	if (bytes.size() < sizeof(SNAPSHOT_MAGIC)
+		|| std::memcmp(bytes.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+	{
+		throw std::runtime_error("Not a self-play snapshot.");
+	}
+
+	BinaryReader reader(bytes.data() + sizeof(SNAPSHOT_MAGIC), bytes.size() - sizeof(SNAPSHOT_MAGIC));
+	if (reader.Read<uint32_t>() != SNAPSHOT_VERSION)
+		throw std::runtime_error("The snapshot was saved by a different version.");
+
+	//Read everything before changing any games, so
+	// that nothing changes if the snapshot is invalid.
+	std::mt19937 randEng;
+	std::stringstream randEngState(reader.ReadString());
+	randEngState >> randEng;
+	if (!randEngState)
+		throw std::runtime_error("Invalid data: bad random number generator state.");
+
+	const size_t numConcurrentGames = (size_t)reader.Read<uint64_t>();
+	const size_t numGamesStarted = (size_t)reader.Read<uint64_t>();
+	const size_t totalGames = (size_t)reader.Read<uint64_t>();
+
+	std::vector<GameState> initialStatePool;
+	const size_t poolSize = reader.ReadSize(1);
+	for (size_t i = 0; i < poolSize; i++)
+		initialStatePool.push_back(GameState::Read(reader));
+
+	const auto gameValues = reader.ReadArray<float>();
+	const auto treeBytesAllocated = reader.ReadArray<uint64_t>();
+
+	std::vector<std::pair<size_t, float>> finishedGames(reader.ReadSize(12));
+	for (auto& game : finishedGames)
 	{
-		m_GameIDs[i] = i;
-		m_pRoots[i] = MCTSNode::CreateRootNode(initialState);
+		game.first = (size_t)reader.Read<uint64_t>();
+		game.second = reader.Read<float>();
 	}
+
+	std::vector<std::vector<float>> gameRecords(reader.ReadSize(8));
+	for (auto& records : gameRecords)
+		records = reader.ReadArray<float>();
+	const auto finishedRecords = reader.ReadArray<float>();
+
+	MCTSNodeArray pTrees(reader.ReadSize(1));
+	for (auto& pTree : pTrees)
+		pTree = MCTSNode::Read(reader);
+
+	const auto gameIDs = reader.ReadArray<uint64_t>();
+	const auto gameTrees = reader.ReadArray<uint64_t>();
+
+	const bool bValid = reader.GetNumBytesLeft() == 0
+		&& numGamesStarted <= totalGames
+		&& (!initialStatePool.empty() || numGamesStarted == totalGames)
+		&& gameValues.size() == totalGames
+		&& treeBytesAllocated.size() == totalGames
+		&& gameRecords.size() == totalGames
+		&& gameIDs.size() == gameTrees.size()
+		&& std::all_of(gameIDs.begin(), gameIDs.end(),
+			[numGamesStarted](uint64_t id) { return id < numGamesStarted; })
+		&& std::all_of(gameTrees.begin(), gameTrees.end(),
+			[&pTrees](uint64_t idx) { return idx < pTrees.size() && !pTrees[idx]->IsTerminal(); })
+		&& std::all_of(finishedGames.begin(), finishedGames.end(),
+			[numGamesStarted](const std::pair<size_t, float>& game) { return game.first < numGamesStarted; });
+
+	if (!bValid)
+		throw std::runtime_error("Invalid data: inconsistent snapshot.");
+
+	//Now resume the games:
+	m_RandEng = randEng;
+	m_NumConcurrentGames = numConcurrentGames;
+	m_NumGamesStarted = numGamesStarted;
+	m_TotalGames = totalGames;
+	m_InitialStatePool = std::move(initialStatePool);
+	m_GameValues = gameValues;
+	m_TreeBytesAllocated.assign(treeBytesAllocated.begin(), treeBytesAllocated.end());
+	m_FinishedGames = std::move(finishedGames);
+	m_GameRecords = std::move(gameRecords);
+	m_FinishedRecords = finishedRecords;
+
+	m_pRoots.clear();
+	m_GameIDs.clear();
+	for (size_t i = 0; i < gameIDs.size(); i++)
+	{
+		m_pRoots.push_back(pTrees[gameTrees[i]]);
+		m_GameIDs.push_back((size_t)gameIDs[i]);
+	}
+
+	m_bOutOfTime = false;
+}
+
+
+void SelfPlayManager::SetEarlyStopping(bool bEnabled)
+{
+	m_bEarlyStopping = bEnabled;
+}
+
+
+void SelfPlayManager::SetShareIdenticalGames(bool bEnabled)
+{
+	m_bShareIdenticalGames = bEnabled;
+}
+
+
+void SelfPlayManager::SetSeed(uint32_t seed)
+{
+	m_RandEng.seed(seed);
+}
+
+
+void SelfPlayManager::SetRecordExperiences(bool bEnabled)
+{
+	m_bRecordExperiences = bEnabled;
 }
 
 
@@ -68,6 +382,9 @@ void SelfPlayManager::Select(std::vector<GameState>& outLeafStates)
 	C40KL_ASSERT_PRECONDITION(!AllFinished(),
 		"Cannot call Select() when all games are finished.");
 
+	TraceSpan span(m_pTrace.get(), "Select");
+	const auto start = std::chrono::steady_clock::now();
+
 	//Clear output vector, and reserve the amount of space we expect to use:
 	outLeafStates.clear();
 	outLeafStates.reserve(m_pRoots.size());
@@ -76,36 +393,107 @@ void SelfPlayManager::Select(std::vector<GameState>& outLeafStates)
 	// not m_SelectedIndices, however it will usually be just as big.
 	m_pSelectedLeaves.resize(m_pRoots.size(), MCTSNodePtr());
 	m_SelectedIndices.reserve(m_pRoots.size());
+	m_bLeafSolved.resize(m_pRoots.size(), 0);
+	m_SolvedLeafValues.resize(m_pRoots.size(), 0.0f);
+	m_LeafDepths.resize(m_pRoots.size(), 0);
+	m_LeafExpansions.resize(m_pRoots.size(), 0);
+	m_LeafOutcomes.resize(m_pRoots.size(), 0);
+	m_LeafBytes.resize(m_pRoots.size(), 0);
+
+	if (m_pCache)
+	{
+		m_LeafHashes.resize(m_pRoots.size(), 0);
+		m_bLeafCached.resize(m_pRoots.size(), 0);
+		m_CachedLeafValues.resize(m_pRoots.size(), 0.0f);
+		m_CachedLeafPolicies.resize(m_pRoots.size());
+		m_LeafDuplicateOf.resize(m_pRoots.size(), NOT_DUPLICATE);
+	}
 
-	boost::asio::thread_pool jobService(m_NumThreads);
+	//Games which share a tree only select one leaf in it between them
+	std::unordered_set<const MCTSNode*> selectedRoots;
 
 	for (size_t i = 0; i < m_pRoots.size(); i++)
 	{
 		C40KL_ASSERT_INVARIANT(!m_pRoots[i]->IsTerminal(),
 			"Roots should be nonterminal.");
 
-		//If this tree hasn't had enough samples yet...
-		if (m_pRoots[i]->GetNumValueSamples() < m_NumSimulations)
+		//If this tree still needs searching...
+		if (!IsGameReady(i) && selectedRoots.insert(m_pRoots[i].get()).second)
+		{
+			//Each job gets its own random engine, since they run in parallel
+			const uint32_t seed = m_RandEng();
+			m_pWorkers->Post([i, seed, this]() { SelectLeafForGame(i, seed); });
+		}
+	}
+
+	m_pWorkers->Wait();
+
+	m_Stats.maxTreesSearched = std::max(m_Stats.maxTreesSearched, selectedRoots.size());
+	for (size_t i = 0; i < m_pRoots.size(); i++)
+	{
+		if (m_pSelectedLeaves[i])
 		{
-			boost::asio::post(jobService, [i, this]() { SelectLeafForGame(i); });
+			m_Stats.numDescents++;
+			m_Stats.totalDescentDepth += m_LeafDepths[i];
+			m_Stats.maxDescentDepth = std::max(m_Stats.maxDescentDepth, m_LeafDepths[i]);
 		}
 	}
+	GatherLeafStats();
 
-	jobService.join();
+	//Maps the hash of each state in outLeafStates to its index, so
+	// that duplicate leaves can be found (if the cache is enabled)
+	std::unordered_multimap<size_t, size_t> selectedHashes;
 
 	for (size_t i = 0; i < m_pRoots.size(); i++)
 	{
 		//If a leaf node needed to be selected for this game...
 		if (m_pSelectedLeaves[i])
 		{
-			//If leaf is nonterminal...
-			if (!m_pSelectedLeaves[i]->GetState().IsFinished())
+			//If leaf is nonterminal and we don't already know its value...
+			if (!m_pSelectedLeaves[i]->GetState().IsFinished() && !m_bLeafSolved[i])
 			{
+				if (m_pCache)
+				{
+					m_CacheStats.numLeaves++;
+
+					if (m_bLeafCached[i])
+					{
+						m_CacheStats.numCacheHits++;
+						continue;
+					}
+
+					//If we've already selected the same state in another
+					// game, share its evaluation rather than returning it again.
+					const GameState& state = m_pSelectedLeaves[i]->GetState();
+					auto range = selectedHashes.equal_range(m_LeafHashes[i]);
+					auto iter = std::find_if(range.first, range.second,
+						[&](const std::pair<const size_t, size_t>& entry)
+						{
+							return outLeafStates[entry.second].IsEquivalentTo(state);
+						});
+
+					if (iter != range.second)
+					{
+						m_LeafDuplicateOf[i] = iter->second;
+						m_CacheStats.numDuplicates++;
+						continue;
+					}
+
+					selectedHashes.emplace(m_LeafHashes[i], outLeafStates.size());
+				}
+
 				outLeafStates.push_back(m_pSelectedLeaves[i]->GetState());
 				m_SelectedIndices.push_back(i);
 			}
 		}
 	}
+
+	m_Stats.numEvaluations += outLeafStates.size();
+	m_Stats.selectSeconds += std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+
+	if (m_pTrace)
+		m_SelectEndTime = TraceRecorder::Clock::now();
 }
 
 
@@ -127,6 +515,10 @@ void SelfPlayManager::Update(const std::vector<float>& valueEstimates,
 	C40KL_ASSERT_PRECONDITION(policies.size() == m_SelectedIndices.size(),
 		"Need correct number of policies.");
 
+	TraceEvaluation();
+	TraceSpan span(m_pTrace.get(), "Update");
+	const auto start = std::chrono::steady_clock::now();
+
 	//First, perform a check to make sure the
 	// individual policy sizes are correct. Do
 	// this before any updates to ensure we don't
@@ -148,8 +540,6 @@ void SelfPlayManager::Update(const std::vector<float>& valueEstimates,
 			"Policy size needs to match number of actions in leaf.");
 	}
 
-	boost::asio::thread_pool jobService(m_NumThreads);
-
 	for (size_t i = 0; i < m_SelectedIndices.size(); i++)
 	{
 		auto job = [i, this, &policies, &valueEstimates]()
@@ -168,8 +558,16 @@ void SelfPlayManager::Update(const std::vector<float>& valueEstimates,
 			}
 
 			ExpandBackpropagate(m_SelectedIndices[i], valEst, policy);
+
+			//Remember the evaluation as it was given (with respect
+			// to the acting team) for next time:
+			if (m_pCache)
+			{
+				m_pCache->Insert(pLeaf->GetState(), m_LeafHashes[j],
+					valueEstimates[i], policy);
+			}
 		};
-		boost::asio::post(jobService, job);
+		m_pWorkers->Post(job);
 	}
 
 	//Don't forget that the selected indices DO NOT include
@@ -177,9 +575,9 @@ void SelfPlayManager::Update(const std::vector<float>& valueEstimates,
 	// terminal values, in cases where a node was selected:
 	for (size_t i = 0; i < m_pSelectedLeaves.size(); i++)
 	{
-		auto job = [i, this]()
+		auto job = [i, this, &policies, &valueEstimates]()
 		{
-			//If there was any terminal node selected...
+			//If there was any terminal (or solved) node selected...
 			if (m_pSelectedLeaves[i].get() != nullptr)
 			{
 				const auto state = m_pSelectedLeaves[i]->GetState();
@@ -191,17 +589,128 @@ void SelfPlayManager::Update(const std::vector<float>& valueEstimates,
 
 					ExpandBackpropagate(i, valEst, std::vector<float>());
 				}
+				else if (m_bLeafSolved[i])
+				{
+					//Solved leaves have an exact value, so we don't
+					// need the network's prior either:
+					const size_t numActions = m_pSelectedLeaves[i]->GetNumActions();
+					ExpandBackpropagate(i, m_SolvedLeafValues[i],
+						std::vector<float>(numActions, 1.0f / (float)numActions));
+				}
+				else if (m_pCache && (m_bLeafCached[i] || m_LeafDuplicateOf[i] != NOT_DUPLICATE))
+				{
+					//Either the evaluation was cached, or another leaf
+					// with the same state was evaluated in this batch
+					// (both are with respect to the acting team):
+					float valEst = m_bLeafCached[i] ? m_CachedLeafValues[i]
+						: valueEstimates[m_LeafDuplicateOf[i]];
+					const auto& policy = m_bLeafCached[i] ? m_CachedLeafPolicies[i]
+						: policies[m_LeafDuplicateOf[i]];
+
+					if (state.GetActingTeam() != 0)
+					{
+						valEst *= -1.0f;
+					}
+
+					ExpandBackpropagate(i, valEst, policy);
+				}
 			}
 		};
-		boost::asio::post(jobService, job);
+		m_pWorkers->Post(job);
 	}
 
 	//Wait until jobs complete:
-	jobService.join();
+	m_pWorkers->Wait();
+	GatherLeafStats();
 
 	//Clear everything as we are no longer in a waiting state:
 	m_SelectedIndices.clear();
 	m_pSelectedLeaves.clear();
+	m_bLeafSolved.clear();
+	m_SolvedLeafValues.clear();
+	ClearCachedLeaves();
+	m_LeafDepths.clear();
+	m_LeafExpansions.clear();
+	m_LeafOutcomes.clear();
+	m_LeafBytes.clear();
+
+	m_Stats.numRounds++;
+	m_Stats.updateSeconds += std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+
+void SelfPlayManager::Update(const float* valueEstimates, const float* policyArrays)
+{
+	TraceEvaluation();
+
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<std::vector<float>> policies;
+	{
+		TraceSpan span(m_pTrace.get(), "DecodeSelectedPolicies");
+		policies = DecodeSelectedPolicies(policyArrays);
+	}
+	m_Stats.updateSeconds += std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+
+	Update(std::vector<float>(valueEstimates, valueEstimates + m_SelectedIndices.size()), policies);
+}
+
+
+std::vector<std::vector<float>> SelfPlayManager::DecodeSelectedPolicies(const float* policyArrays) const
+{
+	C40KL_ASSERT_PRECONDITION(IsWaiting(),
+		"Select() should be called before DecodeSelectedPolicies().");
+
+	std::vector<std::vector<float>> policies(m_SelectedIndices.size());
+	if (m_SelectedIndices.empty())
+		return policies;
+
+	const int size = m_pSelectedLeaves[m_SelectedIndices.front()]->GetState().GetBoardState().GetSize();
+	const size_t policySize = StateEncoder::GetPolicySize(size);
+
+	C40KL_ASSERT_PRECONDITION(std::all_of(m_SelectedIndices.begin(), m_SelectedIndices.end(),
+		[this, size](size_t j) { return m_pSelectedLeaves[j]->GetState().GetBoardState().GetSize() == size; }),
+		"All selected states must have the same board size.");
+
+	for (size_t i = 0; i < m_SelectedIndices.size(); i++)
+	{
+		auto job = [i, this, &policies, policyArrays, size, policySize]()
+		{
+			const MCTSNodePtr& pLeaf = m_pSelectedLeaves[m_SelectedIndices[i]];
+
+			//The leaf's actions are cached, so they won't be generated
+			// again when it is expanded in Update()
+			policies[i] = StateEncoder::DecodePolicy(pLeaf->GetActions(), size,
+				policyArrays + i * policySize);
+		};
+		m_pWorkers->Post(job);
+	}
+
+	m_pWorkers->Wait();
+
+	return policies;
+}
+
+
+size_t SelfPlayManager::GetNumSelected() const
+{
+	return m_SelectedIndices.size();
+}
+
+
+int SelfPlayManager::GetSelectedBoardSize() const
+{
+	if (m_SelectedIndices.empty())
+		return 0;
+
+	const int size = m_pSelectedLeaves[m_SelectedIndices.front()]->GetState().GetBoardState().GetSize();
+	for (size_t j : m_SelectedIndices)
+	{
+		if (m_pSelectedLeaves[j]->GetState().GetBoardState().GetSize() != size)
+			return 0;
+	}
+	return size;
 }
 
 
@@ -213,73 +722,126 @@ void SelfPlayManager::Commit()
 	C40KL_ASSERT_PRECONDITION(!AllFinished(),
 		"Cannot Commit() when all games are finished.");
 
+	TraceSpan span(m_pTrace.get(), "Commit");
+	const auto start = std::chrono::steady_clock::now();
+
 	//TODO: parallelise this. BUT, warning: there is random generation
-	// involved in this loop. To parallelise this loop, we would need
+	// involved in CommitGame(). To parallelise this loop, we would need
 	// to do all random generation beforehand, in the main thread (which
 	// is easy enough to do).
 	for (size_t i = 0; i < m_pRoots.size(); i++)
 	{
-		const auto actions = m_pRoots[i]->GetActions();
+		CommitGame(i);
+	}
 
-		//Use tree search data available at the ith root to select an action.
-		//WARNING: if the final policy is stochastic, and this loop is parallelised,
-		// then this won't work as the threads will all be sharing the random engine!
-		const auto finalPolicyDistribution = GetFinalPolicy(i);
-		const size_t actionIdx = SelectRandomly(m_RandEng, finalPolicyDistribution);
-		
-		C40KL_ASSERT_INVARIANT(actionIdx < m_pRoots[i]->GetNumActions(),
-			"SelectRandomly must return valid action index.");
-		
-		std::vector<GameState> results;
-		std::vector<float> probs;
+	RemoveFinishedGames();
 
-		//Apply the selected action
-		actions[actionIdx]->Apply(m_pRoots[i]->GetState(), results, probs);
+	//The time limit only applied to the move we just made
+	m_bOutOfTime = false;
 
-		//Now randomly select a resulting state:
-		// (Will need to change this if the loop is parallelised!)
-		const size_t resultIdx = SelectRandomly(m_RandEng, probs);
-		const GameState resultingState = results[resultIdx];
+	m_Stats.commitSeconds += std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+}
 
-		//We now need to find the MCTS node corresponding to this state and commit.
-		auto actionChildNodes = m_pRoots[i]->GetStateResults(actionIdx);
 
-		C40KL_ASSERT_INVARIANT(actionChildNodes.size() == results.size(),
-			"MCTS must tie up with command results.");
-		
-		C40KL_ASSERT_INVARIANT(actionChildNodes[resultIdx]->GetState() == resultingState,
-			"MCTS child nodes must be correctly ordered, corresponding to action results.");
+void SelfPlayManager::CommitReady()
+{
+	C40KL_ASSERT_PRECONDITION(!IsWaiting(),
+		"Cannot commit while waiting for Update().");
 
-		//Now we get to re-root the tree as a result of the action!
-		m_pRoots[i] = actionChildNodes[resultIdx];
+	C40KL_ASSERT_PRECONDITION(!AllFinished(),
+		"Cannot commit when all games are finished.");
 
-		//And don't forget to detach!
-		m_pRoots[i]->Detach();
+	TraceSpan span(m_pTrace.get(), "CommitReady");
+	const auto start = std::chrono::steady_clock::now();
 
-		//Now, if the game has finished, record its value:
-		if (m_pRoots[i]->GetState().IsFinished())
+	for (size_t i = 0; i < m_pRoots.size(); i++)
+	{
+		if (IsGameReady(i))
 		{
-			//Store game's value with respect to team 0:
-			m_GameValues[m_GameIDs[i]] = m_pRoots[i]->GetState().GetGameValue(0);
+			CommitGame(i);
 		}
 	}
 
-	//Remove trees representing finished games:
+	RemoveFinishedGames();
 
-	C40KL_ASSERT_INVARIANT(m_pRoots.size() == m_GameIDs.size(),
-		"Tree roots and IDs must be equal length!");
-	
-	//Use Boost remove_if and combine to erase from both m_pRoots and
-	// from m_GameIDs at the same time:
+	m_bOutOfTime = false;
 
-	auto remove_iter = boost::remove_if(
-		boost::combine(m_pRoots, m_GameIDs),
-		[](const boost::tuple<MCTSNodePtr, size_t>& node)
-			{ return node.get<0>()->GetState().IsFinished(); }
-		);
-	
-	m_pRoots.erase(boost::get<0>(remove_iter.get_iterator_tuple()), m_pRoots.end());
-	m_GameIDs.erase(boost::get<1>(remove_iter.get_iterator_tuple()), m_GameIDs.end());
+	m_Stats.commitSeconds += std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - start).count();
+}
+
+
+std::vector<std::vector<float>> SelfPlayManager::SearchFor(size_t milliseconds,
+	const StateEvaluator& evaluator)
+{
+	std::vector<float> values;
+	std::vector<std::vector<float>> policies;
+
+	return SearchUntil(milliseconds, [&](const std::vector<GameState>& leafStates)
+	{
+		values.clear();
+		policies.clear();
+
+		if (!leafStates.empty())
+			evaluator(leafStates, values, policies);
+
+		Update(values, policies);
+	});
+}
+
+
+std::vector<std::vector<float>> SelfPlayManager::SearchFor(size_t milliseconds,
+	const PolicyArrayEvaluator& evaluator)
+{
+	std::vector<float> values, policyArrays;
+
+	return SearchUntil(milliseconds, [&](const std::vector<GameState>& leafStates)
+	{
+		if (leafStates.empty())
+		{
+			Update(std::vector<float>(), std::vector<std::vector<float>>());
+			return;
+		}
+
+		const int size = leafStates.front().GetBoardState().GetSize();
+		values.resize(leafStates.size());
+		policyArrays.resize(leafStates.size() * StateEncoder::GetPolicySize(size));
+
+		evaluator(leafStates, values.data(), policyArrays.data());
+
+		Update(values.data(), policyArrays.data());
+	});
+}
+
+
+std::vector<std::vector<float>> SelfPlayManager::SearchUntil(size_t milliseconds,
+	const std::function<void(const std::vector<GameState>&)>& evaluateAndUpdate)
+{
+	C40KL_ASSERT_PRECONDITION(!IsWaiting(),
+		"Cannot start a search while waiting for Update().");
+
+	C40KL_ASSERT_PRECONDITION(!AllFinished(),
+		"Cannot search when all games are finished.");
+
+	const auto deadline = std::chrono::steady_clock::now()
+		+ std::chrono::milliseconds(milliseconds);
+
+	std::vector<GameState> leafStates;
+
+	//Note: the clock is only checked in between cycles, so
+	// which games are ready doesn't change unexpectedly.
+	m_bOutOfTime = (std::chrono::steady_clock::now() >= deadline);
+
+	while (!ReadyToCommit())
+	{
+		Select(leafStates);
+		evaluateAndUpdate(leafStates);
+
+		m_bOutOfTime = (std::chrono::steady_clock::now() >= deadline);
+	}
+
+	return GetCurrentActionDistributions();
 }
 
 
@@ -291,20 +853,40 @@ bool SelfPlayManager::IsWaiting() const
 
 bool SelfPlayManager::ReadyToCommit() const
 {
+	//Never ready in between Select() and Update(),
+	// because the update is still due.
+	if (IsWaiting())
+		return false;
+
 	for (size_t i = 0; i < m_pRoots.size(); i++)
 	{
-		if (m_pRoots[i]->GetNumValueSamples() < m_NumSimulations)
+		if (!IsGameReady(i))
 		{
-			//We have found a tree which has not had enough simulations
+			//We have found a tree which still needs searching
 			return false;
 		}
 	}
 
-	//Every tree has enough simulations:
+	//Every tree is ready:
 	return true;
 }
 
 
+bool SelfPlayManager::AnyReadyToCommit() const
+{
+	if (IsWaiting())
+		return false;
+
+	for (size_t i = 0; i < m_pRoots.size(); i++)
+	{
+		if (IsGameReady(i))
+			return true;
+	}
+
+	return false;
+}
+
+
 bool SelfPlayManager::AllFinished() const
 {
 	//Note: we specifically want this function to return
@@ -327,28 +909,34 @@ bool SelfPlayManager::AllFinished() const
 }
 
 
-std::vector<GameState> SelfPlayManager::GetCurrentGameStates() const
+std::vector<GameState> SelfPlayManager::GetCurrentGameStates(bool onlyReady) const
 {
 	std::vector<GameState> gss;
 	gss.reserve(m_pRoots.size());
 
 	for (size_t i = 0; i < m_pRoots.size(); i++)
 	{
-		gss.push_back(m_pRoots[i]->GetState());
+		if (!onlyReady || IsGameReady(i))
+		{
+			gss.push_back(m_pRoots[i]->GetState());
+		}
 	}
 
 	return gss;
 }
 
 
-std::vector<std::vector<float>> SelfPlayManager::GetCurrentActionDistributions() const
+std::vector<std::vector<float>> SelfPlayManager::GetCurrentActionDistributions(bool onlyReady) const
 {
 	std::vector<std::vector<float>> actionDists;
-	actionDists.resize(m_pRoots.size());
+	actionDists.reserve(m_pRoots.size());
 
 	for (size_t i = 0; i < m_pRoots.size(); i++)
 	{
-		actionDists[i] = GetFinalPolicy(i);
+		if (!onlyReady || IsGameReady(i))
+		{
+			actionDists.push_back(GetFinalPolicy(i));
+		}
 	}
 
 	return actionDists;
@@ -383,9 +971,39 @@ std::vector<int> SelfPlayManager::GetTreeSizes() const
 }
 
 
-std::vector<size_t> SelfPlayManager::GetRunningGameIds() const
+std::vector<size_t> SelfPlayManager::GetTreeBytesAllocated() const
 {
-	return m_GameIDs;
+	return m_TreeBytesAllocated;
+}
+
+
+size_t SelfPlayManager::GetNumSearchTrees() const
+{
+	std::unordered_set<const MCTSNode*> roots;
+	for (const auto& pRoot : m_pRoots)
+		roots.insert(pRoot.get());
+
+	return roots.size();
+}
+
+
+std::vector<size_t> SelfPlayManager::GetRunningGameIds(bool onlyReady) const
+{
+	if (!onlyReady)
+		return m_GameIDs;
+
+	std::vector<size_t> ids;
+	ids.reserve(m_GameIDs.size());
+
+	for (size_t i = 0; i < m_GameIDs.size(); i++)
+	{
+		if (IsGameReady(i))
+		{
+			ids.push_back(m_GameIDs[i]);
+		}
+	}
+
+	return ids;
 }
 
 
@@ -398,15 +1016,36 @@ std::vector<float> SelfPlayManager::GetGameValues() const
 }
 
 
-void SelfPlayManager::SelectLeafForGame(size_t gameIdx)
+std::vector<std::pair<size_t, float>> SelfPlayManager::PopFinishedGames()
+{
+	std::vector<std::pair<size_t, float>> finishedGames;
+	finishedGames.swap(m_FinishedGames);
+	return finishedGames;
+}
+
+
+std::vector<float> SelfPlayManager::PopFinishedRecords()
+{
+	std::vector<float> finishedRecords;
+	finishedRecords.swap(m_FinishedRecords);
+	return finishedRecords;
+}
+
+
+void SelfPlayManager::SelectLeafForGame(size_t gameIdx, uint32_t seed)
 {
 	C40KL_ASSERT_INVARIANT(gameIdx < m_pRoots.size(),
 		"Need valid game index.");
 
+	TraceSpan span(m_pTrace.get(), "select", gameIdx);
+
+	std::mt19937 randEng(seed);
 	auto pNode = m_pRoots[gameIdx];
+	size_t depth = 0;
 
 	while (!pNode->IsLeaf() && !pNode->IsTerminal())
 	{
+		depth++;
 		const auto actions = pNode->GetActions();
 
 		//Choose the action which maximises UCB1:
@@ -420,11 +1059,8 @@ void SelfPlayManager::SelectLeafForGame(size_t gameIdx)
 		C40KL_ASSERT_INVARIANT(results.size() == probs.size(),
 			"Need to return valid distribution.");
 
-		//WARNING: if parallelising, we need to remove the
-		// dependency on m_RandEng here!
-
 		//Select a random result:
-		const size_t resultingIdx = SelectRandomly(m_RandEng, probs);
+		const size_t resultingIdx = SelectRandomly(randEng, probs);
 
 		C40KL_ASSERT_INVARIANT(resultingIdx < results.size(),
 			"SelectRandomly must return valid index.");
@@ -449,7 +1085,7 @@ void SelfPlayManager::SelectLeafForGame(size_t gameIdx)
 				"Nodes with one action shouldn't be terminal.");
 
 			//Only one possible prior:
-			pNode->Expand({ 1.0f });
+			ExpandLeaf(gameIdx, pNode, { 1.0f });
 
 			//Note that, since this node is nonterminal, expansion
 			// has now made it not a leaf! Thus we will definitely
@@ -457,8 +1093,294 @@ void SelfPlayManager::SelectLeafForGame(size_t gameIdx)
 		}
 	}
 
+	//If the leaf is a small enough endgame, try to solve it
+	// exactly rather than asking for an estimate:
+	if (!pNode->IsTerminal() && ShouldSolve(pNode->GetState()))
+	{
+		TraceSpan solveSpan(m_pTrace.get(), "solve", gameIdx);
+		float value = 0.0f;
+		if (m_pSolver->Solve(pNode->GetState(), 0, value))
+		{
+			m_bLeafSolved[gameIdx] = 1;
+			m_SolvedLeafValues[gameIdx] = value;
+		}
+	}
+
+	//If the leaf's evaluation is cached, we can use that instead
+	// of asking for an estimate:
+	if (m_pCache && !pNode->IsTerminal() && !m_bLeafSolved[gameIdx])
+	{
+		m_LeafHashes[gameIdx] = pNode->GetState().GetHash();
+		if (m_pCache->LookUp(pNode->GetState(), m_LeafHashes[gameIdx],
+			m_CachedLeafValues[gameIdx], m_CachedLeafPolicies[gameIdx]))
+		{
+			m_bLeafCached[gameIdx] = 1;
+		}
+	}
+
 	//We have selected a leaf node!
 	m_pSelectedLeaves[gameIdx] = pNode;
+	m_LeafDepths[gameIdx] = depth;
+}
+
+
+void SelfPlayManager::ClearCachedLeaves()
+{
+	m_LeafHashes.clear();
+	m_bLeafCached.clear();
+	m_CachedLeafValues.clear();
+	m_CachedLeafPolicies.clear();
+	m_LeafDuplicateOf.clear();
+}
+
+
+void SelfPlayManager::GatherLeafStats()
+{
+	for (size_t i = 0; i < m_LeafExpansions.size(); i++)
+	{
+		m_Stats.numExpansions += m_LeafExpansions[i];
+		m_Stats.numOutcomes += m_LeafOutcomes[i];
+		m_Stats.numBytesAllocated += m_LeafBytes[i];
+		m_TreeBytesAllocated[m_GameIDs[i]] += m_LeafBytes[i];
+
+		m_LeafExpansions[i] = 0;
+		m_LeafOutcomes[i] = 0;
+		m_LeafBytes[i] = 0;
+	}
+}
+
+
+void SelfPlayManager::TraceEvaluation()
+{
+	if (m_pTrace && m_SelectEndTime != TraceRecorder::Clock::time_point())
+	{
+		m_pTrace->AddSpan("Evaluate", m_SelectEndTime, TraceRecorder::Clock::now());
+		m_SelectEndTime = TraceRecorder::Clock::time_point();
+	}
+}
+
+
+void SelfPlayManager::ExpandLeaf(size_t gameIdx, const MCTSNodePtr& pNode, const std::vector<float>& policy)
+{
+	TraceSpan span(m_pTrace.get(), "expand", gameIdx);
+	const size_t bytesBefore = pNode->GetMemoryUsage();
+	pNode->Expand(policy);
+
+	//Count the arrays the node allocated, and each new child:
+	size_t numOutcomes = 0;
+	size_t numBytes = pNode->GetMemoryUsage() - bytesBefore;
+	for (size_t i = 0; i < pNode->GetNumActions(); i++)
+	{
+		for (const auto& pChild : pNode->GetStateResults(i))
+		{
+			numOutcomes++;
+			numBytes += pChild->GetMemoryUsage();
+		}
+	}
+
+	m_LeafExpansions[gameIdx]++;
+	m_LeafOutcomes[gameIdx] += numOutcomes;
+	m_LeafBytes[gameIdx] += numBytes;
+}
+
+
+void SelfPlayManager::CommitGame(size_t gameIdx)
+{
+	C40KL_ASSERT_INVARIANT(gameIdx < m_pRoots.size(),
+		"Need valid game index.");
+
+	TraceSpan span(m_pTrace.get(), "commit", gameIdx);
+
+	const auto actions = m_pRoots[gameIdx]->GetActions();
+
+	//Use tree search data available at the root to select an action.
+	//WARNING: if the final policy is stochastic, and this is parallelised,
+	// then this won't work as the threads will all be sharing the random engine!
+	const auto finalPolicyDistribution = GetFinalPolicy(gameIdx);
+	const size_t actionIdx = SelectRandomly(m_RandEng, finalPolicyDistribution);
+
+	C40KL_ASSERT_INVARIANT(actionIdx < m_pRoots[gameIdx]->GetNumActions(),
+		"SelectRandomly must return valid action index.");
+
+	if (m_bRecordExperiences)
+	{
+		const GameState& state = m_pRoots[gameIdx]->GetState();
+		const size_t recordSize = StateEncoder::GetRecordSize(state.GetBoardState().GetSize());
+
+		auto& records = m_GameRecords[m_GameIDs[gameIdx]];
+		records.resize(records.size() + recordSize);
+
+		//The value is filled in when the game finishes
+		StateEncoder::EncodeRecord(state, actions, finalPolicyDistribution,
+			(state.GetActingTeam() == 0) ? 1.0f : -1.0f,
+			records.data() + records.size() - recordSize);
+	}
+
+	std::vector<GameState> results;
+	std::vector<float> probs;
+
+	//Apply the selected action
+	actions[actionIdx]->Apply(m_pRoots[gameIdx]->GetState(), results, probs);
+
+	//Now randomly select a resulting state:
+	// (Will need to change this if parallelised!)
+	const size_t resultIdx = SelectRandomly(m_RandEng, probs);
+	const GameState resultingState = results[resultIdx];
+
+	//We now need to find the MCTS node corresponding to this state and commit.
+	auto actionChildNodes = m_pRoots[gameIdx]->GetStateResults(actionIdx);
+
+	C40KL_ASSERT_INVARIANT(actionChildNodes.size() == results.size(),
+		"MCTS must tie up with command results.");
+
+	C40KL_ASSERT_INVARIANT(actionChildNodes[resultIdx]->GetState() == resultingState,
+		"MCTS child nodes must be correctly ordered, corresponding to action results.");
+
+	//Now we get to re-root the tree as a result of the action!
+	m_pRoots[gameIdx] = actionChildNodes[resultIdx];
+
+	//And don't forget to detach! (Unless another game sharing
+	// the tree has already made the same move, and detached it.)
+	if (!m_pRoots[gameIdx]->IsRoot())
+		m_pRoots[gameIdx]->Detach();
+
+	//Now, if the game has finished, record its value:
+	if (m_pRoots[gameIdx]->GetState().IsFinished())
+	{
+		//Store game's value with respect to team 0:
+		const float value = (float)m_pRoots[gameIdx]->GetState().GetGameValue(0);
+		m_GameValues[m_GameIDs[gameIdx]] = value;
+		m_FinishedGames.emplace_back(m_GameIDs[gameIdx], value);
+
+		//Fill in the values of the game's records, and hand them over:
+		auto& records = m_GameRecords[m_GameIDs[gameIdx]];
+		if (!records.empty())
+		{
+			const size_t recordSize = StateEncoder::GetRecordSize(
+				m_pRoots[gameIdx]->GetState().GetBoardState().GetSize());
+
+			C40KL_ASSERT_INVARIANT(records.size() % recordSize == 0,
+				"Records must all be the same size.");
+
+			for (size_t i = recordSize - 1; i < records.size(); i += recordSize)
+			{
+				records[i] *= value;
+			}
+
+			m_FinishedRecords.insert(m_FinishedRecords.end(), records.begin(), records.end());
+			std::vector<float>().swap(records);
+		}
+	}
+}
+
+
+void SelfPlayManager::RemoveFinishedGames()
+{
+	C40KL_ASSERT_INVARIANT(m_pRoots.size() == m_GameIDs.size(),
+		"Tree roots and IDs must be equal length!");
+
+	//Use Boost remove_if and combine to erase from both m_pRoots and
+	// from m_GameIDs at the same time:
+
+	auto remove_iter = boost::remove_if(
+		boost::combine(m_pRoots, m_GameIDs),
+		[](const boost::tuple<MCTSNodePtr, size_t>& node)
+			{ return node.get<0>()->GetState().IsFinished(); }
+		);
+
+	m_pRoots.erase(boost::get<0>(remove_iter.get_iterator_tuple()), m_pRoots.end());
+	m_GameIDs.erase(boost::get<1>(remove_iter.get_iterator_tuple()), m_GameIDs.end());
+
+	//Replace the finished games, if there are any left to play:
+	StartNewGames();
+}
+
+
+void SelfPlayManager::StartNewGames()
+{
+	C40KL_ASSERT_INVARIANT(!m_InitialStatePool.empty() || m_TotalGames == 0,
+		"Need initial states to start games from.");
+
+	std::uniform_int_distribution<size_t> poolDist(0, m_InitialStatePool.size() - 1);
+
+	//The trees of the games started here, by initial state, for
+	// games to share if they start in the same state
+	std::unordered_map<size_t, MCTSNodePtr> newRoots;
+
+	while (m_pRoots.size() < m_NumConcurrentGames && m_NumGamesStarted < m_TotalGames)
+	{
+		const size_t poolIdx = (m_InitialStatePool.size() > 1) ? poolDist(m_RandEng) : 0;
+
+		if (m_bShareIdenticalGames)
+		{
+			auto& pRoot = newRoots[poolIdx];
+			if (!pRoot)
+				pRoot = MCTSNode::CreateRootNode(m_InitialStatePool[poolIdx]);
+
+			m_pRoots.push_back(pRoot);
+		}
+		else
+		{
+			m_pRoots.push_back(MCTSNode::CreateRootNode(m_InitialStatePool[poolIdx]));
+		}
+
+		m_GameIDs.push_back(m_NumGamesStarted);
+		m_NumGamesStarted++;
+	}
+}
+
+
+bool SelfPlayManager::IsGameReady(size_t gameIdx) const
+{
+	C40KL_ASSERT_INVARIANT(gameIdx < m_pRoots.size(),
+		"Need valid game index.");
+
+	const auto& pRoot = m_pRoots[gameIdx];
+	const size_t numSamples = pRoot->GetNumValueSamples();
+
+	if (numSamples >= m_NumSimulations)
+		return true;
+
+	//Any other reason to stop needs the root to have an
+	// action distribution to commit with.
+	if (pRoot->IsLeaf())
+		return false;
+
+	if (m_bOutOfTime)
+		return true;
+
+	if (m_bEarlyStopping)
+	{
+		auto visits = pRoot->GetActionVisitCounts();
+
+		//Find the top two visit counts (if there is only
+		// one action, there's nothing to decide):
+		if (visits.size() < 2)
+			return true;
+
+		std::partial_sort(visits.begin(), visits.begin() + 2, visits.end(),
+			std::greater<int>());
+
+		//Even if every remaining simulation went to the second
+		// best action, it wouldn't overtake the best one:
+		const size_t remaining = m_NumSimulations - numSamples;
+		if ((size_t)(visits[0] - visits[1]) > remaining)
+			return true;
+	}
+
+	return false;
+}
+
+
+bool SelfPlayManager::ShouldSolve(const GameState& state) const
+{
+	if (!m_pSolver || !state.HasTurnLimit())
+		return false;
+
+	const auto counts = state.GetBoardState().GetUnitCounts();
+
+	return (counts.first + counts.second <= m_SolverMaxUnits
+		&& state.GetTurnLimit() - state.GetTurnNumber() <= m_SolverMaxTurnsRemaining);
 }
 
 
@@ -473,11 +1395,11 @@ void SelfPlayManager::ExpandBackpropagate(size_t gameIdx, float valEst, const st
 	if (!m_pSelectedLeaves[gameIdx]->GetState().IsFinished())
 	{
 		//Expand if not finished:
-		m_pSelectedLeaves[gameIdx]->Expand(policy);
+		ExpandLeaf(gameIdx, m_pSelectedLeaves[gameIdx], policy);
 	}
 
 	//Now add the statistic (automatically backpropagates):
-
+	TraceSpan span(m_pTrace.get(), "backpropagate", gameIdx);
 	m_pSelectedLeaves[gameIdx]->AddValueStatistic(valEst);
 }
 
@@ -492,30 +1414,40 @@ std::vector<float> SelfPlayManager::GetFinalPolicy(size_t gameIdx) const
 	C40KL_ASSERT_INVARIANT(actionVisitCounts.size() > 0,
 		"Need actions in nonterminal state.");
 
+	//Weight each action by its visit count, unless none of
+	// them have been visited, in which case the prior is
+	// the best information we have.
+	std::vector<float> weights(actionVisitCounts.begin(), actionVisitCounts.end());
+	if (std::all_of(actionVisitCounts.begin(), actionVisitCounts.end(),
+		[](int n) { return n == 0; }))
+	{
+		weights = m_pRoots[gameIdx]->GetActionPriorDistribution();
+	}
+
 	if (m_Temperature == 0.0f)
 	{
 		//If temperature is zero then just do an argmax:
 
-		const size_t bestAction = std::distance(actionVisitCounts.begin(),
-			std::max_element(actionVisitCounts.begin(), actionVisitCounts.end()));
+		const size_t bestAction = std::distance(weights.begin(),
+			std::max_element(weights.begin(), weights.end()));
 
-		C40KL_ASSERT_INVARIANT(bestAction < actionVisitCounts.size(),
+		C40KL_ASSERT_INVARIANT(bestAction < weights.size(),
 			"Need to find valid best action.");
 
 		std::vector<float> outPolicy;
-		outPolicy.resize(actionVisitCounts.size(), 0.0f);
+		outPolicy.resize(weights.size(), 0.0f);
 		outPolicy[bestAction] = 1.0f;
 		return outPolicy;
 	}
 	else
 	{
 		std::vector<float> outPolicy;
-		outPolicy.resize(actionVisitCounts.size());
+		outPolicy.resize(weights.size());
 		
-		std::transform(actionVisitCounts.begin(),
-			actionVisitCounts.end(),
+		std::transform(weights.begin(),
+			weights.end(),
 			outPolicy.begin(),
-			boost::bind(std::powf, _1, 1.0f / m_Temperature));
+			[this](float weight) { return std::pow(weight, 1.0f / m_Temperature); });
 
 		const float sum = std::accumulate(outPolicy.begin(),
 			outPolicy.end(), 0.0f);
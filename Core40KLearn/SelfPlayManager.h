@@ -4,7 +4,14 @@
 #include "GameState.h"
 #include "MCTSNode.h"
 #include "UCB1PolicyStrategy.h"
+#include "ExpectimaxSolver.h"
+#include "EvaluationCache.h"
+#include "TraceRecorder.h"
 #include <random>
+#include <memory>
+#include <functional>
+#include <istream>
+#include <ostream>
 #include <boost/noncopyable.hpp>
 
 
@@ -12,6 +19,129 @@ namespace c40kl
 {
 
 
+class WorkerPool;
+
+
+/// <summary>
+/// A function which, given a list of leaf states, computes their
+/// value estimates (with respect to each state's acting team) and
+/// their prior policies, in the form required by SelfPlayManager::Update().
+/// The two output vectors are empty when the function is called.
+/// </summary>
+typedef std::function<void(const std::vector<GameState>& states,
+	std::vector<float>& outValues,
+	std::vector<std::vector<float>>& outPolicies)> StateEvaluator;
+
+
+/// <summary>
+/// A function which, given a list of leaf states (which all have the
+/// same board size), writes out their value estimates (with respect to
+/// each state's acting team) and their policy arrays, as output by the
+/// neural network (see StateEncoder::DecodePolicy()). The outputs have
+/// room for states.size() values and states.size() * StateEncoder::GetPolicySize()
+/// policy array entries.
+/// </summary>
+typedef std::function<void(const std::vector<GameState>& states,
+	float* outValues,
+	float* outPolicyArrays)> PolicyArrayEvaluator;
+
+
+/// <summary>
+/// Counts of how many selected leaves needed evaluating, and how many
+/// of those evaluations were avoided, since the evaluation cache was
+/// enabled (see SelfPlayManager::EnableEvaluationCache()).
+/// </summary>
+struct EvaluationCacheStats
+{
+	/// <summary>
+	/// The number of selected leaves which needed an evaluation
+	/// (that is, which weren't finished or solved exactly.)
+	/// </summary>
+	size_t numLeaves;
+
+
+	/// <summary>
+	/// The number of those leaves whose evaluation was found in the cache.
+	/// </summary>
+	size_t numCacheHits;
+
+
+	/// <summary>
+	/// The number of those leaves which had the same state as another
+	/// leaf selected at the same time, so shared its evaluation.
+	/// </summary>
+	size_t numDuplicates;
+
+
+	/// <summary>
+	/// The number of evaluations currently in the cache.
+	/// </summary>
+	size_t cacheSize;
+};
+
+
+/// <summary>
+/// Counters for the work done by a self-play manager's search, since
+/// it was created or its statistics were reset (see SelfPlayManager::ResetStats()).
+/// These are gathered in the main thread after each parallel step, so
+/// keeping them doesn't slow down the search itself.
+/// </summary>
+struct SelfPlayStats
+{
+	/// <summary>
+	/// The number of rounds of Select() and Update().
+	/// </summary>
+	size_t numRounds;
+
+
+	/// <summary>
+	/// The total time spent in Select(), in Update() (including decoding
+	/// policy arrays) and in committing moves, in seconds.
+	/// </summary>
+	double selectSeconds, updateSeconds, commitSeconds;
+
+
+	/// <summary>
+	/// The number of nodes expanded (including nodes with a single
+	/// action, which are expanded during selection.)
+	/// </summary>
+	size_t numExpansions;
+
+
+	/// <summary>
+	/// The total number of child nodes (chance outcomes) created by those expansions.
+	/// </summary>
+	size_t numOutcomes;
+
+
+	/// <summary>
+	/// The number of descents from a root to a leaf, and the total
+	/// and greatest number of actions taken in a descent.
+	/// </summary>
+	size_t numDescents, totalDescentDepth, maxDescentDepth;
+
+
+	/// <summary>
+	/// The number of leaf states returned by Select() to be evaluated.
+	/// </summary>
+	size_t numEvaluations;
+
+
+	/// <summary>
+	/// An estimate of the number of bytes of memory added to all of the
+	/// search trees by expansions (see MCTSNode::GetMemoryUsage()). See
+	/// SelfPlayManager::GetTreeBytesAllocated() for the figure for each tree.
+	/// </summary>
+	size_t numBytesAllocated;
+
+
+	/// <summary>
+	/// The greatest number of distinct search trees selected in at once.
+	/// </summary>
+	size_t maxTreesSearched;
+};
+
+
 /// <summary>
 /// The 'self-play manager' is a system which manages
 /// several simultaneous games where an AI plays against
@@ -21,6 +151,14 @@ namespace c40kl
 /// and Commit(), which the user should cycle through. The
 /// Commit() function may require Select()/Update() to be called
 /// several times before it is ready.
+/// Alternatively, CommitReady() lets each game move on as soon
+/// as its own search is finished, so games which are quick to
+/// search don't have to wait for the slowest one.
+/// Thread safety: the manager uses its own threads internally, but
+/// is not itself thread safe, so only one thread may call its
+/// functions at a time. In Python, Select(), Update(), Commit(),
+/// CommitReady(), DecodeSelectedPolicies() and SearchFor() release
+/// the GIL, so other Python threads can run while they do.
 /// </summary>
 class C40KL_API SelfPlayManager :
 	public boost::noncopyable
@@ -66,6 +204,198 @@ public:
 	void Reset(size_t numGames, const GameState& initialState);
 
 
+	/// <summary>
+	/// Cancel all current games, and restart play in "streaming" mode. Here, a
+	/// fixed number of games are played at once, and whenever a game finishes
+	/// it is immediately replaced by a new game, whose initial state is drawn
+	/// uniformly at random from the given pool, until the total number of games
+	/// have been started. This keeps the number of states returned from Select()
+	/// roughly constant. Games are given IDs in the order they are started, and
+	/// finished games can be collected with PopFinishedGames().
+	/// PRECONDITION: the pool is nonempty and none of its states are finished,
+	/// and numConcurrentGames > 0 unless totalGames == 0.
+	/// </summary>
+	/// <param name="initialStatePool">The states which new games may start in.</param>
+	/// <param name="numConcurrentGames">The number of games to play at once.</param>
+	/// <param name="totalGames">The total number of games to play.</param>
+	void Reset(const std::vector<GameState>& initialStatePool,
+		size_t numConcurrentGames, size_t totalGames);
+
+
+	/// <summary>
+	/// Enable exact solving of small endgames. When a selected leaf has few
+	/// enough units and few enough turns remaining, the search will attempt to
+	/// compute its exact value with an expectimax solver. If this succeeds, the
+	/// leaf is expanded with a uniform prior and its exact value is backpropagated,
+	/// and it is not returned from Select() for evaluation.
+	/// </summary>
+	/// <param name="maxUnits">The maximum total number of units (over both teams) on the board.</param>
+	/// <param name="maxTurnsRemaining">
+	/// The maximum number of turns remaining before the turn limit. States without a turn limit
+	/// are never solved.
+	/// </param>
+	/// <param name="nodeBudget">The number of states the solver may visit per leaf before giving up.</param>
+	void EnableEndgameSolver(size_t maxUnits, int maxTurnsRemaining, size_t nodeBudget);
+
+
+	/// <summary>
+	/// Enable caching of leaf evaluations. Every evaluation given to Update()
+	/// is remembered (keyed by the leaf's state), and leaves selected later
+	/// whose state is already in the cache are expanded with the remembered
+	/// evaluation, rather than being returned from Select(). Leaves selected
+	/// at the same time with identical states (which is common when every
+	/// game starts from the same state) are only returned once, and share
+	/// the evaluation. The cache is kept between Reset() calls, so call
+	/// ClearEvaluationCache() if the evaluator changes (e.g. the network is
+	/// retrained.) Calling this again replaces the cache and its statistics.
+	/// PRECONDITION: !IsWaiting()
+	/// </summary>
+	/// <param name="maxSize">The maximum number of evaluations to remember. Must be > 0.</param>
+	/// <param name="numShards">The number of independently locked parts of the cache. Must be > 0.</param>
+	void EnableEvaluationCache(size_t maxSize, size_t numShards = 16);
+
+
+	/// <summary>
+	/// Forget all cached evaluations (see EnableEvaluationCache()).
+	/// Does nothing if the cache isn't enabled.
+	/// </summary>
+	void ClearEvaluationCache();
+
+
+	/// <summary>
+	/// Get statistics about the evaluation cache, since it was enabled.
+	/// If the cache isn't enabled, these are all zero.
+	/// </summary>
+	EvaluationCacheStats GetEvaluationCacheStats() const;
+
+
+	/// <summary>
+	/// Get the counters for the search's work since this object was
+	/// created, or since ResetStats() was last called.
+	/// </summary>
+	SelfPlayStats GetStats() const;
+
+
+	/// <summary>
+	/// Reset the counters returned by GetStats() to zero.
+	/// </summary>
+	void ResetStats();
+
+
+	/// <summary>
+	/// Enable or disable tracing. When enabled, the manager records a timeline
+	/// of its work: Select(), Update() and committing in the calling thread, the
+	/// time between Select() and Update() (which is spent evaluating leaves), and
+	/// the selection, expansion and backpropagation for each game in the worker
+	/// threads. Disabling tracing discards the timeline. Disabled by default.
+	/// </summary>
+	/// <param name="bEnabled">True to enable tracing, false to disable.</param>
+	void EnableTracing(bool bEnabled);
+
+
+	/// <summary>
+	/// Forget the timeline recorded so far (see EnableTracing()).
+	/// Does nothing if tracing isn't enabled.
+	/// </summary>
+	void ClearTrace();
+
+
+	/// <summary>
+	/// Write the timeline recorded so far in the Chrome trace event
+	/// format (see TraceRecorder::WriteJson()). The timeline is empty
+	/// if tracing isn't enabled.
+	/// </summary>
+	/// <param name="out">The stream to write to.</param>
+	void WriteTrace(std::ostream& out) const;
+
+
+	/// <summary>
+	/// The current version of the snapshot format (see SaveSnapshot()).
+	/// </summary>
+	static const uint32_t SNAPSHOT_VERSION = 2;
+
+
+	/// <summary>
+	/// Save a snapshot of the games being played, so that play can be resumed
+	/// later with LoadSnapshot(). The snapshot contains every game's search tree
+	/// (see MCTSNode::Write(); games sharing a tree still share it once loaded),
+	/// the game IDs, values, experience records and bytes allocated to each tree
+	/// (see GetTreeBytesAllocated()), the pool of initial states,
+	/// and the state of the random number generator. It doesn't contain the
+	/// manager's settings (those given to the constructor, and which features are
+	/// enabled), the evaluation cache, or the statistics, so these stay as they
+	/// are in the manager the snapshot is loaded into. The snapshot starts with
+	/// the magic string "C40KLSNP" and then SNAPSHOT_VERSION as a uint32.
+	/// PRECONDITION: !IsWaiting()
+	/// </summary>
+	/// <param name="out">The (binary) stream to write the snapshot to.</param>
+	void SaveSnapshot(std::ostream& out) const;
+
+
+	/// <summary>
+	/// Cancel all current games, and resume the games from a snapshot
+	/// saved by SaveSnapshot(). Throws std::runtime_error if the snapshot
+	/// is invalid, or was saved by another version, in which case the
+	/// current games are left as they were.
+	/// PRECONDITION: !IsWaiting()
+	/// </summary>
+	/// <param name="in">The (binary) stream to read the snapshot from.</param>
+	void LoadSnapshot(std::istream& in);
+
+
+	/// <summary>
+	/// Enable or disable early stopping. When enabled, a game's search stops
+	/// as soon as the most visited root action has a lead over the second most
+	/// visited action which cannot be overturned in the remaining simulations.
+	/// Games which stop early are not selected in again, so the evaluations go
+	/// to the games which still need them. Note that this only guarantees that
+	/// the most visited action won't change, so it is most useful when the
+	/// temperature is low. Disabled by default.
+	/// </summary>
+	/// <param name="bEnabled">True to enable early stopping, false to disable.</param>
+	void SetEarlyStopping(bool bEnabled);
+
+
+	/// <summary>
+	/// Enable or disable sharing of search trees between identical games.
+	/// When enabled, games which are started at the same time in the same
+	/// state (such as all the games after Reset(numGames, initialState))
+	/// share one search tree, which is searched as if it were one game, so
+	/// the opening is only searched once rather than once per game. Each
+	/// game still chooses its own move from the shared tree, so they only
+	/// carry on sharing while they choose the same action and get the same
+	/// outcome; as soon as they diverge, each carries on in its own part of
+	/// the tree. Takes effect from the next Reset(). Disabled by default.
+	/// </summary>
+	/// <param name="bEnabled">True to enable sharing, false to disable.</param>
+	void SetShareIdenticalGames(bool bEnabled);
+
+
+	/// <summary>
+	/// Reseed the random number generator which chooses moves and
+	/// outcomes (and, when streaming, initial states.) Managers are
+	/// always seeded the same way when created, so managers in different
+	/// processes should be given different seeds to play different games.
+	/// </summary>
+	/// <param name="seed">The new seed.</param>
+	void SetSeed(uint32_t seed);
+
+
+	/// <summary>
+	/// Enable or disable experience recording. When enabled, every time
+	/// a game is committed, the state at its root is recorded along with
+	/// the final policy used to choose the action (as returned from
+	/// GetCurrentActionDistributions()). When the game finishes, its
+	/// records are given the game's result and queued up together, to
+	/// be collected with PopFinishedRecords(). See StateEncoder for the
+	/// format of each record. Disabled by default.
+	/// PRECONDITION: all games played since the last call to Reset() use
+	/// the same board size, so that all records are the same size.
+	/// </summary>
+	/// <param name="bEnabled">True to enable recording, false to disable.</param>
+	void SetRecordExperiences(bool bEnabled);
+
+
 	/// <summary>
 	/// Perform the 'selection' portion of the tree search algorithm. This is where
 	/// the search trees will traverse the tree from the root until they find a leaf
@@ -76,6 +406,8 @@ public:
 	/// This vector will be cleared, and the game states of a subset of selected leaf nodes will be put into
 	/// this array. Note that not all leaf states will be put here, because (say) if the game's search tree
 	/// is already full, or the selected leaf node is terminal, there is no reason why it should be selected.
+	/// Likewise, leaves whose evaluation is cached, or which duplicate another leaf, are left out (see
+	/// EnableEvaluationCache()).
 	/// </param>
 	void Select(std::vector<GameState>& outLeafStates);
 
@@ -101,6 +433,59 @@ public:
 		const std::vector<std::vector<float>>& policies);
 
 
+	/// <summary>
+	/// The same as the above, but with the policies given as the network's raw
+	/// policy arrays, which are converted to distributions over each leaf's actions
+	/// as in DecodeSelectedPolicies().
+	/// PRECONDITION: IsWaiting() && !ReadyToCommit() && !AllFinished(), and all
+	/// selected states have the same board size.
+	/// </summary>
+	/// <param name="valueEstimates">
+	/// The value estimates for the states returned from the Select() call, with
+	/// respect to the current acting team of each state. Must have size GetNumSelected().
+	/// </param>
+	/// <param name="policyArrays">
+	/// The policy arrays, one after the other, in the same order as the states returned
+	/// from Select(). Must have size StateEncoder::GetPolicySize() * GetNumSelected().
+	/// </param>
+	void Update(const float* valueEstimates, const float* policyArrays);
+
+
+	/// <summary>
+	/// Convert the network's policy arrays for the states returned from the
+	/// Select() call into distributions over each leaf's actions, in the form
+	/// required by Update() (see StateEncoder::DecodePolicy()). This uses the
+	/// actions cached in each selected leaf, which are used again when the
+	/// leaf is expanded, rather than generating them again.
+	/// PRECONDITION: IsWaiting(), and all selected states have the same board size.
+	/// </summary>
+	/// <param name="policyArrays">
+	/// The policy arrays, one after the other, in the same order as the states
+	/// returned from Select(). Must have size StateEncoder::GetPolicySize() times
+	/// the number of selected states.
+	/// </param>
+	/// <returns>The prior policies to pass to Update().</returns>
+	std::vector<std::vector<float>> DecodeSelectedPolicies(const float* policyArrays) const;
+
+
+	/// <summary>
+	/// Get the number of leaf states returned from the last Select() call.
+	/// </summary>
+	/// <returns>The number of states waiting for an Update(), or zero if !IsWaiting().</returns>
+	size_t GetNumSelected() const;
+
+
+	/// <summary>
+	/// Get the board size of the leaf states returned from the last Select() call,
+	/// which determines the size of their policy arrays (see StateEncoder::GetPolicySize().)
+	/// </summary>
+	/// <returns>
+	/// The board size of every selected state, or zero if none are selected, or
+	/// they don't all have the same board size.
+	/// </returns>
+	int GetSelectedBoardSize() const;
+
+
 	/// <summary>
 	/// Once all search trees have been searched throroughly enough, and are of the
 	/// required size, the AIs will be ready to commit to a decision in each game.
@@ -111,6 +496,46 @@ public:
 	void Commit();
 
 
+	/// <summary>
+	/// Like Commit(), but only commits to a decision in the games whose
+	/// searches are finished (see AnyReadyToCommit()). The rest of the
+	/// games carry on searching. Use the onlyReady arguments of
+	/// GetCurrentGameStates(), GetCurrentActionDistributions() and
+	/// GetRunningGameIds() beforehand to find out about the games which
+	/// will be committed.
+	/// PRECONDITION: !IsWaiting() && !AllFinished()
+	/// </summary>
+	void CommitReady();
+
+
+	/// <summary>
+	/// Run Select()/Update() cycles, using the given evaluator, until every search
+	/// tree has the required number of simulations or the time limit passes,
+	/// whichever comes first. Once the time limit has passed, ReadyToCommit() will
+	/// return true (until the next Commit()) even though the trees may be smaller
+	/// than usual, so the search time per move is predictable.
+	/// Note: each tree must be expanded at least once before the search can stop,
+	/// so the time limit may be overrun by one Select()/Update() cycle.
+	/// PRECONDITION: !IsWaiting() && !AllFinished()
+	/// </summary>
+	/// <param name="milliseconds">The time limit for this search.</param>
+	/// <param name="evaluator">The function to compute value estimates and priors of the selected leaves.</param>
+	/// <returns>The same as GetCurrentActionDistributions(), once the search has finished.</returns>
+	std::vector<std::vector<float>> SearchFor(size_t milliseconds, const StateEvaluator& evaluator);
+
+
+	/// <summary>
+	/// The same as the above, but with an evaluator which gives policy arrays,
+	/// such as NeuralNetwork::Predict(). The arrays are converted into prior
+	/// policies using the actions cached in each leaf, as in DecodeSelectedPolicies().
+	/// PRECONDITION: !IsWaiting() && !AllFinished(), and all games use the same board size.
+	/// </summary>
+	/// <param name="milliseconds">The time limit for this search.</param>
+	/// <param name="evaluator">The function to compute value estimates and policy arrays of the selected leaves.</param>
+	/// <returns>The same as GetCurrentActionDistributions(), once the search has finished.</returns>
+	std::vector<std::vector<float>> SearchFor(size_t milliseconds, const PolicyArrayEvaluator& evaluator);
+
+
 	/// <summary>
 	/// Determine if we have selected leaf nodes and are waiting on values and prior policies
 	/// from the user.
@@ -121,12 +546,22 @@ public:
 
 	/// <summary>
 	/// Determine if the AIs are ready to commit, which happens when every
-	/// search tree has reached the required size.
+	/// search tree has reached the required size, or when the time limit
+	/// given to SearchFor() has passed, or (if early stopping is enabled)
+	/// when every tree's decision can no longer change.
 	/// </summary>
 	/// <returns>True if ready for Commit(), false if not.</returns>
 	bool ReadyToCommit() const;
 
 
+	/// <summary>
+	/// Determine if at least one game is ready to commit (by the same
+	/// criteria as ReadyToCommit(), applied to each game individually.)
+	/// </summary>
+	/// <returns>True if CommitReady() would commit in at least one game.</returns>
+	bool AnyReadyToCommit() const;
+
+
 	/// <summary>
 	/// Determine if all games are finished.
 	/// </summary>
@@ -139,8 +574,9 @@ public:
 	/// returned from the Select() call. This returns the state of the roots of every search tree.
 	/// Warning: only returns for the unfinished games.
 	/// </summary>
+	/// <param name="onlyReady">If true, only return the states of games which are ready to commit.</param>
 	/// <returns>The state at the root of every search tree (i.e. what each game is currently in).</returns>
-	std::vector<GameState> GetCurrentGameStates() const;
+	std::vector<GameState> GetCurrentGameStates(bool onlyReady = false) const;
 
 
 	/// <summary>
@@ -148,10 +584,11 @@ public:
 	/// picking the best action, according to the search tree results, either
 	/// deterministically or stochastically.
 	/// Warning: only returns for the unfinished games.
-	/// PRECONDITION: ReadyToCommit()
+	/// PRECONDITION: ReadyToCommit(), unless onlyReady is true.
 	/// </summary>
+	/// <param name="onlyReady">If true, only return the distributions of games which are ready to commit.</param>
 	/// <returns>A list of action distributions (policies) for each root node.</returns>
-	std::vector<std::vector<float>> GetCurrentActionDistributions() const;
+	std::vector<std::vector<float>> GetCurrentActionDistributions(bool onlyReady = false) const;
 
 
 	/// <summary>
@@ -172,18 +609,38 @@ public:
 	std::vector<int> GetTreeSizes() const;
 
 
+	/// <summary>
+	/// Get an estimate of the number of bytes of memory added to each game's
+	/// search tree by expansions, over the whole game so far (including parts
+	/// of the tree discarded as moves were made). Games which share a tree
+	/// (see SetShareIdenticalGames()) count each expansion against the game
+	/// which selected the leaf, so their figures add up to the tree's.
+	/// </summary>
+	/// <returns>The number of bytes for every game, indexed by game ID.</returns>
+	std::vector<size_t> GetTreeBytesAllocated() const;
+
+
+	/// <summary>
+	/// Get the number of distinct search trees. This is the number of
+	/// running games, unless some games share a tree (see SetShareIdenticalGames()).
+	/// </summary>
+	/// <returns>The number of distinct trees being searched.</returns>
+	size_t GetNumSearchTrees() const;
+
+
 	/// <summary>
 	/// Determine the index of each running game (a game is defined to
 	/// be running if it has a tree rooted in this object). Once a game
 	/// is finished it is considered no longer running, and its tree is
 	/// deleted.
 	/// </summary>
+	/// <param name="onlyReady">If true, only return the IDs of games which are ready to commit.</param>
 	/// <returns>
 	/// An array equal to the length of the number of currently running
 	/// games, where the value of each element represents the index that
 	/// the game initially had (before any games were finished).
 	/// </returns>
-	std::vector<size_t> GetRunningGameIds() const;
+	std::vector<size_t> GetRunningGameIds(bool onlyReady = false) const;
 
 
 	/// <summary>
@@ -196,7 +653,37 @@ public:
 	std::vector<float> GetGameValues() const;
 
 
+	/// <summary>
+	/// Get the games which have finished since the last call to this
+	/// function, and forget them.
+	/// </summary>
+	/// <returns>
+	/// A list of (game ID, game value) pairs, where the game values are
+	/// with respect to team 0, like GetGameValues().
+	/// </returns>
+	std::vector<std::pair<size_t, float>> PopFinishedGames();
+
+
+	/// <summary>
+	/// Get the experience records of all games which have finished since the
+	/// last call to this function, and forget them. The records of each game
+	/// are contiguous and in the order they were played, and each record has
+	/// StateEncoder::GetRecordSize() floats. Only games played while recording
+	/// was enabled (see SetRecordExperiences()) have records.
+	/// </summary>
+	/// <returns>The records of all finished games, in one flat array.</returns>
+	std::vector<float> PopFinishedRecords();
+
+
 private:
+	/// <summary>
+	/// Run Select() and evaluateAndUpdate() (which must call Update() with the
+	/// selected states) until ReadyToCommit(), or until the time limit passes.
+	/// </summary>
+	std::vector<std::vector<float>> SearchUntil(size_t milliseconds,
+		const std::function<void(const std::vector<GameState>&)>& evaluateAndUpdate);
+
+
 	/// <summary>
 	/// Traverse the root from m_pRoots[gameIdx]
 	/// to find a leaf node, and write the leaf
@@ -205,7 +692,83 @@ private:
 	/// m_NumSimulations), else don't do selection.
 	/// </summary>
 	/// <param name="gameIdx">The index of the game tree to select in.</param>
-	void SelectLeafForGame(size_t gameIdx);
+	/// <param name="seed">The seed for the random results of actions on the way.</param>
+	void SelectLeafForGame(size_t gameIdx, uint32_t seed);
+
+
+	/// <summary>
+	/// Clear the arrays recording which selected leaves
+	/// were found in the evaluation cache, or duplicated.
+	/// </summary>
+	void ClearCachedLeaves();
+
+
+	/// <summary>
+	/// Add the work counted for each game (in m_LeafDepths etc.)
+	/// to m_Stats, and zero those counts. Call this after the
+	/// parallel jobs which count the work have finished.
+	/// </summary>
+	void GatherLeafStats();
+
+
+	/// <summary>
+	/// If tracing, record the time since Select() returned as
+	/// the time spent evaluating the selected leaves.
+	/// </summary>
+	void TraceEvaluation();
+
+
+	/// <summary>
+	/// Expand the given node with the given prior policy, counting
+	/// the expansion, its outcomes, and the memory it used, for the
+	/// given game (see m_LeafExpansions etc.)
+	/// </summary>
+	/// <param name="gameIdx">The index of the game the node was selected for.</param>
+	/// <param name="pNode">The leaf node to expand.</param>
+	/// <param name="policy">The prior policy to expand the node with.</param>
+	void ExpandLeaf(size_t gameIdx, const MCTSNodePtr& pNode, const std::vector<float>& policy);
+
+
+	/// <summary>
+	/// Select an action in the given game according to its
+	/// final policy, apply it, and re-root the game's tree at
+	/// the resulting state. If the game finishes, its value is
+	/// recorded (but its tree is not removed.)
+	/// </summary>
+	/// <param name="gameIdx">The index of the game tree to commit in.</param>
+	void CommitGame(size_t gameIdx);
+
+
+	/// <summary>
+	/// Remove the trees of all finished games, along with their IDs,
+	/// and then start new games to replace them (if there are more
+	/// games to play.)
+	/// </summary>
+	void RemoveFinishedGames();
+
+
+	/// <summary>
+	/// Start new games, drawing their initial states from the pool,
+	/// until either there are enough games running at once, or the
+	/// total number of games have been started.
+	/// </summary>
+	void StartNewGames();
+
+
+	/// <summary>
+	/// Determine if the given game's search has finished, and is
+	/// ready to commit; see ReadyToCommit() for the conditions.
+	/// Games which are ready are not selected in.
+	/// </summary>
+	/// <param name="gameIdx">The index of the game tree to examine.</param>
+	bool IsGameReady(size_t gameIdx) const;
+
+
+	/// <summary>
+	/// Determine if the given leaf state is small enough
+	/// that we should attempt to solve it exactly.
+	/// </summary>
+	bool ShouldSolve(const GameState& state) const;
 
 
 	/// <summary>
@@ -228,7 +791,9 @@ private:
 	/// Determine what action to take, given the game's
 	/// complete search tree. Typically this will just
 	/// be: selecting the action with the highest number
-	/// of visits.
+	/// of visits. If no action has been visited yet (which
+	/// can happen if the search was stopped early) then the
+	/// prior distribution is used instead.
 	/// </summary>
 	/// <param name="gameIdx">The game search tree to examine.</param>
 	/// <returns>The final policy for this game (distribution over actions).</returns>
@@ -244,7 +809,14 @@ private:
 
 	const size_t m_NumSimulations,
 		m_NumThreads;
+
+	//The threads which Select(), Update() and DecodeSelectedPolicies()
+	// run their jobs on, kept for the manager's lifetime
+	std::unique_ptr<WorkerPool> m_pWorkers;
+
 	const float m_Temperature;
+	bool m_bEarlyStopping;
+	bool m_bShareIdenticalGames;
 	UCB1PolicyStrategy m_TreePolicy;
 
 	//IMPORTANT NOTE about tree value estimates:
@@ -264,20 +836,102 @@ private:
 	// of this game. On resetting, this is just the list
 	// [0, 1, 2, ...], but as games have their trees
 	// removed, their indices are removed as well.
+	// Note that when games share a tree, several
+	// elements of m_pRoots point to the same node.
+	// New games (in streaming mode) take the next
+	// unused index.
 	std::vector<size_t> m_GameIDs;
 
+	//The pool of states new games start in, the number
+	// of games which should be running at once, and the
+	// number of games started so far, and in total.
+	std::vector<GameState> m_InitialStatePool;
+	size_t m_NumConcurrentGames, m_NumGamesStarted, m_TotalGames;
+
+	//Games which have finished, but have not yet been
+	// returned from PopFinishedGames(), with their values
+	// WITH RESPECT TO TEAM 0.
+	std::vector<std::pair<size_t, float>> m_FinishedGames;
+
+	//The experience records of each game which hasn't yet
+	// finished, indexed by game ID. Until the game finishes,
+	// the value of each record holds the sign (+1 or -1)
+	// needed to convert the team 0 value into the value for
+	// the acting team.
+	bool m_bRecordExperiences;
+	std::vector<std::vector<float>> m_GameRecords;
+
+	//The records of finished games which haven't yet been
+	// returned from PopFinishedRecords().
+	std::vector<float> m_FinishedRecords;
+
 	//As games finish, their values	WITH RESPECT TO TEAM 0
 	// are recorded here. This array is only valid once all
 	// games have finished (otherwise it will have entries
 	// not yet filled in).
 	std::vector<float> m_GameValues;
 
+	//The bytes added to each game's search tree by expansions
+	// (see GetTreeBytesAllocated()), indexed by game ID.
+	std::vector<size_t> m_TreeBytesAllocated;
+
 	//This array is to map the returned vector in Select() and the
 	// vectors given as argument in Update() to their corresponding
 	// games. Warning: it is possible, although unlikely, that this
 	// array is empty when m_pSelectedLeaves is nonempty (we may
 	// select a terminal node for every search tree, by chance.)
 	std::vector<size_t> m_SelectedIndices;
+
+	//The endgame solver (null if disabled) and the
+	// conditions under which it is used.
+	std::unique_ptr<ExpectimaxSolver> m_pSolver;
+	size_t m_SolverMaxUnits;
+	int m_SolverMaxTurnsRemaining;
+
+	//These arrays have the same size as m_pSelectedLeaves,
+	// and record which of the selected leaves were solved
+	// exactly, and their values WITH RESPECT TO TEAM 0.
+	// (Note: we avoid vector<bool> because it is written
+	// to from several threads.)
+	std::vector<char> m_bLeafSolved;
+	std::vector<float> m_SolvedLeafValues;
+
+	//The evaluation cache (null if disabled) and its statistics.
+	std::unique_ptr<EvaluationCache> m_pCache;
+	EvaluationCacheStats m_CacheStats;
+
+	//These arrays have the same size as m_pSelectedLeaves while
+	// the cache is enabled. They record the hash of each selected
+	// leaf's state, and which leaves were found in the cache, with
+	// their values (WITH RESPECT TO THE ACTING TEAM, as they are
+	// given to Update()) and priors. Leaves which duplicate another
+	// selected leaf have the index (into m_SelectedIndices) of
+	// that leaf, and the rest have NOT_DUPLICATE.
+	std::vector<size_t> m_LeafHashes;
+	std::vector<char> m_bLeafCached;
+	std::vector<float> m_CachedLeafValues;
+	std::vector<std::vector<float>> m_CachedLeafPolicies;
+	std::vector<size_t> m_LeafDuplicateOf;
+	static const size_t NOT_DUPLICATE = (size_t)-1;
+
+	//The search counters (see GetStats()), and arrays with the same
+	// size as m_pSelectedLeaves which count the work done for each
+	// game by the parallel jobs, until they are added to m_Stats.
+	SelfPlayStats m_Stats;
+	std::vector<size_t> m_LeafDepths;
+	std::vector<size_t> m_LeafExpansions;
+	std::vector<size_t> m_LeafOutcomes;
+	std::vector<size_t> m_LeafBytes;
+
+	//The timeline of the search (null if tracing is disabled), and
+	// the time Select() last returned (to measure the time spent
+	// evaluating the selected leaves.)
+	std::unique_ptr<TraceRecorder> m_pTrace;
+	TraceRecorder::Clock::time_point m_SelectEndTime;
+
+	//True if the time limit given to SearchFor() has passed.
+	// This is cleared by committing.
+	bool m_bOutOfTime;
 };
 
 
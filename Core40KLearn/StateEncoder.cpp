@@ -0,0 +1,290 @@
+#include "StateEncoder.h"
+#include "WorkerPool.h"
+#include <algorithm>
+
+
+namespace c40kl
+{
+
+
+//Write out the features of a unit, in the same order as
+// unit_to_vector() in pyai/converter.py
+static void EncodeUnit(const Unit& unit, float* out)
+{
+	out[0] = (float)unit.count;
+	out[1] = (float)unit.movement;
+	out[2] = (float)unit.ws;
+	out[3] = (float)unit.bs;
+	out[4] = (float)unit.t;
+	out[5] = (float)unit.total_w;
+	out[6] = (float)unit.a;
+	out[7] = (float)unit.ld;
+	out[8] = (float)unit.sv;
+	out[9] = (float)unit.rg_range;
+	out[10] = (float)unit.rg_s;
+	out[11] = (float)unit.rg_ap;
+	out[12] = (float)unit.rg_dmg;
+	out[13] = (float)unit.rg_shots;
+	out[14] = (float)unit.ml_s;
+	out[15] = (float)unit.ml_ap;
+	out[16] = (float)unit.ml_dmg;
+	out[17] = unit.rg_is_rapid ? 1.0f : 0.0f;
+	out[18] = unit.rg_is_heavy ? 1.0f : 0.0f;
+}
+
+
+size_t StateEncoder::GetBoardPlanesSize(int boardSize)
+{
+	return (size_t)boardSize * (size_t)boardSize * 2 * NUM_UNIT_FEATURES;
+}
+
+
+size_t StateEncoder::GetPolicySize(int boardSize)
+{
+	return 2 * (size_t)boardSize * (size_t)boardSize + 1;
+}
+
+
+size_t StateEncoder::GetRecordSize(int boardSize)
+{
+	return GetBoardPlanesSize(boardSize) + NUM_PHASES + GetPolicySize(boardSize) + 1;
+}
+
+
+void StateEncoder::EncodeBoard(const GameState& state, float* out)
+{
+	const auto& board = state.GetBoardState();
+	const int size = board.GetSize();
+	const int team = state.GetActingTeam();
+
+	std::fill(out, out + GetBoardPlanesSize(size), 0.0f);
+
+	for (int unitTeam = 0; unitTeam < 2; unitTeam++)
+	{
+		//Allied features come first, then enemy features
+		const size_t featureOffset = (unitTeam == team) ? 0 : NUM_UNIT_FEATURES;
+
+		for (const auto& pos : board.GetAllUnits(unitTeam))
+		{
+			const size_t squareIdx = (size_t)pos.first * size + pos.second;
+			EncodeUnit(board.GetUnitOnSquare(pos),
+				out + squareIdx * 2 * NUM_UNIT_FEATURES + featureOffset);
+		}
+	}
+}
+
+
+void StateEncoder::EncodePhase(const GameState& state, float* out)
+{
+	std::fill(out, out + NUM_PHASES, 0.0f);
+	out[(size_t)state.GetPhase()] = 1.0f;
+}
+
+
+void StateEncoder::EncodeStates(const std::vector<GameState>& states, float* outPlanes,
+	float* outPhases, WorkerPool* pWorkers)
+{
+	if (states.empty())
+		return;
+
+	const int size = states.front().GetBoardState().GetSize();
+
+	C40KL_ASSERT_PRECONDITION(std::all_of(states.begin(), states.end(),
+		[size](const GameState& state) { return state.GetBoardState().GetSize() == size; }),
+		"All states must have the same board size.");
+
+	const size_t numPlanes = GetBoardPlanesSize(size);
+
+	//Each job encodes a contiguous chunk of the states, so that
+	// jobs write to separate parts of the output.
+	const size_t numThreads = pWorkers ? pWorkers->GetNumThreads() : 1;
+	const size_t numJobs = std::max<size_t>(std::min(numThreads, states.size()), 1);
+	const size_t chunkSize = (states.size() + numJobs - 1) / numJobs;
+
+	auto encodeChunk = [&states, outPlanes, outPhases, numPlanes](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			EncodeBoard(states[i], outPlanes + i * numPlanes);
+			EncodePhase(states[i], outPhases + i * NUM_PHASES);
+		}
+	};
+
+	if (numJobs == 1)
+	{
+		encodeChunk(0, states.size());
+		return;
+	}
+
+	pWorkers->Run((states.size() + chunkSize - 1) / chunkSize, [&](size_t chunk)
+	{
+		const size_t begin = chunk * chunkSize;
+		encodeChunk(begin, std::min(begin + chunkSize, states.size()));
+	});
+}
+
+
+void StateEncoder::EncodePolicy(const GameState& state, const std::vector<float>& policy, float* out)
+{
+	EncodePolicy(state.GetCommands(), state.GetBoardState().GetSize(), policy, out);
+}
+
+
+void StateEncoder::EncodePolicy(const GameCommandArray& cmds, int boardSize,
+	const std::vector<float>& policy, float* out)
+{
+	C40KL_ASSERT_PRECONDITION(policy.size() == cmds.size(),
+		"Policy must have one entry per command.");
+
+	const size_t policySize = GetPolicySize(boardSize);
+
+	std::fill(out, out + policySize, 0.0f);
+
+	for (size_t i = 0; i < cmds.size(); i++)
+	{
+		if (auto pOrder = dynamic_cast<const IUnitOrderCommand*>(cmds[i].get()))
+		{
+			const Position source = pOrder->GetSourcePosition();
+			const Position target = pOrder->GetTargetPosition();
+
+			//There may be many actions for each source and
+			// target, so add to the existing values.
+			out[source.first + source.second * boardSize] += policy[i];
+			out[target.first + target.second * boardSize] += policy[i];
+		}
+		else
+		{
+			out[policySize - 1] = policy[i];
+		}
+	}
+}
+
+
+void StateEncoder::EncodePolicies(const std::vector<GameState>& states,
+	const std::vector<std::vector<float>>& policies, float* out)
+{
+	C40KL_ASSERT_PRECONDITION(states.size() == policies.size(),
+		"Need one policy per state.");
+
+	if (states.empty())
+		return;
+
+	const int size = states.front().GetBoardState().GetSize();
+	const size_t policySize = GetPolicySize(size);
+
+	for (size_t i = 0; i < states.size(); i++)
+	{
+		C40KL_ASSERT_PRECONDITION(states[i].GetBoardState().GetSize() == size,
+			"All states must have the same board size.");
+
+		EncodePolicy(states[i], policies[i], out + i * policySize);
+	}
+}
+
+
+std::vector<float> StateEncoder::DecodePolicy(const GameCommandArray& cmds, int boardSize,
+	const float* policyArray)
+{
+	C40KL_ASSERT_PRECONDITION(!cmds.empty(), "Need at least one command.");
+
+	const size_t policySize = GetPolicySize(boardSize);
+
+	std::vector<float> policy(cmds.size(), 0.0f);
+
+	for (size_t i = 0; i < cmds.size(); i++)
+	{
+		if (auto pOrder = dynamic_cast<const IUnitOrderCommand*>(cmds[i].get()))
+		{
+			const Position source = pOrder->GetSourcePosition();
+			const Position target = pOrder->GetTargetPosition();
+
+			//Multiply the probabilities to 'and' them
+			policy[i] = policyArray[source.first + source.second * boardSize]
+				* policyArray[target.first + target.second * boardSize];
+		}
+		else
+		{
+			//Square the end phase probability to keep it on the same
+			// order as the products of source and target probabilities
+			policy[i] = policyArray[policySize - 1] * policyArray[policySize - 1];
+		}
+	}
+
+	//Discourage passing
+	policy.back() *= 1.0e-3f;
+
+	float total = 0.0f;
+	for (float p : policy)
+		total += p;
+
+	if (total == 0.0f)
+	{
+		std::fill(policy.begin(), policy.end(), 0.0f);
+		policy.front() = 1.0f;
+	}
+	else
+	{
+		for (float& p : policy)
+			p /= total;
+	}
+
+	return policy;
+}
+
+
+std::vector<float> StateEncoder::DecodePolicy(const GameState& state, const float* policyArray)
+{
+	return DecodePolicy(state.GetCommands(), state.GetBoardState().GetSize(), policyArray);
+}
+
+
+std::vector<std::vector<float>> StateEncoder::DecodePolicies(const std::vector<GameState>& states,
+	const float* policyArrays)
+{
+	std::vector<std::vector<float>> policies;
+	policies.reserve(states.size());
+
+	if (states.empty())
+		return policies;
+
+	const int size = states.front().GetBoardState().GetSize();
+	const size_t policySize = GetPolicySize(size);
+
+	for (size_t i = 0; i < states.size(); i++)
+	{
+		C40KL_ASSERT_PRECONDITION(states[i].GetBoardState().GetSize() == size,
+			"All states must have the same board size.");
+
+		policies.push_back(DecodePolicy(states[i], policyArrays + i * policySize));
+	}
+
+	return policies;
+}
+
+
+void StateEncoder::EncodeRecord(const GameState& state, const std::vector<float>& policy,
+	float value, float* out)
+{
+	EncodeRecord(state, state.GetCommands(), policy, value, out);
+}
+
+
+void StateEncoder::EncodeRecord(const GameState& state, const GameCommandArray& cmds,
+	const std::vector<float>& policy, float value, float* out)
+{
+	const int size = state.GetBoardState().GetSize();
+
+	EncodeBoard(state, out);
+	out += GetBoardPlanesSize(size);
+
+	EncodePhase(state, out);
+	out += NUM_PHASES;
+
+	EncodePolicy(cmds, size, policy, out);
+	out += GetPolicySize(size);
+
+	*out = value;
+}
+
+
+} // namespace c40kl
@@ -0,0 +1,206 @@
+#pragma once
+
+
+#include "GameState.h"
+
+
+namespace c40kl
+{
+
+
+class WorkerPool;
+
+
+/// <summary>
+/// Converts game states and policies into the flat arrays of
+/// floats which the neural network is trained on. This gives
+/// exactly the same arrays as the Python functions in
+/// pyai/converter.py, but without creating any Python objects.
+///
+/// An experience record is a single contiguous block of floats,
+/// laid out as:
+///   [board planes][phase vector][policy array][value]
+/// where:
+/// - The board planes have shape (size, size, 2 * NUM_UNIT_FEATURES),
+///   in row-major order indexed by (x, y, feature). The first half
+///   of the features describe units of the acting team, and the
+///   second half describe enemy units.
+/// - The phase vector is a one-hot vector of length NUM_PHASES.
+/// - The policy array has length 2 * size * size + 1 (see EncodePolicy).
+/// - The value is the final game result with respect to the team
+///   acting in the state.
+/// </summary>
+class C40KL_API StateEncoder
+{
+public:
+	/// <summary>
+	/// The number of features describing a single unit.
+	/// </summary>
+	static const size_t NUM_UNIT_FEATURES = 19;
+
+
+	/// <summary>
+	/// The number of phases (the length of the phase vector).
+	/// </summary>
+	static const size_t NUM_PHASES = 4;
+
+	/// <summary>
+	/// Get the number of floats in the board planes for a board of the given size.
+	/// </summary>
+	static size_t GetBoardPlanesSize(int boardSize);
+
+
+	/// <summary>
+	/// Get the number of floats in a policy array for a board of the given size.
+	/// </summary>
+	static size_t GetPolicySize(int boardSize);
+
+
+	/// <summary>
+	/// Get the number of floats in an experience record for a board of the given size.
+	/// </summary>
+	static size_t GetRecordSize(int boardSize);
+
+
+	/// <summary>
+	/// Write out the board planes for the given state, from the
+	/// point of view of the acting team.
+	/// </summary>
+	/// <param name="state">The state to encode.</param>
+	/// <param name="out">The output array, of size GetBoardPlanesSize().</param>
+	static void EncodeBoard(const GameState& state, float* out);
+
+
+	/// <summary>
+	/// Write out the one-hot phase vector for the given state.
+	/// </summary>
+	/// <param name="state">The state to encode.</param>
+	/// <param name="out">The output array, of size NUM_PHASES.</param>
+	static void EncodePhase(const GameState& state, float* out);
+
+
+	/// <summary>
+	/// Write out the board planes and phase vectors for a batch of states,
+	/// splitting the work across the threads of a pool. The planes for each state
+	/// follow on from the previous state's, as do the phase vectors, so the
+	/// outputs are arrays of shape (n, size, size, 2 * NUM_UNIT_FEATURES) and
+	/// (n, NUM_PHASES) respectively.
+	/// PRECONDITION: every state has the same board size.
+	/// </summary>
+	/// <param name="states">The states to encode.</param>
+	/// <param name="outPlanes">The board planes output, of size states.size() * GetBoardPlanesSize().</param>
+	/// <param name="outPhases">The phase vectors output, of size states.size() * NUM_PHASES.</param>
+	/// <param name="pWorkers">The threads to use, or null to use the calling thread.</param>
+	static void EncodeStates(const std::vector<GameState>& states, float* outPlanes,
+		float* outPhases, WorkerPool* pWorkers = nullptr);
+
+
+	/// <summary>
+	/// Convert a distribution over the state's actions into an array of
+	/// size 2 * size * size + 1. Each unit order adds its probability to
+	/// the entries for its source and target squares (both indexed by
+	/// x + y * size, as in policy_to_array() in pyai/converter.py), and
+	/// the last entry is the probability of ending the phase.
+	/// PRECONDITION: policy.size() == state.GetCommands().size()
+	/// </summary>
+	/// <param name="state">The state the policy is for.</param>
+	/// <param name="policy">The distribution over state.GetCommands().</param>
+	/// <param name="out">The output array, of size GetPolicySize().</param>
+	static void EncodePolicy(const GameState& state, const std::vector<float>& policy, float* out);
+
+
+	/// <summary>
+	/// The same as the above, but with the state's commands given, so they
+	/// don't need generating again (e.g. when they are cached in an MCTSNode.)
+	/// PRECONDITION: policy.size() == cmds.size()
+	/// </summary>
+	/// <param name="cmds">The commands available in the state.</param>
+	/// <param name="boardSize">The size of the state's board.</param>
+	/// <param name="policy">The distribution over cmds.</param>
+	/// <param name="out">The output array, of size GetPolicySize().</param>
+	static void EncodePolicy(const GameCommandArray& cmds, int boardSize,
+		const std::vector<float>& policy, float* out);
+
+
+	/// <summary>
+	/// Convert policies into arrays for a batch of states. The arrays for
+	/// each state follow on from the previous state's, so the output is
+	/// an array of shape (n, GetPolicySize()).
+	/// PRECONDITION: states.size() == policies.size(), every state has the
+	/// same board size, and every policy is the right size for its state.
+	/// </summary>
+	/// <param name="states">The states the policies are for.</param>
+	/// <param name="policies">The distribution over each state's commands.</param>
+	/// <param name="out">The output array, of size states.size() * GetPolicySize().</param>
+	static void EncodePolicies(const std::vector<GameState>& states,
+		const std::vector<std::vector<float>>& policies, float* out);
+
+
+	/// <summary>
+	/// Convert a policy array output by the network into a distribution over
+	/// the given commands, like array_to_policy() in pyai/converter.py. Each unit
+	/// order gets the product of the entries for its source and target squares,
+	/// and any other command gets the square of the last entry (so a uniform
+	/// array gives a uniform distribution.) The last command's probability is
+	/// then scaled down by a factor of 1000 to discourage passing, and the
+	/// result is normalised. If every probability is zero, all of the
+	/// probability goes to the first command.
+	/// PRECONDITION: !cmds.empty()
+	/// </summary>
+	/// <param name="cmds">The commands available in the state.</param>
+	/// <param name="boardSize">The size of the state's board.</param>
+	/// <param name="policyArray">The network output, of size GetPolicySize().</param>
+	/// <returns>A distribution over cmds.</returns>
+	static std::vector<float> DecodePolicy(const GameCommandArray& cmds, int boardSize,
+		const float* policyArray);
+
+
+	/// <summary>
+	/// The same as the above, generating the commands from the state.
+	/// PRECONDITION: !state.IsFinished()
+	/// </summary>
+	/// <param name="state">The state the policy is for.</param>
+	/// <param name="policyArray">The network output, of size GetPolicySize().</param>
+	/// <returns>A distribution over state.GetCommands().</returns>
+	static std::vector<float> DecodePolicy(const GameState& state, const float* policyArray);
+
+
+	/// <summary>
+	/// Convert the network's policy arrays into distributions over actions
+	/// for a batch of states.
+	/// PRECONDITION: every state has the same board size and is unfinished.
+	/// </summary>
+	/// <param name="states">The states the policy arrays are for.</param>
+	/// <param name="policyArrays">The network outputs, of size states.size() * GetPolicySize().</param>
+	/// <returns>A distribution over each state's commands.</returns>
+	static std::vector<std::vector<float>> DecodePolicies(const std::vector<GameState>& states,
+		const float* policyArrays);
+
+
+	/// <summary>
+	/// Write out a full experience record (see the class description.)
+	/// PRECONDITION: policy.size() == state.GetCommands().size()
+	/// </summary>
+	/// <param name="state">The state to encode.</param>
+	/// <param name="policy">The target distribution over state.GetCommands().</param>
+	/// <param name="value">The game result with respect to the acting team.</param>
+	/// <param name="out">The output array, of size GetRecordSize().</param>
+	static void EncodeRecord(const GameState& state, const std::vector<float>& policy,
+		float value, float* out);
+
+
+	/// <summary>
+	/// The same as the above, but with the state's commands given.
+	/// PRECONDITION: policy.size() == cmds.size()
+	/// </summary>
+	/// <param name="state">The state to encode.</param>
+	/// <param name="cmds">The commands available in the state.</param>
+	/// <param name="policy">The target distribution over cmds.</param>
+	/// <param name="value">The game result with respect to the acting team.</param>
+	/// <param name="out">The output array, of size GetRecordSize().</param>
+	static void EncodeRecord(const GameState& state, const GameCommandArray& cmds,
+		const std::vector<float>& policy, float value, float* out);
+};
+
+
+} // namespace c40kl
@@ -0,0 +1,144 @@
+#include "StateSerialiser.h"
+#include "BinaryStream.h"
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+
+namespace c40kl
+{
+
+
+const uint32_t StateSerialiser::VERSION;
+
+
+//The bytes at the start of the data, identifying the format
+static const char MAGIC[8] = { 'C', '4', '0', 'K', 'L', 'G', 'S', 'T' };
+
+
+//The header at the start of the data (see StateSerialiser)
+struct SerialisedHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t numUnits; // in the unit table
+	uint32_t numStates;
+};
+static_assert(sizeof(SerialisedHeader) == 20, "Header must not be padded.");
+
+
+//The fewest bytes taken by a unit in the table (its name's size,
+// 20 values and 8 flags, as written by BoardState::WriteUnit())
+static const size_t MIN_UNIT_BYTES = 8 + 20 * 4 + 8;
+
+//The fewest bytes taken by a state (as written by GameState::Write(),
+// with 5 values then the board's size, scale and unit count)
+static const size_t MIN_STATE_BYTES = 5 * 4 + 4 + 4 + 8;
+
+
+std::string StateSerialiser::Encode(const std::vector<GameState>& states)
+{
+	const uint32_t maxCount = std::numeric_limits<uint32_t>::max();
+	if (states.size() > maxCount)
+		throw std::runtime_error("Too many states to encode.");
+
+	//Write the states, replacing each unit with its index in the unit
+	// table. Units are found in the table first by address (since related
+	// boards share most of their units) and then by their encoded bytes.
+	std::string tableBytes;
+	uint32_t numTableUnits = 0;
+	std::unordered_map<const Unit*, uint32_t> indexByAddress;
+	std::unordered_map<std::string, uint32_t> indexByBytes;
+
+	auto writeUnitIndex = [&](const BoardState::UnitPtr& pUnit, BinaryWriter& writer)
+	{
+		auto addressIter = indexByAddress.find(pUnit.get());
+		if (addressIter == indexByAddress.end())
+		{
+			BinaryWriter unitWriter;
+			BoardState::WriteUnit(*pUnit, unitWriter);
+
+			auto bytesIter = indexByBytes.find(unitWriter.GetBytes());
+			if (bytesIter == indexByBytes.end())
+			{
+				if (numTableUnits == maxCount)
+					throw std::runtime_error("Too many distinct units to encode.");
+
+				tableBytes += unitWriter.GetBytes();
+				bytesIter = indexByBytes.emplace(unitWriter.GetBytes(), numTableUnits++).first;
+			}
+
+			addressIter = indexByAddress.emplace(pUnit.get(), bytesIter->second).first;
+		}
+
+		writer.Write(addressIter->second);
+	};
+
+	BinaryWriter statesWriter;
+	for (const auto& state : states)
+		state.Write(statesWriter, writeUnitIndex);
+
+	BinaryWriter writer;
+
+	SerialisedHeader header = {};
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.numUnits = numTableUnits;
+	header.numStates = (uint32_t)states.size();
+	writer.Write(header);
+
+	return writer.GetBytes() + tableBytes + statesWriter.GetBytes();
+}
+
+
+std::vector<GameState> StateSerialiser::Decode(const char* data, size_t size)
+{
+	BinaryReader reader(data, size);
+
+	const auto header = reader.Read<SerialisedHeader>();
+	if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+		throw std::runtime_error("Invalid data: not encoded game states.");
+	if (header.version != VERSION)
+		throw std::runtime_error("Invalid data: unsupported game state format version.");
+
+	//Check the counts before allocating anything for them
+	if (header.numUnits > reader.GetNumBytesLeft() / MIN_UNIT_BYTES)
+		throw std::runtime_error("Invalid data: unit table is larger than the data left.");
+
+	std::vector<BoardState::UnitPtr> tableUnits;
+	tableUnits.reserve(header.numUnits);
+	for (uint32_t i = 0; i < header.numUnits; i++)
+		tableUnits.push_back(std::make_shared<const Unit>(BoardState::ReadUnit(reader)));
+
+	if (header.numStates > reader.GetNumBytesLeft() / MIN_STATE_BYTES)
+		throw std::runtime_error("Invalid data: state count is larger than the data left.");
+
+	//Share the table's units, rather than copying them for every board
+	auto readUnitIndex = [&tableUnits](BinaryReader& unitReader)
+	{
+		const uint32_t index = unitReader.Read<uint32_t>();
+		if (index >= tableUnits.size())
+			throw std::runtime_error("Invalid data: bad unit index.");
+		return tableUnits[index];
+	};
+
+	std::vector<GameState> states;
+	states.reserve(header.numStates);
+	for (uint32_t i = 0; i < header.numStates; i++)
+		states.push_back(GameState::Read(reader, readUnitIndex));
+
+	if (reader.GetNumBytesLeft() != 0)
+		throw std::runtime_error("Invalid data: unexpected bytes after the game states.");
+
+	return states;
+}
+
+
+std::vector<GameState> StateSerialiser::Decode(const std::string& bytes)
+{
+	return Decode(bytes.data(), bytes.size());
+}
+
+
+} // namespace c40kl
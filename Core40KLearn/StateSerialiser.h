@@ -0,0 +1,64 @@
+#pragma once
+
+
+#include "GameState.h"
+#include <vector>
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// Converts arrays of game states to and from a compact, versioned
+/// binary format, for moving states between processes or to disk.
+///
+/// Every unit which appears in the states is stored once, in a table
+/// at the start of the data (as written by BoardState::WriteUnit()), and
+/// each state is written by GameState::Write() with every unit replaced
+/// by its index in the table. The layout is:
+///   [header][unit 0]...[unit m-1][state 0]...[state n-1]
+///
+/// NOTE: unlike GameState::Write(), which is meant to be embedded
+/// in other formats (like MCTSNode::Write()), this format identifies
+/// itself and its version, so can be stored on its own.
+/// </summary>
+class C40KL_API StateSerialiser
+{
+public:
+	/// <summary>
+	/// The current version of the format. Data in
+	/// any other version is rejected by Decode().
+	/// </summary>
+	static const uint32_t VERSION = 2;
+
+
+	/// <summary>
+	/// Encode some game states.
+	/// Throws std::runtime_error if there are too many
+	/// states or units to fit in the format.
+	/// </summary>
+	/// <param name="states">The states to encode.</param>
+	/// <returns>The encoded bytes.</returns>
+	static std::string Encode(const std::vector<GameState>& states);
+
+
+	/// <summary>
+	/// Decode game states encoded by Encode(). Units which are the same
+	/// in several states are shared between their boards.
+	/// Throws std::runtime_error if the data is not valid.
+	/// </summary>
+	/// <param name="data">The encoded data.</param>
+	/// <param name="size">The number of bytes of data.</param>
+	/// <returns>The decoded states.</returns>
+	static std::vector<GameState> Decode(const char* data, size_t size);
+
+
+	/// <summary>
+	/// Decode game states encoded by Encode().
+	/// </summary>
+	static std::vector<GameState> Decode(const std::string& bytes);
+};
+
+
+} // namespace c40kl
@@ -0,0 +1,129 @@
+#include "TraceRecorder.h"
+#include <atomic>
+#include <iomanip>
+
+
+namespace c40kl
+{
+
+
+const size_t TraceRecorder::NO_ID;
+
+
+//The IDs given to recorders, starting from 1 (so that
+// zero can mean "no recorder" in the cached buffers.)
+static std::atomic<size_t> nextRecorderId(1);
+
+
+//Each thread's buffer in the recorder it last recorded in
+struct CachedBuffer
+{
+	size_t recorderId;
+	void* pBuffer;
+};
+static thread_local CachedBuffer cachedBuffer = { 0, nullptr };
+
+
+//Get the number of microseconds from start to time
+static double GetMicroseconds(TraceRecorder::Clock::time_point start,
+	TraceRecorder::Clock::time_point time)
+{
+	return std::chrono::duration<double, std::micro>(time - start).count();
+}
+
+
+TraceRecorder::TraceRecorder() :
+	m_RecorderId(nextRecorderId++),
+	m_StartTime(Clock::now())
+{
+	//The creating thread always gets the first row of the timeline
+	m_pBuffers.push_back(std::make_unique<ThreadBuffer>());
+	m_pBuffers.back()->threadId = std::this_thread::get_id();
+}
+
+
+TraceRecorder::~TraceRecorder()
+{
+}
+
+
+void TraceRecorder::AddSpan(const char* name, Clock::time_point begin,
+	Clock::time_point end, size_t id)
+{
+	GetThreadBuffer().spans.push_back(Span{ name, begin, end, id });
+}
+
+
+size_t TraceRecorder::GetNumSpans() const
+{
+	size_t numSpans = 0;
+	for (const auto& pBuffer : m_pBuffers)
+		numSpans += pBuffer->spans.size();
+	return numSpans;
+}
+
+
+void TraceRecorder::Clear()
+{
+	//Keep the buffers, since threads may still have pointers to them
+	for (const auto& pBuffer : m_pBuffers)
+		pBuffer->spans.clear();
+}
+
+
+void TraceRecorder::WriteJson(std::ostream& out) const
+{
+	out << std::fixed << std::setprecision(3);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+	for (size_t i = 0; i < m_pBuffers.size(); i++)
+	{
+		//Name the thread's row in the timeline:
+		out << (i == 0 ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << i
+			<< ",\"args\":{\"name\":\"Thread " << i << "\"}}";
+
+		for (const auto& span : m_pBuffers[i]->spans)
+		{
+			out << ",\n{\"name\":\"" << span.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << i
+				<< ",\"ts\":" << GetMicroseconds(m_StartTime, span.begin)
+				<< ",\"dur\":" << GetMicroseconds(span.begin, span.end);
+
+			if (span.id != NO_ID)
+				out << ",\"args\":{\"id\":" << span.id << '}';
+
+			out << '}';
+		}
+	}
+
+	out << "\n]}\n";
+}
+
+
+TraceRecorder::ThreadBuffer& TraceRecorder::GetThreadBuffer()
+{
+	if (cachedBuffer.recorderId == m_RecorderId)
+		return *static_cast<ThreadBuffer*>(cachedBuffer.pBuffer);
+
+	std::lock_guard<std::mutex> lock(m_BuffersMutex);
+
+	const auto threadId = std::this_thread::get_id();
+	ThreadBuffer* pBuffer = nullptr;
+	for (const auto& pExisting : m_pBuffers)
+	{
+		if (pExisting->threadId == threadId)
+			pBuffer = pExisting.get();
+	}
+
+	if (!pBuffer)
+	{
+		m_pBuffers.push_back(std::make_unique<ThreadBuffer>());
+		pBuffer = m_pBuffers.back().get();
+		pBuffer->threadId = threadId;
+	}
+
+	cachedBuffer = CachedBuffer{ m_RecorderId, pBuffer };
+	return *pBuffer;
+}
+
+
+} // namespace c40kl
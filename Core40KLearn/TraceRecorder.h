@@ -0,0 +1,160 @@
+#pragma once
+
+
+#include "Utility.h"
+#include <chrono>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <ostream>
+#include <boost/noncopyable.hpp>
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// Records timed spans of work done by several threads, so that they can
+/// be written out as a timeline in the Chrome trace event format (which
+/// can be opened in chrome://tracing or in Perfetto.) Each thread records
+/// into its own buffer, so recording only takes a lock the first time a
+/// thread records a span.
+/// NOTE: AddSpan() is safe to call from several threads at once, but
+/// WriteJson() and Clear() must not be called while any thread is recording.
+/// </summary>
+class C40KL_API TraceRecorder :
+	public boost::noncopyable
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+
+	/// <summary>
+	/// The ID to give spans which aren't about any particular item.
+	/// </summary>
+	static const size_t NO_ID = (size_t)-1;
+
+
+	/// <summary>
+	/// Create a new recorder with no spans. Times in the
+	/// trace are measured from when the recorder was created.
+	/// </summary>
+	TraceRecorder();
+
+
+	~TraceRecorder();
+
+
+	/// <summary>
+	/// Record a span of work done by the calling thread.
+	/// </summary>
+	/// <param name="name">
+	/// The name of the span. Only the pointer is kept, so this must be a
+	/// string literal (or otherwise last as long as the recorder.)
+	/// </param>
+	/// <param name="begin">The time the work began.</param>
+	/// <param name="end">The time the work ended.</param>
+	/// <param name="id">The index of the item worked on (such as a game), or NO_ID.</param>
+	void AddSpan(const char* name, Clock::time_point begin, Clock::time_point end,
+		size_t id = NO_ID);
+
+
+	/// <summary>
+	/// Get the number of spans recorded (by all threads) since the
+	/// recorder was created or cleared.
+	/// </summary>
+	size_t GetNumSpans() const;
+
+
+	/// <summary>
+	/// Forget all recorded spans.
+	/// </summary>
+	void Clear();
+
+
+	/// <summary>
+	/// Write the recorded spans as a JSON trace, with one row for
+	/// each thread, in the order the threads first recorded. The
+	/// first row is the thread which created the recorder.
+	/// </summary>
+	/// <param name="out">The stream to write to.</param>
+	void WriteJson(std::ostream& out) const;
+
+
+private:
+	struct Span
+	{
+		const char* name;
+		Clock::time_point begin, end;
+		size_t id;
+	};
+
+
+	struct ThreadBuffer
+	{
+		std::thread::id threadId;
+		std::vector<Span> spans;
+	};
+
+
+	//Get the calling thread's buffer, creating it if need be
+	ThreadBuffer& GetThreadBuffer();
+
+
+private:
+	//Distinguishes this recorder from any others (including
+	// destroyed ones) in each thread's cached buffer pointer.
+	const size_t m_RecorderId;
+
+	const Clock::time_point m_StartTime;
+
+	//One buffer for each thread which has recorded a span. A thread
+	// reuses the buffer of any earlier thread with the same ID (which
+	// must have exited, since IDs are only unique among running threads.)
+	std::vector<std::unique_ptr<ThreadBuffer>> m_pBuffers;
+	std::mutex m_BuffersMutex;
+};
+
+
+/// <summary>
+/// Records a span for the lifetime of the object,
+/// if given a recorder (and does nothing if not.)
+/// </summary>
+class TraceSpan :
+	public boost::noncopyable
+{
+public:
+	/// <summary>
+	/// Begin a span (see TraceRecorder::AddSpan()).
+	/// </summary>
+	/// <param name="pRecorder">The recorder to add the span to, or null to do nothing.</param>
+	/// <param name="name">The name of the span; must be a string literal.</param>
+	/// <param name="id">The index of the item worked on, or TraceRecorder::NO_ID.</param>
+	TraceSpan(TraceRecorder* pRecorder, const char* name, size_t id = TraceRecorder::NO_ID) :
+		m_pRecorder(pRecorder),
+		m_Name(name),
+		m_Id(id)
+	{
+		if (m_pRecorder)
+			m_Begin = TraceRecorder::Clock::now();
+	}
+
+
+	~TraceSpan()
+	{
+		if (m_pRecorder)
+			m_pRecorder->AddSpan(m_Name, m_Begin, TraceRecorder::Clock::now(), m_Id);
+	}
+
+
+private:
+	TraceRecorder* const m_pRecorder;
+	const char* const m_Name;
+	const size_t m_Id;
+	TraceRecorder::Clock::time_point m_Begin;
+};
+
+
+} // namespace c40kl
@@ -0,0 +1,223 @@
+#include "TreeParallelSearch.h"
+#include "SelectRandomly.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+
+namespace c40kl
+{
+
+
+TreeParallelSearch::TreeParallelSearch(float exploratoryParam, int rootTeam, size_t numThreads) :
+	m_TreePolicy(exploratoryParam, rootTeam),
+	m_Team(rootTeam),
+	m_NumThreads(numThreads),
+	m_LastNumSimulations(0),
+	m_LastNumCollisions(0)
+{
+	C40KL_ASSERT_PRECONDITION(numThreads > 0, "Need at least one thread.");
+
+	m_pWorkers = std::make_unique<WorkerPool>(m_NumThreads);
+}
+
+
+TreeParallelSearch::~TreeParallelSearch()
+{
+}
+
+
+size_t TreeParallelSearch::Search(const MCTSNodePtr& pRoot, size_t numSimulations, size_t milliseconds,
+	const StateEvaluator& evaluator)
+{
+	C40KL_ASSERT_PRECONDITION(!pRoot->IsTerminal(), "Cannot search from a finished state.");
+
+	//(Callers choosing the number of simulations from a time budget
+	// may end up with none, but a search should always add something)
+	numSimulations = std::max<size_t>(numSimulations, 1);
+
+	typedef std::chrono::steady_clock Clock;
+	const auto deadline = Clock::now() + std::chrono::milliseconds(milliseconds);
+	auto isOutOfTime = [&]()
+	{
+		return milliseconds > 0 && Clock::now() >= deadline;
+	};
+
+	//Each thread takes the next simulation index before starting it,
+	// so no more than numSimulations are made between them.
+	std::atomic<size_t> nextSimulation(0), numMade(0), numCollisions(0);
+
+	//The first exception thrown by any thread, which stops the others
+	std::atomic<bool> bFailed(false);
+	std::exception_ptr pError;
+	std::mutex errorMutex;
+
+	for (size_t i = 0; i < m_NumThreads; i++)
+	{
+		const uint32_t seed = m_RandEng();
+		m_pWorkers->Post([&, seed]()
+		{
+			std::mt19937 randEng(seed);
+
+			try
+			{
+				for (size_t sim = nextSimulation++; sim < numSimulations && !bFailed; sim = nextSimulation++)
+				{
+					if (sim > 0 && isOutOfTime())
+						break;
+
+					//If another thread is expanding our leaf, try again
+					// (its virtual loss steers us elsewhere next time)
+					bool bDone = false;
+					while (!bDone && !bFailed)
+					{
+						bDone = Simulate(pRoot.get(), randEng, evaluator);
+						if (!bDone)
+						{
+							numCollisions++;
+							std::this_thread::yield();
+						}
+					}
+
+					if (bDone)
+						numMade++;
+				}
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(errorMutex);
+				if (!pError)
+					pError = std::current_exception();
+				bFailed = true;
+			}
+		});
+	}
+
+	m_pWorkers->Wait();
+
+	m_LastNumSimulations = numMade;
+	m_LastNumCollisions = numCollisions;
+
+	if (pError)
+		std::rethrow_exception(pError);
+
+	return m_LastNumSimulations;
+}
+
+
+void TreeParallelSearch::SetSeed(uint32_t seed)
+{
+	m_RandEng.seed(seed);
+}
+
+
+bool TreeParallelSearch::Simulate(MCTSNode* pRoot, std::mt19937& randEng, const StateEvaluator& evaluator) const
+{
+	//The nodes given virtual losses on the way down. (The root
+	// isn't, since it is never chosen between other nodes.)
+	std::vector<MCTSNode*> path;
+	auto removeVirtualLosses = [&path]()
+	{
+		for (MCTSNode* pNode : path)
+			pNode->RemoveVirtualLoss();
+	};
+
+	//Once we have claimed a leaf, we must give up the claim (and our
+	// virtual losses) if evaluating or expanding it fails, or the leaf
+	// would never be expanded, and every later search would keep
+	// colliding with it.
+	auto abandonLeaf = [&removeVirtualLosses](MCTSNode* pLeaf)
+	{
+		pLeaf->CancelExpansion();
+		removeVirtualLosses();
+	};
+
+	MCTSNode* pNode = pRoot;
+	while (!pNode->IsTerminal())
+	{
+		if (pNode->IsLeaf())
+		{
+			//If another thread got here first, back off. (This includes
+			// the case where it has just finished expanding the node.)
+			if (!pNode->ClaimExpansion())
+			{
+				removeVirtualLosses();
+				return false;
+			}
+
+			//Nodes with only one action need no evaluation, so they
+			// are expanded straight away, and we carry on down:
+			bool bSingleAction = false;
+			try
+			{
+				bSingleAction = (pNode->GetNumActions() == 1);
+				if (bSingleAction)
+					pNode->Expand({ 1.0f });
+			}
+			catch (...)
+			{
+				abandonLeaf(pNode);
+				throw;
+			}
+
+			if (!bSingleAction)
+				break;
+		}
+
+		//Choose the action which maximises UCB1, and a random result:
+		const size_t actionIdx = m_TreePolicy.ActionArgMax(*pNode);
+		const auto& children = pNode->GetStateResults(actionIdx);
+		const size_t resultIdx = (children.size() > 1)
+			? SelectRandomly(randEng, pNode->GetStateResultDistribution(actionIdx)) : 0;
+
+		C40KL_ASSERT_INVARIANT(resultIdx < children.size(),
+			"SelectRandomly must return valid index.");
+
+		pNode = children[resultIdx].get();
+		pNode->AddVirtualLoss();
+		path.push_back(pNode);
+	}
+
+	float value = 0.0f;
+	if (pNode->IsTerminal())
+	{
+		value = (float)pNode->GetState().GetGameValue(m_Team);
+	}
+	else
+	{
+		std::vector<float> values;
+		std::vector<std::vector<float>> policies;
+		try
+		{
+			evaluator({ pNode->GetState() }, values, policies);
+
+			if (values.size() != 1 || policies.size() != 1
+				|| policies.front().size() != pNode->GetNumActions())
+			{
+				throw std::runtime_error("Evaluator must give one value, and a policy over the leaf's actions.");
+			}
+
+			pNode->Expand(policies.front());
+		}
+		catch (...)
+		{
+			abandonLeaf(pNode);
+			throw;
+		}
+
+		//Values are given with respect to the acting team
+		value = (pNode->GetState().GetActingTeam() == m_Team) ? values.front() : -values.front();
+	}
+
+	pNode->AddValueStatistic(value);
+	removeVirtualLosses();
+	return true;
+}
+
+
+} // namespace c40kl
@@ -0,0 +1,130 @@
+#pragma once
+
+
+#include "MCTSNode.h"
+#include "UCB1PolicyStrategy.h"
+#include "SelfPlayManager.h"
+#include <memory>
+#include <random>
+#include <boost/noncopyable.hpp>
+
+
+namespace c40kl
+{
+
+
+class WorkerPool;
+
+
+/// <summary>
+/// Searches a single MCTS tree with several threads at once (so-called
+/// "tree parallelisation"), so that one game's decision can use every
+/// core, e.g. when an AI is playing against a human. Each thread repeatedly
+/// descends the shared tree with UCB1, evaluates and expands the leaf it
+/// reaches, and backpropagates the leaf's value, without any locks:
+/// - The node statistics are updated atomically (see MCTSNode).
+/// - Each node on a thread's path is given a virtual loss until the
+///   leaf's value arrives (see MCTSNode::AddVirtualLoss()), so that the
+///   other threads spread out over the tree rather than following it.
+/// - Only the thread which claims a leaf expands it; any other thread
+///   reaching it meanwhile gives up its path and descends again (this
+///   is counted as a "collision".)
+/// Nodes with a single action are expanded as they are reached, as in
+/// SelfPlayManager. The search adds to whatever statistics the tree
+/// already has, so it can be mixed with searches by other means.
+/// </summary>
+class C40KL_API TreeParallelSearch :
+	public boost::noncopyable
+{
+public:
+	/// <summary>
+	/// Create a new search.
+	/// </summary>
+	/// <param name="exploratoryParam">The UCB1 exploration parameter (see UCB1PolicyStrategy.)</param>
+	/// <param name="rootTeam">The team which the values added to the tree are with respect to.</param>
+	/// <param name="numThreads">The number of threads to search with. Must be > 0.</param>
+	TreeParallelSearch(float exploratoryParam, int rootTeam, size_t numThreads);
+
+
+	~TreeParallelSearch();
+
+
+	/// <summary>
+	/// Search the tree from the given root until the given number of
+	/// simulations have been made, or the time limit passes. At least
+	/// one simulation is made, even if numSimulations is zero or the
+	/// simulation takes longer than the time limit. Throws whatever
+	/// the evaluator throws (once every thread has stopped), or
+	/// std::runtime_error if it doesn't give one value and one policy
+	/// over the leaf's actions.
+	/// PRECONDITION: !pRoot->IsTerminal(), and no other thread is using the
+	/// tree or this search.
+	/// </summary>
+	/// <param name="pRoot">The root of the tree to search.</param>
+	/// <param name="numSimulations">The number of leaf values to add to the tree.</param>
+	/// <param name="milliseconds">The time limit, or zero for no time limit.</param>
+	/// <param name="evaluator">
+	/// The function to compute the value estimate and prior policy of each leaf,
+	/// which is called with one state at a time, from all of the threads at once.
+	/// </param>
+	/// <returns>The number of simulations made.</returns>
+	size_t Search(const MCTSNodePtr& pRoot, size_t numSimulations, size_t milliseconds,
+		const StateEvaluator& evaluator);
+
+
+	/// <summary>
+	/// Reseed the random number generator which seeds each thread's
+	/// generator (which chooses the outcomes of actions) at the start
+	/// of each search.
+	/// </summary>
+	void SetSeed(uint32_t seed);
+
+
+	inline size_t GetNumThreads() const
+	{
+		return m_NumThreads;
+	}
+
+
+	/// <summary>
+	/// Get the number of simulations made by the last call to Search().
+	/// </summary>
+	inline size_t GetLastNumSimulations() const
+	{
+		return m_LastNumSimulations;
+	}
+
+
+	/// <summary>
+	/// Get the number of times a thread in the last call to Search()
+	/// reached a leaf which another thread was expanding, so had to
+	/// descend again.
+	/// </summary>
+	inline size_t GetLastNumCollisions() const
+	{
+		return m_LastNumCollisions;
+	}
+
+
+private:
+	/// <summary>
+	/// Descend from the root to a leaf, evaluate and expand it, and
+	/// backpropagate its value. Returns false if the leaf was being
+	/// expanded by another thread, in which case nothing is changed.
+	/// </summary>
+	bool Simulate(MCTSNode* pRoot, std::mt19937& randEng, const StateEvaluator& evaluator) const;
+
+
+private:
+	const UCB1PolicyStrategy m_TreePolicy;
+	const int m_Team;
+	const size_t m_NumThreads;
+	std::mt19937 m_RandEng;
+	size_t m_LastNumSimulations, m_LastNumCollisions;
+
+	//The threads which search, kept between searches
+	std::unique_ptr<WorkerPool> m_pWorkers;
+};
+
+
+} // namespace c40kl
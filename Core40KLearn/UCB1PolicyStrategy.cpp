@@ -39,6 +39,7 @@ size_t UCB1PolicyStrategy::ActionArgMax(const MCTSNode& node) const
 	const auto priors = node.GetActionPriorDistribution();
 	const auto actionVals = node.GetActionValueEstimates();
 	const auto actionVisitCounts = node.GetActionVisitCounts();
+	const auto actionVirtualLosses = node.GetActionVirtualLosses();
 
 	const float teamMultiplier = (curTeam == m_Team) ? 1.0f : (-1.0f);
 
@@ -48,9 +49,11 @@ size_t UCB1PolicyStrategy::ActionArgMax(const MCTSNode& node) const
 
 	const size_t n = priors.size();
 
-	//Determine the total number of visits:
+	//Determine the total number of visits (counting the
+	// visits of other threads which are still in progress):
 	const size_t totalVisits = std::accumulate(actionVisitCounts.begin(),
-		actionVisitCounts.end(), 0U);
+		actionVisitCounts.end(), 0U) + std::accumulate(actionVirtualLosses.begin(),
+		actionVirtualLosses.end(), 0U);
 
 	//Note: if it's the case that we have never visited this
 	// node, then just select straight from the prior. To do
@@ -62,9 +65,21 @@ size_t UCB1PolicyStrategy::ActionArgMax(const MCTSNode& node) const
 
 	for (size_t i = 0; i < n; i++)
 	{
-		ucbValues[i] = actionVals[i] * teamMultiplier
-			+ m_ExploratoryParam * priors[i] * std::sqrtf(
-				logVisits / (1.0f + (float)actionVisitCounts[i])
+		float value = actionVals[i] * teamMultiplier;
+		float visits = (float)actionVisitCounts[i];
+
+		//Count each visit in progress (see MCTSNode::AddVirtualLoss())
+		// as a loss for the acting team, until its value arrives:
+		if (actionVirtualLosses[i] > 0)
+		{
+			const float virtualLosses = (float)actionVirtualLosses[i];
+			value = (value * visits - virtualLosses) / (visits + virtualLosses);
+			visits += virtualLosses;
+		}
+
+		ucbValues[i] = value
+			+ m_ExploratoryParam * priors[i] * std::sqrt(
+				logVisits / (1.0f + visits)
 			);
 	}
 
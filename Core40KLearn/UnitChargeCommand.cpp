@@ -5,6 +5,7 @@
 #include "OverwatchCommand.h"
 #include <sstream>
 #include <algorithm>
+#include <cmath>
 
 
 namespace c40kl
@@ -261,7 +262,7 @@ void UnitChargeCommand::ApplyChargeCmd(const GameState& state, float probOfCurre
 	const float distance = board.GetDistance(m_Source, m_Target);
 
 	//The minimum dice roll to succeed:
-	const int minDiceRoll = (int)ceil(distance);
+	const int minDiceRoll = (int)std::ceil(distance);
 
 	//Sum up the probability that we fail the charge:
 	float pFail = 0.0f;
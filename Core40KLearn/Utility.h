@@ -3,22 +3,30 @@
 
 #include <cassert>
 #include <exception>
+#include <stdexcept>
 #include <vector>
 #include <string>
 
 
+#ifdef _MSC_VER
 //We are using the same compiler version for all projects
 // so disable the warning about using STL variables in
 // exported classes.
 #pragma warning(disable:4251)
 #pragma warning(disable:4275)
+#endif
 
 
+#ifdef _WIN32
 #ifdef CORE_40KLEARN_EXPORTS
 #define C40KL_API __declspec(dllexport)
 #else
 #define C40KL_API __declspec(dllimport)
 #endif
+#else
+//Everything is exported from shared libraries by default
+#define C40KL_API
+#endif
 
 
 #ifdef _DEBUG
@@ -0,0 +1,125 @@
+#pragma once
+
+
+#include <condition_variable>
+#include <mutex>
+#include <boost/noncopyable.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// A fixed set of threads which runs batches of jobs, and stays alive
+/// between batches (a boost::asio::thread_pool can't be reused once it
+/// has been joined.) Keeping the same threads means that per-thread state,
+/// such as each thread's buffer in a TraceRecorder, lasts between batches,
+/// and that threads aren't created for every batch.
+/// NOTE: Jobs must not throw. Only one thread may use Post() and Wait() at
+/// a time, but Run() may be called from several threads at once. Neither
+/// may be called from a job, since it would wait for its own thread.
+/// </summary>
+class WorkerPool :
+	public boost::noncopyable
+{
+public:
+	explicit WorkerPool(size_t numThreads) :
+		m_NumThreads(numThreads),
+		m_Pool(numThreads),
+		m_Work(boost::asio::make_work_guard(m_Pool)),
+		m_NumPending(0)
+	{
+	}
+
+
+	~WorkerPool()
+	{
+		m_Work.reset();
+		m_Pool.join();
+	}
+
+
+	size_t GetNumThreads() const
+	{
+		return m_NumThreads;
+	}
+
+
+	/// <summary>
+	/// Run job(i) for each i in [0, numJobs) on the threads, and wait for
+	/// those jobs (and no others) to finish.
+	/// </summary>
+	template<typename Job_t>
+	void Run(size_t numJobs, const Job_t& job)
+	{
+		std::mutex mutex;
+		std::condition_variable finished;
+		size_t numLeft = numJobs;
+
+		for (size_t i = 0; i < numJobs; i++)
+		{
+			boost::asio::post(m_Pool, [&, i]()
+			{
+				job(i);
+
+				//(Notified under the lock, so the waiting thread can't
+				// return and destroy the condition before this is done)
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--numLeft == 0)
+					finished.notify_all();
+			});
+		}
+
+		std::unique_lock<std::mutex> lock(mutex);
+		finished.wait(lock, [&numLeft]() { return numLeft == 0; });
+	}
+
+
+	/// <summary>
+	/// Start running a job on one of the threads.
+	/// </summary>
+	template<typename Job_t>
+	void Post(Job_t job)
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_NumPending++;
+		}
+
+		boost::asio::post(m_Pool, [this, job]()
+		{
+			job();
+
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			if (--m_NumPending == 0)
+				m_Finished.notify_all();
+		});
+	}
+
+
+	/// <summary>
+	/// Wait for every job posted so far to finish.
+	/// </summary>
+	void Wait()
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_Finished.wait(lock, [this]() { return m_NumPending == 0; });
+	}
+
+
+private:
+	const size_t m_NumThreads;
+	boost::asio::thread_pool m_Pool;
+	boost::asio::executor_work_guard<boost::asio::thread_pool::executor_type> m_Work;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_Finished;
+	size_t m_NumPending;
+};
+
+
+} // namespace c40kl
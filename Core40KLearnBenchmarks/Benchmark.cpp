@@ -0,0 +1,139 @@
+#include "Benchmark.h"
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <iomanip>
+
+
+namespace c40kl
+{
+
+
+static volatile size_t keptValue = 0;
+
+
+//Write a string as a JSON string literal
+static void WriteJsonString(const std::string& str, std::ostream& out)
+{
+	out << '"';
+	for (char c : str)
+	{
+		switch (c)
+		{
+		case '"': out << "\\\""; break;
+		case '\\': out << "\\\\"; break;
+		case '\n': out << "\\n"; break;
+		case '\t': out << "\\t"; break;
+		default:
+			if ((unsigned char)c < 0x20)
+				out << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec;
+			else
+				out << c;
+		}
+	}
+	out << '"';
+}
+
+
+//Get a description of the compiler this was built with
+static std::string GetCompiler()
+{
+#if defined(__clang__)
+	return "clang " __clang_version__;
+#elif defined(__GNUC__)
+	return "gcc " __VERSION__;
+#elif defined(_MSC_VER)
+	return "msvc " + std::to_string(_MSC_VER);
+#else
+	return "unknown";
+#endif
+}
+
+
+void BenchmarkSuite::Add(const std::string& name, BenchmarkFunction function)
+{
+	m_Benchmarks.emplace_back(name, std::move(function));
+}
+
+
+std::vector<BenchmarkResult> BenchmarkSuite::Run(const std::string& filter,
+	double minSeconds, std::ostream& log) const
+{
+	std::vector<BenchmarkResult> results;
+
+	for (const auto& benchmark : m_Benchmarks)
+	{
+		if (benchmark.first.find(filter) == std::string::npos)
+			continue;
+
+		BenchmarkResult result{ benchmark.first, 0, 0, 0.0 };
+		for (size_t iterations = 1; ; iterations *= 2)
+		{
+			const auto start = std::chrono::steady_clock::now();
+			const size_t items = benchmark.second(iterations);
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+			result.iterations = iterations;
+			result.items = items;
+			result.seconds = elapsed.count();
+
+			if (result.seconds >= minSeconds)
+				break;
+		}
+
+		log << result.name << ": " << (1.0e9 * result.seconds / result.iterations)
+			<< " ns/iteration, " << (result.items / result.seconds) << " items/s" << std::endl;
+
+		results.push_back(result);
+	}
+
+	return results;
+}
+
+
+void BenchmarkSuite::WriteJson(const std::vector<BenchmarkResult>& results, std::ostream& out)
+{
+	char date[32] = "";
+	const std::time_t now = std::time(nullptr);
+	std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+	out << std::setprecision(9);
+	out << "{\n  \"context\": {\n";
+	out << "    \"date\": \"" << date << "\",\n";
+	out << "    \"compiler\": ";
+	WriteJsonString(GetCompiler(), out);
+	out << ",\n";
+#ifdef NDEBUG
+	out << "    \"build_type\": \"release\",\n";
+#else
+	out << "    \"build_type\": \"debug\",\n";
+#endif
+	out << "    \"hardware_threads\": " << std::thread::hardware_concurrency() << '\n';
+	out << "  },\n  \"benchmarks\": [";
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const auto& result = results[i];
+
+		out << (i == 0 ? "\n" : ",\n") << "    {\n      \"name\": ";
+		WriteJsonString(result.name, out);
+		out << ",\n      \"iterations\": " << result.iterations;
+		out << ",\n      \"items\": " << result.items;
+		out << ",\n      \"seconds\": " << result.seconds;
+		out << ",\n      \"ns_per_iteration\": " << (1.0e9 * result.seconds / result.iterations);
+		out << ",\n      \"iterations_per_second\": " << (result.iterations / result.seconds);
+		out << ",\n      \"items_per_second\": " << (result.items / result.seconds);
+		out << "\n    }";
+	}
+
+	out << "\n  ]\n}\n";
+}
+
+
+void BenchmarkSuite::KeepValue(size_t value)
+{
+	keptValue = keptValue + value;
+}
+
+
+} // namespace c40kl
@@ -0,0 +1,83 @@
+#pragma once
+
+
+#include <string>
+#include <vector>
+#include <functional>
+#include <ostream>
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// A function which runs the code being measured the given number
+/// of times, and returns the number of 'items' it processed (such as
+/// commands generated or leaves evaluated) so that a rate can be
+/// reported alongside the time per iteration. Any setup should be
+/// done before the function is created, so that it isn't timed.
+/// </summary>
+typedef std::function<size_t(size_t iterations)> BenchmarkFunction;
+
+
+/// <summary>
+/// The measurements from running one benchmark.
+/// </summary>
+struct BenchmarkResult
+{
+	std::string name;
+	size_t iterations;
+	size_t items;
+	double seconds;
+};
+
+
+/// <summary>
+/// A list of named benchmarks, which can be run (each for at least
+/// a minimum length of time) and have their results written as JSON.
+/// </summary>
+class BenchmarkSuite
+{
+public:
+	/// <summary>
+	/// Add a benchmark to the suite.
+	/// </summary>
+	/// <param name="name">The benchmark's name, which should be unique.</param>
+	/// <param name="function">The function to time.</param>
+	void Add(const std::string& name, BenchmarkFunction function);
+
+
+	/// <summary>
+	/// Run every benchmark whose name contains the filter. Each is run
+	/// with a doubling number of iterations until a run takes at least
+	/// the minimum time, and the results of that run are kept.
+	/// </summary>
+	/// <param name="filter">Only benchmarks whose names contain this are run.</param>
+	/// <param name="minSeconds">The minimum time to measure each benchmark over.</param>
+	/// <param name="log">Progress is written here as each benchmark finishes.</param>
+	/// <returns>The results, in the order the benchmarks were added.</returns>
+	std::vector<BenchmarkResult> Run(const std::string& filter, double minSeconds,
+		std::ostream& log) const;
+
+
+	/// <summary>
+	/// Write a set of results as a JSON object, with a "context" object
+	/// describing the build and machine, and a "benchmarks" array with
+	/// one object per result.
+	/// </summary>
+	static void WriteJson(const std::vector<BenchmarkResult>& results, std::ostream& out);
+
+
+	/// <summary>
+	/// Make sure the compiler can't optimise away the computation of
+	/// a value, by storing it somewhere it can't see through.
+	/// </summary>
+	static void KeepValue(size_t value);
+
+private:
+	std::vector<std::pair<std::string, BenchmarkFunction>> m_Benchmarks;
+};
+
+
+} // namespace c40kl
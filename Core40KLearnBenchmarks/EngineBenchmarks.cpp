@@ -0,0 +1,224 @@
+#include "EngineBenchmarks.h"
+#include <stdexcept>
+
+
+namespace c40kl
+{
+
+
+static const Phase allPhases[] = { Phase::MOVEMENT, Phase::SHOOTING, Phase::CHARGE, Phase::FIGHT };
+
+
+static std::string GetPhaseName(Phase phase)
+{
+	switch (phase)
+	{
+	case Phase::MOVEMENT: return "Movement";
+	case Phase::SHOOTING: return "Shooting";
+	case Phase::CHARGE: return "Charge";
+	case Phase::FIGHT: return "Fight";
+	default: return "Unknown";
+	}
+}
+
+
+//The same position as a scenario, but in a different phase
+static GameState InPhase(const Scenario& scenario, Phase phase)
+{
+	return GameState(0, 0, phase, scenario.state.GetBoardState(),
+		scenario.state.GetTurnLimit());
+}
+
+
+//Get the unit orders available in a state, optionally only
+// those from one square to another.
+static GameCommandArray GetUnitOrders(const GameState& state,
+	const Position* pSource = nullptr, const Position* pTarget = nullptr)
+{
+	GameCommandArray orders;
+	for (const auto& pCmd : state.GetCommands())
+	{
+		if (auto pOrder = dynamic_cast<const IUnitOrderCommand*>(pCmd.get()))
+		{
+			if ((pSource == nullptr || pOrder->GetSourcePosition() == *pSource)
+				&& (pTarget == nullptr || pOrder->GetTargetPosition() == *pTarget))
+			{
+				orders.push_back(pCmd);
+			}
+		}
+	}
+
+	if (orders.empty())
+		throw std::runtime_error("Benchmark position has no unit orders to apply.");
+
+	return orders;
+}
+
+
+//Get the single end phase command available in a state
+static GameCommandArray GetEndPhase(const GameState& state)
+{
+	GameCommandArray cmds;
+	for (const auto& pCmd : state.GetCommands())
+	{
+		if (pCmd->GetType() == CommandType::END_PHASE)
+			cmds.push_back(pCmd);
+	}
+	return cmds;
+}
+
+
+//A benchmark which generates the commands for a state
+static BenchmarkFunction MeasureGetCommands(const GameState& state)
+{
+	return [state](size_t iterations)
+	{
+		size_t numCommands = 0;
+		for (size_t i = 0; i < iterations; i++)
+			numCommands += state.GetCommands().size();
+		return numCommands;
+	};
+}
+
+
+//A benchmark which applies each of the given commands to a state,
+// counting each command applied as an item.
+static BenchmarkFunction MeasureApply(const GameState& state, const GameCommandArray& cmds)
+{
+	return [state, cmds](size_t iterations)
+	{
+		std::vector<GameState> results;
+		std::vector<float> probs;
+		for (size_t i = 0; i < iterations; i++)
+		{
+			for (const auto& pCmd : cmds)
+			{
+				results.clear();
+				probs.clear();
+				pCmd->Apply(state, results, probs);
+				BenchmarkSuite::KeepValue(results.size());
+			}
+		}
+		return iterations * cmds.size();
+	};
+}
+
+
+//Where the charging unit starts, and the square it charges into
+static const Position chargeSource(10, 2), chargeTarget(10, 8);
+
+
+//A position where a unit can charge into a square surrounded by
+// enemies, all of which will fire overwatch at it.
+static GameState MakeOverwatchPosition(const Scenario& scenario, size_t numOverwatchers)
+{
+	//The squares around the target, except those facing the charger
+	static const Position surroundingSquares[] = {
+		Position(10, 9), Position(9, 8), Position(11, 8), Position(9, 9), Position(11, 9)
+	};
+
+	if (numOverwatchers > sizeof(surroundingSquares) / sizeof(surroundingSquares[0]))
+		throw std::runtime_error("Too many overwatchers for the benchmark position.");
+
+	BoardState board(scenario.state.GetBoardState().GetSize(),
+		scenario.state.GetBoardState().GetScale());
+
+	Unit charger = FindUnit(scenario, "Nobz with Power Klaws");
+	charger.rg_range = 0;
+	board.SetUnitOnSquare(chargeSource, charger, 0);
+
+	const Unit& shooter = FindUnit(scenario, "Tactical Space Marines");
+	for (size_t i = 0; i < numOverwatchers; i++)
+		board.SetUnitOnSquare(surroundingSquares[i], shooter, 1);
+
+	return GameState(0, 0, Phase::CHARGE, board);
+}
+
+
+//A position with two units in combat
+static GameState MakeFightPosition(const Scenario& scenario)
+{
+	BoardState board(scenario.state.GetBoardState().GetSize(),
+		scenario.state.GetBoardState().GetScale());
+
+	board.SetUnitOnSquare(Position(10, 10), FindUnit(scenario, "Nobz with Power Klaws"), 0);
+	board.SetUnitOnSquare(Position(10, 11), FindUnit(scenario, "Tactical Space Marines"), 1);
+	board.SetUnitOnSquare(Position(11, 11), FindUnit(scenario, "Tactical Space Marines"), 1);
+
+	return GameState(0, 0, Phase::FIGHT, board);
+}
+
+
+//A position at the end of the fight phase where every unit
+// has lost models, so must take a morale check.
+static GameState MakeMoralePosition(const Scenario& scenario)
+{
+	const BoardState& original = scenario.state.GetBoardState();
+	BoardState board(original.GetSize(), original.GetScale());
+
+	for (int team = 0; team < 2; team++)
+	{
+		const auto positions = original.GetAllUnits(team);
+		auto stats = original.GetAllUnitStats(team);
+		for (size_t i = 0; i < positions.size(); i++)
+		{
+			if (stats[i].count > 1)
+			{
+				stats[i].modelsLostThisPhase = 1;
+				stats[i].count--;
+				stats[i].total_w -= stats[i].w;
+			}
+			board.SetUnitOnSquare(positions[i], stats[i], team);
+		}
+	}
+
+	return GameState(0, 0, Phase::FIGHT, board);
+}
+
+
+void AddEngineBenchmarks(BenchmarkSuite& suite, const std::vector<Scenario>& scenarios)
+{
+	for (const auto& scenario : scenarios)
+	{
+		for (Phase phase : allPhases)
+		{
+			suite.Add("GetCommands/" + GetPhaseName(phase) + "/" + scenario.name,
+				MeasureGetCommands(InPhase(scenario, phase)));
+		}
+	}
+
+	for (const auto& scenario : scenarios)
+	{
+		const GameState movement = InPhase(scenario, Phase::MOVEMENT);
+		suite.Add("Apply/Move/" + scenario.name,
+			MeasureApply(movement, GetUnitOrders(movement)));
+
+		const GameState shooting = InPhase(scenario, Phase::SHOOTING);
+		suite.Add("Apply/Shoot/" + scenario.name,
+			MeasureApply(shooting, GetUnitOrders(shooting)));
+	}
+
+	//The rest of the positions are set up specially, using the units from the first map
+	const Scenario& scenario = scenarios.front();
+	for (size_t numOverwatchers : { 1, 3, 5 })
+	{
+		const GameState charge = MakeOverwatchPosition(scenario, numOverwatchers);
+		suite.Add("Apply/Charge/" + std::to_string(numOverwatchers) + "_overwatchers",
+			MeasureApply(charge, GetUnitOrders(charge, &chargeSource, &chargeTarget)));
+	}
+
+	const GameState fight = MakeFightPosition(scenario);
+	suite.Add("Apply/Fight", MeasureApply(fight, GetUnitOrders(fight)));
+
+	for (Phase phase : allPhases)
+	{
+		const GameState state = InPhase(scenario, phase);
+		suite.Add("Apply/EndPhase/" + GetPhaseName(phase), MeasureApply(state, GetEndPhase(state)));
+	}
+
+	const GameState morale = MakeMoralePosition(scenario);
+	suite.Add("Apply/EndPhase/MoraleChecks", MeasureApply(morale, GetEndPhase(morale)));
+}
+
+
+} // namespace c40kl
@@ -0,0 +1,21 @@
+#pragma once
+
+
+#include "Benchmark.h"
+#include "Scenario.h"
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// Add benchmarks of the game rules: generating the commands available
+/// in each phase, and applying each type of command.
+/// </summary>
+/// <param name="suite">The suite to add the benchmarks to.</param>
+/// <param name="scenarios">The maps to generate and apply commands on.</param>
+void AddEngineBenchmarks(BenchmarkSuite& suite, const std::vector<Scenario>& scenarios);
+
+
+} // namespace c40kl
@@ -0,0 +1,119 @@
+#include "EngineBenchmarks.h"
+#include "SearchBenchmarks.h"
+#include <ScenarioLoader.h>
+#include <iostream>
+#include <fstream>
+#include <stdexcept>
+#include <algorithm>
+using namespace c40kl;
+
+
+//The board used by pyapp (see pyapp/model)
+static const int boardSize = 24;
+static const float boardScale = 1.0f;
+static const int turnLimit = 6;
+
+
+static const char* const usage =
+	"Usage: Core40KLearnBenchmarks [options]\n"
+	"Runs benchmarks of the game engine and search, and writes the results as JSON.\n"
+	"Options:\n"
+	"  --data <dir>        The folder containing unit_stats.csv and map_1..3.csv (default: UnitData)\n"
+	"  --filter <text>     Only run benchmarks whose names contain this\n"
+	"  --min_time <secs>   The minimum time to measure each benchmark over (default: 0.5)\n"
+	"  --threads <n>       The number of threads for self-play (default: 3)\n"
+	"  --output <file>     Write the JSON here instead of to standard output\n";
+
+
+const Unit& c40kl::FindUnit(const Scenario& scenario, const std::string& name)
+{
+	auto iter = std::find_if(scenario.units.begin(), scenario.units.end(),
+		[&name](const Unit& unit) { return unit.name == name; });
+
+	if (iter == scenario.units.end())
+		throw std::runtime_error("No unit called \"" + name + "\" in the unit data.");
+
+	return *iter;
+}
+
+
+int main(int argc, char* argv[])
+{
+	std::string dataDir = "UnitData", filter, outputFilename;
+	double minSeconds = 0.5;
+	size_t numThreads = 3;
+
+	try
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string arg = argv[i];
+			if (arg == "--help")
+			{
+				std::cout << usage;
+				return 0;
+			}
+			else if (i + 1 >= argc)
+			{
+				throw std::runtime_error("Unknown option or missing value: " + arg);
+			}
+
+			const std::string value = argv[++i];
+			if (arg == "--data")
+				dataDir = value;
+			else if (arg == "--filter")
+				filter = value;
+			else if (arg == "--min_time")
+				minSeconds = std::stod(value);
+			else if (arg == "--threads")
+				numThreads = (size_t)std::max(1, std::stoi(value));
+			else if (arg == "--output")
+				outputFilename = value;
+			else
+				throw std::runtime_error("Unknown option: " + arg);
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << '\n' << usage;
+		return 1;
+	}
+
+	try
+	{
+		const auto units = ScenarioLoader::LoadUnits(dataDir + "/unit_stats.csv");
+
+		std::vector<Scenario> scenarios;
+		for (const char* name : { "map_1", "map_2", "map_3" })
+		{
+			const GameState state = ScenarioLoader::LoadGameState(units,
+				dataDir + "/" + name + ".csv", boardSize, boardScale, turnLimit);
+			scenarios.push_back(Scenario{ name, state, units });
+		}
+
+		BenchmarkSuite suite;
+		AddEngineBenchmarks(suite, scenarios);
+		AddSearchBenchmarks(suite, scenarios, numThreads);
+
+		const auto results = suite.Run(filter, minSeconds, std::cerr);
+
+		if (outputFilename.empty())
+		{
+			BenchmarkSuite::WriteJson(results, std::cout);
+		}
+		else
+		{
+			std::ofstream output(outputFilename);
+			BenchmarkSuite::WriteJson(results, output);
+			if (!output)
+				throw std::runtime_error("Could not write " + outputFilename + ".");
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
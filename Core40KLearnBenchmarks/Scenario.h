@@ -0,0 +1,33 @@
+#pragma once
+
+
+#include <GameState.h>
+#include <string>
+#include <vector>
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// A named starting position to run benchmarks on, such as one of
+/// the maps in UnitData/. The unit statistics are kept too, so that
+/// benchmarks can set up their own positions with the same units.
+/// </summary>
+struct Scenario
+{
+	std::string name;
+	GameState state;
+	std::vector<Unit> units;
+};
+
+
+/// <summary>
+/// Find a unit by name in a scenario's unit statistics.
+/// Throws std::runtime_error if there is no such unit.
+/// </summary>
+const Unit& FindUnit(const Scenario& scenario, const std::string& name);
+
+
+} // namespace c40kl
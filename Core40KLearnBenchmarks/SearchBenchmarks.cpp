@@ -0,0 +1,133 @@
+#include "SearchBenchmarks.h"
+#include <MCTSNode.h>
+#include <UCB1PolicyStrategy.h>
+#include <SelfPlayManager.h>
+#include <cmath>
+#include <memory>
+
+
+namespace c40kl
+{
+
+
+//The search settings used by Scripts/play.py by default
+static const float ucb1Parameter = 2.0f * std::sqrt(2.0f);
+static const float policyTemperature = 0.5f;
+static const size_t numSimulations = 100;
+static const size_t numGames = 20;
+
+
+//A uniform prior over the commands of a state
+static std::vector<float> GetUniformPolicy(const GameState& state)
+{
+	const size_t numActions = state.GetCommands().size();
+	return std::vector<float>(numActions, 1.0f / numActions);
+}
+
+
+//A benchmark which creates and expands a root node
+static BenchmarkFunction MeasureExpand(const GameState& state)
+{
+	const auto prior = GetUniformPolicy(state);
+	return [state, prior](size_t iterations)
+	{
+		size_t numChildren = 0;
+		for (size_t i = 0; i < iterations; i++)
+		{
+			auto pRoot = MCTSNode::CreateRootNode(state);
+			pRoot->Expand(prior);
+			for (size_t j = 0; j < pRoot->GetNumActions(); j++)
+				numChildren += pRoot->GetNumResultingStates(j);
+		}
+		return numChildren;
+	};
+}
+
+
+//A benchmark which picks the best action from an expanded root
+// node, whose actions have been visited different numbers of times.
+static BenchmarkFunction MeasureActionArgMax(const GameState& state)
+{
+	auto pRoot = MCTSNode::CreateRootNode(state);
+	pRoot->Expand(GetUniformPolicy(state));
+
+	for (size_t i = 0; i < pRoot->GetNumActions(); i++)
+	{
+		const auto& results = pRoot->GetStateResults(i);
+		for (size_t j = 0; j < i % 5; j++)
+		{
+			const float value = (float)((i * 7 + j * 3) % 11) / 5.0f - 1.0f;
+			results[j % results.size()]->AddValueStatistic(value);
+		}
+	}
+
+	const UCB1PolicyStrategy strategy(ucb1Parameter, state.GetActingTeam());
+
+	return [pRoot, strategy](size_t iterations)
+	{
+		for (size_t i = 0; i < iterations; i++)
+			BenchmarkSuite::KeepValue(strategy.ActionArgMax(*pRoot));
+		return iterations * pRoot->GetNumActions();
+	};
+}
+
+
+//A benchmark which plays games with a self-play manager, using
+// uniform priors and zero value estimates in place of a network.
+// Each iteration is one round of Select(), Update() and (when
+// ready) Commit(), and each leaf evaluated is counted as an item.
+static BenchmarkFunction MeasureSelfPlay(const GameState& state, size_t numThreads)
+{
+	std::shared_ptr<SelfPlayManager> pManager = std::make_shared<SelfPlayManager>(
+		ucb1Parameter, policyTemperature, numSimulations, numThreads);
+	pManager->Reset(numGames, state);
+
+	return [state, pManager](size_t iterations)
+	{
+		std::vector<GameState> leaves;
+		std::vector<float> values;
+		std::vector<std::vector<float>> policies;
+		size_t numLeaves = 0;
+
+		for (size_t i = 0; i < iterations; i++)
+		{
+			pManager->Select(leaves);
+
+			if (pManager->IsWaiting())
+			{
+				values.assign(leaves.size(), 0.0f);
+				policies.clear();
+				for (const auto& leaf : leaves)
+					policies.push_back(GetUniformPolicy(leaf));
+
+				pManager->Update(values, policies);
+				numLeaves += leaves.size();
+			}
+
+			if (pManager->ReadyToCommit())
+				pManager->Commit();
+
+			if (pManager->AllFinished())
+				pManager->Reset(numGames, state);
+		}
+
+		return numLeaves;
+	};
+}
+
+
+void AddSearchBenchmarks(BenchmarkSuite& suite, const std::vector<Scenario>& scenarios,
+	size_t numThreads)
+{
+	for (const auto& scenario : scenarios)
+		suite.Add("MCTSNode::Expand/" + scenario.name, MeasureExpand(scenario.state));
+
+	for (const auto& scenario : scenarios)
+		suite.Add("UCB1PolicyStrategy::ActionArgMax/" + scenario.name, MeasureActionArgMax(scenario.state));
+
+	for (const auto& scenario : scenarios)
+		suite.Add("SelfPlayManager/" + scenario.name, MeasureSelfPlay(scenario.state, numThreads));
+}
+
+
+} // namespace c40kl
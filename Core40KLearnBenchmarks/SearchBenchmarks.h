@@ -0,0 +1,23 @@
+#pragma once
+
+
+#include "Benchmark.h"
+#include "Scenario.h"
+
+
+namespace c40kl
+{
+
+
+/// <summary>
+/// Add benchmarks of the tree search: expanding a node, choosing
+/// an action with UCB1, and whole rounds of self-play.
+/// </summary>
+/// <param name="suite">The suite to add the benchmarks to.</param>
+/// <param name="scenarios">The maps to search from.</param>
+/// <param name="numThreads">The number of threads for the self-play manager to use.</param>
+void AddSearchBenchmarks(BenchmarkSuite& suite, const std::vector<Scenario>& scenarios,
+	size_t numThreads);
+
+
+} // namespace c40kl
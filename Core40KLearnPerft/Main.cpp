@@ -0,0 +1,275 @@
+#include <Perft.h>
+#include <ScenarioLoader.h>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+using namespace c40kl;
+
+
+//The board used by pyapp (see pyapp/model)
+static const int boardSize = 24;
+static const float boardScale = 1.0f;
+
+
+static const char* const usage =
+	"Usage: Core40KLearnPerft [options]\n"
+	"Expands the whole game tree from a map to a fixed depth, counting the commands,\n"
+	"chance outcomes and probability mass at each depth, and writes the counts as JSON.\n"
+	"Options:\n"
+	"  --units <file>      The table of unit statistics (default: UnitData/unit_stats.csv)\n"
+	"  --map <file>        The starting positions (default: UnitData/map_1.csv)\n"
+	"  --phase <phase>     The phase to start in: movement, shooting, charge or fight (default: movement)\n"
+	"  --turn_limit <n>    The game's turn limit, or negative for none (default: -1)\n"
+	"  --depth <n>         The number of commands to apply along each path (default: 2)\n"
+	"  --threads <n>       The number of threads to use (default: 1)\n"
+	"  --output <file>     Write the JSON here instead of to standard output\n"
+	"  --compare <file>    Compare the counts with the output of an earlier run (for\n"
+	"                      instance, by another build) and fail if they differ\n";
+
+
+//The results of a run, as written to (and read back from) JSON
+struct PerftResult
+{
+	std::vector<PerftCounts> counts;
+	double seconds = 0.0;
+};
+
+
+static Phase ParsePhase(const std::string& name)
+{
+	if (name == "movement") return Phase::MOVEMENT;
+	if (name == "shooting") return Phase::SHOOTING;
+	if (name == "charge") return Phase::CHARGE;
+	if (name == "fight") return Phase::FIGHT;
+	throw std::runtime_error("Unknown phase: " + name);
+}
+
+
+//Get the total number of states in the tree, including the root
+static size_t GetNumNodes(const PerftResult& result)
+{
+	size_t numNodes = 1;
+	for (const auto& counts : result.counts)
+		numNodes += counts.numOutcomes;
+	return numNodes;
+}
+
+
+//Quote a string for JSON (only filenames and phase names are written)
+static std::string Quote(const std::string& str)
+{
+	std::string quoted = "\"";
+	for (char c : str)
+	{
+		if (c == '"' || c == '\\')
+			quoted += '\\';
+		quoted += c;
+	}
+	return quoted + '"';
+}
+
+
+static void WriteJson(const PerftResult& result, const std::string& map,
+	const std::string& phase, std::ostream& out)
+{
+	out << std::setprecision(17);
+	out << "{\n  \"map\": " << Quote(map) << ",\n  \"phase\": " << Quote(phase) << ",\n";
+	out << "  \"seconds\": " << result.seconds << ",\n";
+	out << "  \"nodes\": " << GetNumNodes(result) << ",\n";
+	out << "  \"nodes_per_second\": " << (GetNumNodes(result) / result.seconds) << ",\n";
+	out << "  \"depths\": [";
+
+	for (size_t i = 0; i < result.counts.size(); i++)
+	{
+		const auto& counts = result.counts[i];
+		out << (i == 0 ? "\n" : ",\n") << "    { \"depth\": " << (i + 1)
+			<< ", \"commands\": " << counts.numCommands
+			<< ", \"outcomes\": " << counts.numOutcomes
+			<< ", \"finished\": " << counts.numFinished
+			<< ", \"probability_mass\": " << counts.probabilityMass << " }";
+	}
+
+	out << "\n  ]\n}\n";
+}
+
+
+//Find the number following "key": in some JSON text, starting from pos
+static double ReadNumber(const std::string& json, const std::string& key, size_t pos)
+{
+	const std::string quotedKey = '"' + key + '"';
+	pos = json.find(quotedKey, pos);
+	if (pos == std::string::npos)
+		throw std::runtime_error("No \"" + key + "\" in the results to compare with.");
+
+	pos = json.find(':', pos + quotedKey.size());
+	return std::stod(json.substr(pos + 1));
+}
+
+
+//Read back the results written by WriteJson()
+static PerftResult ReadJson(const std::string& filename)
+{
+	std::ifstream file(filename);
+	if (!file)
+		throw std::runtime_error("Could not open " + filename + ".");
+
+	std::stringstream contents;
+	contents << file.rdbuf();
+	const std::string json = contents.str();
+
+	PerftResult result;
+	result.seconds = ReadNumber(json, "seconds", 0);
+
+	size_t pos = json.find("\"depths\"");
+	while ((pos = json.find('{', pos)) != std::string::npos)
+	{
+		PerftCounts counts;
+		counts.numCommands = (size_t)ReadNumber(json, "commands", pos);
+		counts.numOutcomes = (size_t)ReadNumber(json, "outcomes", pos);
+		counts.numFinished = (size_t)ReadNumber(json, "finished", pos);
+		counts.probabilityMass = ReadNumber(json, "probability_mass", pos);
+		result.counts.push_back(counts);
+		pos++;
+	}
+
+	return result;
+}
+
+
+//Compare with an earlier run, and print any differences. The counts
+// must match exactly, but the probability masses are sums of floats,
+// so may be rounded differently by different builds.
+static bool Compare(const PerftResult& result, const PerftResult& other, std::ostream& log)
+{
+	bool bMatch = (result.counts.size() == other.counts.size());
+	if (!bMatch)
+		log << "Different depths: " << result.counts.size() << " vs " << other.counts.size() << '\n';
+
+	for (size_t i = 0; i < std::min(result.counts.size(), other.counts.size()); i++)
+	{
+		const auto& a = result.counts[i];
+		const auto& b = other.counts[i];
+		const double massTolerance = 1.0e-6 * std::max(1.0, std::abs(b.probabilityMass));
+
+		if (a.numCommands != b.numCommands || a.numOutcomes != b.numOutcomes
+			|| a.numFinished != b.numFinished
+			|| std::abs(a.probabilityMass - b.probabilityMass) > massTolerance)
+		{
+			log << "Depth " << (i + 1) << " differs: commands " << a.numCommands << " vs " << b.numCommands
+				<< ", outcomes " << a.numOutcomes << " vs " << b.numOutcomes
+				<< ", finished " << a.numFinished << " vs " << b.numFinished
+				<< ", probability mass " << a.probabilityMass << " vs " << b.probabilityMass << '\n';
+			bMatch = false;
+		}
+	}
+
+	if (bMatch)
+	{
+		log << "Counts match. Speed: " << (GetNumNodes(result) / result.seconds) << " vs "
+			<< (GetNumNodes(other) / other.seconds) << " nodes/s ("
+			<< (other.seconds / result.seconds) << "x)\n";
+	}
+
+	return bMatch;
+}
+
+
+int main(int argc, char* argv[])
+{
+	std::string unitsFilename = "UnitData/unit_stats.csv", mapFilename = "UnitData/map_1.csv",
+		phaseName = "movement", outputFilename, compareFilename;
+	int turnLimit = -1, depth = 2;
+	size_t numThreads = 1;
+
+	try
+	{
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string arg = argv[i];
+			if (arg == "--help")
+			{
+				std::cout << usage;
+				return 0;
+			}
+			else if (i + 1 >= argc)
+			{
+				throw std::runtime_error("Unknown option or missing value: " + arg);
+			}
+
+			const std::string value = argv[++i];
+			if (arg == "--units")
+				unitsFilename = value;
+			else if (arg == "--map")
+				mapFilename = value;
+			else if (arg == "--phase")
+				phaseName = value;
+			else if (arg == "--turn_limit")
+				turnLimit = std::stoi(value);
+			else if (arg == "--depth")
+				depth = std::max(0, std::stoi(value));
+			else if (arg == "--threads")
+				numThreads = (size_t)std::max(1, std::stoi(value));
+			else if (arg == "--output")
+				outputFilename = value;
+			else if (arg == "--compare")
+				compareFilename = value;
+			else
+				throw std::runtime_error("Unknown option: " + arg);
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << '\n' << usage;
+		return 1;
+	}
+
+	try
+	{
+		const auto units = ScenarioLoader::LoadUnits(unitsFilename);
+		const GameState initial = ScenarioLoader::LoadGameState(units, mapFilename,
+			boardSize, boardScale, turnLimit);
+		const GameState state(0, 0, ParsePhase(phaseName), initial.GetBoardState(), turnLimit);
+
+		PerftResult result;
+		const auto start = std::chrono::steady_clock::now();
+		result.counts = Perft::Count(state, depth, numThreads);
+		result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		for (size_t i = 0; i < result.counts.size(); i++)
+		{
+			const auto& counts = result.counts[i];
+			std::cerr << "Depth " << (i + 1) << ": " << counts.numCommands << " commands, "
+				<< counts.numOutcomes << " outcomes, " << counts.numFinished << " finished, "
+				<< "probability mass " << counts.probabilityMass << '\n';
+		}
+		std::cerr << GetNumNodes(result) << " nodes in " << result.seconds << "s ("
+			<< (GetNumNodes(result) / result.seconds) << " nodes/s)" << std::endl;
+
+		if (outputFilename.empty())
+		{
+			WriteJson(result, mapFilename, phaseName, std::cout);
+		}
+		else
+		{
+			std::ofstream output(outputFilename);
+			WriteJson(result, mapFilename, phaseName, output);
+			if (!output)
+				throw std::runtime_error("Could not write " + outputFilename + ".");
+		}
+
+		if (!compareFilename.empty() && !Compare(result, ReadJson(compareFilename), std::cerr))
+			return 2;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << "Error: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
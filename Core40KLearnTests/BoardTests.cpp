@@ -184,6 +184,49 @@ BOOST_AUTO_TEST_CASE(GetDistanceTest)
 }
 
 
+BOOST_AUTO_TEST_CASE(CopyOnWriteTest)
+{
+	BoardState original(25, 1.0f);
+
+	Unit u, v;
+	v.count = 5;
+
+	original.SetUnitOnSquare(Position(0, 0), u, 0);
+	original.SetUnitOnSquare(Position(3, 3), u, 1);
+
+	BoardState copy = original;
+
+	BOOST_TEST((copy == original));
+
+	//Modifying the copy shouldn't affect the original
+	copy.SetUnitOnSquare(Position(0, 0), v, 0);
+	copy.ClearSquare(Position(3, 3));
+	copy.SetUnitOnSquare(Position(5, 5), u, 1);
+
+	BOOST_TEST(!(copy == original));
+
+	BOOST_TEST((original.GetUnitOnSquare(Position(0, 0)) == u));
+	BOOST_TEST(original.IsOccupied(Position(3, 3)));
+	BOOST_TEST(!original.IsOccupied(Position(5, 5)));
+
+	BOOST_TEST((copy.GetUnitOnSquare(Position(0, 0)) == v));
+	BOOST_TEST(!copy.IsOccupied(Position(3, 3)));
+	BOOST_TEST(copy.IsOccupied(Position(5, 5)));
+
+	//Modifying the original shouldn't affect the copy either
+	original.ClearSquare(Position(0, 0));
+
+	BOOST_TEST(copy.IsOccupied(Position(0, 0)));
+
+	//Boards constructed independently with the same units
+	// should still compare equal
+	BoardState other(25, 1.0f);
+	other.SetUnitOnSquare(Position(3, 3), u, 1);
+
+	BOOST_TEST((other == original));
+}
+
+
 BOOST_AUTO_TEST_SUITE_END();
 
 
@@ -0,0 +1,163 @@
+#include "Test.h"
+#include <EvaluationCache.h>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+using namespace c40kl;
+
+
+//A space marine with an AP-1 bolter.
+static const Unit unitWithGun{
+	"", 1, 6, 3, 3,
+	4, 1, 1, 1, 8,
+	3, 7, 24, 4, -1,
+	1, 1, 4, 0, 1, 0,
+	true, false, false,
+	false, false, false,
+	false, false
+};
+
+
+//A state with a unit in the given column
+static GameState MakeState(int x, int turnLimit = 5, int turnNumber = 0)
+{
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(x, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(x, 5), unitWithGun, 1);
+	return GameState(0, 0, Phase::MOVEMENT, b, turnLimit, turnNumber);
+}
+
+
+BOOST_AUTO_TEST_SUITE(EvaluationCacheTests, *boost::unit_test::depends_on("GameStateTests"));
+
+
+BOOST_AUTO_TEST_CASE(TestLookUpFindsInsertedStates)
+{
+	EvaluationCache cache(100, 4);
+	const GameState gs = MakeState(0);
+
+	float value = 0.0f;
+	std::vector<float> policy;
+	BOOST_TEST(!cache.LookUp(gs, gs.GetHash(), value, policy));
+	BOOST_TEST(cache.GetSize() == 0);
+
+	cache.Insert(gs, gs.GetHash(), 0.25f, { 0.5f, 0.5f });
+	BOOST_TEST(cache.GetSize() == 1);
+
+	//An equal state is found:
+	const GameState copy = MakeState(0);
+	BOOST_REQUIRE(cache.LookUp(copy, copy.GetHash(), value, policy));
+	BOOST_TEST(value == 0.25f);
+	BOOST_TEST((policy == std::vector<float>{ 0.5f, 0.5f }));
+
+	//Inserting again replaces the evaluation:
+	cache.Insert(gs, gs.GetHash(), -0.25f, { 1.0f });
+	BOOST_TEST(cache.GetSize() == 1);
+	BOOST_REQUIRE(cache.LookUp(gs, gs.GetHash(), value, policy));
+	BOOST_TEST(value == -0.25f);
+	BOOST_TEST((policy == std::vector<float>{ 1.0f }));
+
+	//A different board isn't found:
+	const GameState other = MakeState(1);
+	BOOST_TEST(!cache.LookUp(other, other.GetHash(), value, policy));
+
+	cache.Clear();
+	BOOST_TEST(cache.GetSize() == 0);
+	BOOST_TEST(!cache.LookUp(gs, gs.GetHash(), value, policy));
+}
+
+
+BOOST_AUTO_TEST_CASE(TestStatesAtDifferentPointsInTheGameAreDifferent)
+{
+	const GameState gs = MakeState(0);
+	const GameState otherLimit = MakeState(0, 6);
+	const GameState noLimit = MakeState(0, -1);
+	const GameState laterTurn = MakeState(0, 5, 1);
+
+	//Even if the hashes collide, they aren't mixed up:
+	EvaluationCache cache(100, 1);
+	cache.Insert(gs, 0, 1.0f, {});
+
+	float value = 0.0f;
+	std::vector<float> policy;
+	BOOST_TEST(!cache.LookUp(otherLimit, 0, value, policy));
+	BOOST_TEST(!cache.LookUp(noLimit, 0, value, policy));
+	BOOST_TEST(!cache.LookUp(laterTurn, 0, value, policy));
+	BOOST_TEST(cache.LookUp(gs, 0, value, policy));
+
+	//But any state without a limit finds the same evaluation:
+	const GameState otherNoLimit = MakeState(0, -2);
+	cache.Insert(noLimit, noLimit.GetHash(), -1.0f, {});
+	BOOST_TEST(cache.LookUp(otherNoLimit, otherNoLimit.GetHash(), value, policy));
+	BOOST_TEST(value == -1.0f);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestSizeIsBounded)
+{
+	EvaluationCache cache(8, 2);
+
+	for (int x = 0; x < 20; x++)
+	{
+		const GameState gs = MakeState(x);
+		cache.Insert(gs, gs.GetHash(), (float)x, {});
+		BOOST_TEST(cache.GetSize() <= 8);
+	}
+
+	//The most recent state is always kept:
+	const GameState last = MakeState(19);
+	float value = 0.0f;
+	std::vector<float> policy;
+	BOOST_REQUIRE(cache.LookUp(last, last.GetHash(), value, policy));
+	BOOST_TEST(value == 19.0f);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestSizeIsBoundedWithMoreShardsThanEvaluations)
+{
+	EvaluationCache cache(3, 16);
+
+	for (int x = 0; x < 20; x++)
+	{
+		const GameState gs = MakeState(x);
+		cache.Insert(gs, gs.GetHash(), (float)x, {});
+		BOOST_TEST(cache.GetSize() <= 3);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(TestConcurrentAccess)
+{
+	EvaluationCache cache(1000, 4);
+
+	{
+		boost::asio::thread_pool jobService(4);
+		for (int x = 0; x < 25; x++)
+		{
+			boost::asio::post(jobService, [x, &cache]()
+			{
+				const GameState gs = MakeState(x);
+				for (int i = 0; i < 20; i++)
+				{
+					float value = 0.0f;
+					std::vector<float> policy;
+					if (!cache.LookUp(gs, gs.GetHash(), value, policy))
+						cache.Insert(gs, gs.GetHash(), (float)x, { (float)x });
+				}
+			});
+		}
+		jobService.join();
+	}
+
+	BOOST_TEST(cache.GetSize() == 25);
+	for (int x = 0; x < 25; x++)
+	{
+		const GameState gs = MakeState(x);
+		float value = 0.0f;
+		std::vector<float> policy;
+		BOOST_REQUIRE(cache.LookUp(gs, gs.GetHash(), value, policy));
+		BOOST_TEST(value == (float)x);
+	}
+}
+
+
+BOOST_AUTO_TEST_SUITE_END();
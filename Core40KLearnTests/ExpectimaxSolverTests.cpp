@@ -0,0 +1,101 @@
+#include "Test.h"
+#include <ExpectimaxSolver.h>
+using namespace c40kl;
+
+
+//A single model with a two-shot gun (which hits on
+// 3+, wounds T4 on 4+, and ignores saves of 7+) and
+// no melee weapon, who cannot move.
+static const Unit shooter{
+	"", 1, 0, 3, 3,
+	4, 1, 1, 1, 8,
+	7, 7, 24, 4, 0,
+	1, 2, 0, 0, 0, 0,
+	false, false, false,
+	false, false, false,
+	false, false
+};
+
+
+//A single model with no weapons, who cannot move,
+// and gets no saving throws.
+static const Unit target{
+	"", 1, 0, 3, 3,
+	4, 1, 1, 1, 8,
+	7, 7, 0, 0, 0,
+	0, 0, 0, 0, 0, 0,
+	false, false, false,
+	false, false, false,
+	false, false
+};
+
+
+BOOST_AUTO_TEST_SUITE(ExpectimaxSolverTests, *boost::unit_test::depends_on("GameStateTests"));
+
+
+BOOST_AUTO_TEST_CASE(TestSolverReturnsGameValueOfFinishedState)
+{
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), shooter, 0);
+	GameState gs(0, 0, Phase::MOVEMENT, b);
+
+	ExpectimaxSolver solver(1);
+
+	float value = 0.0f;
+	BOOST_REQUIRE(solver.Solve(gs, 0, value));
+	BOOST_TEST(value == 1.0f);
+	BOOST_REQUIRE(solver.Solve(gs, 1, value));
+	BOOST_TEST(value == -1.0f);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestSolverComputesExactValue, *boost::unit_test::tolerance(1.0e-4f))
+{
+	//Team 0 gets exactly one shooting phase before
+	// the game ends; the target has nothing it can
+	// do in return. Hence team 0 wins if and only
+	// if one of its two shots kills the target,
+	// each of which succeeds with probability
+	// 4/6 * 1/2 = 1/3.
+
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), shooter, 0);
+	b.SetUnitOnSquare(Position(0, 10), target, 1);
+	GameState gs(0, 0, Phase::SHOOTING, b, 1);
+
+	ExpectimaxSolver solver(10000);
+
+	const float expected = 1.0f - (2.0f / 3.0f) * (2.0f / 3.0f);
+
+	float value = 0.0f;
+	BOOST_REQUIRE(solver.Solve(gs, 0, value));
+	BOOST_TEST(value == expected);
+
+	BOOST_TEST(solver.GetTableSize() > 0);
+
+	//Should be able to answer the same query from
+	// the table, even with the other team's perspective:
+	BOOST_REQUIRE(solver.Solve(gs, 1, value));
+	BOOST_TEST(value == -expected);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestSolverGivesUpWhenOutOfBudget)
+{
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), shooter, 0);
+	b.SetUnitOnSquare(Position(0, 10), target, 1);
+	GameState gs(0, 0, Phase::SHOOTING, b, 1);
+
+	ExpectimaxSolver solver(1);
+
+	float value = 0.5f;
+	BOOST_TEST(!solver.Solve(gs, 0, value));
+	BOOST_TEST(value == 0.5f);
+
+	solver.ClearTable();
+	BOOST_TEST(solver.GetTableSize() == 0);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,140 @@
+#include "Test.h"
+#include <ExpectiminimaxSearch.h>
+#include <ExpectimaxSolver.h>
+#include <chrono>
+using namespace c40kl;
+
+
+//A single model with a two-shot gun (which hits on
+// 3+, wounds T4 on 4+, and ignores saves of 7+) and
+// no melee weapon, who cannot move.
+static const Unit shooter{
+	"", 1, 0, 3, 3,
+	4, 1, 1, 1, 8,
+	7, 7, 24, 4, 0,
+	1, 2, 0, 0, 0, 0,
+	false, false, false,
+	false, false, false,
+	false, false
+};
+
+
+//A space marine with an AP-1 bolter.
+static const Unit unitWithGun{
+	"", 1, 6, 3, 3,
+	4, 1, 1, 1, 8,
+	3, 7, 24, 4, -1,
+	1, 1, 4, 0, 1, 0,
+	true, false, false,
+	false, false, false,
+	false, false
+};
+
+
+BOOST_AUTO_TEST_SUITE(ExpectiminimaxSearchTests, *boost::unit_test::depends_on("ExpectimaxSolverTests"));
+
+
+BOOST_AUTO_TEST_CASE(TestHeuristicIsWoundBalance, *boost::unit_test::tolerance(1.0e-4f))
+{
+	Unit big = unitWithGun;
+	big.count = 3;
+	big.total_w = 3;
+
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), big, 0);
+	b.SetUnitOnSquare(Position(0, 10), unitWithGun, 1);
+	GameState gs(0, 0, Phase::MOVEMENT, b);
+
+	BOOST_TEST(ExpectiminimaxSearch::EvaluateHeuristic(gs, 0) == 0.5f);
+	BOOST_TEST(ExpectiminimaxSearch::EvaluateHeuristic(gs, 1) == -0.5f);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestSearchMatchesExactSolver, *boost::unit_test::tolerance(1.0e-4f))
+{
+	//Two immobile shooters trade shots until the
+	// turn limit; when searching deep enough to see
+	// the end of the game, the pruned search should
+	// agree exactly with the exhaustive solver.
+
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), shooter, 0);
+	b.SetUnitOnSquare(Position(0, 10), shooter, 1);
+	GameState gs(0, 0, Phase::SHOOTING, b, 2);
+
+	ExpectimaxSolver solver(1000000);
+	float exactValue = 0.0f;
+	BOOST_REQUIRE(solver.Solve(gs, 0, exactValue));
+
+	ExpectiminimaxSearch search(20, 100000);
+	const size_t idx = search.Search(gs);
+
+	BOOST_TEST(search.GetLastValue() == exactValue);
+	BOOST_TEST(search.GetLastDepth() == 20);
+	BOOST_TEST(search.GetLastNodeCount() > 0);
+
+	//Shooting is clearly better than ending the phase:
+	BOOST_TEST((gs.GetCommands()[idx]->GetType() == CommandType::UNIT_ORDER));
+}
+
+
+BOOST_AUTO_TEST_CASE(TestSearchForSecondTeam, *boost::unit_test::tolerance(1.0e-4f))
+{
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), shooter, 0);
+	b.SetUnitOnSquare(Position(0, 10), shooter, 1);
+	GameState gs(1, 1, Phase::SHOOTING, b, 2);
+
+	ExpectimaxSolver solver(1000000);
+	float exactValue = 0.0f;
+	BOOST_REQUIRE(solver.Solve(gs, 1, exactValue));
+
+	ExpectiminimaxSearch search(20, 100000);
+	const size_t idx = search.Search(gs);
+
+	BOOST_TEST(search.GetLastValue() == exactValue);
+	BOOST_TEST((gs.GetCommands()[idx]->GetType() == CommandType::UNIT_ORDER));
+}
+
+
+BOOST_AUTO_TEST_CASE(TestSearchRespectsTimeLimit)
+{
+	//A position with far too many actions to search
+	// deeply, so the time limit should kick in:
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(1, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 12), unitWithGun, 1);
+	b.SetUnitOnSquare(Position(1, 12), unitWithGun, 1);
+	GameState gs(0, 0, Phase::MOVEMENT, b);
+
+	ExpectiminimaxSearch search(100, 50);
+
+	const auto start = std::chrono::steady_clock::now();
+	const size_t idx = search.Search(gs);
+	const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - start).count();
+
+	BOOST_TEST(idx < gs.GetCommands().size());
+	BOOST_TEST(search.GetLastDepth() >= 1);
+	BOOST_TEST(search.GetLastDepth() < 100);
+	BOOST_TEST(elapsedMs < 5000);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestSearchPreconditions)
+{
+	C40KL_CHECK_PRE_POST_EXCEPTION(ExpectiminimaxSearch(0, 100), std::runtime_error);
+	C40KL_CHECK_PRE_POST_EXCEPTION(ExpectiminimaxSearch(1, 0), std::runtime_error);
+
+	//Finished game:
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), shooter, 0);
+	GameState gs(0, 0, Phase::SHOOTING, b);
+
+	ExpectiminimaxSearch search(1, 100);
+	C40KL_CHECK_PRE_POST_EXCEPTION(search.Search(gs), std::runtime_error);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,162 @@
+#include "Test.h"
+#include <ExperienceFile.h>
+#include <cstdio>
+#include <cmath>
+#include <limits>
+using namespace c40kl;
+
+
+//A space marine with an AP-1 bolter.
+static const Unit unitWithGun{
+	"", 1, 6, 3, 3,
+	4, 1, 1, 1, 8,
+	3, 7, 24, 4, -1,
+	1, 1, 4, 0, 1, 0,
+	true, false, false,
+	false, false, false,
+	false, false
+};
+
+
+static const char* const TEST_FILENAME = "ExperienceFileTests.tmp";
+
+
+//Create a record for a small game, with the given value
+static std::vector<float> MakeRecord(float value)
+{
+	BoardState b(5, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 2), unitWithGun, 1);
+	GameState gs(0, 0, Phase::SHOOTING, b);
+
+	const size_t numCmds = gs.GetCommands().size();
+	std::vector<float> record(StateEncoder::GetRecordSize(5));
+	StateEncoder::EncodeRecord(gs, std::vector<float>(numCmds, 1.0f / numCmds),
+		value, record.data());
+	return record;
+}
+
+
+BOOST_AUTO_TEST_SUITE(ExperienceFileTests, *boost::unit_test::depends_on("StateEncoderTests"));
+
+
+BOOST_AUTO_TEST_CASE(TestHalfConversion)
+{
+	//Small integers, and simple fractions, are exact:
+	for (float x : { 0.0f, 1.0f, -1.0f, 24.0f, -3.0f, 0.5f, 0.25f, 2048.0f })
+	{
+		BOOST_TEST(ExperienceFile::HalfToFloat(ExperienceFile::FloatToHalf(x)) == x);
+	}
+
+	//Known bit patterns:
+	BOOST_TEST(ExperienceFile::FloatToHalf(1.0f) == 0x3c00);
+	BOOST_TEST(ExperienceFile::FloatToHalf(-2.0f) == 0xc000);
+	BOOST_TEST(ExperienceFile::FloatToHalf(65504.0f) == 0x7bff);
+	BOOST_TEST(ExperienceFile::HalfToFloat(0x0001) == std::ldexp(1.0f, -24));
+
+	//Ties round to even, and overflow goes to infinity:
+	BOOST_TEST(ExperienceFile::FloatToHalf(2049.0f) == ExperienceFile::FloatToHalf(2048.0f));
+	BOOST_TEST(ExperienceFile::FloatToHalf(2051.0f) == ExperienceFile::FloatToHalf(2052.0f));
+	BOOST_TEST(ExperienceFile::FloatToHalf(1.0e6f) == 0x7c00);
+	BOOST_TEST(std::isnan(ExperienceFile::HalfToFloat(
+		ExperienceFile::FloatToHalf(std::numeric_limits<float>::quiet_NaN()))));
+
+	//Rounding error is within half precision:
+	const float third = ExperienceFile::HalfToFloat(ExperienceFile::FloatToHalf(1.0f / 3.0f));
+	BOOST_TEST(std::abs(third - 1.0f / 3.0f) < 1.0e-3f);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestWriteThenRead)
+{
+	std::remove(TEST_FILENAME);
+
+	const auto first = MakeRecord(1.0f);
+	const auto second = MakeRecord(-0.5f);
+
+	{
+		ExperienceFileWriter writer(TEST_FILENAME, 5);
+		writer.Write(first.data(), 1);
+		writer.Write(second.data(), 1);
+		BOOST_TEST(writer.GetNumRecords() == 2);
+	}
+
+	//Appending keeps the existing records:
+	{
+		ExperienceFileWriter writer(TEST_FILENAME, 5);
+		BOOST_TEST(writer.GetNumRecords() == 2);
+		writer.Write(first.data(), 1);
+		writer.Close();
+		BOOST_TEST(writer.GetNumRecords() == 3);
+	}
+
+	{
+		ExperienceFileReader reader(TEST_FILENAME);
+		BOOST_TEST(reader.GetBoardSize() == 5);
+		BOOST_REQUIRE(reader.GetNumRecords() == 3);
+
+		std::vector<float> out(2 * first.size());
+		reader.ReadRecords({ 1, 2 }, out.data());
+
+		//All of the values are exactly representable:
+		BOOST_TEST(std::equal(second.begin(), second.end(), out.begin()));
+		BOOST_TEST(std::equal(first.begin(), first.end(), out.begin() + first.size()));
+
+		//Around half the size of the float records:
+		const size_t recordBytes = ExperienceFile::GetRecordBytes(5);
+		BOOST_TEST(recordBytes < first.size() * sizeof(float) * 3 / 5);
+		BOOST_TEST(reader.GetRecordData(1) - reader.GetRecordData(0) == (ptrdiff_t)recordBytes);
+
+		C40KL_CHECK_PRE_POST_EXCEPTION(reader.GetRecordData(3), std::runtime_error);
+	}
+
+	//Can't append records for a different board size:
+	BOOST_CHECK_THROW(ExperienceFileWriter(TEST_FILENAME, 6), std::runtime_error);
+
+	std::remove(TEST_FILENAME);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestInvalidFiles)
+{
+	BOOST_CHECK_THROW(ExperienceFileReader("ThisFileDoesNotExist.tmp"), std::runtime_error);
+
+	//Not an experience file:
+	{
+		std::ofstream file(TEST_FILENAME, std::ios::binary);
+		file << "This is not an experience file, but it is long enough to have a header.";
+	}
+	BOOST_CHECK_THROW(ExperienceFileReader reader(TEST_FILENAME), std::runtime_error);
+	BOOST_CHECK_THROW(ExperienceFileWriter writer(TEST_FILENAME, 5), std::runtime_error);
+
+	//Partial record:
+	std::remove(TEST_FILENAME);
+	{
+		ExperienceFileWriter writer(TEST_FILENAME, 5);
+	}
+	{
+		std::ofstream file(TEST_FILENAME, std::ios::binary | std::ios::app);
+		file << "partial";
+	}
+	BOOST_CHECK_THROW(ExperienceFileReader reader(TEST_FILENAME), std::runtime_error);
+
+	//Board sizes which are too large, or negative as an int:
+	for (uint32_t boardSize : { (uint32_t)ExperienceFile::MAX_BOARD_SIZE + 1, 0x80000000u, 0xffffffffu })
+	{
+		std::remove(TEST_FILENAME);
+		{
+			ExperienceFileWriter writer(TEST_FILENAME, 5);
+		}
+		{
+			std::fstream file(TEST_FILENAME, std::ios::binary | std::ios::in | std::ios::out);
+			file.seekp(12); //(After the magic string and version)
+			file.write(reinterpret_cast<const char*>(&boardSize), sizeof(boardSize));
+		}
+		BOOST_CHECK_THROW(ExperienceFileReader reader(TEST_FILENAME), std::runtime_error);
+	}
+
+	std::remove(TEST_FILENAME);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END();
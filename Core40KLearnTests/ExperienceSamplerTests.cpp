@@ -0,0 +1,141 @@
+#include "Test.h"
+#include <ExperienceSampler.h>
+#include <cstdio>
+#include <string>
+using namespace c40kl;
+
+
+//Write a file of records for a 3x3 board, where every value
+// of each record is its index (plus the given offset)
+static void WriteTestFile(const std::string& filename, size_t numRecords, float offset)
+{
+	std::remove(filename.c_str());
+
+	const size_t recordSize = StateEncoder::GetRecordSize(3);
+	std::vector<float> records(numRecords * recordSize);
+	for (size_t i = 0; i < numRecords; i++)
+	{
+		std::fill(records.begin() + i * recordSize, records.begin() + (i + 1) * recordSize,
+			(float)i + offset);
+	}
+
+	ExperienceFileWriter writer(filename, 3);
+	writer.Write(records.data(), numRecords);
+}
+
+
+BOOST_AUTO_TEST_SUITE(ExperienceSamplerTests, *boost::unit_test::depends_on("ExperienceFileTests"));
+
+
+BOOST_AUTO_TEST_CASE(TestSampleSplitsRecords)
+{
+	WriteTestFile("ExperienceSamplerTests1.tmp", 4, 0.0f);
+	WriteTestFile("ExperienceSamplerTests2.tmp", 0, 0.0f);
+	WriteTestFile("ExperienceSamplerTests3.tmp", 2, 4.0f);
+
+	{
+		ExperienceSampler sampler;
+		BOOST_TEST(sampler.GetBoardSize() == 0);
+
+		sampler.AddFile("ExperienceSamplerTests1.tmp");
+		sampler.AddFile("ExperienceSamplerTests2.tmp");
+		sampler.AddFile("ExperienceSamplerTests3.tmp");
+
+		BOOST_TEST(sampler.GetNumFiles() == 3);
+		BOOST_TEST(sampler.GetNumRecords() == 6);
+		BOOST_TEST(sampler.GetBoardSize() == 3);
+
+		const size_t n = 50;
+		std::vector<float> planes(n * StateEncoder::GetBoardPlanesSize(3)),
+			phases(n * StateEncoder::NUM_PHASES),
+			policies(n * StateEncoder::GetPolicySize(3)),
+			values(n);
+
+		sampler.Sample(n, planes.data(), phases.data(), policies.data(), values.data());
+
+		//Each part should come from the same record, whose
+		// value tells us its overall index:
+		std::vector<int> counts(6, 0);
+		for (size_t i = 0; i < n; i++)
+		{
+			const float v = values[i];
+			BOOST_REQUIRE(v >= 0.0f);
+			BOOST_REQUIRE(v < 6.0f);
+			counts[(size_t)v]++;
+
+			BOOST_TEST(planes[i * StateEncoder::GetBoardPlanesSize(3)] == v);
+			BOOST_TEST(phases[(i + 1) * StateEncoder::NUM_PHASES - 1] == v);
+			BOOST_TEST(policies[i * StateEncoder::GetPolicySize(3)] == v);
+		}
+
+		//With 50 uniform draws, it would be very unlikely to miss a record:
+		for (int count : counts)
+		{
+			BOOST_TEST(count > 0);
+		}
+	}
+
+	std::remove("ExperienceSamplerTests1.tmp");
+	std::remove("ExperienceSamplerTests2.tmp");
+	std::remove("ExperienceSamplerTests3.tmp");
+}
+
+
+BOOST_AUTO_TEST_CASE(TestRecencyWeighting)
+{
+	WriteTestFile("ExperienceSamplerTests1.tmp", 100, 0.0f);
+
+	{
+		ExperienceSampler sampler;
+		sampler.AddFile("ExperienceSamplerTests1.tmp");
+
+		//With a half life of 10 records, the newest 10 records should
+		// get about half of the samples, and the oldest half of the
+		// records should only get about 1/32 of them.
+		sampler.SetRecencyHalfLife(10.0f);
+		const auto indices = sampler.SampleIndices(10000);
+
+		size_t numNewest = 0, numOldest = 0;
+		for (size_t idx : indices)
+		{
+			BOOST_REQUIRE(idx < 100);
+			if (idx >= 90) numNewest++;
+			if (idx < 50) numOldest++;
+		}
+
+		BOOST_TEST(numNewest > 4500);
+		BOOST_TEST(numNewest < 5500);
+		BOOST_TEST(numOldest > 150);
+		BOOST_TEST(numOldest < 500);
+
+		C40KL_CHECK_PRE_POST_EXCEPTION(sampler.SetRecencyHalfLife(-1.0f), std::runtime_error);
+	}
+
+	std::remove("ExperienceSamplerTests1.tmp");
+}
+
+
+BOOST_AUTO_TEST_CASE(TestPreconditions)
+{
+	WriteTestFile("ExperienceSamplerTests1.tmp", 1, 0.0f);
+	std::remove("ExperienceSamplerTests2.tmp");
+	{
+		ExperienceFileWriter writer("ExperienceSamplerTests2.tmp", 4);
+	}
+
+	{
+		ExperienceSampler sampler;
+		C40KL_CHECK_PRE_POST_EXCEPTION(sampler.SampleIndices(1), std::runtime_error);
+
+		//Mismatched board sizes:
+		sampler.AddFile("ExperienceSamplerTests1.tmp");
+		BOOST_CHECK_THROW(sampler.AddFile("ExperienceSamplerTests2.tmp"), std::runtime_error);
+		BOOST_TEST(sampler.GetNumFiles() == 1);
+	}
+
+	std::remove("ExperienceSamplerTests1.tmp");
+	std::remove("ExperienceSamplerTests2.tmp");
+}
+
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -65,6 +65,81 @@ BOOST_AUTO_TEST_CASE(GameCompletionTests)
 }
 
 
+BOOST_AUTO_TEST_CASE(TestEquivalence)
+{
+	BoardState b(25, 1.0f), other(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), Unit(), 0);
+	b.SetUnitOnSquare(Position(0, 5), Unit(), 1);
+	other.SetUnitOnSquare(Position(1, 0), Unit(), 0);
+	other.SetUnitOnSquare(Position(0, 5), Unit(), 1);
+
+	const GameState s(0, 0, Phase::MOVEMENT, b, 5, 0);
+	const GameState otherLimit(0, 0, Phase::MOVEMENT, b, 6, 0);
+	const GameState noLimit(0, 0, Phase::MOVEMENT, b, -1, 0);
+	const GameState laterTurn(0, 0, Phase::MOVEMENT, b, 5, 1);
+
+	BOOST_TEST(s.IsEquivalentTo(GameState(0, 0, Phase::MOVEMENT, b, 5, 0)));
+	BOOST_TEST(!s.IsEquivalentTo(otherLimit));
+	BOOST_TEST(!s.IsEquivalentTo(noLimit));
+	BOOST_TEST(!s.IsEquivalentTo(laterTurn));
+	BOOST_TEST(!s.IsEquivalentTo(GameState(0, 0, Phase::MOVEMENT, other, 5, 0)));
+
+	//All negative limits mean there's no limit, so they're equivalent and hash the same:
+	const GameState otherNoLimit(0, 0, Phase::MOVEMENT, b, -2, 0);
+	BOOST_TEST(noLimit.IsEquivalentTo(otherNoLimit));
+	BOOST_TEST(noLimit.GetHash() == otherNoLimit.GetHash());
+	BOOST_TEST(s.GetHash() == GameState(0, 0, Phase::MOVEMENT, b, 5, 0).GetHash());
+}
+
+
+BOOST_AUTO_TEST_CASE(TestWriteAndRead)
+{
+	Unit unit;
+	unit.name = "Tactical Squad";
+	unit.count = 5;
+	unit.w = unit.total_w = 5;
+	unit.rg_ap = -1;
+	unit.firedThisTurn = true;
+
+	Unit other;
+	other.count = 1;
+	other.foughtThisTurn = true;
+
+	BoardState b(25, 2.0f);
+	b.SetUnitOnSquare(Position(3, 4), unit, 0);
+	b.SetUnitOnSquare(Position(24, 0), other, 1);
+	b.SetUnitOnSquare(Position(3, 5), other, 0);
+	const GameState s(1, 0, Phase::FIGHT, b, 5, 3);
+
+	BinaryWriter writer;
+	s.Write(writer);
+	BinaryReader reader(writer.GetBytes());
+	const GameState read = GameState::Read(reader);
+
+	BOOST_TEST(reader.GetNumBytesLeft() == 0);
+	BOOST_TEST((read == s));
+	BOOST_TEST(read.GetHash() == s.GetHash());
+	BOOST_TEST(read.GetTurnLimit() == 5);
+	BOOST_TEST(read.GetTurnNumber() == 3);
+	BOOST_TEST(read.GetBoardState().GetScale() == 2.0f);
+	BOOST_TEST((read.GetBoardState().GetUnitOnSquare(Position(3, 4)) == unit));
+	BOOST_TEST(read.GetBoardState().GetTeamOnSquare(Position(24, 0)) == 1);
+
+	//Truncated or corrupt data is rejected:
+	const std::string& bytes = writer.GetBytes();
+	for (size_t size : { (size_t)0, (size_t)10, bytes.size() - 1 })
+	{
+		BinaryReader truncated(bytes.data(), size);
+		BOOST_CHECK_THROW(GameState::Read(truncated), std::runtime_error);
+	}
+
+	std::string corrupt = bytes;
+	corrupt[0] = 2; //(The internal team)
+	BinaryReader corruptReader(corrupt);
+	BOOST_CHECK_THROW(GameState::Read(corruptReader), std::runtime_error);
+}
+
+
 BOOST_AUTO_TEST_SUITE_END();
 
 
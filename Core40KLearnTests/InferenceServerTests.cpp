@@ -0,0 +1,280 @@
+#include "Test.h"
+#include <InferenceServer.h>
+#include <StateEncoder.h>
+#include <StateSerialiser.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+using namespace c40kl;
+
+
+//Get a shared memory name which no other test run is using
+static std::string GetUniqueName()
+{
+	static std::atomic<int> counter(0);
+	return "C40KLTest_" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count())
+		+ "_" + std::to_string(counter++);
+}
+
+
+//Make states which are told apart by their turn numbers
+static std::vector<GameState> MakeStates(int boardSize, size_t numStates, int firstTurn)
+{
+	Unit unit;
+	unit.count = 1;
+
+	BoardState board(boardSize, 1.0f);
+	board.SetUnitOnSquare(Position(0, 0), unit, 0);
+	board.SetUnitOnSquare(Position(1, 1), unit, 1);
+
+	std::vector<GameState> states;
+	for (size_t i = 0; i < numStates; i++)
+		states.emplace_back(0, 0, Phase::MOVEMENT, board, -1, firstTurn + (int)i);
+	return states;
+}
+
+
+//Answer requests until every worker finishes, with each state's turn
+// number as its value, and the turn number plus the action index as
+// its policy. Returns the number of batches answered.
+static size_t RunServer(InferenceServer& server, size_t& outNumStates)
+{
+	const size_t policySize = StateEncoder::GetPolicySize(server.GetBoardSize());
+	std::vector<GameState> states;
+	size_t numBatches = 0;
+	outNumStates = 0;
+
+	while (!server.AllWorkersFinished())
+	{
+		if (!server.WaitForRequests(10, states))
+			continue;
+
+		std::vector<float> values(states.size());
+		std::vector<float> policies(states.size() * policySize);
+		for (size_t i = 0; i < states.size(); i++)
+		{
+			values[i] = (float)states[i].GetTurnNumber();
+			for (size_t j = 0; j < policySize; j++)
+				policies[i * policySize + j] = values[i] + (float)j;
+		}
+
+		server.Respond(values.data(), policies.data());
+		numBatches++;
+		outNumStates += states.size();
+	}
+
+	return numBatches;
+}
+
+
+BOOST_AUTO_TEST_SUITE(InferenceServerTests);
+
+
+BOOST_AUTO_TEST_CASE(TestWorkersAreAnswered)
+{
+	const int boardSize = 5;
+	const size_t numWorkers = 3;
+	const size_t numRounds = 20;
+	const size_t policySize = StateEncoder::GetPolicySize(boardSize);
+	const std::string name = GetUniqueName();
+
+	InferenceServer server(name, numWorkers, boardSize, 4, 4096);
+	BOOST_TEST(server.GetNumWorkers() == numWorkers);
+	BOOST_TEST(!server.AllWorkersFinished());
+
+	//Each worker sends a different number of states each round, and
+	// checks that it gets the answers for its own states back:
+	std::atomic<size_t> numErrors(0);
+	std::vector<std::thread> workers;
+	for (size_t w = 0; w < numWorkers; w++)
+	{
+		workers.emplace_back([&, w]()
+		{
+			InferenceClient client(name, w);
+
+			for (size_t round = 0; round < numRounds; round++)
+			{
+				const int firstTurn = (int)(1000 * w + 10 * round);
+				const auto states = MakeStates(boardSize, 1 + (w + round) % 4, firstTurn);
+
+				std::vector<float> values(states.size());
+				std::vector<float> policies(states.size() * policySize);
+				client.Predict(states, values.data(), policies.data());
+
+				for (size_t i = 0; i < states.size(); i++)
+				{
+					if (values[i] != (float)(firstTurn + i)
+						|| policies[i * policySize + policySize - 1] != values[i] + (float)(policySize - 1))
+					{
+						numErrors++;
+					}
+				}
+			}
+
+			client.Disconnect();
+		});
+	}
+
+	size_t numStates = 0;
+	const size_t numBatches = RunServer(server, numStates);
+	for (auto& worker : workers)
+		worker.join();
+
+	BOOST_TEST(numErrors == 0);
+	BOOST_TEST(server.AllWorkersFinished());
+
+	size_t expectedStates = 0;
+	for (size_t w = 0; w < numWorkers; w++)
+	{
+		for (size_t round = 0; round < numRounds; round++)
+			expectedStates += 1 + (w + round) % 4;
+	}
+	BOOST_TEST(numStates == expectedStates);
+	BOOST_TEST(numBatches <= numWorkers * numRounds);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestInvalidUseIsRejected)
+{
+	const int boardSize = 5;
+	const std::string name = GetUniqueName();
+	const size_t policySize = StateEncoder::GetPolicySize(boardSize);
+
+	BOOST_CHECK_THROW(InferenceClient(name, 0), std::runtime_error);
+	BOOST_CHECK_THROW(InferenceServer(name, 0, boardSize, 2, 4096), std::runtime_error);
+
+	InferenceServer server(name, 2, boardSize, 2, 4096);
+	BOOST_CHECK_THROW(InferenceServer(name, 2, boardSize, 2, 4096), std::runtime_error);
+
+	BOOST_CHECK_THROW(InferenceClient(name, 2), std::runtime_error);
+
+	InferenceClient client(name, 0);
+	BOOST_TEST(client.GetBoardSize() == boardSize);
+	BOOST_CHECK_THROW(InferenceClient(name, 0), std::runtime_error);
+
+	std::vector<float> values(3), policies(3 * policySize);
+	BOOST_CHECK_THROW(client.Predict(MakeStates(boardSize, 3, 0), values.data(), policies.data()),
+		std::runtime_error);
+	BOOST_CHECK_THROW(client.Predict(MakeStates(boardSize + 1, 1, 0), values.data(), policies.data()),
+		std::runtime_error);
+
+	//Nothing to evaluate doesn't need the server:
+	client.Predict({}, values.data(), policies.data());
+
+	//A worker waiting when the server shuts down gives up:
+	std::atomic<bool> threw(false);
+	std::thread worker([&]()
+	{
+		try
+		{
+			client.Predict(MakeStates(boardSize, 1, 0), values.data(), policies.data());
+		}
+		catch (const std::runtime_error&)
+		{
+			threw = true;
+		}
+	});
+
+	std::vector<GameState> states;
+	while (!server.WaitForRequests(10, states))
+	{
+	}
+	BOOST_TEST(states.size() == 1);
+	BOOST_TEST(server.IsWaitingToRespond());
+
+	server.Shutdown();
+	worker.join();
+	BOOST_TEST(threw);
+	BOOST_CHECK_THROW(InferenceClient(name, 1), std::runtime_error);
+
+	client.Disconnect();
+	BOOST_CHECK_THROW(client.Predict(MakeStates(boardSize, 1, 0), values.data(), policies.data()),
+		std::runtime_error);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestUnreadableRequestsAreRejected)
+{
+	const int boardSize = 5;
+	const std::string name = GetUniqueName();
+	const size_t policySize = StateEncoder::GetPolicySize(boardSize);
+
+	InferenceServer server(name, 2, boardSize, 2, 4096);
+	InferenceClient badClient(name, 0), goodClient(name, 1);
+
+	//Send a request, then corrupt it in the shared memory (as a
+	// misbehaving worker process might) before the server reads it:
+	const auto badStates = MakeStates(boardSize, 1, 0);
+	const std::string badBytes = StateSerialiser::Encode(badStates);
+
+	std::atomic<bool> badThrew(false);
+	std::thread badWorker([&]()
+	{
+		std::vector<float> values(1), policies(policySize);
+		try
+		{
+			badClient.Predict(badStates, values.data(), policies.data());
+		}
+		catch (const std::runtime_error&)
+		{
+			badThrew = true;
+		}
+	});
+
+	namespace bip = boost::interprocess;
+	bip::shared_memory_object memory(bip::open_only, name.c_str(), bip::read_write);
+	bip::mapped_region region(memory, bip::read_write);
+	char* pBegin = static_cast<char*>(region.get_address());
+	char* pEnd = pBegin + region.get_size();
+
+	char* pRequest = pEnd;
+	while (pRequest == pEnd)
+	{
+		pRequest = std::search(pBegin, pEnd, badBytes.begin(), badBytes.end());
+		std::this_thread::yield();
+	}
+	pRequest[0] = ~pRequest[0];
+
+	//Another worker's request is still answered, in the same round or later:
+	std::vector<float> goodValues(1), goodPolicies(policySize);
+	std::thread goodWorker([&]()
+	{
+		goodClient.Predict(MakeStates(boardSize, 1, 7), goodValues.data(), goodPolicies.data());
+	});
+
+	std::vector<GameState> states;
+	while (!server.WaitForRequests(10, states))
+	{
+	}
+	BOOST_TEST(states.size() == 1);
+	BOOST_TEST(states.front().GetTurnNumber() == 7);
+
+	std::vector<float> policies(policySize, 1.0f);
+	const float value = 7.0f;
+	server.Respond(&value, policies.data());
+	BOOST_TEST(!server.IsWaitingToRespond());
+
+	goodWorker.join();
+	badWorker.join();
+	BOOST_TEST(badThrew);
+	BOOST_TEST(goodValues.front() == 7.0f);
+
+	//The rejected worker can carry on:
+	std::thread retry([&]()
+	{
+		std::vector<float> values(1), retryPolicies(policySize);
+		badClient.Predict(MakeStates(boardSize, 1, 3), values.data(), retryPolicies.data());
+	});
+	while (!server.WaitForRequests(10, states))
+	{
+	}
+	BOOST_TEST(states.size() == 1);
+	server.Respond(&value, policies.data());
+	retry.join();
+}
+
+
+BOOST_AUTO_TEST_SUITE_END();
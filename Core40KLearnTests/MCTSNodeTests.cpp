@@ -834,6 +834,79 @@ BOOST_AUTO_TEST_CASE(ChildOrderingTest)
 }
 
 
+BOOST_AUTO_TEST_CASE(TestWriteAndReadSubtree, *boost::unit_test::tolerance(1.0e-5f))
+{
+	//Shooting has several outcomes, so the tree has chance weights
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 10), unitWithGun, 1);
+	GameState gs(0, 0, Phase::SHOOTING, b);
+
+	auto pRoot = MCTSNode::CreateRootNode(gs);
+	const size_t numActions = pRoot->GetNumActions();
+	pRoot->Expand(std::vector<float>(numActions, 1.0f / numActions));
+
+	//Expand and visit some of the root's grandchildren
+	for (size_t i = 0; i < numActions; i++)
+	{
+		const auto& children = pRoot->GetStateResults(i);
+		for (size_t j = 0; j < children.size(); j++)
+		{
+			const auto& pChild = children[j];
+			if (j % 2 == 0 && !pChild->IsTerminal())
+			{
+				const size_t n = pChild->GetNumActions();
+				pChild->Expand(std::vector<float>(n, 1.0f / n));
+			}
+			pChild->AddValueStatistic((float)(i + j) / 10.0f);
+		}
+	}
+
+	BinaryWriter writer;
+	pRoot->Write(writer);
+	BinaryReader reader(writer.GetBytes());
+	const auto pRead = MCTSNode::Read(reader);
+
+	BOOST_TEST(reader.GetNumBytesLeft() == 0);
+	BOOST_TEST(pRead->IsRoot());
+	BOOST_TEST((pRead->GetState() == gs));
+	BOOST_TEST(pRead->GetValueEstimate() == pRoot->GetValueEstimate());
+	BOOST_TEST(pRead->GetNumValueSamples() == pRoot->GetNumValueSamples());
+	BOOST_TEST(pRead->GetActionPriorDistribution() == pRoot->GetActionPriorDistribution(),
+		boost::test_tools::per_element());
+	BOOST_TEST(pRead->GetActionVisitCounts() == pRoot->GetActionVisitCounts(),
+		boost::test_tools::per_element());
+	BOOST_TEST(pRead->GetActionValueEstimates() == pRoot->GetActionValueEstimates(),
+		boost::test_tools::per_element());
+
+	for (size_t i = 0; i < numActions; i++)
+	{
+		BOOST_TEST(pRead->GetStateResultDistribution(i) == pRoot->GetStateResultDistribution(i),
+			boost::test_tools::per_element());
+
+		const auto& children = pRoot->GetStateResults(i);
+		const auto& readChildren = pRead->GetStateResults(i);
+		BOOST_REQUIRE(readChildren.size() == children.size());
+		for (size_t j = 0; j < children.size(); j++)
+		{
+			BOOST_TEST((readChildren[j]->GetState() == children[j]->GetState()));
+			BOOST_TEST(readChildren[j]->IsLeaf() == children[j]->IsLeaf());
+			BOOST_TEST(readChildren[j]->GetDepth() == 1);
+			BOOST_TEST(readChildren[j]->GetValueEstimate() == children[j]->GetValueEstimate());
+		}
+	}
+
+	//The read tree is connected, so statistics backpropagate with the same weights:
+	pRoot->GetStateResults(0).back()->AddValueStatistic(1.0f);
+	pRead->GetStateResults(0).back()->AddValueStatistic(1.0f);
+	BOOST_TEST(pRead->GetValueEstimate() == pRoot->GetValueEstimate());
+
+	//A truncated tree is rejected:
+	BinaryReader truncated(writer.GetBytes().data(), writer.GetBytes().size() / 2);
+	BOOST_CHECK_THROW(MCTSNode::Read(truncated), std::runtime_error);
+}
+
+
 BOOST_AUTO_TEST_SUITE_END();
 
 
@@ -0,0 +1,446 @@
+#include "Test.h"
+#include <NeuralNetwork.h>
+#include <StateEncoder.h>
+#include <SelfPlayManager.h>
+#include <Gemm.h>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <thread>
+using namespace c40kl;
+
+
+//A space marine with an AP-1 bolter.
+static const Unit unitWithGun{
+	"", 1, 6, 3, 3,
+	4, 1, 1, 1, 8,
+	3, 7, 24, 4, -1,
+	1, 1, 4, 0, 1, 0,
+	true, false, false,
+	false, false, false,
+	false, false
+};
+
+
+static const char* const TEST_FILENAME = "NeuralNetworkTests.tmp";
+
+
+typedef NeuralNetwork::Layer Layer;
+typedef NeuralNetwork::Activation Activation;
+
+
+//Create a layer with random weights, and (optionally) random batch normalisation
+static Layer MakeLayer(std::mt19937& randEng, size_t kernelSize, size_t inSize,
+	size_t outSize, Activation activation, bool bBatchNorm)
+{
+	std::uniform_real_distribution<float> dist(-0.5f, 0.5f);
+	auto randomVector = [&](size_t n, float offset)
+	{
+		std::vector<float> values(n);
+		for (float& x : values)
+			x = dist(randEng) + offset;
+		return values;
+	};
+
+	Layer layer;
+	layer.kernelSize = kernelSize;
+	layer.inSize = inSize;
+	layer.outSize = outSize;
+	layer.activation = activation;
+	layer.weights = randomVector(kernelSize * kernelSize * inSize * outSize, 0.0f);
+	layer.bias = randomVector(outSize, 0.0f);
+	layer.bnEpsilon = 0.001f;
+
+	if (bBatchNorm)
+	{
+		layer.bnGamma = randomVector(outSize, 1.0f);
+		layer.bnBeta = randomVector(outSize, 0.0f);
+		layer.bnMean = randomVector(outSize, 0.5f);
+		layer.bnVariance = randomVector(outSize, 1.0f);
+	}
+
+	return layer;
+}
+
+
+//A small network in the same shape as NNModel, for a 5x5 board
+struct TestNetwork
+{
+	std::vector<Layer> conv, dense, value, policy;
+
+	TestNetwork()
+	{
+		std::mt19937 randEng(1234);
+		const size_t inChannels = 2 * StateEncoder::NUM_UNIT_FEATURES;
+
+		//5x5 -> 3x3 -> 1x1
+		conv.push_back(MakeLayer(randEng, 3, inChannels, 6, Activation::RELU, true));
+		conv.push_back(MakeLayer(randEng, 3, 6, 5, Activation::RELU, true));
+		dense.push_back(MakeLayer(randEng, 1, 5 + StateEncoder::NUM_PHASES, 20, Activation::RELU, true));
+		dense.push_back(MakeLayer(randEng, 1, 20, 17, Activation::RELU, false));
+		value.push_back(MakeLayer(randEng, 1, 17, 3, Activation::RELU, false));
+		value.push_back(MakeLayer(randEng, 1, 3, 1, Activation::TANH, false));
+		policy.push_back(MakeLayer(randEng, 1, 17, StateEncoder::GetPolicySize(5), Activation::SOFTMAX, false));
+	}
+};
+
+
+//Apply a layer the slow way, with batch normalisation as a separate step
+static std::vector<float> ApplyLayer(const Layer& layer, const std::vector<float>& input,
+	size_t& size)
+{
+	const size_t k = layer.kernelSize, c = layer.inSize, o = layer.outSize;
+	const size_t outSize = size - k + 1;
+	std::vector<float> output(outSize * outSize * o);
+
+	for (size_t i = 0; i < outSize; i++)
+	{
+		for (size_t j = 0; j < outSize; j++)
+		{
+			float* out = output.data() + (i * outSize + j) * o;
+			for (size_t oc = 0; oc < o; oc++)
+			{
+				double total = layer.bias[oc];
+				for (size_t di = 0; di < k; di++)
+					for (size_t dj = 0; dj < k; dj++)
+						for (size_t ic = 0; ic < c; ic++)
+							total += (double)input[((i + di) * size + j + dj) * c + ic]
+								* layer.weights[((di * k + dj) * c + ic) * o + oc];
+				out[oc] = (float)total;
+			}
+
+			switch (layer.activation)
+			{
+			case Activation::RELU:
+				for (size_t oc = 0; oc < o; oc++) out[oc] = std::max(out[oc], 0.0f);
+				break;
+			case Activation::TANH:
+				for (size_t oc = 0; oc < o; oc++) out[oc] = std::tanh(out[oc]);
+				break;
+			case Activation::SOFTMAX:
+			{
+				double total = 0.0;
+				for (size_t oc = 0; oc < o; oc++) total += std::exp((double)out[oc]);
+				for (size_t oc = 0; oc < o; oc++) out[oc] = (float)(std::exp((double)out[oc]) / total);
+				break;
+			}
+			default:
+				break;
+			}
+
+			for (size_t oc = 0; oc < layer.bnGamma.size(); oc++)
+			{
+				out[oc] = (out[oc] - layer.bnMean[oc]) / std::sqrt(layer.bnVariance[oc] + layer.bnEpsilon)
+					* layer.bnGamma[oc] + layer.bnBeta[oc];
+			}
+		}
+	}
+
+	size = outSize;
+	return output;
+}
+
+
+//Run the test network on a single state the slow way
+static void ReferencePredict(const TestNetwork& net, const float* planes, const float* phase,
+	float& outValue, std::vector<float>& outPolicy)
+{
+	size_t size = 5;
+	std::vector<float> x(planes, planes + StateEncoder::GetBoardPlanesSize(5));
+	for (const auto& layer : net.conv)
+		x = ApplyLayer(layer, x, size);
+
+	x.insert(x.end(), phase, phase + StateEncoder::NUM_PHASES);
+	for (const auto& layer : net.dense)
+	{
+		size = 1;
+		x = ApplyLayer(layer, x, size);
+	}
+
+	std::vector<float> v = x;
+	for (const auto& layer : net.value)
+	{
+		size = 1;
+		v = ApplyLayer(layer, v, size);
+	}
+	outValue = v[0];
+
+	outPolicy = x;
+	for (const auto& layer : net.policy)
+	{
+		size = 1;
+		outPolicy = ApplyLayer(layer, outPolicy, size);
+	}
+}
+
+
+//Some states on a 5x5 board
+static std::vector<GameState> MakeStates(size_t n)
+{
+	std::vector<GameState> states;
+	for (size_t i = 0; i < n; i++)
+	{
+		Unit enemy = unitWithGun;
+		enemy.count = 1 + (int)(i % 3);
+
+		BoardState b(5, 1.0f);
+		b.SetUnitOnSquare(Position((int)i % 5, 0), unitWithGun, 0);
+		b.SetUnitOnSquare(Position(4, (int)(i / 2) % 5), enemy, 1);
+		states.emplace_back((int)i % 2, (int)i % 2, (Phase)(i % 4), b, 5);
+	}
+	return states;
+}
+
+
+//Write a network file in the format documented in NeuralNetwork.h
+static void WriteNetworkFile(const std::string& filename, const TestNetwork& net)
+{
+	std::ofstream file(filename, std::ios::binary);
+	auto writeU32 = [&file](uint32_t x) { file.write(reinterpret_cast<const char*>(&x), sizeof(x)); };
+	auto writeFloats = [&file](const std::vector<float>& x)
+	{
+		file.write(reinterpret_cast<const char*>(x.data()), x.size() * sizeof(float));
+	};
+
+	file.write("C40KLNET", 8);
+	writeU32(NeuralNetwork::FILE_VERSION);
+	writeU32(5);
+	writeU32((uint32_t)net.conv.size());
+	writeU32((uint32_t)net.dense.size());
+	writeU32((uint32_t)net.value.size());
+	writeU32((uint32_t)net.policy.size());
+
+	for (const auto* pLayers : { &net.conv, &net.dense, &net.value, &net.policy })
+	{
+		for (const auto& layer : *pLayers)
+		{
+			writeU32((uint32_t)layer.kernelSize);
+			writeU32((uint32_t)layer.inSize);
+			writeU32((uint32_t)layer.outSize);
+			writeU32((uint32_t)layer.activation);
+			writeU32(layer.bnGamma.empty() ? 0 : 1);
+			file.write(reinterpret_cast<const char*>(&layer.bnEpsilon), sizeof(float));
+			writeFloats(layer.weights);
+			writeFloats(layer.bias);
+			writeFloats(layer.bnGamma);
+			writeFloats(layer.bnBeta);
+			writeFloats(layer.bnMean);
+			writeFloats(layer.bnVariance);
+		}
+	}
+}
+
+
+BOOST_AUTO_TEST_SUITE(NeuralNetworkTests, *boost::unit_test::depends_on("SelfPlayManagerTests"));
+
+
+BOOST_AUTO_TEST_CASE(TestGemmMatchesNaiveProduct)
+{
+	std::mt19937 randEng(42);
+	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+	//Sizes which exercise the full and partial blocks of each kernel:
+	const size_t sizes[][3] = { { 1, 1, 1 }, { 4, 16, 3 }, { 5, 19, 7 },
+		{ 9, 300, 270 }, { 3, 8, 513 }, { 17, 40, 1 } };
+
+	for (const auto& mnk : sizes)
+	{
+		const size_t m = mnk[0], n = mnk[1], k = mnk[2];
+
+		std::vector<float> a(m * k), b(k * n), bias(n);
+		for (float& x : a) x = dist(randEng);
+		for (float& x : b) x = dist(randEng);
+		for (float& x : bias) x = dist(randEng);
+
+		std::vector<float> c(m * n, -1.0f), cScalar(m * n, -1.0f), cNoBias(m * n, -1.0f);
+		Gemm::Multiply(m, n, k, a.data(), b.data(), bias.data(), c.data());
+		Gemm::MultiplyScalar(m, n, k, a.data(), b.data(), bias.data(), cScalar.data());
+		Gemm::Multiply(m, n, k, a.data(), b.data(), nullptr, cNoBias.data());
+
+		for (size_t i = 0; i < m; i++)
+		{
+			for (size_t j = 0; j < n; j++)
+			{
+				double expected = 0.0;
+				for (size_t kk = 0; kk < k; kk++)
+					expected += (double)a[i * k + kk] * b[kk * n + j];
+
+				const float tol = 1.0e-4f * (float)k;
+				BOOST_TEST(std::abs(c[i * n + j] - (expected + bias[j])) < tol);
+				BOOST_TEST(std::abs(cScalar[i * n + j] - (expected + bias[j])) < tol);
+				BOOST_TEST(std::abs(cNoBias[i * n + j] - expected) < tol);
+			}
+		}
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(TestPredictMatchesReference)
+{
+	const TestNetwork net;
+	const auto states = MakeStates(7);
+
+	const size_t numPlanes = StateEncoder::GetBoardPlanesSize(5);
+	const size_t policySize = StateEncoder::GetPolicySize(5);
+
+	std::vector<float> planes(states.size() * numPlanes), phases(states.size() * StateEncoder::NUM_PHASES);
+	StateEncoder::EncodeStates(states, planes.data(), phases.data());
+
+	//Should be the same for any number of threads:
+	for (size_t numThreads : { 1, 3 })
+	{
+		NeuralNetwork network(5, net.conv, net.dense, net.value, net.policy, numThreads);
+		BOOST_TEST(network.GetBoardSize() == 5);
+
+		std::vector<float> values(states.size()), policies(states.size() * policySize);
+		network.Predict(states, values.data(), policies.data());
+
+		for (size_t i = 0; i < states.size(); i++)
+		{
+			float expectedValue = 0.0f;
+			std::vector<float> expectedPolicy;
+			ReferencePredict(net, planes.data() + i * numPlanes,
+				phases.data() + i * StateEncoder::NUM_PHASES, expectedValue, expectedPolicy);
+
+			BOOST_TEST(std::abs(values[i] - expectedValue) < 1.0e-4f);
+			for (size_t j = 0; j < policySize; j++)
+			{
+				BOOST_TEST(std::abs(policies[i * policySize + j] - expectedPolicy[j]) < 1.0e-5f);
+			}
+		}
+
+		//Evaluate() decodes the same policy arrays:
+		std::vector<float> evalValues;
+		std::vector<std::vector<float>> evalPolicies;
+		network.Evaluate(states, evalValues, evalPolicies);
+		BOOST_REQUIRE(evalPolicies.size() == states.size());
+		BOOST_TEST(evalValues == values, boost::test_tools::per_element());
+		BOOST_TEST((evalPolicies.back() == StateEncoder::DecodePolicy(states.back(),
+			policies.data() + (states.size() - 1) * policySize)));
+
+		//Several threads can share the network's threads at once (checking
+		// the results afterwards, since Boost.Test isn't thread-safe):
+		std::vector<std::vector<float>> threadValues(4, std::vector<float>(states.size()));
+		std::vector<std::vector<float>> threadPolicies(4, std::vector<float>(policies.size()));
+		std::vector<std::thread> threads;
+		for (size_t t = 0; t < threadValues.size(); t++)
+		{
+			threads.emplace_back([&, t]()
+			{
+				for (int repeat = 0; repeat < 10; repeat++)
+					network.Predict(states, threadValues[t].data(), threadPolicies[t].data());
+			});
+		}
+		for (auto& thread : threads)
+			thread.join();
+
+		for (size_t t = 0; t < threadValues.size(); t++)
+		{
+			BOOST_TEST(threadValues[t] == values, boost::test_tools::per_element());
+			BOOST_TEST(threadPolicies[t] == policies, boost::test_tools::per_element());
+		}
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(TestLoadFromFile)
+{
+	const TestNetwork net;
+	WriteNetworkFile(TEST_FILENAME, net);
+
+	const auto states = MakeStates(3);
+	const size_t policySize = StateEncoder::GetPolicySize(5);
+
+	NeuralNetwork fromLayers(5, net.conv, net.dense, net.value, net.policy);
+	NeuralNetwork fromFile(TEST_FILENAME);
+	BOOST_TEST(fromFile.GetBoardSize() == 5);
+
+	std::vector<float> values(3), policies(3 * policySize),
+		fileValues(3), filePolicies(3 * policySize);
+	fromLayers.Predict(states, values.data(), policies.data());
+	fromFile.Predict(states, fileValues.data(), filePolicies.data());
+
+	BOOST_TEST(values == fileValues, boost::test_tools::per_element());
+	BOOST_TEST(policies == filePolicies, boost::test_tools::per_element());
+
+	//Truncated file:
+	{
+		std::ofstream file(TEST_FILENAME, std::ios::binary);
+		file.write("C40KLNET", 8);
+	}
+	BOOST_CHECK_THROW(NeuralNetwork network(TEST_FILENAME), std::runtime_error);
+
+	//Not a network file:
+	{
+		std::ofstream file(TEST_FILENAME, std::ios::binary);
+		file << "This is not a network file.";
+	}
+	BOOST_CHECK_THROW(NeuralNetwork network(TEST_FILENAME), std::runtime_error);
+	BOOST_CHECK_THROW(NeuralNetwork network("ThisFileDoesNotExist.tmp"), std::runtime_error);
+
+	std::remove(TEST_FILENAME);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestLayersMustFitTogether)
+{
+	TestNetwork net;
+
+	//Wrong board size for the dense layers:
+	BOOST_CHECK_THROW(NeuralNetwork(6, net.conv, net.dense, net.value, net.policy), std::runtime_error);
+
+	//Batch normalisation on an output:
+	auto value = net.value;
+	value.back().bnGamma = value.back().bnBeta = value.back().bnMean = value.back().bnVariance = { 1.0f };
+	BOOST_CHECK_THROW(NeuralNetwork(5, net.conv, net.dense, value, net.policy), std::runtime_error);
+
+	//Missing weights:
+	auto dense = net.dense;
+	dense.front().weights.pop_back();
+	BOOST_CHECK_THROW(NeuralNetwork(5, net.conv, dense, net.value, net.policy), std::runtime_error);
+
+	//No policy head:
+	BOOST_CHECK_THROW(NeuralNetwork(5, net.conv, net.dense, net.value, {}), std::runtime_error);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestSelfPlayWithNetwork)
+{
+	const TestNetwork net;
+	NeuralNetwork network(5, net.conv, net.dense, net.value, net.policy, 2);
+
+	BoardState b(5, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 4), unitWithGun, 1);
+	GameState gs(0, 0, Phase::MOVEMENT, b, 2);
+
+	SelfPlayManager mgr(1.4f, 0.4f, 20, 2);
+	mgr.Reset(3, gs);
+
+	auto evaluator = [&network](const std::vector<GameState>& states,
+		float* outValues, float* outPolicyArrays)
+	{
+		network.Predict(states, outValues, outPolicyArrays);
+	};
+
+	//Play the games through, without any Python:
+	size_t numMoves = 0;
+	while (!mgr.AllFinished() && numMoves < 1000)
+	{
+		const auto distributions = mgr.SearchFor(100000000, evaluator);
+		BOOST_REQUIRE(!distributions.empty());
+		for (int treeSize : mgr.GetTreeSizes())
+		{
+			BOOST_TEST(treeSize >= 20);
+		}
+
+		mgr.Commit();
+		numMoves++;
+	}
+
+	BOOST_TEST(mgr.AllFinished());
+}
+
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,122 @@
+#include "Test.h"
+#include <Perft.h>
+using namespace c40kl;
+
+
+//A space marine with an AP-1 bolter.
+static const Unit unitWithGun{
+	"", 5, 6, 3, 3,
+	4, 1, 5, 1, 8,
+	3, 7, 24, 4, -1,
+	1, 1, 4, 0, 1, 0,
+	true, false, false,
+	false, false, false,
+	false, false
+};
+
+
+//Count the tree level by level, keeping every state, to check Perft against
+static std::vector<PerftCounts> CountBreadthFirst(const GameState& state, int depth)
+{
+	std::vector<PerftCounts> counts(depth);
+	std::vector<GameState> level = { state };
+
+	for (int d = 0; d < depth; d++)
+	{
+		std::vector<GameState> nextLevel;
+		for (const auto& gs : level)
+		{
+			for (const auto& pCmd : gs.GetCommands())
+			{
+				std::vector<GameState> results;
+				std::vector<float> probs;
+				pCmd->Apply(gs, results, probs);
+
+				counts[d].numCommands++;
+				counts[d].numOutcomes += results.size();
+				for (size_t i = 0; i < results.size(); i++)
+				{
+					counts[d].probabilityMass += probs[i];
+					if (results[i].IsFinished())
+						counts[d].numFinished++;
+					else
+						nextLevel.push_back(results[i]);
+				}
+			}
+		}
+		level = std::move(nextLevel);
+	}
+
+	return counts;
+}
+
+
+BOOST_AUTO_TEST_SUITE(PerftTests, *boost::unit_test::depends_on("GameStateTests"));
+
+
+BOOST_AUTO_TEST_CASE(TestCountsMatchBreadthFirstExpansion, *boost::unit_test::tolerance(1.0e-6))
+{
+	//Two units close enough to shoot and charge each other
+	BoardState b(10, 1.0f);
+	b.SetUnitOnSquare(Position(2, 2), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(2, 7), unitWithGun, 1);
+	const GameState gs(0, 0, Phase::SHOOTING, b, 2);
+
+	const auto expected = CountBreadthFirst(gs, 4);
+	const auto counts = Perft::Count(gs, 4);
+
+	BOOST_REQUIRE(counts.size() == 4);
+	for (size_t d = 0; d < counts.size(); d++)
+	{
+		BOOST_TEST(counts[d].numCommands == expected[d].numCommands);
+		BOOST_TEST(counts[d].numOutcomes == expected[d].numOutcomes);
+		BOOST_TEST(counts[d].numFinished == expected[d].numFinished);
+		BOOST_TEST(counts[d].probabilityMass == expected[d].probabilityMass);
+
+		//Every command's outcomes are a distribution:
+		BOOST_TEST(counts[d].probabilityMass == (double)counts[d].numCommands);
+	}
+
+	//Shooting (at least) has several outcomes, so there are more outcomes than commands:
+	BOOST_TEST(counts.front().numOutcomes > counts.front().numCommands);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestThreadsDontChangeCounts)
+{
+	BoardState b(10, 1.0f);
+	b.SetUnitOnSquare(Position(2, 2), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(5, 2), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(2, 7), unitWithGun, 1);
+	const GameState gs(0, 0, Phase::SHOOTING, b);
+
+	const auto counts = Perft::Count(gs, 3, 1);
+	BOOST_TEST((Perft::Count(gs, 3, 4) == counts));
+}
+
+
+BOOST_AUTO_TEST_CASE(TestEdgeCases)
+{
+	BoardState b(10, 1.0f);
+	b.SetUnitOnSquare(Position(2, 2), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(2, 7), unitWithGun, 1);
+
+	//Depth zero has nothing to count:
+	BOOST_TEST(Perft::Count(GameState(0, 0, Phase::MOVEMENT, b), 0).empty());
+
+	//Nor does a finished game:
+	const GameState finished(0, 0, Phase::MOVEMENT, b, 1, 1);
+	BOOST_REQUIRE(finished.IsFinished());
+	const auto counts = Perft::Count(finished, 2);
+	BOOST_REQUIRE(counts.size() == 2);
+	BOOST_TEST((counts.front() == PerftCounts()));
+	BOOST_TEST((counts.back() == PerftCounts()));
+
+	//The movement phase has one outcome per command, since moving is deterministic:
+	const auto movement = Perft::Count(GameState(0, 0, Phase::MOVEMENT, b), 1);
+	BOOST_TEST(movement.front().numOutcomes == movement.front().numCommands);
+	BOOST_TEST(movement.front().numFinished == 0);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,110 @@
+#include "Test.h"
+#include <ScenarioLoader.h>
+#include <cstdio>
+#include <fstream>
+using namespace c40kl;
+
+
+static const char* const UNITS_FILENAME = "ScenarioLoaderTestsUnits.tmp";
+static const char* const PLACEMENTS_FILENAME = "ScenarioLoaderTestsPlacements.tmp";
+
+
+static void WriteFile(const char* filename, const std::string& contents)
+{
+	std::ofstream file(filename, std::ios::binary);
+	file << contents;
+}
+
+
+//The first two units of UnitData/unit_stats.csv, with Windows line endings
+static const std::string UNITS_CSV =
+	"name,movement,count,ws,bs,t,w,total_w,a,ld,sv,inv,rg_range,rg_s,rg_ap,rg_dmg,rg_shots,rg_is_rapid,rg_is_heavy,ml_s,ml_ap,ml_dmg\r\n"
+	"Tactical Space Marines,6,5,3,3,4,1,5,1,8,3,7,24,4,0,1,1,1,0,4,0,1\r\n"
+	"Hellblaster Squad,6,5,3,3,4,2,10,2,8,3,7,30,7,-4,1,1,1,0,4,0,1\r\n";
+
+
+BOOST_AUTO_TEST_SUITE(ScenarioLoaderTests, *boost::unit_test::depends_on("GameStateTests"));
+
+
+BOOST_AUTO_TEST_CASE(TestLoadUnits)
+{
+	WriteFile(UNITS_FILENAME, UNITS_CSV);
+	const auto units = ScenarioLoader::LoadUnits(UNITS_FILENAME);
+	std::remove(UNITS_FILENAME);
+
+	BOOST_REQUIRE(units.size() == 2);
+
+	const Unit& hellblasters = units.back();
+	BOOST_TEST(hellblasters.name == "Hellblaster Squad");
+	BOOST_TEST(hellblasters.movement == 6);
+	BOOST_TEST(hellblasters.count == 5);
+	BOOST_TEST(hellblasters.w == 2);
+	BOOST_TEST(hellblasters.total_w == 10);
+	BOOST_TEST(hellblasters.a == 2);
+	BOOST_TEST(hellblasters.inv == 7);
+	BOOST_TEST(hellblasters.rg_range == 30);
+	BOOST_TEST(hellblasters.rg_s == 7);
+	BOOST_TEST(hellblasters.rg_ap == -4);
+	BOOST_TEST(hellblasters.rg_is_rapid);
+	BOOST_TEST(!hellblasters.rg_is_heavy);
+	BOOST_TEST(hellblasters.ml_dmg == 1);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestLoadGameState)
+{
+	WriteFile(UNITS_FILENAME, UNITS_CSV);
+	WriteFile(PLACEMENTS_FILENAME,
+		"name,team,x,y\n"
+		"Tactical Space Marines,0,5,5\n"
+		"Hellblaster Squad,1,10,20");
+
+	const auto units = ScenarioLoader::LoadUnits(UNITS_FILENAME);
+	const GameState gs = ScenarioLoader::LoadGameState(units, PLACEMENTS_FILENAME, 24, 1.0f, 5);
+
+	BOOST_TEST(gs.GetActingTeam() == 0);
+	BOOST_TEST((gs.GetPhase() == Phase::MOVEMENT));
+	BOOST_TEST(gs.GetTurnLimit() == 5);
+
+	const BoardState& board = gs.GetBoardState();
+	BOOST_TEST(board.GetAllUnits(0).size() == 1);
+	BOOST_TEST(board.GetAllUnits(1).size() == 1);
+	BOOST_TEST(board.GetTeamOnSquare(Position(10, 20)) == 1);
+	BOOST_TEST((board.GetUnitOnSquare(Position(5, 5)) == units.front()));
+	BOOST_TEST((board.GetUnitOnSquare(Position(10, 20)) == units.back()));
+
+	//Unknown units, and units off the board, are errors:
+	WriteFile(PLACEMENTS_FILENAME, "name,team,x,y\nGretchin,0,5,5\n");
+	BOOST_CHECK_THROW(ScenarioLoader::LoadGameState(units, PLACEMENTS_FILENAME, 24), std::runtime_error);
+
+	WriteFile(PLACEMENTS_FILENAME, "name,team,x,y\nHellblaster Squad,0,5,24\n");
+	BOOST_CHECK_THROW(ScenarioLoader::LoadGameState(units, PLACEMENTS_FILENAME, 24), std::runtime_error);
+
+	std::remove(UNITS_FILENAME);
+	std::remove(PLACEMENTS_FILENAME);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestInvalidFilesThrow)
+{
+	BOOST_CHECK_THROW(ScenarioLoader::LoadUnits("ThisFileDoesNotExist.tmp"), std::runtime_error);
+
+	//Missing column:
+	WriteFile(UNITS_FILENAME, "name,movement\nGretchin,5\n");
+	BOOST_CHECK_THROW(ScenarioLoader::LoadUnits(UNITS_FILENAME), std::runtime_error);
+
+	//Not a number:
+	std::string units = UNITS_CSV;
+	units.replace(units.find(",6,5,3,3,4,2,"), 3, ",six,");
+	WriteFile(UNITS_FILENAME, units);
+	BOOST_CHECK_THROW(ScenarioLoader::LoadUnits(UNITS_FILENAME), std::runtime_error);
+
+	//Wrong number of columns:
+	WriteFile(UNITS_FILENAME, UNITS_CSV + "Gretchin,5\n");
+	BOOST_CHECK_THROW(ScenarioLoader::LoadUnits(UNITS_FILENAME), std::runtime_error);
+
+	std::remove(UNITS_FILENAME);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END();
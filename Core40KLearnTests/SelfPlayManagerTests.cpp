@@ -1,5 +1,11 @@
 #include "Test.h"
 #include <SelfPlayManager.h>
+#include <StateEncoder.h>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <chrono>
+#include <sstream>
 using namespace c40kl;
 
 
@@ -112,6 +118,799 @@ BOOST_AUTO_TEST_CASE(TestSelfPlayManagerThrowsWhenResetWithFinishedState)
 }
 
 
-BOOST_AUTO_TEST_SUITE_END();
+BOOST_AUTO_TEST_CASE(TestSolvedLeavesAreNotReturnedForEvaluation)
+{
+	//A unit which can shoot but not move or fight:
+	Unit shooter = unitWithGun;
+	shooter.movement = 0;
+	shooter.ml_s = 0;
+
+	//A unit with no weapons, which cannot move:
+	Unit target;
+	target.count = target.w = target.total_w = 1;
+	target.t = 4;
+	target.sv = target.inv = 7;
+
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), shooter, 0);
+	b.SetUnitOnSquare(Position(0, 10), target, 1);
+	GameState gs(0, 0, Phase::SHOOTING, b, 1);
+
+	SelfPlayManager mgr(1.4f, 0.4f, 2, 3);
+	mgr.EnableEndgameSolver(2, 1, 10000);
+	mgr.Reset(2, gs);
+
+	//The root is small enough to be solved straight
+	// away, so nothing should need evaluating:
+	std::vector<GameState> selectedStates;
+	mgr.Select(selectedStates);
+
+	BOOST_TEST(selectedStates.empty());
+	BOOST_TEST(mgr.IsWaiting());
+
+	mgr.Update({}, {});
+
+	BOOST_TEST(!mgr.IsWaiting());
+	for (auto size : mgr.GetTreeSizes())
+	{
+		BOOST_TEST(size == 1);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(TestSearchForStopsAtTimeLimit)
+{
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 12), unitWithGun, 1);
+	GameState gs(0, 0, Phase::MOVEMENT, b);
+
+	//Far more simulations than could be done in time:
+	SelfPlayManager mgr(1.4f, 0.4f, 100000000, 3);
+	mgr.Reset(2, gs);
+
+	//Uniform priors and uninformative values:
+	size_t numEvaluations = 0;
+	auto evaluator = [&numEvaluations](const std::vector<GameState>& states,
+		std::vector<float>& outValues, std::vector<std::vector<float>>& outPolicies)
+	{
+		numEvaluations += states.size();
+		for (const auto& state : states)
+		{
+			const size_t numActions = state.GetCommands().size();
+			outValues.push_back(0.0f);
+			outPolicies.emplace_back(numActions, 1.0f / (float)numActions);
+		}
+	};
+
+	const auto start = std::chrono::steady_clock::now();
+	const auto policies = mgr.SearchFor(50, evaluator);
+	const auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - start).count();
+
+	BOOST_TEST(elapsedMs >= 50);
+	BOOST_TEST(elapsedMs < 5000);
+	BOOST_TEST(numEvaluations > 0);
+	BOOST_TEST(!mgr.IsWaiting());
+	BOOST_TEST(mgr.ReadyToCommit());
+
+	BOOST_REQUIRE(policies.size() == 2);
+	for (const auto& policy : policies)
+	{
+		BOOST_TEST(policy.size() == gs.GetCommands().size());
+	}
+
+	//Committing clears the time limit, so we are
+	// no longer ready to commit:
+	mgr.Commit();
+	BOOST_TEST(!mgr.ReadyToCommit());
+}
+
+
+BOOST_AUTO_TEST_CASE(TestSearchForStopsAtSimulationCount)
+{
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 12), unitWithGun, 1);
+	GameState gs(0, 0, Phase::MOVEMENT, b);
+
+	SelfPlayManager mgr(1.4f, 0.4f, 5, 3);
+	mgr.Reset(2, gs);
+
+	auto evaluator = [](const std::vector<GameState>& states,
+		std::vector<float>& outValues, std::vector<std::vector<float>>& outPolicies)
+	{
+		for (const auto& state : states)
+		{
+			const size_t numActions = state.GetCommands().size();
+			outValues.push_back(0.0f);
+			outPolicies.emplace_back(numActions, 1.0f / (float)numActions);
+		}
+	};
+
+	//A very long time limit, which should never be reached:
+	mgr.SearchFor(100000000, evaluator);
+
+	BOOST_TEST(mgr.ReadyToCommit());
+	for (auto size : mgr.GetTreeSizes())
+	{
+		BOOST_TEST(size == 5);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(TestEarlyStoppingIsPerGame)
+{
+	//Two actions to choose between (see BasicUsageTest)
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 1), unitWithGun, 1);
+	b.SetUnitOnSquare(Position(1, 0), unitWithGun, 1);
+	GameState gs(0, 0, Phase::FIGHT, b);
+
+	SelfPlayManager mgr(1.4f, 0.0f, 10, 3);
+	mgr.SetEarlyStopping(true);
+	mgr.Reset(2, gs);
+
+	//The first game's prior puts all of its weight on one
+	// action, so every simulation will go to it, but the
+	// second game's prior is uniform.
+	std::vector<GameState> selectedStates;
+	mgr.Select(selectedStates);
+	BOOST_REQUIRE(selectedStates.size() == 2);
+	mgr.Update({ 0.0f, 0.0f }, { { 1.0f, 0.0f }, { 0.5f, 0.5f } });
+
+	auto evaluator = [](const std::vector<GameState>& states,
+		std::vector<float>& outValues, std::vector<std::vector<float>>& outPolicies)
+	{
+		for (const auto& state : states)
+		{
+			const size_t numActions = state.GetCommands().size();
+			outValues.push_back(0.0f);
+			outPolicies.emplace_back(numActions, 1.0f / (float)numActions);
+		}
+	};
+
+	mgr.SearchFor(100000000, evaluator);
+
+	//With 6 samples, the first game's leading action has a lead
+	// of 5 visits, with only 4 simulations left. The second game
+	// alternates between its actions so can't stop early.
+	const auto treeSizes = mgr.GetTreeSizes();
+	BOOST_REQUIRE(treeSizes.size() == 2);
+	BOOST_TEST(treeSizes[0] == 6);
+	BOOST_TEST(treeSizes[1] == 10);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestCommitReadyOnlyCommitsReadyGames)
+{
+	//Same setup as TestEarlyStoppingIsPerGame
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 1), unitWithGun, 1);
+	b.SetUnitOnSquare(Position(1, 0), unitWithGun, 1);
+	GameState gs(0, 0, Phase::FIGHT, b);
+
+	SelfPlayManager mgr(1.4f, 0.0f, 10, 3);
+	mgr.SetEarlyStopping(true);
+	mgr.Reset(2, gs);
+
+	std::vector<GameState> selectedStates;
+	mgr.Select(selectedStates);
+	BOOST_REQUIRE(selectedStates.size() == 2);
+	mgr.Update({ 0.0f, 0.0f }, { { 1.0f, 0.0f }, { 0.5f, 0.5f } });
+
+	//Keep searching until the first game stops early:
+	while (!mgr.AnyReadyToCommit())
+	{
+		mgr.Select(selectedStates);
+
+		std::vector<float> values;
+		std::vector<std::vector<float>> policies;
+		for (const auto& state : selectedStates)
+		{
+			const size_t numActions = state.GetCommands().size();
+			values.push_back(0.0f);
+			policies.emplace_back(numActions, 1.0f / (float)numActions);
+		}
+
+		mgr.Update(values, policies);
+	}
+
+	BOOST_TEST(!mgr.ReadyToCommit());
+
+	//Only the first game should be reported as ready:
+	const auto readyIds = mgr.GetRunningGameIds(true);
+	BOOST_REQUIRE(readyIds.size() == 1);
+	BOOST_TEST(readyIds.front() == 0);
+	BOOST_TEST(mgr.GetCurrentGameStates(true).size() == 1);
+	BOOST_TEST(mgr.GetCurrentActionDistributions(true).size() == 1);
+
+	const int secondTreeSize = mgr.GetTreeSizes()[1];
+
+	mgr.CommitReady();
+
+	//The first game has moved on, but the second
+	// game's search should be left untouched:
+	const auto curStates = mgr.GetCurrentGameStates();
+	BOOST_REQUIRE(curStates.size() == 2);
+	BOOST_TEST(!(curStates[0] == gs));
+	BOOST_TEST((curStates[1] == gs));
+	BOOST_TEST(mgr.GetTreeSizes()[1] == secondTreeSize);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestStreamingRefillsFinishedGames)
+{
+	//Two short games (limited to a single turn) to choose from:
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 1), unitWithGun, 1);
+	const std::vector<GameState> pool{
+		GameState(0, 0, Phase::FIGHT, b, 1),
+		GameState(0, 0, Phase::SHOOTING, b, 1)
+	};
+
+	SelfPlayManager mgr(1.4f, 0.4f, 4, 3);
+	mgr.Reset(pool, 2, 5);
+
+	auto evaluator = [](const std::vector<GameState>& states,
+		std::vector<float>& outValues, std::vector<std::vector<float>>& outPolicies)
+	{
+		for (const auto& state : states)
+		{
+			const size_t numActions = state.GetCommands().size();
+			outValues.push_back(0.0f);
+			outPolicies.emplace_back(numActions, 1.0f / (float)numActions);
+		}
+	};
+
+	std::vector<size_t> finishedIds;
+	size_t numIterations = 0;
+
+	while (!mgr.AllFinished())
+	{
+		//The batch should only shrink once all games have been started
+		// (the last one may already have finished before an earlier one):
+		const auto runningIds = mgr.GetRunningGameIds();
+		size_t maxStarted = *std::max_element(runningIds.begin(), runningIds.end());
+		for (size_t id : finishedIds)
+			maxStarted = std::max(maxStarted, id);
+
+		if (maxStarted < 4)
+		{
+			BOOST_TEST(runningIds.size() == 2);
+		}
+
+		mgr.SearchFor(100000000, evaluator);
+		mgr.Commit();
+
+		for (const auto& game : mgr.PopFinishedGames())
+		{
+			BOOST_TEST(game.second >= -1.0f);
+			BOOST_TEST(game.second <= 1.0f);
+			finishedIds.push_back(game.first);
+		}
+
+		BOOST_REQUIRE(++numIterations < 1000);
+	}
+
+	//Every game should have been reported exactly once:
+	std::sort(finishedIds.begin(), finishedIds.end());
+	BOOST_TEST(finishedIds == std::vector<size_t>({ 0, 1, 2, 3, 4 }), boost::test_tools::per_element());
+	BOOST_TEST(mgr.GetGameValues().size() == 5);
+	BOOST_TEST(mgr.PopFinishedGames().empty());
+
+	C40KL_CHECK_PRE_POST_EXCEPTION(mgr.Reset(std::vector<GameState>(), 2, 5), std::runtime_error);
+	C40KL_CHECK_PRE_POST_EXCEPTION(mgr.Reset(pool, 0, 5), std::runtime_error);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestRecordsAreEmittedWhenGamesFinish, *boost::unit_test::tolerance(1.0e-5f))
+{
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 1), unitWithGun, 1);
+	GameState gs(0, 0, Phase::FIGHT, b, 1);
+
+	SelfPlayManager mgr(1.4f, 0.4f, 4, 3);
+	mgr.SetRecordExperiences(true);
+	mgr.Reset(2, gs);
+
+	auto evaluator = [](const std::vector<GameState>& states,
+		std::vector<float>& outValues, std::vector<std::vector<float>>& outPolicies)
+	{
+		for (const auto& state : states)
+		{
+			const size_t numActions = state.GetCommands().size();
+			outValues.push_back(0.0f);
+			outPolicies.emplace_back(numActions, 1.0f / (float)numActions);
+		}
+	};
+
+	const size_t recordSize = StateEncoder::GetRecordSize(25);
+	size_t numMoves = 0;
+	std::vector<float> records;
+
+	while (!mgr.AllFinished())
+	{
+		mgr.SearchFor(100000000, evaluator);
+		numMoves += mgr.GetCurrentGameStates().size();
+		mgr.Commit();
+
+		//Nothing is emitted until a game finishes:
+		const auto newRecords = mgr.PopFinishedRecords();
+		BOOST_REQUIRE(newRecords.size() % recordSize == 0);
+		if (mgr.PopFinishedGames().empty())
+		{
+			BOOST_TEST(newRecords.empty());
+		}
+
+		records.insert(records.end(), newRecords.begin(), newRecords.end());
+	}
+
+	//One record for every move in every game:
+	const size_t numRecords = records.size() / recordSize;
+	BOOST_TEST(numRecords == numMoves);
+
+	//The first record of each game is the initial state:
+	std::vector<float> expected(recordSize);
+	StateEncoder::EncodeBoard(gs, expected.data());
+	BOOST_TEST(std::equal(expected.begin(), expected.begin() + StateEncoder::GetBoardPlanesSize(25),
+		records.begin()));
+
+	//Each record's policy sums to at least 1 (unit orders count
+	// twice), and values are game results for the acting team:
+	const size_t policyOffset = StateEncoder::GetBoardPlanesSize(25) + StateEncoder::NUM_PHASES;
+	for (size_t i = 0; i < numRecords; i++)
+	{
+		const float* pRecord = records.data() + i * recordSize;
+		const float policySum = std::accumulate(pRecord + policyOffset,
+			pRecord + policyOffset + StateEncoder::GetPolicySize(25), 0.0f);
+		BOOST_TEST(policySum >= 1.0f);
+		BOOST_TEST(std::abs(pRecord[recordSize - 1]) <= 1.0f);
+	}
+
+	BOOST_TEST(mgr.PopFinishedRecords().empty());
+}
+
+
+BOOST_AUTO_TEST_CASE(TestDecodeSelectedPoliciesMatchesStates, *boost::unit_test::tolerance(1.0e-5f))
+{
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 1), unitWithGun, 1);
+	b.SetUnitOnSquare(Position(1, 0), unitWithGun, 1);
+	GameState gs(0, 0, Phase::MOVEMENT, b);
 
+	SelfPlayManager mgr(1.4f, 0.4f, 10, 3);
+	mgr.Reset(3, gs);
 
+	C40KL_CHECK_PRE_POST_EXCEPTION(mgr.DecodeSelectedPolicies(nullptr), std::runtime_error);
+	BOOST_TEST(mgr.GetSelectedBoardSize() == 0);
+
+	const size_t policySize = StateEncoder::GetPolicySize(25);
+
+	//Run a few rounds, so that different leaves get selected:
+	for (int round = 0; round < 4; round++)
+	{
+		std::vector<GameState> states;
+		mgr.Select(states);
+		BOOST_REQUIRE(mgr.GetNumSelected() == states.size());
+		BOOST_TEST(mgr.GetSelectedBoardSize() == 25);
+
+		std::vector<float> policyArrays(states.size() * policySize);
+		for (size_t i = 0; i < policyArrays.size(); i++)
+			policyArrays[i] = (float)((i * 7 + round) % 11) / 10.0f;
+
+		const auto policies = mgr.DecodeSelectedPolicies(policyArrays.data());
+		const auto expected = StateEncoder::DecodePolicies(states, policyArrays.data());
+
+		BOOST_REQUIRE(policies.size() == expected.size());
+		for (size_t i = 0; i < policies.size(); i++)
+		{
+			BOOST_TEST(policies[i] == expected[i], boost::test_tools::per_element());
+		}
+
+		mgr.Update(std::vector<float>(states.size(), 0.0f), policies);
+		BOOST_TEST(mgr.GetNumSelected() == 0);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(TestUpdateFromPolicyArrays)
+{
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 1), unitWithGun, 1);
+	b.SetUnitOnSquare(Position(1, 0), unitWithGun, 1);
+	GameState gs(0, 0, Phase::MOVEMENT, b);
+
+	SelfPlayManager mgr(1.4f, 0.4f, 10, 3);
+	mgr.Reset(2, gs);
+
+	const size_t policySize = StateEncoder::GetPolicySize(25);
+
+	for (int round = 0; round < 5; round++)
+	{
+		std::vector<GameState> states;
+		mgr.Select(states);
+		BOOST_REQUIRE(states.size() == 2);
+
+		std::vector<float> values{ 0.5f, -0.5f }, policyArrays(states.size() * policySize);
+		for (size_t i = 0; i < policyArrays.size(); i++)
+			policyArrays[i] = (float)((i * 5 + round) % 13) / 12.0f;
+
+		mgr.Update(values.data(), policyArrays.data());
+
+		//Each game's tree gets one more sample:
+		BOOST_TEST(!mgr.IsWaiting());
+		BOOST_TEST((mgr.GetTreeSizes() == std::vector<int>(2, round + 1)));
+	}
+
+	//The policy arrays are decoded into one probability per action:
+	std::vector<GameState> states;
+	mgr.Select(states);
+	BOOST_REQUIRE(!states.empty());
+	std::vector<float> policyArrays(states.size() * policySize, 1.0f);
+	const auto policies = mgr.DecodeSelectedPolicies(policyArrays.data());
+	BOOST_REQUIRE(policies.size() == states.size());
+	for (size_t i = 0; i < states.size(); i++)
+	{
+		BOOST_TEST(policies[i].size() == states[i].GetCommands().size());
+	}
+	mgr.Update(std::vector<float>(states.size(), 0.0f).data(), policyArrays.data());
+	BOOST_TEST(!mgr.IsWaiting());
+}
+
+BOOST_AUTO_TEST_CASE(TestEvaluationCacheSharesLeaves)
+{
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 1), unitWithGun, 1);
+	b.SetUnitOnSquare(Position(1, 0), unitWithGun, 1);
+	GameState gs(0, 0, Phase::MOVEMENT, b);
+
+	SelfPlayManager mgr(1.4f, 0.4f, 1, 3);
+	mgr.EnableEvaluationCache(1000, 4);
+	mgr.Reset(3, gs);
+
+	//Every game starts in the same state, so only one is returned:
+	std::vector<GameState> states;
+	mgr.Select(states);
+	BOOST_REQUIRE(states.size() == 1);
+	BOOST_TEST(mgr.GetNumSelected() == 1);
+
+	auto stats = mgr.GetEvaluationCacheStats();
+	BOOST_TEST(stats.numLeaves == 3);
+	BOOST_TEST(stats.numCacheHits == 0);
+	BOOST_TEST(stats.numDuplicates == 2);
+
+	const size_t numActions = states.front().GetCommands().size();
+	std::vector<float> policy(numActions, 0.0f);
+	policy.back() = 1.0f;
+	mgr.Update({ 0.5f }, { policy });
+
+	//...but every game is updated with its evaluation:
+	BOOST_TEST((mgr.GetTreeSizes() == std::vector<int>(3, 1)));
+	BOOST_TEST(mgr.GetEvaluationCacheStats().cacheSize == 1);
+
+	//The cache is kept between resets, so the games' roots
+	// don't need evaluating again:
+	mgr.Reset(3, gs);
+	mgr.Select(states);
+	BOOST_TEST(states.empty());
+
+	stats = mgr.GetEvaluationCacheStats();
+	BOOST_TEST(stats.numLeaves == 6);
+	BOOST_TEST(stats.numCacheHits == 3);
+
+	mgr.Update({}, {});
+	BOOST_TEST((mgr.GetTreeSizes() == std::vector<int>(3, 1)));
+
+	//The cached prior was used (the games have no visits to
+	// decide with, so their distributions are the prior):
+	for (const auto& distribution : mgr.GetCurrentActionDistributions())
+	{
+		BOOST_TEST(distribution == policy, boost::test_tools::per_element());
+	}
+
+	mgr.ClearEvaluationCache();
+	BOOST_TEST(mgr.GetEvaluationCacheStats().cacheSize == 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestEvaluationCacheAccountsForEveryLeaf)
+{
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 1), unitWithGun, 1);
+	b.SetUnitOnSquare(Position(1, 0), unitWithGun, 1);
+	GameState gs(0, 0, Phase::MOVEMENT, b);
+
+	SelfPlayManager mgr(1.4f, 0.4f, 30, 3);
+	mgr.EnableEvaluationCache(100000);
+	mgr.Reset(4, gs);
+
+	size_t numEvaluations = 0;
+	auto evaluator = [&numEvaluations](const std::vector<GameState>& states,
+		std::vector<float>& outValues, std::vector<std::vector<float>>& outPolicies)
+	{
+		numEvaluations += states.size();
+		for (const auto& state : states)
+		{
+			const size_t numActions = state.GetCommands().size();
+			outValues.push_back(0.0f);
+			outPolicies.emplace_back(numActions, 1.0f / (float)numActions);
+		}
+	};
+
+	mgr.SearchFor(100000000, evaluator);
+	BOOST_TEST((mgr.GetTreeSizes() == std::vector<int>(4, 30)));
+
+	//Every leaf was either evaluated, found in the cache, or shared:
+	const auto stats = mgr.GetEvaluationCacheStats();
+	BOOST_TEST(stats.numLeaves == numEvaluations + stats.numCacheHits + stats.numDuplicates);
+	BOOST_TEST(stats.numDuplicates >= 3);
+	BOOST_TEST(stats.cacheSize == numEvaluations);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestIdenticalGamesShareATree)
+{
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 1), unitWithGun, 1);
+	b.SetUnitOnSquare(Position(1, 0), unitWithGun, 1);
+	GameState gs(0, 0, Phase::MOVEMENT, b, 2);
+
+	SelfPlayManager mgr(1.4f, 1.0f, 20, 3);
+	mgr.SetShareIdenticalGames(true);
+	mgr.Reset(4, gs);
+	BOOST_TEST(mgr.GetNumSearchTrees() == 1);
+
+	size_t numEvaluations = 0, maxBatchSize = 0;
+	auto evaluator = [&](const std::vector<GameState>& states,
+		std::vector<float>& outValues, std::vector<std::vector<float>>& outPolicies)
+	{
+		numEvaluations += states.size();
+		maxBatchSize = std::max(maxBatchSize, states.size());
+		for (const auto& state : states)
+		{
+			const size_t numActions = state.GetCommands().size();
+			outValues.push_back(0.0f);
+			outPolicies.emplace_back(numActions, 1.0f / (float)numActions);
+		}
+	};
+
+	//The games share the search of one tree:
+	mgr.SearchFor(100000000, evaluator);
+	BOOST_TEST((mgr.GetTreeSizes() == std::vector<int>(4, 20)));
+	BOOST_TEST(numEvaluations <= 20);
+	BOOST_TEST(maxBatchSize == 1);
+
+	//Games keep sharing their tree until they diverge, and
+	// then play on as normal:
+	size_t numTrees = 1;
+	while (!mgr.AllFinished())
+	{
+		mgr.Commit();
+
+		BOOST_TEST(mgr.GetNumSearchTrees() <= mgr.GetRunningGameIds().size());
+		BOOST_TEST((mgr.GetNumSearchTrees() >= numTrees || mgr.GetRunningGameIds().size() < 4));
+		numTrees = mgr.GetNumSearchTrees();
+
+		if (!mgr.AllFinished())
+			mgr.SearchFor(100000000, evaluator);
+	}
+
+	BOOST_TEST(mgr.GetGameValues().size() == 4);
+
+	//Sharing is off by default:
+	SelfPlayManager unshared(1.4f, 1.0f, 20, 3);
+	unshared.Reset(4, gs);
+	BOOST_TEST(unshared.GetNumSearchTrees() == 4);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestStatsCountTheSearch)
+{
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 1), unitWithGun, 1);
+	b.SetUnitOnSquare(Position(1, 0), unitWithGun, 1);
+	GameState gs(0, 0, Phase::MOVEMENT, b, 2);
+
+	SelfPlayManager mgr(1.4f, 1.0f, 10, 3);
+	mgr.Reset(3, gs);
+
+	auto stats = mgr.GetStats();
+	BOOST_TEST(stats.numRounds == 0);
+	BOOST_TEST(stats.numExpansions == 0);
+
+	size_t numEvaluations = 0, numRounds = 0;
+	std::vector<GameState> states;
+	while (!mgr.ReadyToCommit())
+	{
+		mgr.Select(states);
+		numEvaluations += states.size();
+		numRounds++;
+
+		std::vector<float> values(states.size(), 0.0f);
+		std::vector<std::vector<float>> policies;
+		for (const auto& state : states)
+		{
+			const size_t numActions = state.GetCommands().size();
+			policies.emplace_back(numActions, 1.0f / (float)numActions);
+		}
+		mgr.Update(values, policies);
+	}
+	mgr.Commit();
+
+	stats = mgr.GetStats();
+	BOOST_TEST(stats.numRounds == numRounds);
+	BOOST_TEST(stats.numEvaluations == numEvaluations);
+	BOOST_TEST(stats.maxTreesSearched == 3);
+
+	//Each game selected a leaf each round, and every
+	// evaluated leaf was expanded:
+	BOOST_TEST(stats.numDescents == 3 * numRounds);
+	BOOST_TEST(stats.numExpansions >= numEvaluations);
+	BOOST_TEST(stats.numOutcomes >= stats.numExpansions);
+	BOOST_TEST(stats.maxDescentDepth >= 1);
+	BOOST_TEST(stats.maxDescentDepth * stats.numDescents >= stats.totalDescentDepth);
+	BOOST_TEST(stats.numBytesAllocated >= stats.numOutcomes * sizeof(MCTSNode));
+	BOOST_TEST(stats.selectSeconds > 0.0);
+	BOOST_TEST(stats.updateSeconds > 0.0);
+	BOOST_TEST(stats.commitSeconds > 0.0);
+
+	//The bytes are also counted for each game's tree:
+	const auto treeBytes = mgr.GetTreeBytesAllocated();
+	BOOST_TEST_REQUIRE(treeBytes.size() == 3);
+	BOOST_TEST(std::accumulate(treeBytes.begin(), treeBytes.end(), (size_t)0) == stats.numBytesAllocated);
+	BOOST_TEST(std::none_of(treeBytes.begin(), treeBytes.end(), [](size_t n) { return n == 0; }));
+
+	mgr.ResetStats();
+	stats = mgr.GetStats();
+	BOOST_TEST(stats.numRounds == 0);
+	BOOST_TEST(stats.numDescents == 0);
+	BOOST_TEST(stats.numBytesAllocated == 0);
+	BOOST_TEST(stats.updateSeconds == 0.0);
+	BOOST_TEST(mgr.GetTreeBytesAllocated() == treeBytes, boost::test_tools::per_element());
+}
+
+
+BOOST_AUTO_TEST_CASE(TestTracingRecordsTheSearch)
+{
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 1), unitWithGun, 1);
+	GameState gs(0, 0, Phase::MOVEMENT, b, 2);
+
+	SelfPlayManager mgr(1.4f, 1.0f, 5, 2);
+	mgr.Reset(2, gs);
+
+	//Nothing is recorded until tracing is enabled:
+	std::stringstream trace;
+	mgr.WriteTrace(trace);
+	BOOST_TEST(trace.str().find("\"ph\":\"X\"") == std::string::npos);
+
+	mgr.EnableTracing(true);
+
+	std::vector<GameState> states;
+	while (!mgr.ReadyToCommit())
+	{
+		mgr.Select(states);
+		std::vector<std::vector<float>> policies;
+		for (const auto& state : states)
+		{
+			const size_t numActions = state.GetCommands().size();
+			policies.emplace_back(numActions, 1.0f / (float)numActions);
+		}
+		mgr.Update(std::vector<float>(states.size(), 0.0f), policies);
+	}
+	mgr.Commit();
+
+	trace.str("");
+	mgr.WriteTrace(trace);
+	for (const char* name : { "Select", "Evaluate", "Update", "Commit",
+		"select", "expand", "backpropagate", "commit" })
+	{
+		BOOST_TEST(trace.str().find("\"name\":\"" + std::string(name) + "\"") != std::string::npos,
+			name << " should be traced");
+	}
+
+	//The manager's threads are kept between rounds, so there is one row
+	// for each of them (and the calling thread), however many rounds ran:
+	size_t numRows = 0;
+	for (size_t pos = trace.str().find("thread_name"); pos != std::string::npos;
+		pos = trace.str().find("thread_name", pos + 1))
+	{
+		numRows++;
+	}
+	BOOST_TEST(numRows <= 3);
+
+	mgr.ClearTrace();
+	trace.str("");
+	mgr.WriteTrace(trace);
+	BOOST_TEST(trace.str().find("\"ph\":\"X\"") == std::string::npos);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestSnapshotResumesGames)
+{
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 1), unitWithGun, 1);
+	b.SetUnitOnSquare(Position(1, 0), unitWithGun, 1);
+	GameState gs(0, 0, Phase::MOVEMENT, b, 2);
+
+	//A deterministic evaluator which favours the first action
+	auto evaluator = [](const std::vector<GameState>& states,
+		std::vector<float>& outValues, std::vector<std::vector<float>>& outPolicies)
+	{
+		for (const auto& state : states)
+		{
+			const size_t numActions = state.GetCommands().size();
+			outValues.push_back((float)(numActions % 3) / 3.0f);
+			outPolicies.emplace_back(numActions, 1.0f / (float)(numActions + 1));
+			outPolicies.back().front() += 1.0f / (float)(numActions + 1);
+		}
+	};
+
+	//(One thread, so that the games are reproducible)
+	SelfPlayManager mgr(1.4f, 1.0f, 10, 1);
+	mgr.SetRecordExperiences(true);
+	mgr.SetShareIdenticalGames(true);
+	mgr.Reset(3, gs);
+
+	for (int i = 0; i < 2 && !mgr.AllFinished(); i++)
+	{
+		mgr.SearchFor(100000000, evaluator);
+		mgr.Commit();
+	}
+
+	std::stringstream snapshot;
+	mgr.SaveSnapshot(snapshot);
+
+	SelfPlayManager resumed(1.4f, 1.0f, 10, 1);
+	resumed.SetRecordExperiences(true);
+	resumed.SetShareIdenticalGames(true);
+	resumed.LoadSnapshot(snapshot);
+
+	BOOST_TEST(resumed.GetRunningGameIds() == mgr.GetRunningGameIds(), boost::test_tools::per_element());
+	BOOST_TEST(resumed.GetTreeSizes() == mgr.GetTreeSizes(), boost::test_tools::per_element());
+	BOOST_TEST(resumed.GetNumSearchTrees() == mgr.GetNumSearchTrees());
+	BOOST_TEST(resumed.GetTreeBytesAllocated() == mgr.GetTreeBytesAllocated(), boost::test_tools::per_element());
+	BOOST_TEST((resumed.GetCurrentGameStates() == mgr.GetCurrentGameStates()));
+
+	//Both managers play on in exactly the same way:
+	while (!mgr.AllFinished())
+	{
+		mgr.SearchFor(100000000, evaluator);
+		mgr.Commit();
+		resumed.SearchFor(100000000, evaluator);
+		resumed.Commit();
+
+		BOOST_TEST(resumed.GetTreeSizes() == mgr.GetTreeSizes(), boost::test_tools::per_element());
+	}
+
+	BOOST_TEST(resumed.AllFinished());
+	BOOST_TEST(resumed.GetGameValues() == mgr.GetGameValues(), boost::test_tools::per_element());
+	BOOST_TEST(resumed.PopFinishedRecords() == mgr.PopFinishedRecords(), boost::test_tools::per_element());
+
+	//Invalid snapshots are rejected, leaving the games as they were:
+	mgr.Reset(2, gs);
+	const std::string bytes = snapshot.str();
+	for (const std::string& invalid : { std::string("C40KLEXP"), bytes.substr(0, bytes.size() / 2),
+		bytes + "extra" })
+	{
+		std::stringstream in(invalid);
+		BOOST_CHECK_THROW(mgr.LoadSnapshot(in), std::runtime_error);
+		BOOST_TEST(mgr.GetRunningGameIds().size() == 2);
+	}
+}
+
+
+BOOST_AUTO_TEST_SUITE_END();
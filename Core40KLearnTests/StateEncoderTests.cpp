@@ -0,0 +1,241 @@
+#include "Test.h"
+#include <StateEncoder.h>
+#include <WorkerPool.h>
+#include <numeric>
+using namespace c40kl;
+
+
+//A space marine with an AP-1 bolter.
+static const Unit unitWithGun{
+	"", 1, 6, 3, 3,
+	4, 1, 1, 1, 8,
+	3, 7, 24, 4, -1,
+	1, 1, 4, 0, 1, 0,
+	true, false, false,
+	false, false, false,
+	false, false
+};
+
+
+BOOST_AUTO_TEST_SUITE(StateEncoderTests, *boost::unit_test::depends_on("GameStateTests"));
+
+
+BOOST_AUTO_TEST_CASE(TestSizes)
+{
+	BOOST_TEST(StateEncoder::GetBoardPlanesSize(3) == 3 * 3 * 38);
+	BOOST_TEST(StateEncoder::GetPolicySize(3) == 19);
+	BOOST_TEST(StateEncoder::GetRecordSize(3) == 3 * 3 * 38 + 4 + 19 + 1);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestBoardIsFromActingTeamPerspective)
+{
+	Unit enemy = unitWithGun;
+	enemy.count = 2;
+
+	BoardState b(3, 1.0f);
+	b.SetUnitOnSquare(Position(0, 1), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(2, 0), enemy, 1);
+
+	const size_t n = 2 * StateEncoder::NUM_UNIT_FEATURES;
+	std::vector<float> planes(StateEncoder::GetBoardPlanesSize(3), -1.0f);
+
+	//Team 0's point of view:
+	StateEncoder::EncodeBoard(GameState(0, 0, Phase::MOVEMENT, b), planes.data());
+
+	//Squares are indexed by (x, y):
+	const float* pAlly = planes.data() + (0 * 3 + 1) * n;
+	const float* pEnemy = planes.data() + (2 * 3 + 0) * n;
+
+	BOOST_TEST(pAlly[0] == 1.0f); //count
+	BOOST_TEST(pAlly[1] == 6.0f); //movement
+	BOOST_TEST(pAlly[11] == -1.0f); //ranged AP
+	BOOST_TEST(pAlly[StateEncoder::NUM_UNIT_FEATURES] == 0.0f);
+	BOOST_TEST(pEnemy[0] == 0.0f);
+	BOOST_TEST(pEnemy[StateEncoder::NUM_UNIT_FEATURES] == 2.0f);
+
+	//Only the two unit counts and their features should be nonzero:
+	const float total = std::accumulate(planes.begin(), planes.end(), 0.0f);
+	const float allyTotal = std::accumulate(pAlly, pAlly + n, 0.0f);
+	const float enemyTotal = std::accumulate(pEnemy, pEnemy + n, 0.0f);
+	BOOST_TEST(total == allyTotal + enemyTotal);
+
+	//Team 1's point of view swaps the halves:
+	StateEncoder::EncodeBoard(GameState(1, 1, Phase::MOVEMENT, b), planes.data());
+	BOOST_TEST(pAlly[0] == 0.0f);
+	BOOST_TEST(pAlly[StateEncoder::NUM_UNIT_FEATURES] == 1.0f);
+	BOOST_TEST(pEnemy[0] == 2.0f);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestPolicyAndRecordLayout, *boost::unit_test::tolerance(1.0e-5f))
+{
+	BoardState b(3, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 2), unitWithGun, 1);
+	GameState gs(0, 0, Phase::SHOOTING, b);
+
+	//One shooting order, and ending the phase
+	const auto cmds = gs.GetCommands();
+	BOOST_REQUIRE(cmds.size() == 2);
+	BOOST_REQUIRE((cmds[0]->GetType() == CommandType::UNIT_ORDER));
+
+	const std::vector<float> policy{ 0.75f, 0.25f };
+	std::vector<float> record(StateEncoder::GetRecordSize(3), -1.0f);
+	StateEncoder::EncodeRecord(gs, policy, 0.5f, record.data());
+
+	//Phase vector comes straight after the board:
+	const float* pPhase = record.data() + StateEncoder::GetBoardPlanesSize(3);
+	BOOST_TEST(pPhase[0] == 0.0f);
+	BOOST_TEST(pPhase[1] == 1.0f);
+
+	//Then the policy; source (0, 0) and target (0, 2):
+	const float* pPolicy = pPhase + StateEncoder::NUM_PHASES;
+	BOOST_TEST(pPolicy[0] == 0.75f);
+	BOOST_TEST(pPolicy[6] == 0.75f);
+	BOOST_TEST(pPolicy[18] == 0.25f);
+	BOOST_TEST(std::accumulate(pPolicy, pPolicy + 19, 0.0f) == 1.75f);
+
+	//Then the value:
+	BOOST_TEST(record.back() == 0.5f);
+
+	C40KL_CHECK_PRE_POST_EXCEPTION(StateEncoder::EncodePolicy(gs, { 1.0f }, record.data()),
+		std::runtime_error);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestEncodeStatesMatchesSingleStates)
+{
+	std::vector<GameState> states;
+	for (int i = 0; i < 5; i++)
+	{
+		BoardState b(4, 1.0f);
+		b.SetUnitOnSquare(Position(i % 4, 0), unitWithGun, 0);
+		b.SetUnitOnSquare(Position(3, i % 4), unitWithGun, 1);
+		states.emplace_back(i % 2, i % 2, (Phase)(i % 4), b);
+	}
+
+	const size_t numPlanes = StateEncoder::GetBoardPlanesSize(4);
+
+	std::vector<float> expectedPlanes(states.size() * numPlanes),
+		expectedPhases(states.size() * StateEncoder::NUM_PHASES);
+	for (size_t i = 0; i < states.size(); i++)
+	{
+		StateEncoder::EncodeBoard(states[i], expectedPlanes.data() + i * numPlanes);
+		StateEncoder::EncodePhase(states[i], expectedPhases.data() + i * StateEncoder::NUM_PHASES);
+	}
+
+	//Should be the same without any threads, or for any number of threads:
+	std::vector<float> planes(expectedPlanes.size(), -1.0f),
+		phases(expectedPhases.size(), -1.0f);
+	StateEncoder::EncodeStates(states, planes.data(), phases.data());
+	BOOST_TEST(planes == expectedPlanes, boost::test_tools::per_element());
+	BOOST_TEST(phases == expectedPhases, boost::test_tools::per_element());
+
+	for (size_t numThreads : { 1, 2, 3, 8 })
+	{
+		WorkerPool workers(numThreads);
+
+		//(Twice, since the threads are reused)
+		for (int repeat = 0; repeat < 2; repeat++)
+		{
+			std::fill(planes.begin(), planes.end(), -1.0f);
+			std::fill(phases.begin(), phases.end(), -1.0f);
+
+			StateEncoder::EncodeStates(states, planes.data(), phases.data(), &workers);
+
+			BOOST_TEST(planes == expectedPlanes, boost::test_tools::per_element());
+			BOOST_TEST(phases == expectedPhases, boost::test_tools::per_element());
+		}
+	}
+
+	//Mixed board sizes:
+	states.emplace_back(0, 0, Phase::MOVEMENT, BoardState(5, 1.0f));
+	planes.resize(states.size() * StateEncoder::GetBoardPlanesSize(5));
+	phases.resize(states.size() * StateEncoder::NUM_PHASES);
+	C40KL_CHECK_PRE_POST_EXCEPTION(StateEncoder::EncodeStates(states, planes.data(), phases.data()),
+		std::runtime_error);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestDecodePolicy, *boost::unit_test::tolerance(1.0e-5f))
+{
+	BoardState b(3, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 2), unitWithGun, 1);
+	GameState gs(0, 0, Phase::SHOOTING, b);
+
+	const auto cmds = gs.GetCommands();
+	BOOST_REQUIRE(cmds.size() == 2);
+
+	//The shooting order gets source (0, 0) times target (0, 2), and
+	// ending the phase gets its entry squared, then discouraged:
+	std::vector<float> policyArray(StateEncoder::GetPolicySize(3), 0.0f);
+	policyArray[0] = 0.5f;
+	policyArray[6] = 0.4f;
+	policyArray[18] = 0.1f;
+
+	const float order = 0.2f, pass = 0.01f * 1.0e-3f;
+	const auto policy = StateEncoder::DecodePolicy(cmds, 3, policyArray.data());
+	BOOST_REQUIRE(policy.size() == 2);
+	BOOST_TEST(policy[0] == order / (order + pass));
+	BOOST_TEST(policy[1] == pass / (order + pass));
+
+	//Generating the commands gives the same result:
+	BOOST_TEST(StateEncoder::DecodePolicy(gs, policyArray.data()) == policy,
+		boost::test_tools::per_element());
+
+	//All zeroes gives everything to the first command:
+	std::fill(policyArray.begin(), policyArray.end(), 0.0f);
+	BOOST_TEST(StateEncoder::DecodePolicy(cmds, 3, policyArray.data()) == std::vector<float>({ 1.0f, 0.0f }),
+		boost::test_tools::per_element());
+
+	C40KL_CHECK_PRE_POST_EXCEPTION(StateEncoder::DecodePolicy(GameCommandArray(), 3, policyArray.data()),
+		std::runtime_error);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestPolicyBatchesMatchSingleStates, *boost::unit_test::tolerance(1.0e-5f))
+{
+	std::vector<GameState> states;
+	std::vector<std::vector<float>> policies;
+	for (int i = 0; i < 4; i++)
+	{
+		BoardState b(4, 1.0f);
+		b.SetUnitOnSquare(Position(i, 0), unitWithGun, 0);
+		b.SetUnitOnSquare(Position(3 - i, 2), unitWithGun, 1);
+		states.emplace_back(0, 0, (Phase)i, b);
+
+		const size_t numCmds = states.back().GetCommands().size();
+		policies.emplace_back(numCmds, 1.0f / (float)numCmds);
+	}
+
+	const size_t policySize = StateEncoder::GetPolicySize(4);
+
+	std::vector<float> arrays(states.size() * policySize, -1.0f);
+	StateEncoder::EncodePolicies(states, policies, arrays.data());
+
+	std::vector<float> expected(policySize);
+	for (size_t i = 0; i < states.size(); i++)
+	{
+		StateEncoder::EncodePolicy(states[i], policies[i], expected.data());
+		BOOST_TEST(std::equal(expected.begin(), expected.end(), arrays.begin() + i * policySize));
+	}
+
+	const auto decoded = StateEncoder::DecodePolicies(states, arrays.data());
+	BOOST_REQUIRE(decoded.size() == states.size());
+	for (size_t i = 0; i < states.size(); i++)
+	{
+		BOOST_TEST(decoded[i] == StateEncoder::DecodePolicy(states[i], arrays.data() + i * policySize),
+			boost::test_tools::per_element());
+		BOOST_TEST(std::accumulate(decoded[i].begin(), decoded[i].end(), 0.0f) == 1.0f);
+	}
+
+	//Mismatched sizes:
+	policies.pop_back();
+	C40KL_CHECK_PRE_POST_EXCEPTION(StateEncoder::EncodePolicies(states, policies, arrays.data()),
+		std::runtime_error);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,112 @@
+#include "Test.h"
+#include <StateSerialiser.h>
+using namespace c40kl;
+
+
+//Make some states which share units in the way search trees do
+static std::vector<GameState> MakeStates()
+{
+	Unit unit;
+	unit.name = "Tactical Squad";
+	unit.count = 5;
+	unit.w = unit.total_w = 5;
+	unit.rg_ap = -1;
+	unit.firedThisTurn = true;
+
+	Unit other;
+	other.count = 1;
+	other.foughtThisTurn = true;
+
+	BoardState b(25, 2.0f);
+	b.SetUnitOnSquare(Position(3, 4), unit, 0);
+	b.SetUnitOnSquare(Position(24, 0), other, 1);
+	b.SetUnitOnSquare(Position(3, 5), other, 0);
+
+	std::vector<GameState> states;
+	states.emplace_back(0, 0, Phase::MOVEMENT, b);
+	states.emplace_back(1, 0, Phase::FIGHT, b, 5, 3);
+
+	//Moving a unit keeps sharing the others:
+	BoardState moved = b;
+	moved.ClearSquare(Position(3, 4));
+	moved.SetUnitOnSquare(Position(10, 10), unit, 0);
+	states.emplace_back(0, 0, Phase::SHOOTING, moved, 5, 4);
+
+	//And a finished game (with no units left for team 1):
+	BoardState won(25, 2.0f);
+	won.SetUnitOnSquare(Position(0, 0), unit, 0);
+	states.emplace_back(1, 1, Phase::MOVEMENT, won, 5, 4);
+
+	return states;
+}
+
+
+BOOST_AUTO_TEST_SUITE(StateSerialiserTests);
+
+
+BOOST_AUTO_TEST_CASE(TestEncodeAndDecode)
+{
+	const auto states = MakeStates();
+	const std::string bytes = StateSerialiser::Encode(states);
+
+	//The two distinct units are stored once, and each state only needs
+	// its fields and board (36 bytes) and placements with indices (16 bytes):
+	const size_t tableBytes = 2 * (8 + 80 + 8) + std::string("Tactical Squad").size();
+	BOOST_TEST(bytes.size() == 20 + tableBytes + 4 * 36 + 10 * 16);
+
+	const auto decoded = StateSerialiser::Decode(bytes);
+	BOOST_TEST_REQUIRE(decoded.size() == states.size());
+	for (size_t i = 0; i < states.size(); i++)
+	{
+		BOOST_TEST((decoded[i] == states[i]));
+		BOOST_TEST(decoded[i].GetHash() == states[i].GetHash());
+		BOOST_TEST(decoded[i].IsFinished() == states[i].IsFinished());
+		BOOST_TEST(decoded[i].GetTurnNumber() == states[i].GetTurnNumber());
+		BOOST_TEST(decoded[i].HasTurnLimit() == states[i].HasTurnLimit());
+		BOOST_TEST(decoded[i].GetBoardState().GetScale() == 2.0f);
+	}
+
+	//Equal units are shared between the decoded boards:
+	const Unit& first = decoded[0].GetBoardState().GetUnitOnSquare(Position(3, 4));
+	const Unit& moved = decoded[2].GetBoardState().GetUnitOnSquare(Position(10, 10));
+	const Unit& won = decoded[3].GetBoardState().GetUnitOnSquare(Position(0, 0));
+	BOOST_TEST(&first == &moved);
+	BOOST_TEST(&first == &won);
+
+	//No states is fine too:
+	BOOST_TEST(StateSerialiser::Decode(StateSerialiser::Encode({})).empty());
+}
+
+
+BOOST_AUTO_TEST_CASE(TestDecodeRejectsInvalidData)
+{
+	const std::string bytes = StateSerialiser::Encode(MakeStates());
+
+	for (size_t size : { (size_t)0, (size_t)19, (size_t)100, bytes.size() - 1 })
+	{
+		BOOST_CHECK_THROW(StateSerialiser::Decode(bytes.data(), size), std::runtime_error);
+	}
+
+	BOOST_CHECK_THROW(StateSerialiser::Decode(bytes + '\0'), std::runtime_error);
+
+	std::string wrongMagic = bytes;
+	wrongMagic[0] = 'X';
+	BOOST_CHECK_THROW(StateSerialiser::Decode(wrongMagic), std::runtime_error);
+
+	std::string wrongVersion = bytes;
+	wrongVersion[8] = (char)(StateSerialiser::VERSION + 1);
+	BOOST_CHECK_THROW(StateSerialiser::Decode(wrongVersion), std::runtime_error);
+
+	//A huge unit count is rejected without allocating for it
+	std::string hugeCount = bytes;
+	hugeCount[15] = (char)0x7F;
+	BOOST_CHECK_THROW(StateSerialiser::Decode(hugeCount), std::runtime_error);
+
+	//The last unit's index is out of the table
+	std::string badIndex = bytes;
+	badIndex[bytes.size() - 4] = 2;
+	BOOST_CHECK_THROW(StateSerialiser::Decode(badIndex), std::runtime_error);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END();
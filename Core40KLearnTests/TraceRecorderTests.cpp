@@ -0,0 +1,94 @@
+#include "Test.h"
+#include <TraceRecorder.h>
+#include <sstream>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+using namespace c40kl;
+
+
+//Count the occurrences of some text in a string
+static size_t CountOccurrences(const std::string& str, const std::string& text)
+{
+	size_t count = 0;
+	for (size_t pos = str.find(text); pos != std::string::npos; pos = str.find(text, pos + 1))
+		count++;
+	return count;
+}
+
+
+BOOST_AUTO_TEST_SUITE(TraceRecorderTests);
+
+
+BOOST_AUTO_TEST_CASE(TestSpansAreWrittenAsTraceEvents)
+{
+	TraceRecorder trace;
+	BOOST_TEST(trace.GetNumSpans() == 0);
+
+	const auto begin = TraceRecorder::Clock::now();
+	trace.AddSpan("first", begin, begin + std::chrono::milliseconds(2), 7);
+	{
+		TraceSpan span(&trace, "second");
+	}
+	BOOST_TEST(trace.GetNumSpans() == 2);
+
+	std::stringstream json;
+	trace.WriteJson(json);
+	const std::string str = json.str();
+
+	//One row (for this thread), and its two spans:
+	BOOST_TEST(CountOccurrences(str, "\"ph\":\"M\"") == 1);
+	BOOST_TEST(CountOccurrences(str, "\"ph\":\"X\"") == 2);
+	BOOST_TEST(CountOccurrences(str, "\"name\":\"first\"") == 1);
+	BOOST_TEST(CountOccurrences(str, "\"name\":\"second\"") == 1);
+	BOOST_TEST(CountOccurrences(str, "\"dur\":2000.000") == 1);
+	BOOST_TEST(CountOccurrences(str, "\"args\":{\"id\":7}") == 1);
+
+	//A span with no recorder does nothing:
+	{
+		TraceSpan span(nullptr, "third");
+	}
+
+	trace.Clear();
+	BOOST_TEST(trace.GetNumSpans() == 0);
+
+	json.str("");
+	trace.WriteJson(json);
+	BOOST_TEST(CountOccurrences(json.str(), "\"ph\":\"X\"") == 0);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestThreadsRecordIntoSeparateRows)
+{
+	TraceRecorder trace;
+	const size_t numJobs = 100;
+
+	//Two rounds, with a new pool each time (as the self-play manager does):
+	for (int round = 0; round < 2; round++)
+	{
+		boost::asio::thread_pool jobService(4);
+		for (size_t i = 0; i < numJobs; i++)
+		{
+			boost::asio::post(jobService, [&trace, i]()
+			{
+				TraceSpan span(&trace, "job", i);
+			});
+		}
+		jobService.join();
+	}
+
+	BOOST_TEST(trace.GetNumSpans() == 2 * numJobs);
+
+	std::stringstream json;
+	trace.WriteJson(json);
+	const std::string str = json.str();
+	BOOST_TEST(CountOccurrences(str, "\"name\":\"job\"") == 2 * numJobs);
+
+	//The creating thread has a row, and each worker thread
+	// which was running at once needs its own:
+	const size_t numRows = CountOccurrences(str, "\"ph\":\"M\"");
+	BOOST_TEST(numRows >= 2);
+	BOOST_TEST(numRows <= 9);
+}
+
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,172 @@
+#include "Test.h"
+#include <TreeParallelSearch.h>
+#include <atomic>
+#include <stdexcept>
+using namespace c40kl;
+
+
+//A space marine with an AP-1 bolter.
+static const Unit unitWithGun{
+	"", 1, 6, 3, 3,
+	4, 1, 1, 1, 8,
+	3, 7, 24, 4, -1,
+	1, 1, 4, 0, 1, 0,
+	true, false, false,
+	false, false, false,
+	false, false
+};
+
+
+//A small game which can finish within the search
+static GameState MakeState()
+{
+	BoardState b(10, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 3), unitWithGun, 1);
+	b.SetUnitOnSquare(Position(2, 3), unitWithGun, 1);
+	return GameState(0, 0, Phase::MOVEMENT, b, 2);
+}
+
+
+//Evaluates each state as a draw, with a uniform prior
+static void EvaluateUniformly(const std::vector<GameState>& states,
+	std::vector<float>& outValues, std::vector<std::vector<float>>& outPolicies)
+{
+	for (const auto& state : states)
+	{
+		const size_t numActions = state.GetCommands().size();
+		outValues.push_back(0.0f);
+		outPolicies.emplace_back(numActions, 1.0f / (float)numActions);
+	}
+}
+
+
+//Check that no virtual losses are left in the tree, and that every
+// expanded node (other than the root, which is evaluated itself) has
+// exactly one more sample than its children, unless it was expanded
+// without an evaluation (having one action.) Returns the number of
+// nodes checked.
+static size_t CheckTree(const MCTSNodePtr& pRoot)
+{
+	std::vector<MCTSNode*> pNodes = { pRoot.get() };
+	size_t numNodes = 0;
+	while (!pNodes.empty())
+	{
+		MCTSNode* pNode = pNodes.back();
+		pNodes.pop_back();
+		numNodes++;
+
+		BOOST_TEST(pNode->GetNumVirtualLosses() == 0);
+
+		if (pNode->IsLeaf())
+			continue;
+
+		size_t childSamples = 0;
+		for (int visits : pNode->GetActionVisitCounts())
+			childSamples += (size_t)visits;
+
+		if (pNode->GetNumActions() == 1)
+			BOOST_TEST(childSamples == pNode->GetNumValueSamples());
+		else
+			BOOST_TEST(childSamples + 1 == pNode->GetNumValueSamples());
+
+		for (size_t i = 0; i < pNode->GetNumActions(); i++)
+		{
+			for (const auto& pChild : pNode->GetStateResults(i))
+				pNodes.push_back(pChild.get());
+		}
+	}
+	return numNodes;
+}
+
+
+BOOST_AUTO_TEST_SUITE(TreeParallelSearchTests, *boost::unit_test::depends_on("MCTSNodeTests"));
+
+
+BOOST_AUTO_TEST_CASE(TestStatisticsAreConsistent)
+{
+	const size_t numSimulations = 400;
+
+	for (size_t numThreads : { 1, 4 })
+	{
+		TreeParallelSearch search(1.4f, 0, numThreads);
+		BOOST_TEST(search.GetNumThreads() == numThreads);
+
+		//(Boost.Test can't be used from the search's threads)
+		std::atomic<size_t> numEvaluated(0);
+		auto evaluator = [&numEvaluated](const std::vector<GameState>& states,
+			std::vector<float>& outValues, std::vector<std::vector<float>>& outPolicies)
+		{
+			numEvaluated += states.size();
+			EvaluateUniformly(states, outValues, outPolicies);
+		};
+
+		const auto pRoot = MCTSNode::CreateRootNode(MakeState());
+		const size_t numMade = search.Search(pRoot, numSimulations, 0, evaluator);
+
+		BOOST_TEST(numMade == numSimulations);
+		BOOST_TEST(search.GetLastNumSimulations() == numSimulations);
+		BOOST_TEST(pRoot->GetNumValueSamples() == numSimulations);
+		BOOST_TEST(numEvaluated <= numSimulations);
+		BOOST_TEST(CheckTree(pRoot) > numSimulations);
+
+		//Searching again carries on from the same tree:
+		search.Search(pRoot, 10, 0, evaluator);
+		BOOST_TEST(pRoot->GetNumValueSamples() == numSimulations + 10);
+		CheckTree(pRoot);
+
+		//And always makes at least one simulation:
+		BOOST_TEST(search.Search(pRoot, 0, 0, evaluator) == 1);
+		BOOST_TEST(pRoot->GetNumValueSamples() == numSimulations + 11);
+	}
+}
+
+
+BOOST_AUTO_TEST_CASE(TestTimeLimit)
+{
+	TreeParallelSearch search(1.4f, 0, 2);
+	const auto pRoot = MCTSNode::CreateRootNode(MakeState());
+
+	const size_t numMade = search.Search(pRoot, (size_t)-1, 50, EvaluateUniformly);
+
+	BOOST_TEST(numMade > 0);
+	BOOST_TEST(pRoot->GetNumValueSamples() == numMade);
+	CheckTree(pRoot);
+}
+
+
+BOOST_AUTO_TEST_CASE(TestEvaluatorErrorsAreRethrown)
+{
+	TreeParallelSearch search(1.4f, 0, 4);
+	const auto pRoot = MCTSNode::CreateRootNode(MakeState());
+
+	//An evaluator which fails part way through:
+	std::atomic<size_t> numEvaluations(0);
+	auto failing = [&numEvaluations](const std::vector<GameState>& states,
+		std::vector<float>& outValues, std::vector<std::vector<float>>& outPolicies)
+	{
+		if (++numEvaluations > 20)
+			throw std::logic_error("Evaluation failed.");
+		EvaluateUniformly(states, outValues, outPolicies);
+	};
+	BOOST_CHECK_THROW(search.Search(pRoot, 100, 0, failing), std::logic_error);
+	CheckTree(pRoot);
+
+	//The leaves which failed weren't left claimed, so can still be searched:
+	search.Search(pRoot, 100, 0, EvaluateUniformly);
+	CheckTree(pRoot);
+
+	//Policies must cover the leaf's actions:
+	auto wrongSize = [](const std::vector<GameState>& /*states*/,
+		std::vector<float>& outValues, std::vector<std::vector<float>>& outPolicies)
+	{
+		outValues.push_back(0.0f);
+		outPolicies.emplace_back(1, 1.0f);
+	};
+	const auto pOtherRoot = MCTSNode::CreateRootNode(MakeState());
+	BOOST_CHECK_THROW(search.Search(pOtherRoot, 10, 0, wrongSize), std::runtime_error);
+	BOOST_TEST(pOtherRoot->IsLeaf());
+}
+
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -79,6 +79,43 @@ BOOST_AUTO_TEST_CASE(TestUCB1SelectsWorstActionForOtherTeam)
 }
 
 
+BOOST_AUTO_TEST_CASE(TestUCB1AvoidsActionsWithVirtualLosses)
+{
+	UCB1PolicyStrategy policy(1.4f, 0);
+
+	BoardState b(25, 1.0f);
+	b.SetUnitOnSquare(Position(0, 0), unitWithGun, 0);
+	b.SetUnitOnSquare(Position(0, 1), unitWithGun, 1);
+	b.SetUnitOnSquare(Position(1, 0), unitWithGun, 1);
+	GameState gs(0, 0, Phase::FIGHT, b);
+
+	MCTSNodePtr pRoot = MCTSNode::CreateRootNode(gs);
+	pRoot->Expand({ 0.5f, 0.5f });
+
+	//Action 0 looks slightly better...
+	for (auto pNode : pRoot->GetStateResults(0))
+		pNode->AddValueStatistic(0.2f);
+	for (auto pNode : pRoot->GetStateResults(1))
+		pNode->AddValueStatistic(0.0f);
+	BOOST_TEST(policy.ActionArgMax(*pRoot) == 0);
+
+	//...until other threads are searching it:
+	auto pSearched = pRoot->GetStateResults(0).front();
+	pSearched->AddVirtualLoss();
+	pSearched->AddVirtualLoss();
+	BOOST_TEST((pRoot->GetActionVirtualLosses() == std::vector<int>{ 2, 0 }));
+	BOOST_TEST(policy.ActionArgMax(*pRoot) == 1);
+
+	//Their values don't change until they arrive:
+	BOOST_TEST(pSearched->GetValueEstimate() == 0.2f);
+
+	pSearched->RemoveVirtualLoss();
+	pSearched->RemoveVirtualLoss();
+	BOOST_TEST(pSearched->GetNumVirtualLosses() == 0);
+	BOOST_TEST(policy.ActionArgMax(*pRoot) == 0);
+}
+
+
 BOOST_AUTO_TEST_SUITE_END();
 
 
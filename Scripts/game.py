@@ -4,17 +4,22 @@ from pyapp.view import GameView
 from pyapp.human_controller import HumanController
 from pyapp.two_player_controller import TwoPlayerController
 from pyai.nn_ai_controller import NeuralNetworkAIController
+from pyai.search_ai_controller import SearchAIController
 from pyapp.model import Model
 from pyapp.game_util import load_units_csv, load_unit_placements_csv
 
 
 def create_controller(ctrl_type, model,
-                      model_filename):
+                      model_filename, search_depth, search_time_ms,
+                      ai_move_time, ai_threads):
     if ctrl_type == "P":
         return HumanController(model)
+    elif ctrl_type == "SEARCH":
+        return SearchAIController(model, search_depth, search_time_ms)
     else:
         assert(ctrl_type == "AI")
-        return NeuralNetworkAIController(model, model_filename)
+        return NeuralNetworkAIController(model, model_filename,
+                                         ai_move_time, ai_threads)
 
 
 if __name__ == "__main__":
@@ -35,13 +40,36 @@ if __name__ == "__main__":
                     type=int,
                     default=6)
     ap.add_argument("--team0",
-                    help="Who is playing as team 0 (P or AI).",
+                    help="Who is playing as team 0 (P, AI or SEARCH).",
                     type=str,
                     default="P")
     ap.add_argument("--team1",
-                    help="Who is playing as team 1 (P or AI).",
+                    help="Who is playing as team 1 (P, AI or SEARCH).",
                     type=str,
                     default="AI")
+    ap.add_argument("--search_depth",
+                    help=("The maximum number of actions the SEARCH"
+                          " controller looks ahead."),
+                    type=int,
+                    default=8)
+    ap.add_argument("--search_time_ms",
+                    help=("The time budget (in milliseconds) for each"
+                          " decision of the SEARCH controller."),
+                    type=int,
+                    default=1000)
+    ap.add_argument("--ai_move_time",
+                    help=("If given, the number of seconds the AI"
+                          " controller searches for before each decision,"
+                          " rather than a fixed number of searches."),
+                    type=float,
+                    default=None)
+    ap.add_argument("--ai_threads",
+                    help=("The number of threads the AI controller searches"
+                          " its tree with. If > 1, the network is run with"
+                          " the built-in inference engine, so the threads"
+                          " can evaluate positions at the same time."),
+                    type=int,
+                    default=1)
 
     args = ap.parse_args()
 
@@ -50,8 +78,12 @@ if __name__ == "__main__":
             os.path.exists(args.initial_state) and
             os.path.exists(args.unit_data) and
             args.turn_limit != 0 and
-            args.team0 in ["P", "AI"] and
-            args.team1 in ["P", "AI"]):
+            args.team0 in ["P", "AI", "SEARCH"] and
+            args.team1 in ["P", "AI", "SEARCH"] and
+            args.search_depth > 0 and
+            args.search_time_ms > 0 and
+            (args.ai_move_time is None or args.ai_move_time > 0.0) and
+            args.ai_threads > 0):
         raise ValueError("Invalid command line arguments.")
 
     # Load the unit statistics dataset:
@@ -69,8 +101,12 @@ if __name__ == "__main__":
 
     model = Model(units_dataset, unit_placements)
 
-    team0 = create_controller(args.team0, model, args.model_filename)
-    team1 = create_controller(args.team1, model, args.model_filename)
+    team0 = create_controller(args.team0, model, args.model_filename,
+                              args.search_depth, args.search_time_ms,
+                              args.ai_move_time, args.ai_threads)
+    team1 = create_controller(args.team1, model, args.model_filename,
+                              args.search_depth, args.search_time_ms,
+                              args.ai_move_time, args.ai_threads)
 
     ctrl = TwoPlayerController(model, team0, team1)
     view = GameView(model, ctrl)
@@ -1,18 +1,297 @@
 import os
+import queue
+import multiprocessing
 import py40kl
 import numpy as np
 from argparse import ArgumentParser
 from glob import iglob
-from random import choice
-from pyai.nn_model import NNModel
+from random import choice, SystemRandom
 from pyai.experience_dataset import ExperienceDataset
-from pyai.converter import (convert_states_to_arrays, array_to_policy,
-                            policy_to_array, NUM_FEATURES)
+from pyai.converter import convert_states_to_arrays, NUM_FEATURES
 from pyapp.model import BOARD_SIZE, BOARD_SCALE
 from pyapp.game_util import (load_units_csv, new_game_state,
                              load_unit_placements_csv)
 
 
+# The most bytes a worker may send to the inference server for each state
+# it wants evaluated (see py40kl.StateSerialiser: a state takes 32 bytes,
+# plus 12 for each unit on its board and about 100 for each distinct unit)
+MAX_REQUEST_BYTES_PER_STATE = 16384
+
+
+def load_initial_state(filename, units_dataset, unit_names, turn_limit):
+    """
+    Create the initial game state described by a unit placements CSV file.
+    """
+    unit_placements = load_unit_placements_csv(filename)
+    # Need to convert name column to index column:
+    unit_placements = [(unit_names.index(n), t, x, y)
+                       for n, t, x, y in unit_placements]
+    # Check all names in the map file were valid:
+    assert(all([i >= 0 and i < len(units_dataset)
+                for i, _, __, ___ in unit_placements]))
+    # Now create the start game state:
+    return new_game_state(units_dataset, unit_placements,
+                          BOARD_SIZE,
+                          board_scale=BOARD_SCALE,
+                          turn_limit=turn_limit)
+
+
+def create_manager(args):
+    """
+    Create a self-play manager with the settings from the command line.
+    """
+    mgr = py40kl.SelfPlayManager(args.ucb1_parameter, args.policy_temperature,
+                                 args.search_size, args.threads)
+    mgr.set_early_stopping(args.early_stopping)
+    mgr.set_share_identical_games(args.share_trees)
+    # Experiences are recorded by the manager itself, and handed over
+    # in one block of records when each game finishes:
+    mgr.set_record_experiences(True)
+    if args.solver_budget > 0:
+        mgr.enable_endgame_solver(args.solver_units, args.solver_turns,
+                                  args.solver_budget)
+    if args.cache_size > 0:
+        mgr.enable_evaluation_cache(args.cache_size)
+    if args.trace:
+        mgr.enable_tracing(True)
+    return mgr
+
+
+def start_games(mgr, args, units_dataset, num_games, concurrent_games,
+                map_fname):
+    """
+    Start the next batch of games: if concurrent_games > 0, streamed from
+    every map, and otherwise all on the map in map_fname.
+    """
+    unit_names = [x["name"] for x in units_dataset]
+
+    if concurrent_games > 0:
+        # Load every map, to draw new games from:
+        map_fnames = list(iglob(args.initial_states))
+        initial_game_states = [load_initial_state(f, units_dataset,
+                                                  unit_names,
+                                                  args.turn_limit)
+                               for f in map_fnames]
+
+        mgr.reset(initial_game_states, concurrent_games, num_games)
+
+        print("*** Playing", num_games, "games through self-play,",
+              concurrent_games, "at a time, on maps", map_fnames, "...")
+    else:
+        initial_game_state = load_initial_state(map_fname, units_dataset,
+                                                unit_names, args.turn_limit)
+
+        mgr.reset(num_games, initial_game_state)
+
+        print("*** Playing", num_games, "games through self-play on map",
+              map_fname, "...")
+
+
+def play_games(mgr, predict, snapshot=""):
+    """
+    Play the manager's games to the end, evaluating leaf states with
+    predict(states), which returns float32 arrays of values and policy
+    arrays. Returns the experience records of the finished games, as a
+    list of float32 arrays (if saving snapshots, the records are kept in
+    the manager instead, so they are saved too.)
+    """
+    records = []
+    while not mgr.all_finished():
+        # Search until at least one game is ready to move:
+        while not mgr.any_ready_to_commit():
+            # Select leaf nodes in search trees, and
+            # get states at each of them:
+            states = py40kl.GameStateArray()
+            mgr.select(states)
+
+            # If we selected any states which need evaluating...
+            if len(states) > 0:
+                # Run the network on these states to get
+                # value/policy estimates:
+                values, policies_as_numeric = predict(states)
+
+                # Update games with this info. The policies are
+                # converted from the network's array form in C++,
+                # using the actions cached in the search trees, and
+                # both arrays are read without copying into Python
+                # objects:
+                mgr.update_from_network(values, policies_as_numeric)
+            else:
+                # Empty update:
+                mgr.update([], [])
+
+        print("*** Search finished, committing to a move!",
+              "Number of games moving:",
+              len(mgr.get_running_game_ids(only_ready=True)))
+
+        # Now ready to make a decision in those games (each game
+        # moves on independently, as soon as its own search is done):
+        mgr.commit_ready()
+
+        # Collect the experiences of any games which just finished:
+        if snapshot:
+            mgr.save_snapshot(snapshot + ".tmp")
+            os.replace(snapshot + ".tmp", snapshot)
+        else:
+            records.append(np.frombuffer(mgr.pop_finished_records(),
+                                         dtype=np.float32))
+
+        # (In streaming mode, these will have been replaced already)
+        for game_id, game_value in mgr.pop_finished_games():
+            print("*** Game", game_id, "finished with score",
+                  game_value, "for team 0.")
+
+    return records
+
+
+def print_search_stats(mgr, args, prefix="***"):
+    """
+    Print (and reset) the manager's statistics about its search.
+    """
+    if args.cache_size > 0:
+        stats = mgr.get_evaluation_cache_stats()
+        print(prefix, "Evaluation cache: {num_cache_hits} hits and"
+              " {num_duplicates} duplicates out of {num_leaves} leaves"
+              " ({cache_size} cached)".format(**stats))
+
+    stats = mgr.get_stats()
+    print(prefix, "Search: {num_rounds} rounds, {select_seconds:.2f}s"
+          " selecting, {update_seconds:.2f}s updating, {commit_seconds:.2f}s"
+          " committing".format(**stats))
+    print(prefix, "Search: {num_expansions} expansions"
+          " ({outcomes_per_expansion:.2f} outcomes each), {num_evaluations}"
+          " evaluations, descent depth {avg_descent_depth:.2f} average /"
+          " {max_descent_depth} max".format(**stats))
+
+    # (Per game, since the totals above cover every game played)
+    tree_bytes = stats["tree_bytes_allocated"]
+    if tree_bytes:
+        print(prefix, "Search: {avg_mb:.1f} MB added to each game's tree on"
+              " average, {max_mb:.1f} MB at most".format(
+                  avg_mb=sum(tree_bytes) / len(tree_bytes) / 1.0e6,
+                  max_mb=max(tree_bytes) / 1.0e6))
+    mgr.reset_stats()
+
+
+def split_evenly(total, num_parts):
+    """
+    Split a number into num_parts whole numbers, as evenly as possible.
+    """
+    return [total // num_parts + (1 if i < total % num_parts else 0)
+            for i in range(num_parts)]
+
+
+def run_worker(args, server_name, worker_idx, num_games, concurrent_games,
+               map_fname, seed, results):
+    """
+    Play games in a worker process, evaluating the leaf states with the
+    network in the main process (through the inference server), and put
+    (worker_idx, record bytes, game values) into the results queue.
+    """
+    client = py40kl.InferenceClient(server_name, worker_idx)
+    policy_size = py40kl.StateEncoder.get_policy_size(BOARD_SIZE)
+
+    def predict(states):
+        values = np.empty(len(states), dtype=np.float32)
+        policies = np.empty((len(states), policy_size), dtype=np.float32)
+        client.predict(states, values, policies)
+        return values, policies
+
+    mgr = create_manager(args)
+    mgr.set_seed(seed)
+    start_games(mgr, args, load_units_csv(args.unit_data), num_games,
+                concurrent_games, map_fname)
+
+    records = play_games(mgr, predict)
+    records.append(np.frombuffer(mgr.pop_finished_records(),
+                                 dtype=np.float32))
+    client.disconnect()
+
+    print_search_stats(mgr, args,
+                       prefix="*** Worker {}:".format(worker_idx + 1))
+    results.put((worker_idx, np.concatenate(records).tobytes(),
+                 list(mgr.get_game_values())))
+
+
+def check_workers(workers):
+    """
+    Raise an error if any worker process has failed.
+    """
+    if any(w.exitcode not in (None, 0) for w in workers):
+        raise RuntimeError("A self-play worker process failed.")
+
+
+def play_in_workers(args, predict, map_fname, iteration):
+    """
+    Play the iteration's games in args.workers worker processes, acting as
+    their inference server: leaf states from every worker are gathered
+    into one batch, evaluated with predict(), and sent back. Returns the
+    experience records (as a float32 array) and the game values.
+    """
+    num_games = split_evenly(args.num_games, args.workers)
+    concurrent_games = split_evenly(args.concurrent_games, args.workers)
+
+    # A worker sends at most one leaf per running game at once:
+    max_states = max(concurrent_games) if args.concurrent_games > 0 \
+        else max(num_games)
+    server_name = "c40kl_play_{}_{}".format(os.getpid(), iteration)
+    server = py40kl.InferenceServer(server_name, args.workers, BOARD_SIZE,
+                                    max_states,
+                                    max_states * MAX_REQUEST_BYTES_PER_STATE)
+
+    # (Spawned rather than forked, since this process may be running
+    # TensorFlow)
+    context = multiprocessing.get_context("spawn")
+    results_queue = context.Queue()
+    seeds = SystemRandom()
+    workers = [context.Process(target=run_worker,
+                               args=(args, server_name, i, num_games[i],
+                                     concurrent_games[i], map_fname,
+                                     seeds.getrandbits(32), results_queue))
+               for i in range(args.workers)]
+    for worker in workers:
+        worker.start()
+
+    try:
+        num_batches = 0
+        num_states = 0
+        while not server.all_workers_finished():
+            states = server.wait_for_requests(100)
+            if len(states) > 0:
+                server.respond(*predict(states))
+                num_batches += 1
+                num_states += len(states)
+            check_workers(workers)
+
+        print("*** Evaluated", num_states, "states for", args.workers,
+              "workers in", num_batches, "batches")
+
+        results = []
+        while len(results) < len(workers):
+            try:
+                results.append(results_queue.get(timeout=1.0))
+            except queue.Empty:
+                check_workers(workers)
+    except BaseException:
+        # Nothing will read the other workers' results now, and a worker
+        # can't exit until its results have been read, so stop them
+        # rather than wait for them forever
+        for worker in workers:
+            worker.terminate()
+        raise
+    finally:
+        # (If anything failed, this stops any workers still waiting)
+        server.shutdown()
+        for worker in workers:
+            worker.join()
+
+    results.sort(key=lambda result: result[0])
+    records = [np.frombuffer(r, dtype=np.float32) for _, r, __ in results]
+    game_values = [v for _, __, values in results for v in values]
+    return np.concatenate(records), game_values
+
+
 if __name__ == "__main__":
     ap = ArgumentParser()
     ap.add_argument("--model_filename",
@@ -21,7 +300,7 @@ if __name__ == "__main__":
                     type=str,
                     default='')
     ap.add_argument("--data",
-                    help="The wildcard pattern for all data folders.",
+                    help="The wildcard pattern for all experience files.",
                     type=str, required=True)
     ap.add_argument("--initial_states",
                     help=("The wildcard pattern for all CSV files of"
@@ -40,6 +319,15 @@ if __name__ == "__main__":
                           " iteration."),
                     type=int,
                     default=20)
+    ap.add_argument("--concurrent_games",
+                    help=("If > 0, play in 'streaming' mode: only this many"
+                          " games are played at once, and each finished game"
+                          " is immediately replaced by a new one (until"
+                          " num_games have been played), with its map drawn"
+                          " at random from all of the initial states. This"
+                          " keeps the evaluation batches the same size."),
+                    type=int,
+                    default=0)
     ap.add_argument("--threads",
                     help="The number of threads to use for self-play.",
                     type=int,
@@ -69,6 +357,65 @@ if __name__ == "__main__":
                           " means closer to an argmax. Must be >= 0."),
                     type=float,
                     default=0.5)
+    ap.add_argument("--early_stopping",
+                    help=("Stop searching a game as soon as its most"
+                          " visited action can no longer be overtaken."),
+                    action="store_true")
+    ap.add_argument("--share_trees",
+                    help=("Let games which start in the same state share"
+                          " one search tree until their moves diverge."),
+                    action="store_true")
+    ap.add_argument("--solver_budget",
+                    help=("The maximum number of states the exact endgame"
+                          " solver may visit per leaf. Zero disables the"
+                          " solver."),
+                    type=int,
+                    default=0)
+    ap.add_argument("--solver_units",
+                    help=("The maximum number of units left on the board"
+                          " for a leaf to be given to the endgame solver."),
+                    type=int,
+                    default=2)
+    ap.add_argument("--solver_turns",
+                    help=("The maximum number of turns remaining for a leaf"
+                          " to be given to the endgame solver."),
+                    type=int,
+                    default=1)
+    ap.add_argument("--cache_size",
+                    help=("The maximum number of leaf evaluations to cache"
+                          " and reuse between games and moves. Zero disables"
+                          " the cache."),
+                    type=int,
+                    default=0)
+    ap.add_argument("--native_inference",
+                    help=("Run the network with the built-in C++ inference"
+                          " engine during self-play, instead of with"
+                          " TensorFlow."),
+                    action="store_true")
+    ap.add_argument("--trace",
+                    help=("If given, record a timeline of the search on each"
+                          " iteration, and write it to this file (in the"
+                          " Chrome trace format, for chrome://tracing or"
+                          " Perfetto.) '{iteration}' is replaced by the"
+                          " iteration number."),
+                    type=str,
+                    default="")
+    ap.add_argument("--snapshot",
+                    help=("If given, save the games in progress (including"
+                          " their search trees) to this file after every"
+                          " move, so that an interrupted run can resume: if"
+                          " the file exists when starting, the first"
+                          " iteration carries on with its games."),
+                    type=str,
+                    default="")
+    ap.add_argument("--workers",
+                    help=("If > 0, play the games in this many worker"
+                          " processes (each using --threads threads), with"
+                          " this process running the network for all of"
+                          " them in shared batches. Can't be used with"
+                          " --trace or --snapshot."),
+                    type=int,
+                    default=0)
 
     args = ap.parse_args()
 
@@ -77,16 +424,30 @@ if __name__ == "__main__":
             os.path.exists(args.unit_data) and
             args.search_size > 0 and
             args.num_games > 0 and
+            args.concurrent_games >= 0 and
             args.threads > 0 and
             args.iterations > 0 and
             args.turn_limit != 0 and
             args.ucb1_parameter > 0.0 and
-            args.policy_temperature >= 0.0):
+            args.policy_temperature >= 0.0 and
+            args.solver_budget >= 0 and
+            args.solver_units >= 0 and
+            args.solver_turns >= 0 and
+            args.cache_size >= 0 and
+            args.workers >= 0 and
+            args.workers <= args.num_games and
+            (args.concurrent_games == 0 or
+             args.workers <= args.concurrent_games) and
+            not (args.workers > 0 and (args.trace or args.snapshot))):
         raise ValueError("Invalid command line arguments.")
 
-    # Create the self-play manager:
-    mgr = py40kl.SelfPlayManager(args.ucb1_parameter, args.policy_temperature,
-                                 args.search_size, args.threads)
+    # (Imported here rather than at the top, so that worker processes,
+    # which import this script, don't load TensorFlow)
+    from pyai.nn_model import NNModel
+
+    # Create the self-play manager (unless the workers play the games):
+    mgr = create_manager(args) if args.workers == 0 else None
+    record_size = py40kl.StateEncoder.get_record_size(BOARD_SIZE)
 
     # Create the neural network model:
     model = NNModel(board_size=BOARD_SIZE,
@@ -94,6 +455,39 @@ if __name__ == "__main__":
                               os.path.exists(args.model_filename)
                               else None))
 
+    # The weights don't change during self-play, so the C++ network only
+    # needs exporting once:
+    network = None
+    encoder_workers = None
+    if args.native_inference:
+        network = model.load_native_network(args.threads)
+        print("*** Using the built-in inference engine, AVX2 enabled:",
+              py40kl.NeuralNetwork.uses_avx2())
+    elif args.threads > 1:
+        # (Kept for every batch, rather than starting threads each time)
+        encoder_workers = py40kl.WorkerPool(args.threads)
+    policy_size = py40kl.StateEncoder.get_policy_size(BOARD_SIZE)
+
+    def predict(states):
+        """
+        Run the network on some states, to get value/policy estimates
+        as float32 arrays.
+        """
+        if network is not None:
+            values = np.empty(len(states), dtype=np.float32)
+            policies_as_numeric = np.empty((len(states), policy_size),
+                                           dtype=np.float32)
+            network.predict(states, values, policies_as_numeric)
+        else:
+            # Get game states and phases in array form
+            game_states_arr, phases_arr = convert_states_to_arrays(
+                states, workers=encoder_workers)
+            values, policies_as_numeric = model.predict(game_states_arr,
+                                                        phases_arr)
+
+        return (np.ascontiguousarray(values, dtype=np.float32),
+                np.ascontiguousarray(policies_as_numeric, dtype=np.float32))
+
     # Create the dataset:
     dataset = ExperienceDataset(filename=args.data,
                                 board_size=BOARD_SIZE,
@@ -101,107 +495,59 @@ if __name__ == "__main__":
 
     # Load the unit statistics dataset:
     units_dataset = load_units_csv(args.unit_data)
-    # Extract a separate list of names:
-    unit_names = [x["name"] for x in units_dataset]
 
     for self_play_iteration in range(args.iterations):
         print("*** Starting self-play iteration", self_play_iteration + 1)
 
-        # Load initial game state:
-        unit_placements_fname = choice(list(iglob(args.initial_states)))
-        unit_placements = load_unit_placements_csv(unit_placements_fname)
-        # Need to convert name column to index column:
-        unit_placements = [(unit_names.index(n), t, x, y)
-                           for n, t, x, y in unit_placements]
-        # Check all names in the map file were valid:
-        assert(all([i >= 0 and i < len(units_dataset)
-                    for i, _, __, ___ in unit_placements]))
-        # Now create the start game state:
-        initial_game_state = new_game_state(units_dataset, unit_placements,
-                                            BOARD_SIZE,
-                                            board_scale=BOARD_SCALE,
-                                            turn_limit=args.turn_limit)
-
-        # Reserve space for next batch of experiences:
-        mgr.reset(args.num_games, initial_game_state)
-        dataset.set_buffer(args.num_games)
-
-        print("*** Playing", args.num_games, "games through self-play on map",
-              unit_placements_fname, "...")
-
-        # Generate the next batch of experiences:
-        while not mgr.all_finished():
-            while not mgr.ready_to_commit():
-                # Select leaf nodes in search trees, and
-                # get states at each of them:
-                states = py40kl.GameStateArray()
-                mgr.select(states)
-
-                # If we selected any states which need evaluating...
-                if len(states) > 0:
-                    # Get game states and phases in array form
-                    (game_states_arr,
-                     phases_arr) = convert_states_to_arrays(states)
-
-                    # Run the network on these states to get
-                    # value/policy estimates:
-                    (values,
-                     policies_as_numeric) = model.predict(game_states_arr,
-                                                          phases_arr)
-
-                    # Obtain the actual policies from the numeric (array)
-                    # output from the neural network:
-                    policies = [array_to_policy(pol_arr, state)
-                                for pol_arr, state
-                                in zip(policies_as_numeric, states)]
-
-                    # Convert the values into a CPP usable form (namely
-                    # by reshaping it to a 1D array and converting from
-                    # numpy.float32 to native float):
-                    values = list(map(float, values.reshape((-1,))))
-
-                    # Update games with this info:
-                    mgr.update(values, policies)
-                else:
-                    # Empty update:
-                    mgr.update([], [])
-
-            # Get current game info:
-            game_states = mgr.get_current_game_states()
-            game_states_numeric, phases = convert_states_to_arrays(game_states)
-            policies = mgr.get_current_action_distributions()
-            game_ids = mgr.get_running_game_ids()  # some might be finished
-            teams = [state.get_acting_team() for state in game_states]
-
-            print("*** Search finished, committing to a move!",
-                  "Number of unfinished games:", len(game_states),
-                  "Average turn number:", np.average([state.get_turn_number()
-                                                      for state in game_states
-                                                      if not state.is_finished(
-                                                      )]))
-
-            # Convert policies into the trainable format:
-            policies = [policy_to_array(pol, gs)
-                        for pol, gs in zip(policies, game_states)]
-
-            # Save to experience dataset buffer:
-            dataset.add_to_buffer(game_states_numeric, teams, phases,
-                                  policies, ids=game_ids)
-
-            # Now ready to make a decision in-game:
-            mgr.commit()
-
-        # Get the game values, with respect to team 0:
-        game_values = mgr.get_game_values()
+        # Choose this iteration's map (unless streaming from every map):
+        map_fname = (None if args.concurrent_games > 0
+                     else choice(list(iglob(args.initial_states))))
+
+        if args.workers > 0:
+            print("*** Playing in", args.workers, "worker processes...")
+            records, game_values = play_in_workers(args, predict, map_fname,
+                                                   self_play_iteration)
+        else:
+            if (self_play_iteration == 0 and args.snapshot and
+                    os.path.exists(args.snapshot)):
+                mgr.load_snapshot(args.snapshot)
+
+                print("*** Resuming", len(mgr.get_running_game_ids()),
+                      "games from", args.snapshot, "...")
+            else:
+                start_games(mgr, args, units_dataset, args.num_games,
+                            args.concurrent_games, map_fname)
+
+            # Generate the next batch of experiences:
+            records = play_games(mgr, predict, args.snapshot)
+
+            # Get the game values, with respect to team 0:
+            game_values = mgr.get_game_values()
+
+            print_search_stats(mgr, args)
+
+            if args.trace:
+                trace_filename = args.trace.format(
+                    iteration=self_play_iteration + 1)
+                print("*** Writing search timeline to", trace_filename)
+                mgr.write_trace(trace_filename)
+                mgr.clear_trace()
+
+            records.append(np.frombuffer(mgr.pop_finished_records(),
+                                         dtype=np.float32))
+            records = np.concatenate(records)
 
         print("*** Finished playing! Average game score for team 0:",
               np.average(game_values))
 
+        # Now we've built up a batch of new experiences, commit them
+        # to the database:
         print("*** Saving game results...")
+        dataset.commit_records(records.reshape((-1, record_size)))
 
-        # Now we've built up a buffer of new experiences, commit them
-        # to the database and train:
-        dataset.commit(game_values)
+        # The games are safely saved, so there is nothing to resume:
+        if args.snapshot and os.path.exists(args.snapshot):
+            os.remove(args.snapshot)
 
         print("*** Finished! Iteration complete.")
 
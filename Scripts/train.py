@@ -14,7 +14,7 @@ if __name__ == "__main__":
                           "doesn't exist, will start training from scratch."),
                     type=str, required=True)
     ap.add_argument("--data",
-                    help="The wildcard pattern for all data folders.",
+                    help="The wildcard pattern for all experience files.",
                     type=str, required=True)
     ap.add_argument("--num_batches",
                     help=("The number of batches to run. Each batch "
@@ -32,6 +32,13 @@ if __name__ == "__main__":
                           "batch."),
                     type=int,
                     default=25)
+    ap.add_argument("--recency_half_life",
+                    help=("If > 0, sample recent experiences more often:"
+                          " the chance of sampling an experience halves"
+                          " for every this many experiences recorded after"
+                          " it. Zero means uniform sampling."),
+                    type=float,
+                    default=0.0)
 
     args = ap.parse_args()
 
@@ -39,7 +46,8 @@ if __name__ == "__main__":
     if not(len(list(iglob(args.data))) > 0 and
            args.num_batches > 0 and
            args.batch_size > 0 and
-           args.num_epochs > 0):
+           args.num_epochs > 0 and
+           args.recency_half_life >= 0.0):
         raise ValueError("Invalid command line arguments.")
 
     # Create the neural network model:
@@ -51,7 +59,8 @@ if __name__ == "__main__":
     # Create the dataset:
     dataset = ExperienceDataset(filename=args.data,
                                 board_size=BOARD_SIZE,
-                                num_board_features=NUM_FEATURES)
+                                num_board_features=NUM_FEATURES,
+                                recency_half_life=args.recency_half_life)
 
     for i in range(args.num_batches):
         print("*** Starting batch", i + 1, "... collecting sample...")
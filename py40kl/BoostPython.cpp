@@ -12,6 +12,15 @@ BOOST_PYTHON_MODULE(py40kl)
 	ExportUCB1PolicyStrategy();
 	ExportUniformRandomEstimator();
 	ExportSelfPlayManager();
+	ExportExpectimaxSolver();
+	ExportExpectiminimaxSearch();
+	ExportStateEncoder();
+	ExportStateSerialiser();
+	ExportExperienceFile();
+	ExportExperienceSampler();
+	ExportNeuralNetwork();
+	ExportInferenceServer();
+	ExportTreeParallelSearch();
 }
 
 
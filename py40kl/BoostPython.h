@@ -17,5 +17,20 @@ void ExportMCTS();
 void ExportUCB1PolicyStrategy();
 void ExportUniformRandomEstimator();
 void ExportSelfPlayManager();
+void ExportExpectimaxSolver();
+void ExportExpectiminimaxSearch();
+void ExportStateEncoder();
+void ExportStateSerialiser();
+void ExportExperienceFile();
+void ExportExperienceSampler();
+void ExportNeuralNetwork();
+void ExportInferenceServer();
+void ExportTreeParallelSearch();
+
+
+//Convert Python iterables of values and policies, as returned from
+// evaluators, to CPP (defined in SelfPlayManager.cpp)
+std::vector<float> ConvertValues(object values);
+std::vector<std::vector<float>> ConvertPolicies(object policies);
 
 
@@ -0,0 +1,24 @@
+#include "BoostPython.h"
+#include <ExpectimaxSolver.h>
+using namespace c40kl;
+
+
+//Returns the value, or None if the solver ran out of budget
+object ExpectimaxSolver_PySolve(ExpectimaxSolver& solver, const GameState& state, int team)
+{
+	float value = 0.0f;
+	if (solver.Solve(state, team, value))
+		return object(value);
+	else
+		return object();
+}
+
+
+void ExportExpectimaxSolver()
+{
+	class_<ExpectimaxSolver, boost::noncopyable>("ExpectimaxSolver", init<size_t>())
+		.def(init<size_t, size_t>())
+		.def("solve", &ExpectimaxSolver_PySolve)
+		.def("get_table_size", &ExpectimaxSolver::GetTableSize)
+		.def("clear_table", &ExpectimaxSolver::ClearTable);
+}
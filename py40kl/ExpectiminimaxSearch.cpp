@@ -0,0 +1,15 @@
+#include "BoostPython.h"
+#include <ExpectiminimaxSearch.h>
+using namespace c40kl;
+
+
+void ExportExpectiminimaxSearch()
+{
+	class_<ExpectiminimaxSearch, boost::noncopyable>("ExpectiminimaxSearch", init<int, int>())
+		.def("search", &ExpectiminimaxSearch::Search)
+		.def("get_last_value", &ExpectiminimaxSearch::GetLastValue)
+		.def("get_last_depth", &ExpectiminimaxSearch::GetLastDepth)
+		.def("get_last_node_count", &ExpectiminimaxSearch::GetLastNodeCount)
+		.def("evaluate_heuristic", &ExpectiminimaxSearch::EvaluateHeuristic)
+		.staticmethod("evaluate_heuristic");
+}
@@ -0,0 +1,66 @@
+#include "BoostPython.h"
+#include "FloatBuffer.h"
+#include <ExperienceFile.h>
+#include <stdexcept>
+using namespace c40kl;
+
+
+//Write records from any C-contiguous float32 array (e.g. a numpy array,
+// or numpy.frombuffer() of SelfPlayManager.pop_finished_records())
+// without copying them into Python objects first.
+void ExperienceFileWriter_PyWrite(ExperienceFileWriter& writer, object records)
+{
+	ReadableFloatBuffer recordsBuf(records, "records");
+
+	const size_t recordSize = StateEncoder::GetRecordSize(writer.GetBoardSize());
+	if (recordsBuf.GetSize() % recordSize != 0)
+		throw std::runtime_error("records must contain a whole number of records.");
+
+	writer.Write(recordsBuf.Get(), recordsBuf.GetSize() / recordSize);
+}
+
+
+//Returns the records as a bytes object of float32 values, in the
+// same format as SelfPlayManager.pop_finished_records()
+object ExperienceFileReader_PyReadRecords(const ExperienceFileReader& reader, object indices)
+{
+	std::vector<size_t> cppIndices;
+	cppIndices.reserve(len(indices));
+	for (size_t i = 0; i < (size_t)len(indices); i++)
+	{
+		cppIndices.push_back(extract<size_t>(indices[i]));
+	}
+
+	for (size_t idx : cppIndices)
+	{
+		if (idx >= reader.GetNumRecords())
+			throw std::out_of_range("Record index out of range.");
+	}
+
+	std::vector<float> records(cppIndices.size() * StateEncoder::GetRecordSize(reader.GetBoardSize()));
+	reader.ReadRecords(cppIndices, records.data());
+
+	PyObject* pBytes = PyBytes_FromStringAndSize(
+		reinterpret_cast<const char*>(records.data()),
+		(Py_ssize_t)(records.size() * sizeof(float)));
+	return object(handle<>(pBytes));
+}
+
+
+void ExportExperienceFile()
+{
+	class_<ExperienceFile>("ExperienceFile", no_init)
+		.def("get_record_bytes", &ExperienceFile::GetRecordBytes)
+		.staticmethod("get_record_bytes");
+
+	class_<ExperienceFileWriter, boost::noncopyable>("ExperienceFileWriter", init<std::string, int>())
+		.def("write", &ExperienceFileWriter_PyWrite)
+		.def("close", &ExperienceFileWriter::Close)
+		.def("get_board_size", &ExperienceFileWriter::GetBoardSize)
+		.def("get_num_records", &ExperienceFileWriter::GetNumRecords);
+
+	class_<ExperienceFileReader, boost::noncopyable>("ExperienceFileReader", init<std::string>())
+		.def("read_records", &ExperienceFileReader_PyReadRecords)
+		.def("get_board_size", &ExperienceFileReader::GetBoardSize)
+		.def("get_num_records", &ExperienceFileReader::GetNumRecords);
+}
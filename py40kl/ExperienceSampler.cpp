@@ -0,0 +1,37 @@
+#include "BoostPython.h"
+#include "FloatBuffer.h"
+#include <ExperienceSampler.h>
+using namespace c40kl;
+
+
+//Fill preallocated float32 arrays (of any shape, as long as they have
+// the right number of elements) with a sample. The sample size is the
+// number of elements in 'values'.
+void ExperienceSampler_PySample(ExperienceSampler& sampler, object states, object phases,
+	object values, object policies)
+{
+	if (sampler.GetNumRecords() == 0)
+		throw std::runtime_error("No experiences to sample from.");
+
+	const int boardSize = sampler.GetBoardSize();
+	const size_t n = len(values);
+
+	WritableFloatBuffer statesBuf(states, n * StateEncoder::GetBoardPlanesSize(boardSize), "states");
+	WritableFloatBuffer phasesBuf(phases, n * StateEncoder::NUM_PHASES, "phases");
+	WritableFloatBuffer valuesBuf(values, n, "values");
+	WritableFloatBuffer policiesBuf(policies, n * StateEncoder::GetPolicySize(boardSize), "policies");
+
+	sampler.Sample(n, statesBuf.Get(), phasesBuf.Get(), policiesBuf.Get(), valuesBuf.Get());
+}
+
+
+void ExportExperienceSampler()
+{
+	class_<ExperienceSampler, boost::noncopyable>("ExperienceSampler", init<>())
+		.def("add_file", &ExperienceSampler::AddFile)
+		.def("set_recency_half_life", &ExperienceSampler::SetRecencyHalfLife)
+		.def("sample", &ExperienceSampler_PySample)
+		.def("get_num_records", &ExperienceSampler::GetNumRecords)
+		.def("get_num_files", &ExperienceSampler::GetNumFiles)
+		.def("get_board_size", &ExperienceSampler::GetBoardSize);
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+
+#include "BoostPython.h"
+#include <boost/noncopyable.hpp>
+#include <cstdint>
+#include <string>
+
+
+//Holds a C-contiguous buffer of numbers (e.g. a numpy array)
+// for as long as it is in scope.
+class ArrayBuffer :
+	public boost::noncopyable
+{
+public:
+	~ArrayBuffer()
+	{
+		PyBuffer_Release(&m_View);
+	}
+
+	//The number of items in the buffer
+	size_t GetSize() const
+	{
+		return (size_t)(m_View.len / m_View.itemsize);
+	}
+
+protected:
+	//formats lists the buffer format characters which are
+	// allowed, all of which must have the given item size.
+	ArrayBuffer(object obj, const char* name, int flags, const char* formats,
+		size_t itemSize, const char* typeName)
+	{
+		if (PyObject_GetBuffer(obj.ptr(), &m_View,
+			PyBUF_C_CONTIGUOUS | PyBUF_FORMAT | flags) != 0)
+		{
+			throw_error_already_set();
+		}
+
+		//Native or little-endian byte order are both fine
+		std::string format = (m_View.format != nullptr) ? m_View.format : "";
+		if (!format.empty() && (format[0] == '@' || format[0] == '=' || format[0] == '<'))
+			format = format.substr(1);
+
+		if ((size_t)m_View.itemsize != itemSize || format.size() != 1
+			|| std::string(formats).find(format[0]) == std::string::npos)
+		{
+			PyBuffer_Release(&m_View);
+			throw std::runtime_error(std::string(name) + " must be a " + typeName + " array.");
+		}
+	}
+
+	//Called from derived constructors, so the buffer is
+	// released by our destructor if this throws
+	void CheckSize(size_t expectedSize, const char* name) const
+	{
+		if (GetSize() != expectedSize)
+			throw std::runtime_error(std::string(name) + " has the wrong size.");
+	}
+
+	void* GetData() const
+	{
+		return m_View.buf;
+	}
+
+private:
+	Py_buffer m_View;
+};
+
+
+//A float32 buffer which we write the output of a function into
+class WritableFloatBuffer :
+	public ArrayBuffer
+{
+public:
+	WritableFloatBuffer(object obj, size_t expectedSize, const char* name) :
+		ArrayBuffer(obj, name, PyBUF_WRITABLE, "f", sizeof(float), "float32")
+	{
+		CheckSize(expectedSize, name);
+	}
+
+	float* Get()
+	{
+		return static_cast<float*>(GetData());
+	}
+};
+
+
+//A float32 buffer which we only read from
+class ReadableFloatBuffer :
+	public ArrayBuffer
+{
+public:
+	ReadableFloatBuffer(object obj, const char* name) :
+		ArrayBuffer(obj, name, PyBUF_SIMPLE, "f", sizeof(float), "float32")
+	{
+	}
+
+	ReadableFloatBuffer(object obj, size_t expectedSize, const char* name) :
+		ReadableFloatBuffer(obj, name)
+	{
+		CheckSize(expectedSize, name);
+	}
+
+	const float* Get() const
+	{
+		return static_cast<const float*>(GetData());
+	}
+};
+
+
+//An int64 buffer which we only read from (e.g. a list of offsets)
+class ReadableInt64Buffer :
+	public ArrayBuffer
+{
+public:
+	ReadableInt64Buffer(object obj, size_t expectedSize, const char* name) :
+		ArrayBuffer(obj, name, PyBUF_SIMPLE, "ql", sizeof(int64_t), "int64")
+	{
+		CheckSize(expectedSize, name);
+	}
+
+	const int64_t* Get() const
+	{
+		return static_cast<const int64_t*>(GetData());
+	}
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+
+#include "BoostPython.h"
+#include <boost/noncopyable.hpp>
+
+
+//Releases the GIL for as long as it is in scope, so that other
+// Python threads can run during long C++ calls. No Python objects
+// (including boost::python::object) may be touched while released.
+class ReleaseGIL :
+	public boost::noncopyable
+{
+public:
+	ReleaseGIL() :
+		m_pThreadState(PyEval_SaveThread())
+	{
+	}
+
+	~ReleaseGIL()
+	{
+		PyEval_RestoreThread(m_pThreadState);
+	}
+
+private:
+	PyThreadState* m_pThreadState;
+};
+
+
+//Acquires the GIL for as long as it is in scope, e.g. to call back
+// into Python from inside a call which released it with ReleaseGIL.
+class AcquireGIL :
+	public boost::noncopyable
+{
+public:
+	AcquireGIL() :
+		m_State(PyGILState_Ensure())
+	{
+	}
+
+	~AcquireGIL()
+	{
+		PyGILState_Release(m_State);
+	}
+
+private:
+	PyGILState_STATE m_State;
+};
@@ -1,6 +1,7 @@
 #include "BoostPython.h"
 #include "CommandWrapper.h"
 #include <GameState.h>
+#include <StateSerialiser.h>
 using namespace c40kl;
 
 
@@ -14,6 +15,41 @@ std::vector<CommandWrapper> WrappedGetCommands(const GameState& gs)
 }
 
 
+//Encodes the state on its own (see StateSerialiser) as a bytes object
+object GameState_ToBytes(const GameState& gs)
+{
+	const std::string bytes = StateSerialiser::Encode({ gs });
+	return object(handle<>(PyBytes_FromStringAndSize(bytes.data(), (Py_ssize_t)bytes.size())));
+}
+
+
+//Decodes a state from a bytes object made by to_bytes()
+GameState GameState_FromBytes(const std::string& bytes)
+{
+	auto states = StateSerialiser::Decode(bytes);
+	if (states.size() != 1)
+		throw std::runtime_error("Expected exactly one encoded game state.");
+	return states.front();
+}
+
+
+//Constructs a state from a bytes object made by to_bytes() (for pickling)
+std::shared_ptr<GameState> GameState_ConstructFromBytes(const std::string& bytes)
+{
+	return std::make_shared<GameState>(GameState_FromBytes(bytes));
+}
+
+
+//Pickles states as their bytes (see to_bytes())
+struct GameStatePickleSuite : pickle_suite
+{
+	static tuple getinitargs(const GameState& gs)
+	{
+		return make_tuple(GameState_ToBytes(gs));
+	}
+};
+
+
 void ExportGameState()
 {
 	class_<std::vector<GameState>>("GameStateArray")
@@ -32,6 +68,11 @@ void ExportGameState()
 		.def("get_turn_number", &GameState::GetTurnNumber)
 		.def("get_board_state", &GameState::GetBoardState,
 			return_value_policy<copy_const_reference>())
+		.def("to_bytes", &GameState_ToBytes)
+		.def("from_bytes", &GameState_FromBytes)
+		.staticmethod("from_bytes")
+		.def("__init__", make_constructor(&GameState_ConstructFromBytes))
+		.def_pickle(GameStatePickleSuite())
 		.def(self == self)
 		.def("__str__", &GameState::ToString);
 }
@@ -0,0 +1,74 @@
+#include "BoostPython.h"
+#include "FloatBuffer.h"
+#include "GIL.h"
+#include <InferenceServer.h>
+#include <StateEncoder.h>
+using namespace c40kl;
+
+
+//Returns the states of every request which arrived within the timeout,
+// as a GameStateArray (which is empty if there were none.) The GIL is
+// released while waiting.
+std::vector<GameState> InferenceServer_PyWaitForRequests(InferenceServer& server, size_t timeoutMilliseconds)
+{
+	if (server.IsWaitingToRespond())
+		throw std::runtime_error("respond() must be called before waiting for more requests.");
+
+	std::vector<GameState> states;
+
+	ReleaseGIL release;
+	server.WaitForRequests(timeoutMilliseconds, states);
+	return states;
+}
+
+
+//Answer the states from wait_for_requests() with float32 arrays
+// of shape (n,) (or (n, 1)) and (n, get_policy_size()).
+void InferenceServer_PyRespond(InferenceServer& server, object values, object policies)
+{
+	if (!server.IsWaitingToRespond())
+		throw std::runtime_error("wait_for_requests() must return some states before respond().");
+
+	const size_t n = server.GetBatchSize();
+	ReadableFloatBuffer valuesBuf(values, n, "values");
+	ReadableFloatBuffer policiesBuf(policies,
+		n * StateEncoder::GetPolicySize(server.GetBoardSize()), "policies");
+
+	server.Respond(valuesBuf.Get(), policiesBuf.Get());
+}
+
+
+//Evaluate states with the server's network, writing into preallocated
+// float32 arrays like NeuralNetwork.predict(). The GIL is released
+// while waiting for the server.
+void InferenceClient_PyPredict(InferenceClient& client, const std::vector<GameState>& states,
+	object outValues, object outPolicies)
+{
+	WritableFloatBuffer valuesBuf(outValues, states.size(), "out_values");
+	WritableFloatBuffer policiesBuf(outPolicies,
+		states.size() * StateEncoder::GetPolicySize(client.GetBoardSize()), "out_policies");
+
+	ReleaseGIL release;
+	client.Predict(states, valuesBuf.Get(), policiesBuf.Get());
+}
+
+
+void ExportInferenceServer()
+{
+	class_<InferenceServer, boost::noncopyable>("InferenceServer",
+		init<std::string, size_t, int, size_t, size_t>((arg("name"), arg("num_workers"),
+			arg("board_size"), arg("max_states_per_request"), arg("max_request_bytes"))))
+		.def("wait_for_requests", &InferenceServer_PyWaitForRequests, (arg("timeout_milliseconds")))
+		.def("respond", &InferenceServer_PyRespond, (arg("values"), arg("policies")))
+		.def("shutdown", &InferenceServer::Shutdown)
+		.def("all_workers_finished", &InferenceServer::AllWorkersFinished)
+		.def("get_num_workers", &InferenceServer::GetNumWorkers)
+		.def("get_board_size", &InferenceServer::GetBoardSize);
+
+	class_<InferenceClient, boost::noncopyable>("InferenceClient",
+		init<std::string, size_t>((arg("name"), arg("worker_index"))))
+		.def("predict", &InferenceClient_PyPredict,
+			(arg("states"), arg("out_values"), arg("out_policies")))
+		.def("disconnect", &InferenceClient::Disconnect)
+		.def("get_board_size", &InferenceClient::GetBoardSize);
+}
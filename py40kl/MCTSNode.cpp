@@ -17,6 +17,24 @@ void MCTSNodeExpandWithPythonList(MCTSNodeWrapper& node, list& py_list)
 }
 
 
+//Writes the subtree (see MCTSNode::Write()) as a bytes object
+object MCTSNodeToBytes(const MCTSNodeWrapper& node)
+{
+	BinaryWriter writer;
+	node.GetRawPtr()->Write(writer);
+	const std::string& bytes = writer.GetBytes();
+	return object(handle<>(PyBytes_FromStringAndSize(bytes.data(), (Py_ssize_t)bytes.size())));
+}
+
+
+//Reads a subtree from a bytes object written by to_bytes()
+MCTSNodeWrapper MCTSNodeFromBytes(const std::string& bytes)
+{
+	BinaryReader reader(bytes);
+	return MCTSNodeWrapper(MCTSNode::Read(reader));
+}
+
+
 void ExportMCTS()
 {        
 	class_<MCTSNodeWrapper>("MCTSNode", no_init)
@@ -41,7 +59,10 @@ void ExportMCTS()
 		.def("get_state_results", &MCTSNodeWrapper::GetStateResults)
 		.def("get_state", &MCTSNodeWrapper::GetState,
 			return_value_policy<copy_const_reference>())
-		.def("get_depth", &MCTSNodeWrapper::GetDepth);
+		.def("get_depth", &MCTSNodeWrapper::GetDepth)
+		.def("to_bytes", &MCTSNodeToBytes)
+		.def("from_bytes", &MCTSNodeFromBytes)
+		.staticmethod("from_bytes");
 
 	class_<std::vector<MCTSNodeWrapper>>("MCTSNodeArray")
 		.def(vector_indexing_suite<std::vector<MCTSNodeWrapper>, true>());
@@ -0,0 +1,42 @@
+#include "BoostPython.h"
+#include "FloatBuffer.h"
+#include "GIL.h"
+#include <NeuralNetwork.h>
+#include <StateEncoder.h>
+#include <Gemm.h>
+using namespace c40kl;
+
+
+//Run the network on a GameStateArray, writing into preallocated float32
+// arrays of shape (n,) (or (n, 1)) and (n, get_policy_size()). The GIL
+// is released while the network runs.
+void NeuralNetwork_PyPredict(const NeuralNetwork& network, const std::vector<GameState>& states,
+	object outValues, object outPolicies)
+{
+	const int size = network.GetBoardSize();
+	for (const auto& state : states)
+	{
+		if (state.GetBoardState().GetSize() != size)
+			throw std::runtime_error("States must have the same board size as the network.");
+	}
+
+	WritableFloatBuffer valuesBuf(outValues, states.size(), "out_values");
+	WritableFloatBuffer policiesBuf(outPolicies,
+		states.size() * StateEncoder::GetPolicySize(size), "out_policies");
+
+	ReleaseGIL release;
+	network.Predict(states, valuesBuf.Get(), policiesBuf.Get());
+}
+
+
+void ExportNeuralNetwork()
+{
+	class_<NeuralNetwork, boost::noncopyable>("NeuralNetwork",
+		init<std::string, size_t>((arg("filename"), arg("num_threads") = 1)))
+		.def("get_board_size", &NeuralNetwork::GetBoardSize)
+		.def("predict", &NeuralNetwork_PyPredict,
+			(arg("states"), arg("out_values"), arg("out_policies")))
+		.def("uses_avx2", &Gemm::HasAVX2)
+		.staticmethod("uses_avx2")
+		.setattr("FILE_VERSION", (size_t)NeuralNetwork::FILE_VERSION);
+}
@@ -1,13 +1,17 @@
 #include "BoostPython.h"
+#include "FloatBuffer.h"
+#include "GIL.h"
 #include <SelfPlayManager.h>
+#include <NeuralNetwork.h>
+#include <StateEncoder.h>
+#include <fstream>
+#include <stdexcept>
 using namespace c40kl;
 
 
-//Special version of Update() for arbitrary Python iterables
-void SelfPlayManager_PyUpdate(SelfPlayManager& mgr, object values, object policies)
+//Convert an arbitrary Python iterable of values to CPP
+std::vector<float> ConvertValues(object values)
 {
-	//Convert values to CPP
-
 	std::vector<float> cppValues;
 	cppValues.reserve(len(values));
 	for (size_t i = 0; i < len(values); i++)
@@ -15,9 +19,13 @@ void SelfPlayManager_PyUpdate(SelfPlayManager& mgr, object values, object polici
 		auto val = values[i];
 		cppValues.push_back(extract<float>(val));
 	}
+	return cppValues;
+}
 
-	//Convert policies to CPP
 
+//Convert an arbitrary Python iterable of policies to CPP
+std::vector<std::vector<float>> ConvertPolicies(object policies)
+{
 	std::vector<std::vector<float>> cppPolicies;
 	cppPolicies.reserve(len(policies));
 	for (size_t i = 0; i < len(policies); i++)
@@ -32,16 +40,305 @@ void SelfPlayManager_PyUpdate(SelfPlayManager& mgr, object values, object polici
 			cppPolicies.back().push_back(extract<float>(policy[j]));
 		}
 	}
+	return cppPolicies;
+}
+
+
+//The long-running calls below release the GIL while in C++, so
+// other Python threads (e.g. writing experiences, or running the
+// network) can carry on. The manager itself is not thread safe:
+// only one thread may use it at a time, and the arguments (such as
+// the output array given to select()) must not be used by other
+// threads until the call returns.
 
-	//Now call the Update function:
+
+//Special version of Update() for arbitrary Python iterables
+void SelfPlayManager_PyUpdate(SelfPlayManager& mgr, object values, object policies)
+{
+	const auto cppValues = ConvertValues(values);
+	const auto cppPolicies = ConvertPolicies(policies);
+
+	ReleaseGIL release;
 	mgr.Update(cppValues, cppPolicies);
 }
 
 
-std::vector<int> SelfPlayManager_GetRunningGameIds(const SelfPlayManager& mgr)
+void SelfPlayManager_PyUpdateFromVectors(SelfPlayManager& mgr, const std::vector<float>& values,
+	const std::vector<std::vector<float>>& policies)
+{
+	ReleaseGIL release;
+	mgr.Update(values, policies);
+}
+
+
+void SelfPlayManager_PySelect(SelfPlayManager& mgr, std::vector<GameState>& outLeafStates)
+{
+	ReleaseGIL release;
+	mgr.Select(outLeafStates);
+}
+
+
+void SelfPlayManager_PyCommit(SelfPlayManager& mgr)
+{
+	ReleaseGIL release;
+	mgr.Commit();
+}
+
+
+void SelfPlayManager_PyCommitReady(SelfPlayManager& mgr)
+{
+	ReleaseGIL release;
+	mgr.CommitReady();
+}
+
+
+//The size of a float32 buffer holding one policy array for each of
+// the states returned from select(), which must all have the same
+// board size. (The size is never inferred from the buffer itself,
+// since the manager reads a policy array for each of its leaves.)
+static size_t GetSelectedPolicyArraysSize(const SelfPlayManager& mgr)
+{
+	const size_t n = mgr.GetNumSelected();
+	if (n == 0)
+		return 0;
+
+	const int size = mgr.GetSelectedBoardSize();
+	if (size == 0)
+		throw std::runtime_error("All selected states must have the same board size.");
+
+	return n * StateEncoder::GetPolicySize(size);
+}
+
+
+//Decode a float32 array of the network's policy outputs for the
+// states returned from select(), of shape (n, get_policy_size()).
+std::vector<std::vector<float>> SelfPlayManager_PyDecodeSelectedPolicies(const SelfPlayManager& mgr,
+	object policyArrays)
+{
+	if (!mgr.IsWaiting())
+		throw std::runtime_error("select() should be called before decode_selected_policies().");
+
+	ReadableFloatBuffer policyBuf(policyArrays, GetSelectedPolicyArraysSize(mgr), "policy_arrays");
+
+	ReleaseGIL release;
+	return mgr.DecodeSelectedPolicies(policyBuf.Get());
+}
+
+
+//Version of Update() which reads float32 arrays directly: a value for
+// each selected state, and every policy one after the other, where the
+// ith policy is policies[offsets[i]:offsets[i + 1]].
+void SelfPlayManager_PyUpdateFromBuffers(SelfPlayManager& mgr, object values, object policies,
+	object offsets)
+{
+	const size_t n = mgr.GetNumSelected();
+
+	ReadableFloatBuffer valuesBuf(values, n, "values");
+	ReadableFloatBuffer policiesBuf(policies, "policies");
+	ReadableInt64Buffer offsetsBuf(offsets, n + 1, "offsets");
+
+	const int64_t* pOffsets = offsetsBuf.Get();
+	if (pOffsets[0] != 0 || pOffsets[n] != (int64_t)policiesBuf.GetSize())
+		throw std::runtime_error("offsets must start at 0 and end at the size of policies.");
+
+	for (size_t i = 0; i < n; i++)
+	{
+		if (pOffsets[i + 1] < pOffsets[i])
+			throw std::runtime_error("offsets must be nondecreasing.");
+	}
+
+	//The buffers stay valid until they are released (after the GIL
+	// is acquired again), so they can be read without the GIL.
+	ReleaseGIL release;
+
+	std::vector<std::vector<float>> cppPolicies;
+	cppPolicies.reserve(n);
+	for (size_t i = 0; i < n; i++)
+	{
+		cppPolicies.emplace_back(policiesBuf.Get() + pOffsets[i], policiesBuf.Get() + pOffsets[i + 1]);
+	}
+
+	mgr.Update(std::vector<float>(valuesBuf.Get(), valuesBuf.Get() + n), cppPolicies);
+}
+
+
+//Version of Update() which takes the network's raw outputs: a float32
+// array of values, of shape (n,) or (n, 1), and a float32 array of
+// policy arrays, of shape (n, get_policy_size()).
+void SelfPlayManager_PyUpdateFromNetwork(SelfPlayManager& mgr, object values, object policyArrays)
+{
+	ReadableFloatBuffer valuesBuf(values, mgr.GetNumSelected(), "values");
+	ReadableFloatBuffer policyBuf(policyArrays, GetSelectedPolicyArraysSize(mgr), "policy_arrays");
+
+	ReleaseGIL release;
+	mgr.Update(valuesBuf.Get(), policyBuf.Get());
+}
+
+
+//Version of SearchFor() which takes a Python callable. The callable
+// is given a GameStateArray and must return a (values, policies) pair
+// in the same form as the arguments to update(). The GIL is only held
+// while the callable runs.
+std::vector<std::vector<float>> SelfPlayManager_PySearchFor(SelfPlayManager& mgr, size_t milliseconds, object evaluator)
+{
+	auto cppEvaluator = [&evaluator](const std::vector<GameState>& states,
+		std::vector<float>& outValues, std::vector<std::vector<float>>& outPolicies)
+	{
+		AcquireGIL acquire;
+		object result = evaluator(states);
+		outValues = ConvertValues(result[0]);
+		outPolicies = ConvertPolicies(result[1]);
+	};
+
+	ReleaseGIL release;
+	return mgr.SearchFor(milliseconds, cppEvaluator);
+}
+
+
+//Version of SearchFor() which evaluates leaves with the built-in
+// network, without calling into Python at all.
+std::vector<std::vector<float>> SelfPlayManager_PySearchForWithNetwork(SelfPlayManager& mgr,
+	size_t milliseconds, const NeuralNetwork& network)
+{
+	auto evaluator = [&network](const std::vector<GameState>& states,
+		float* outValues, float* outPolicyArrays)
+	{
+		if (states.front().GetBoardState().GetSize() != network.GetBoardSize())
+			throw std::runtime_error("States must have the same board size as the network.");
+
+		network.Predict(states, outValues, outPolicyArrays);
+	};
+
+	ReleaseGIL release;
+	return mgr.SearchFor(milliseconds, PolicyArrayEvaluator(evaluator));
+}
+
+
+//Version of the streaming Reset() which takes any Python iterable
+// of initial states. Checks the arguments, since the preconditions
+// are only checked in debug builds and the manager would otherwise
+// never finish.
+void SelfPlayManager_PyResetFromPool(SelfPlayManager& mgr, object initialStates,
+	size_t numConcurrentGames, size_t totalGames)
+{
+	if (numConcurrentGames == 0 && totalGames > 0)
+		throw std::runtime_error("Need to play at least one game at a time.");
+	if (len(initialStates) == 0)
+		throw std::runtime_error("Need at least one initial state.");
+
+	std::vector<GameState> pool;
+	pool.reserve(len(initialStates));
+	for (size_t i = 0; i < (size_t)len(initialStates); i++)
+	{
+		pool.push_back(extract<GameState>(initialStates[i]));
+	}
+
+	mgr.Reset(pool, numConcurrentGames, totalGames);
+}
+
+
+//Returns the finished games as a list of (game ID, value) tuples
+list SelfPlayManager_PopFinishedGames(SelfPlayManager& mgr)
+{
+	list output;
+	for (const auto& game : mgr.PopFinishedGames())
+		output.append(make_tuple((int)game.first, game.second));
+
+	return output;
+}
+
+
+//Returns the finished records as a bytes object of float32 values,
+// to avoid creating a Python object per value. Use numpy.frombuffer()
+// and reshape with StateEncoder.get_record_size() to read them.
+object SelfPlayManager_PopFinishedRecords(SelfPlayManager& mgr)
+{
+	const auto records = mgr.PopFinishedRecords();
+	PyObject* pBytes = PyBytes_FromStringAndSize(
+		reinterpret_cast<const char*>(records.data()),
+		(Py_ssize_t)(records.size() * sizeof(float)));
+	return object(handle<>(pBytes));
+}
+
+
+//Returns the evaluation cache statistics as a dict, with the same names
+dict SelfPlayManager_GetEvaluationCacheStats(const SelfPlayManager& mgr)
+{
+	const auto stats = mgr.GetEvaluationCacheStats();
+
+	dict output;
+	output["num_leaves"] = stats.numLeaves;
+	output["num_cache_hits"] = stats.numCacheHits;
+	output["num_duplicates"] = stats.numDuplicates;
+	output["cache_size"] = stats.cacheSize;
+	return output;
+}
+
+
+dict SelfPlayManager_GetStats(const SelfPlayManager& mgr)
+{
+	const auto stats = mgr.GetStats();
+
+	dict output;
+	output["num_rounds"] = stats.numRounds;
+	output["select_seconds"] = stats.selectSeconds;
+	output["update_seconds"] = stats.updateSeconds;
+	output["commit_seconds"] = stats.commitSeconds;
+	output["num_expansions"] = stats.numExpansions;
+	output["num_outcomes"] = stats.numOutcomes;
+	output["num_descents"] = stats.numDescents;
+	output["max_descent_depth"] = stats.maxDescentDepth;
+	output["num_evaluations"] = stats.numEvaluations;
+	output["num_bytes_allocated"] = stats.numBytesAllocated;
+	output["max_trees_searched"] = stats.maxTreesSearched;
+
+	//The bytes added to each game's tree, indexed by game ID (these
+	// are kept with the games, so aren't cleared by reset_stats())
+	list treeBytes;
+	for (size_t numBytes : mgr.GetTreeBytesAllocated())
+		treeBytes.append(numBytes);
+	output["tree_bytes_allocated"] = treeBytes;
+
+	//Averages, for convenience (zero if nothing has been counted yet)
+	output["avg_descent_depth"] = stats.numDescents == 0 ? 0.0
+		: (double)stats.totalDescentDepth / stats.numDescents;
+	output["outcomes_per_expansion"] = stats.numExpansions == 0 ? 0.0
+		: (double)stats.numOutcomes / stats.numExpansions;
+	return output;
+}
+
+
+void SelfPlayManager_SaveSnapshot(const SelfPlayManager& mgr, const std::string& filename)
+{
+	std::ofstream file(filename, std::ios::binary);
+	mgr.SaveSnapshot(file);
+	if (!file)
+		throw std::runtime_error("Could not write " + filename + ".");
+}
+
+
+void SelfPlayManager_LoadSnapshot(SelfPlayManager& mgr, const std::string& filename)
+{
+	std::ifstream file(filename, std::ios::binary);
+	if (!file)
+		throw std::runtime_error("Could not open " + filename + ".");
+	mgr.LoadSnapshot(file);
+}
+
+
+void SelfPlayManager_WriteTrace(const SelfPlayManager& mgr, const std::string& filename)
+{
+	std::ofstream file(filename);
+	mgr.WriteTrace(file);
+	if (!file)
+		throw std::runtime_error("Could not write " + filename + ".");
+}
+
+
+std::vector<int> SelfPlayManager_GetRunningGameIds(const SelfPlayManager& mgr, bool onlyReady)
 {
 	std::vector<int> output;
-	auto result = mgr.GetRunningGameIds();
+	auto result = mgr.GetRunningGameIds(onlyReady);
 	output.reserve(result.size());
 
 	for (auto i : result)
@@ -54,19 +351,51 @@ std::vector<int> SelfPlayManager_GetRunningGameIds(const SelfPlayManager& mgr)
 void ExportSelfPlayManager()
 {
 	class_<SelfPlayManager, boost::noncopyable>("SelfPlayManager", init<float, float, size_t, size_t>())
-		.def("reset", &SelfPlayManager::Reset)
-		.def("select", &SelfPlayManager::Select)
-		.def("update", &SelfPlayManager::Update)
+		.def("reset", (void (SelfPlayManager::*)(size_t, const GameState&))&SelfPlayManager::Reset)
+		.def("reset", &SelfPlayManager_PyResetFromPool)
+		.def("enable_endgame_solver", &SelfPlayManager::EnableEndgameSolver)
+		.def("enable_evaluation_cache", &SelfPlayManager::EnableEvaluationCache,
+			(arg("max_size"), arg("num_shards") = 16))
+		.def("clear_evaluation_cache", &SelfPlayManager::ClearEvaluationCache)
+		.def("get_evaluation_cache_stats", &SelfPlayManager_GetEvaluationCacheStats)
+		.def("get_stats", &SelfPlayManager_GetStats)
+		.def("reset_stats", &SelfPlayManager::ResetStats)
+		.def("enable_tracing", &SelfPlayManager::EnableTracing)
+		.def("clear_trace", &SelfPlayManager::ClearTrace)
+		.def("write_trace", &SelfPlayManager_WriteTrace)
+		.def("save_snapshot", &SelfPlayManager_SaveSnapshot)
+		.def("load_snapshot", &SelfPlayManager_LoadSnapshot)
+		.def("set_early_stopping", &SelfPlayManager::SetEarlyStopping)
+		.def("set_share_identical_games", &SelfPlayManager::SetShareIdenticalGames)
+		.def("set_seed", &SelfPlayManager::SetSeed)
+		.def("set_record_experiences", &SelfPlayManager::SetRecordExperiences)
+		.def("select", &SelfPlayManager_PySelect)
+		.def("update", &SelfPlayManager_PyUpdateFromVectors)
 		.def("update", &SelfPlayManager_PyUpdate)
-		.def("commit", &SelfPlayManager::Commit)
+		.def("update", &SelfPlayManager_PyUpdateFromBuffers)
+		.def("update_from_network", &SelfPlayManager_PyUpdateFromNetwork)
+		.def("decode_selected_policies", &SelfPlayManager_PyDecodeSelectedPolicies)
+		.def("get_num_selected", &SelfPlayManager::GetNumSelected)
+		.def("get_selected_board_size", &SelfPlayManager::GetSelectedBoardSize)
+		.def("commit", &SelfPlayManager_PyCommit)
+		.def("commit_ready", &SelfPlayManager_PyCommitReady)
+		.def("search_for", &SelfPlayManager_PySearchFor)
+		.def("search_for", &SelfPlayManager_PySearchForWithNetwork)
 		.def("is_waiting", &SelfPlayManager::IsWaiting)
 		.def("ready_to_commit", &SelfPlayManager::ReadyToCommit)
+		.def("any_ready_to_commit", &SelfPlayManager::AnyReadyToCommit)
 		.def("all_finished", &SelfPlayManager::AllFinished)
-		.def("get_current_game_states", &SelfPlayManager::GetCurrentGameStates)
-		.def("get_current_action_distributions", &SelfPlayManager::GetCurrentActionDistributions)
+		.def("get_current_game_states", &SelfPlayManager::GetCurrentGameStates,
+			(arg("only_ready") = false))
+		.def("get_current_action_distributions", &SelfPlayManager::GetCurrentActionDistributions,
+			(arg("only_ready") = false))
 		.def("get_game_values", &SelfPlayManager::GetGameValues)
+		.def("pop_finished_games", &SelfPlayManager_PopFinishedGames)
+		.def("pop_finished_records", &SelfPlayManager_PopFinishedRecords)
 		.def("get_tree_sizes", &SelfPlayManager::GetTreeSizes)
-		.def("get_running_game_ids", &SelfPlayManager_GetRunningGameIds)
+		.def("get_num_search_trees", &SelfPlayManager::GetNumSearchTrees)
+		.def("get_running_game_ids", &SelfPlayManager_GetRunningGameIds,
+			(arg("only_ready") = false))
 		.def("get_action_visit_counts", &SelfPlayManager::GetActionVisitCounts);
 }
 
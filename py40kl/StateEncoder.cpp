@@ -0,0 +1,115 @@
+#include "BoostPython.h"
+#include "FloatBuffer.h"
+#include <StateEncoder.h>
+#include <WorkerPool.h>
+using namespace c40kl;
+
+
+//Check that every state has the same board size, and return it
+static int GetCommonBoardSize(const std::vector<GameState>& states)
+{
+	const int size = states.empty() ? 0 : states.front().GetBoardState().GetSize();
+
+	for (const auto& state : states)
+	{
+		if (state.GetBoardState().GetSize() != size)
+			throw std::runtime_error("All states must have the same board size.");
+	}
+
+	return size;
+}
+
+
+//Encode a GameStateArray into preallocated float32 arrays (e.g.
+// numpy arrays of shape (n, size, size, 2 * NUM_UNIT_FEATURES) and
+// (n, NUM_PHASES)), without creating any Python objects per state.
+void StateEncoder_PyEncodeStates(const std::vector<GameState>& states, object outPlanes,
+	object outPhases, WorkerPool* pWorkers)
+{
+	const int size = GetCommonBoardSize(states);
+
+	WritableFloatBuffer planesBuf(outPlanes,
+		states.size() * StateEncoder::GetBoardPlanesSize(size), "out_planes");
+	WritableFloatBuffer phasesBuf(outPhases,
+		states.size() * StateEncoder::NUM_PHASES, "out_phases");
+
+	StateEncoder::EncodeStates(states, planesBuf.Get(), phasesBuf.Get(), pWorkers);
+}
+
+
+//Encode a list of policies (distributions over each state's commands)
+// into a preallocated float32 array of shape (n, get_policy_size()).
+void StateEncoder_PyEncodePolicies(const std::vector<GameState>& states, object policies,
+	object out)
+{
+	const int size = GetCommonBoardSize(states);
+	const size_t policySize = StateEncoder::GetPolicySize(size);
+
+	if ((size_t)len(policies) != states.size())
+		throw std::runtime_error("Need one policy per state.");
+
+	WritableFloatBuffer outBuf(out, states.size() * policySize, "out");
+
+	for (size_t i = 0; i < states.size(); i++)
+	{
+		const auto cmds = states[i].GetCommands();
+		object policy = policies[i];
+
+		std::vector<float> cppPolicy;
+		cppPolicy.reserve(cmds.size());
+		for (size_t j = 0; j < (size_t)len(policy); j++)
+			cppPolicy.push_back(extract<float>(policy[j]));
+
+		if (cppPolicy.size() != cmds.size())
+			throw std::runtime_error("Policy size needs to match the number of commands.");
+
+		StateEncoder::EncodePolicy(cmds, size, cppPolicy, outBuf.Get() + i * policySize);
+	}
+}
+
+
+//Decode a float32 array of network policy outputs, of shape
+// (n, get_policy_size()), into distributions over each state's commands.
+std::vector<std::vector<float>> StateEncoder_PyDecodePolicies(const std::vector<GameState>& states,
+	object policyArrays)
+{
+	const int size = GetCommonBoardSize(states);
+
+	for (const auto& state : states)
+	{
+		if (state.IsFinished())
+			throw std::runtime_error("Cannot decode a policy for a finished state.");
+	}
+
+	ReadableFloatBuffer policyBuf(policyArrays,
+		states.size() * StateEncoder::GetPolicySize(size), "policy_arrays");
+
+	return StateEncoder::DecodePolicies(states, policyBuf.Get());
+}
+
+
+void ExportStateEncoder()
+{
+	//For encode_states(), so that the threads are kept between batches
+	class_<WorkerPool, boost::noncopyable>("WorkerPool", init<size_t>())
+		.def("get_num_threads", &WorkerPool::GetNumThreads);
+
+	class_<StateEncoder>("StateEncoder", no_init)
+		.setattr("NUM_UNIT_FEATURES", (size_t)StateEncoder::NUM_UNIT_FEATURES)
+		.setattr("NUM_PHASES", (size_t)StateEncoder::NUM_PHASES)
+		.def("get_board_planes_size", &StateEncoder::GetBoardPlanesSize)
+		.staticmethod("get_board_planes_size")
+		.def("get_policy_size", &StateEncoder::GetPolicySize)
+		.staticmethod("get_policy_size")
+		.def("get_record_size", &StateEncoder::GetRecordSize)
+		.staticmethod("get_record_size")
+		.def("encode_states", &StateEncoder_PyEncodeStates,
+			(arg("states"), arg("out_planes"), arg("out_phases"), arg("workers") = object()))
+		.staticmethod("encode_states")
+		.def("encode_policies", &StateEncoder_PyEncodePolicies,
+			(arg("states"), arg("policies"), arg("out")))
+		.staticmethod("encode_policies")
+		.def("decode_policies", &StateEncoder_PyDecodePolicies,
+			(arg("states"), arg("policy_arrays")))
+		.staticmethod("decode_policies");
+}
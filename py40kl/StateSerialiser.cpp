@@ -0,0 +1,29 @@
+#include "BoostPython.h"
+#include <StateSerialiser.h>
+using namespace c40kl;
+
+
+//Encodes a GameStateArray (see StateSerialiser::Encode()) as a bytes object
+object StateSerialiser_PyEncode(const std::vector<GameState>& states)
+{
+	const std::string bytes = StateSerialiser::Encode(states);
+	return object(handle<>(PyBytes_FromStringAndSize(bytes.data(), (Py_ssize_t)bytes.size())));
+}
+
+
+//Decodes a bytes object made by encode() into a GameStateArray
+std::vector<GameState> StateSerialiser_PyDecode(const std::string& bytes)
+{
+	return StateSerialiser::Decode(bytes);
+}
+
+
+void ExportStateSerialiser()
+{
+	class_<StateSerialiser>("StateSerialiser", no_init)
+		.setattr("VERSION", StateSerialiser::VERSION)
+		.def("encode", &StateSerialiser_PyEncode, (arg("states")))
+		.staticmethod("encode")
+		.def("decode", &StateSerialiser_PyDecode, (arg("data")))
+		.staticmethod("decode");
+}
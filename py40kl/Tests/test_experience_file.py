@@ -0,0 +1,47 @@
+"""
+Tests for the checks the py40kl bindings make on the records given to
+ExperienceFileWriter. Run with the built module on the path, e.g.
+through ctest.
+"""
+from array import array
+import os
+import tempfile
+import unittest
+
+import py40kl
+
+
+class ExperienceFileWriterTests(unittest.TestCase):
+
+    def setUp(self):
+        self.dir = tempfile.TemporaryDirectory()
+        self.filename = os.path.join(self.dir.name, "test.c40klexp")
+
+    def tearDown(self):
+        self.dir.cleanup()
+
+    def test_write_rejects_other_types(self):
+        record_size = py40kl.StateEncoder.get_record_size(5)
+        writer = py40kl.ExperienceFileWriter(self.filename, 5)
+
+        # float64 (or bytes) must not be reinterpreted as float32:
+        with self.assertRaises(RuntimeError):
+            writer.write(array('d', [0.0] * record_size))
+        with self.assertRaises(RuntimeError):
+            writer.write(bytes(4 * record_size))
+        self.assertEqual(writer.get_num_records(), 0)
+
+        writer.write(array('f', [0.0] * (2 * record_size)))
+        self.assertEqual(writer.get_num_records(), 2)
+
+    def test_write_rejects_partial_records(self):
+        record_size = py40kl.StateEncoder.get_record_size(5)
+        writer = py40kl.ExperienceFileWriter(self.filename, 5)
+
+        with self.assertRaises(RuntimeError):
+            writer.write(array('f', [0.0] * (record_size + 1)))
+        self.assertEqual(writer.get_num_records(), 0)
+
+
+if __name__ == '__main__':
+    unittest.main()
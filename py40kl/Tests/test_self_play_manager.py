@@ -0,0 +1,110 @@
+"""
+Tests for the checks the py40kl bindings make on the arrays given to
+SelfPlayManager, which the C++ library only checks in debug builds.
+Run with the built module on the path, e.g. through ctest.
+"""
+from array import array
+import unittest
+
+import py40kl
+
+
+def make_unit():
+    # A space marine with a bolter
+    unit = py40kl.Unit()
+    unit.count = 1
+    unit.movement = 6
+    unit.ws = 3
+    unit.bs = 3
+    unit.t = 4
+    unit.w = 1
+    unit.total_w = 1
+    unit.a = 1
+    unit.ld = 8
+    unit.sv = 3
+    unit.inv = 7
+    unit.rg_range = 24
+    unit.rg_s = 4
+    unit.rg_shots = 1
+    unit.rg_dmg = 1
+    unit.ml_s = 4
+    unit.ml_dmg = 1
+    unit.rg_is_rapid = True
+    return unit
+
+
+def make_manager(board_size, num_games=3):
+    b = py40kl.BoardState(board_size, 1.0)
+    b.set_unit_on_square(py40kl.Position(0, 0), make_unit(), 0)
+    b.set_unit_on_square(py40kl.Position(0, 1), make_unit(), 1)
+    b.set_unit_on_square(py40kl.Position(1, 0), make_unit(), 1)
+    gs = py40kl.GameState(0, 0, py40kl.Phase.MOVEMENT, b, -1)
+
+    mgr = py40kl.SelfPlayManager(1.4, 0.4, 10, 1)
+    mgr.reset(num_games, gs)
+    return mgr
+
+
+def select(mgr):
+    states = py40kl.GameStateArray()
+    mgr.select(states)
+    return len(states)
+
+
+class PolicyArraySizeTests(unittest.TestCase):
+
+    def test_selected_board_size(self):
+        mgr = make_manager(10)
+        self.assertEqual(mgr.get_selected_board_size(), 0)
+        select(mgr)
+        self.assertEqual(mgr.get_selected_board_size(), 10)
+
+    def test_decode_rejects_wrongly_sized_arrays(self):
+        mgr = make_manager(10)
+        n = select(mgr)
+        self.assertGreater(n, 0)
+        policy_size = py40kl.StateEncoder.get_policy_size(10)
+
+        # Each of these is a whole number of policy arrays for some other
+        # board size (e.g. 25, for the last), so must be rejected:
+        for size in (0, n * policy_size - 1, n * policy_size + 1,
+                     n * py40kl.StateEncoder.get_policy_size(25)):
+            with self.assertRaises(RuntimeError):
+                mgr.decode_selected_policies(array('f', [0.0] * size))
+
+        policies = mgr.decode_selected_policies(
+            array('f', [1.0] * (n * policy_size)))
+        self.assertEqual(len(policies), n)
+
+    def test_update_rejects_wrongly_sized_arrays(self):
+        mgr = make_manager(10)
+        n = select(mgr)
+        self.assertGreater(n, 0)
+        values = array('f', [0.0] * n)
+
+        wrong_size = n * py40kl.StateEncoder.get_policy_size(25)
+        with self.assertRaises(RuntimeError):
+            mgr.update_from_network(values, array('f', [0.0] * wrong_size))
+        self.assertTrue(mgr.is_waiting())
+
+        mgr.update_from_network(values, array('f', [1.0] * (
+            n * py40kl.StateEncoder.get_policy_size(10))))
+        self.assertFalse(mgr.is_waiting())
+
+
+class StreamingResetTests(unittest.TestCase):
+
+    def test_reset_rejects_no_concurrent_games(self):
+        mgr = make_manager(10)
+        pool = [mgr.get_current_game_states()[0]]
+        with self.assertRaises(RuntimeError):
+            mgr.reset(pool, 0, 5)
+        with self.assertRaises(RuntimeError):
+            mgr.reset([], 2, 5)
+
+        mgr.reset(pool, 2, 5)
+        self.assertEqual(select(mgr), 2)
+
+
+if __name__ == '__main__':
+    unittest.main()
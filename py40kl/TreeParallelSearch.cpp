@@ -0,0 +1,90 @@
+#include "BoostPython.h"
+#include "GIL.h"
+#include "MCTSNodeWrapper.h"
+#include <TreeParallelSearch.h>
+#include <NeuralNetwork.h>
+#include <stdexcept>
+using namespace c40kl;
+
+
+//Version of Search() which takes a Python callable, in the same form as
+// the one given to SelfPlayManager.search_for(). The threads take turns
+// to hold the GIL while calling it, so only the tree search itself runs
+// in parallel.
+size_t TreeParallelSearch_PySearch(TreeParallelSearch& search, const MCTSNodeWrapper& root,
+	size_t numSimulations, size_t milliseconds, object evaluator)
+{
+	//Each thread has its own Python error state, so the first error
+	// raised by the callable is moved to this thread to be raised here.
+	// (These are only touched while holding the GIL.)
+	PyObject *pErrorType = nullptr, *pErrorValue = nullptr, *pErrorTraceback = nullptr;
+
+	auto cppEvaluator = [&](const std::vector<GameState>& states,
+		std::vector<float>& outValues, std::vector<std::vector<float>>& outPolicies)
+	{
+		AcquireGIL acquire;
+		try
+		{
+			object result = evaluator(states);
+			outValues = ConvertValues(result[0]);
+			outPolicies = ConvertPolicies(result[1]);
+		}
+		catch (const error_already_set&)
+		{
+			if (pErrorType == nullptr)
+				PyErr_Fetch(&pErrorType, &pErrorValue, &pErrorTraceback);
+			else
+				PyErr_Clear();
+			throw;
+		}
+	};
+
+	try
+	{
+		ReleaseGIL release;
+		return search.Search(root.GetRawPtr(), numSimulations, milliseconds, cppEvaluator);
+	}
+	catch (const error_already_set&)
+	{
+		PyErr_Restore(pErrorType, pErrorValue, pErrorTraceback);
+		throw;
+	}
+	catch (...)
+	{
+		Py_XDECREF(pErrorType);
+		Py_XDECREF(pErrorValue);
+		Py_XDECREF(pErrorTraceback);
+		throw;
+	}
+}
+
+
+//Version of Search() which evaluates leaves with the built-in network,
+// so every thread runs without calling into Python at all.
+size_t TreeParallelSearch_PySearchWithNetwork(TreeParallelSearch& search, const MCTSNodeWrapper& root,
+	size_t numSimulations, size_t milliseconds, const NeuralNetwork& network)
+{
+	if (root.GetState().GetBoardState().GetSize() != network.GetBoardSize())
+		throw std::runtime_error("States must have the same board size as the network.");
+
+	auto evaluator = [&network](const std::vector<GameState>& states,
+		std::vector<float>& outValues, std::vector<std::vector<float>>& outPolicies)
+	{
+		network.Evaluate(states, outValues, outPolicies);
+	};
+
+	ReleaseGIL release;
+	return search.Search(root.GetRawPtr(), numSimulations, milliseconds, evaluator);
+}
+
+
+void ExportTreeParallelSearch()
+{
+	class_<TreeParallelSearch, boost::noncopyable>("TreeParallelSearch", init<float, int, size_t>())
+		.def("search", &TreeParallelSearch_PySearch)
+		.def("search", &TreeParallelSearch_PySearchWithNetwork)
+		.def("set_seed", &TreeParallelSearch::SetSeed)
+		.def("get_num_threads", &TreeParallelSearch::GetNumThreads)
+		.def("get_last_num_simulations", &TreeParallelSearch::GetLastNumSimulations)
+		.def("get_last_num_collisions", &TreeParallelSearch::GetLastNumCollisions);
+}
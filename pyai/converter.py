@@ -83,16 +83,74 @@ def phase_to_vector(phase):
         return [0.0, 0.0, 0.0, 1.0]
 
 
-def convert_states_to_arrays(game_states):
+def convert_states_to_arrays(game_states, workers=None):
     """
-    Convert a list of game states into a list of board
-    arrays and a list of phase vectors. This function
+    Convert a list of game states into an array of board
+    arrays and an array of phase vectors. This function
     is used for preparing game input in a format that
-    a neural network can use.
+    a neural network can use. The conversion is done
+    in C++ (see StateEncoder), giving the same result as
+    board_to_array() and phase_to_vector() on each state,
+    but without creating Python objects for every square.
+    'workers' is an optional py40kl.WorkerPool to split the
+    work between (kept by the caller, to reuse its threads.)
     """
-    return ([board_to_array(state.get_board_state(), state.get_acting_team())
-             for state in game_states],
-            [phase_to_vector(state.get_phase()) for state in game_states])
+    game_states = _to_state_array(game_states)
+    n = len(game_states)
+    size = game_states[0].get_board_state().get_size() if n > 0 else 0
+
+    boards = np.empty((n, size, size, NUM_FEATURES * 2), dtype=np.float32)
+    phases = np.empty((n, py40kl.StateEncoder.NUM_PHASES), dtype=np.float32)
+    py40kl.StateEncoder.encode_states(game_states, boards, phases,
+                                      workers=workers)
+
+    return boards, phases
+
+
+def _to_state_array(game_states):
+    """
+    Convert a list of game states into a GameStateArray, which
+    can be passed to the C++ functions without copying each time.
+    """
+    if isinstance(game_states, py40kl.GameStateArray):
+        return game_states
+
+    states = py40kl.GameStateArray()
+    states.extend(game_states)
+    return states
+
+
+def policies_to_arrays(policies, game_states):
+    """
+    Convert a list of policies (distributions over actions) into
+    an array of shape (len(game_states), 2 * BOARD_SIZE * BOARD_SIZE + 1),
+    where each row is policy_to_array() of the corresponding policy.
+    The conversion is done in C++ (see StateEncoder).
+    """
+    game_states = _to_state_array(game_states)
+    n = len(game_states)
+    size = game_states[0].get_board_state().get_size() if n > 0 else 0
+
+    policy_arrays = np.empty((n, py40kl.StateEncoder.get_policy_size(size)),
+                             dtype=np.float32)
+    py40kl.StateEncoder.encode_policies(game_states, policies, policy_arrays)
+    return policy_arrays
+
+
+def arrays_to_policies(policy_arrays, game_states):
+    """
+    Convert the policy outputs of the network, of shape
+    (len(game_states), 2 * BOARD_SIZE * BOARD_SIZE + 1), into a
+    list of distributions over each state's actions, where each
+    is array_to_policy() of the corresponding array. The conversion
+    is done in C++ (see StateEncoder). When the states were returned
+    from SelfPlayManager.select(), use the manager's
+    decode_selected_policies() instead, which reuses the actions
+    cached in its search trees.
+    """
+    policy_arrays = np.ascontiguousarray(policy_arrays, dtype=np.float32)
+    return py40kl.StateEncoder.decode_policies(_to_state_array(game_states),
+                                               policy_arrays)
 
 
 def policy_to_array(policy, game_state):
@@ -102,76 +160,23 @@ def policy_to_array(policy, game_state):
     which has the same length as game_state.get_commands().
     This function returns an array of size 2 * BOARD_SIZE * BOARD_SIZE + 1.
     This represents the probability of a particular source position, a
-    particular target position, or just ending phase.
-    """
-    actions = game_state.get_commands()
-    assert(len(policy) == len(actions))
-    sz = game_state.get_board_state().get_size()
-    policy_array = [0.0] * (2 * sz * sz + 1)
-    for action, prob in zip(actions, policy):
-        if action.get_type() == py40kl.CommandType.UNIT_ORDER:
-            source = action.get_source_position()
-            target = action.get_target_position()
-            source_idx = source.x + source.y * sz
-            target_idx = target.x + target.y * sz
-            # add the probability to existing values, because
-            # we may have many actions for each source and each
-            # target.
-            policy_array[source_idx] += prob
-            policy_array[target_idx] += prob
-        else:
-            policy_array[-1] = prob
-
-    return policy_array
+    particular target position, or just ending phase. Each unit order
+    adds its probability to the entries for its source and target
+    squares (indexed by x + y * BOARD_SIZE), because there may be
+    many actions for each source and each target.
+    """
+    return [float(x) for x in policies_to_arrays([policy], [game_state])[0]]
 
 
 def array_to_policy(policy_array, game_state):
     """
     Convert the policy output of the network, in array form, into
-    a true policy over the potential game actions. The input array
-    is given in logit probabilities. The returned array is a distribution
-    over game_state.get_commands().
-    """
-    sz = game_state.get_board_state().get_size()
-    assert(len(policy_array) == 2 * sz * sz + 1)
-    actions = game_state.get_commands()
-    policy = [0.0] * len(actions)
-    for i, action in enumerate(actions):
-        if action.get_type() == py40kl.CommandType.UNIT_ORDER:
-            source = action.get_source_position()
-            target = action.get_target_position()
-
-            source_idx = source.x + source.y * sz
-            target_idx = target.x + target.y * sz
-
-            # Get probabilities
-            p_source = policy_array[source_idx]
-            p_target = policy_array[target_idx]
-
-            # Multiply the probabilities to 'and' them:
-            policy[i] = p_source * p_target
-        else:
-            # End phase is at the end of policy_array
-
-            # We need to square this probability to keep
-            # it on the same order as the other probabilities
-            # in the policy - because they will be the product
-            # of a source and target. I.e. we just want to make
-            # a uniform output from the neural network transfer
-            # to a uniform output over final policies.
-
-            policy[i] = policy_array[-1] ** 2.0
-
-    # NOTE: slight hack, we want to discourage passing, so
-    # multiply pass probability by a small value:
-    policy[-1] *= 1.0e-3
-
-    # Normalise:
-    policy = np.array(policy)
-    s = np.sum(policy)
-    if s == 0.0:
-        # Panic and return this
-        return [1.0] + [0.0] * (len(policy) - 1)
-    else:
-        policy /= np.sum(policy)
-        return [float(x) for x in policy]
+    a true policy over the potential game actions. The returned array
+    is a distribution over game_state.get_commands(). Each unit order
+    gets the product of the probabilities of its source and target
+    squares, and ending the phase gets the square of its probability
+    (so a uniform output from the network gives a uniform policy.)
+    The probability of the last action (passing) is then multiplied
+    by a small value to discourage it, and the result is normalised.
+    """
+    return list(arrays_to_policies([policy_array], [game_state])[0])
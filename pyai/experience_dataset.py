@@ -1,21 +1,22 @@
 import numpy as np
-import pandas as pd
-import dask.dataframe as dd
+import py40kl
 import os
+from glob import iglob
 
 
 class ExperienceDataset:
     """
     This class is used for recording "experiences" for the AI to learn
     from, so they can be used multiple times. This stores experiences
-    in several files. It does this by creating a pandas dataframe for
-    each commit(), saving in the Parquet file format, and then uses the
-    Dask library to read all of these in at once and create a sample from
-    them. We thus never store the experience dataset in memory in large
-    proportions.
+    in several files, one for each commit(), in the binary experience
+    file format (see ExperienceFile in the C++ library). Records in
+    these files have a fixed size, so sampling only needs to read the
+    records chosen, and we never store the experience dataset in memory
+    in large proportions.
     """
 
-    def __init__(self, filename, board_size, num_board_features):
+    def __init__(self, filename, board_size, num_board_features,
+                 recency_half_life=0.0):
         assert('*' in filename)  # need wildcard for the index
 
         self.filename = filename
@@ -32,39 +33,40 @@ class ExperienceDataset:
 
         self.buffer_size = 0  # number of games being fed into buffer
 
+        # The sampler maps every experience file, and draws records
+        # straight into preallocated arrays:
+        self.sampler = py40kl.ExperienceSampler()
+        self.sampler.set_recency_half_life(recency_half_life)
+        self.sampled_files = set()
+        self.sample_buffers = None
+
     def sample(self, n):
-        # returns game_states (as arrays), phase vectors, values, policies
-
-        # Load all data (lazily)
-        dataset = dd.read_parquet(self.filename)
-
-        # unfortunately Dask does not support drawing a specific number of
-        # samples from dataset. Instead, sample 10% and trim to the given
-        # size (bit of a hacky workaround, though.)
-        sample = np.empty((0, 4))
-        while len(sample) < n:
-            s = dataset.sample(frac=0.1, replace=True)
-            if s.shape[1] > 4:
-                s = np.delete(np.array(s.values), 4, 1)  # trim last column
-            sample = np.concatenate((sample, s), axis=0)
-
-        # Clip to correct size if we went over:
-        sz = min(n, sample.shape[0])
-        sample = sample[:sz]
-
-        # Compute shape of game state arrays:
-        gs_shape = (self.board_size, self.board_size,
-                    self.num_board_features * 2)
-
-        # Note that each entry in the sample array is a string which
-        # needs converting into a numpy array. Also, fromstring interprets
-        # as a 1D array, so we need to reshape the game state elements to
-        # make them the correct shape.
-        states = np.array([np.fromstring(x, sep=',').reshape(gs_shape)
-                           for x in sample.T[0]])
-        values = np.array(list(sample.T[1]))  # list of floats so this is fine
-        policies = np.array([np.fromstring(x, sep=',') for x in sample.T[2]])
-        phases = np.array([np.fromstring(x, sep=',') for x in sample.T[3]])
+        """
+        Draw n experiences (with replacement) from all experience files,
+        returning (game_states, phase vectors, values, policies) arrays.
+        Note that the arrays are reused by the next call to sample(),
+        so they must be copied if they are needed for longer.
+        """
+        # Map any new files, oldest first (committed files never change,
+        # and recency weighting relies on this ordering):
+        new_files = [f for f in iglob(self.filename)
+                     if f not in self.sampled_files]
+        for fname in sorted(new_files, key=os.path.getmtime):
+            self.sampler.add_file(fname)
+            self.sampled_files.add(fname)
+
+        if self.sample_buffers is None or len(self.sample_buffers[2]) != n:
+            policy_size = 2 * self.board_size * self.board_size + 1
+            self.sample_buffers = (
+                np.empty((n, self.board_size, self.board_size,
+                          self.num_board_features * 2), dtype=np.float32),
+                np.empty((n, py40kl.StateEncoder.NUM_PHASES),
+                         dtype=np.float32),
+                np.empty((n,), dtype=np.float32),
+                np.empty((n, policy_size), dtype=np.float32))
+
+        states, phases, values, policies = self.sample_buffers
+        self.sampler.sample(states, phases, values, policies)
 
         return states, phases, values, policies
 
@@ -124,30 +126,34 @@ class ExperienceDataset:
         del self.buffer_ph
         del self.buffer_gs_teams
 
-        # Convert numpy to string, so we can serialise it:
-        def to_serialisable_format(A):
-            # Convert A to numpy array first, then
-            # reshape so that it's a 1D array, then
-            # convert to list then string to get it
-            # in a good format, then trim the opening
-            # and closing brackets.
-            return str(list(np.array(A).reshape((-1,))))[1:-1]
-        exp_states = map(to_serialisable_format, exp_states)
-        exp_policies = map(to_serialisable_format, exp_policies)
-        exp_phases = map(to_serialisable_format, exp_phases)
-
-        # Put data in a Pandas dataframe, embed this
-        # in a Dask dataframe, save to new file.
-        new_data = pd.DataFrame(data=[(s, v, po, ph) for
-                                      s, v, po, ph in zip(
-                                      exp_states,
-                                      exp_values,
-                                      exp_policies,
-                                      exp_phases
-                                      )],
-                                columns=['state', 'value',
-                                         'policy', 'phase'])
-        new_data = dd.from_pandas(new_data, npartitions=1)
+        # Put the experiences in record form, and save them:
+        num_exps = len(exp_states)
+        if num_exps == 0:
+            return
+
+        self.commit_records(np.concatenate(
+            (np.array(exp_states, dtype=np.float32).reshape((num_exps, -1)),
+             np.array(exp_phases, dtype=np.float32).reshape((num_exps, -1)),
+             np.array(exp_policies, dtype=np.float32).reshape((num_exps, -1)),
+             np.array(exp_values, dtype=np.float32).reshape((num_exps, 1))),
+            axis=1))
+
+    def commit_records(self, records):
+        """
+        Write a batch of experience records, as emitted by the self-play
+        manager's pop_finished_records() (see StateEncoder in the C++
+        library), to a new file in our dataset. 'records' should be a
+        float32 array with one record per row, each laid out as
+        [board planes][phase vector][policy][value], where the value is
+        already with respect to the acting team in each state. Unlike
+        commit(), this doesn't use the buffer at all.
+        """
+        records = np.ascontiguousarray(records, dtype=np.float32)
+        if len(records) == 0:
+            return
+
+        assert(records.shape[1] ==
+               py40kl.StateEncoder.get_record_size(self.board_size))
 
         # Determine filename to save to (by replacing
         # wildcard.)
@@ -156,7 +162,10 @@ class ExperienceDataset:
             i += 1
 
         # Save the data
-        new_data.to_parquet(self.filename.replace('*', str(i)))
+        writer = py40kl.ExperienceFileWriter(self.filename.replace('*', str(i)),
+                                             self.board_size)
+        writer.write(records)
+        writer.close()
 
     def add_to_buffer(self, game_states, teams, phases, policies, ids=None):
         """
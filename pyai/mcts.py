@@ -1,5 +1,6 @@
 from pyapp.game_util import select_randomly
 import py40kl
+import time
 
 
 class MCTS:
@@ -73,69 +74,106 @@ class MCTS:
         print("Simulating", n, "steps...")
         # For each simulation...
         for i in range(n):
-            cur_node = self.root
+            self._simulate_once()
 
-            # Simulate until the end of our MCTS tree:
-            while not cur_node.is_leaf() and not cur_node.is_terminal():
-                # Compute distribution over actions:
-                action_dist = \
-                    self.tree_policy.get_action_distribution(cur_node)
-
-                actions = cur_node.get_actions()
-                # Select an action according to our tree policy:
-                action_idx = select_randomly([i for i in range(len(actions))],
-                                             action_dist)
-
-                # Get resulting state distribution:
-                state_results = cur_node.get_state_results(action_idx)
-                state_dist = cur_node.get_state_result_distribution(action_idx)
-
-                # Select a state (via the random state transition dynamics)
-                # and then update the current node
-                cur_node = select_randomly(state_results, state_dist)
-
-            # Add value statistic and expand if nonterminal node:
-            if cur_node.is_terminal():
-                # Note that, in this case, since the state is terminal,
-                # this is not an estimate - it is a true value!
-                value_estimate = cur_node.get_state().get_game_value(self.team)
-
-                # Add new statistic:
-                cur_node.add_value_statistic(value_estimate)
-
-            elif cur_node.is_leaf():
-                # This means we need to get actions and prior probabilities
-                actions = cur_node.get_actions()
-
-                priors = self.est_strategy.compute_prior_distribution(
-                    cur_node.get_state(), actions)
-
-                value_estimate = self.est_strategy.compute_value_estimate(
-                    cur_node.get_state())
-
-                # Add new statistic:
-                cur_node.add_value_statistic(value_estimate)
-
-                cur_node.expand(priors)
-
-                # Apply an action sampled from the prior:
-                action_idx = select_randomly([i for i in range(len(actions))],
-                                             priors)
-
-                # Get resulting state distribution:
-                state_results = cur_node.get_state_results(action_idx)
-                state_dist = cur_node.get_state_result_distribution(action_idx)
+    """
+    Simulate repeatedly until the given number of seconds have
+    passed, to improve the current action distribution estimate
+    within a predictable amount of time. At least one simulation
+    is always performed. Returns the number of simulations.
+    """
+    def simulate_for(self, seconds):
+        deadline = time.monotonic() + seconds
+        n = 0
+        while n == 0 or time.monotonic() < deadline:
+            self._simulate_once()
+            n += 1
+        print("Simulated", n, "steps in", seconds, "seconds")
+        return n
 
-                # Select a state (via the random state transition dynamics)
-                # and then update the current node
-                cur_node = select_randomly(state_results, state_dist)
+    """
+    Simulate on several threads at once, with a py40kl.TreeParallelSearch
+    (which must have been created with this tree's team) and an evaluator
+    it accepts, such as a py40kl.NeuralNetwork, until n simulations are
+    made or the given number of seconds pass. Returns the number of
+    simulations.
+    """
+    def simulate_in_parallel(self, search, evaluator, n, seconds=None):
+        milliseconds = 0 if seconds is None else max(int(seconds * 1000), 1)
+        n = search.search(self.root, n, milliseconds, evaluator)
+        print("Simulated", n, "steps on", search.get_num_threads(),
+              "threads, with", search.get_last_num_collisions(),
+              "collisions")
+        return n
 
-                # We will then backpropagate this valule below!
-                # Determine if we have just gone deeper into the tree:
-                depth = cur_node.get_depth()
-                if depth > self.maxDepth:
-                    self.maxDepth = depth
-                    print("MCTS tree deepened to", depth)
+    """
+    Perform a single simulation: select a leaf, evaluate and
+    expand it, and backpropagate the value.
+    """
+    def _simulate_once(self):
+        cur_node = self.root
+
+        # Simulate until the end of our MCTS tree:
+        while not cur_node.is_leaf() and not cur_node.is_terminal():
+            # Compute distribution over actions:
+            action_dist = \
+                self.tree_policy.get_action_distribution(cur_node)
+
+            actions = cur_node.get_actions()
+            # Select an action according to our tree policy:
+            action_idx = select_randomly([i for i in range(len(actions))],
+                                         action_dist)
+
+            # Get resulting state distribution:
+            state_results = cur_node.get_state_results(action_idx)
+            state_dist = cur_node.get_state_result_distribution(action_idx)
+
+            # Select a state (via the random state transition dynamics)
+            # and then update the current node
+            cur_node = select_randomly(state_results, state_dist)
+
+        # Add value statistic and expand if nonterminal node:
+        if cur_node.is_terminal():
+            # Note that, in this case, since the state is terminal,
+            # this is not an estimate - it is a true value!
+            value_estimate = cur_node.get_state().get_game_value(self.team)
+
+            # Add new statistic:
+            cur_node.add_value_statistic(value_estimate)
+
+        elif cur_node.is_leaf():
+            # This means we need to get actions and prior probabilities
+            actions = cur_node.get_actions()
+
+            priors = self.est_strategy.compute_prior_distribution(
+                cur_node.get_state(), actions)
+
+            value_estimate = self.est_strategy.compute_value_estimate(
+                cur_node.get_state())
+
+            # Add new statistic:
+            cur_node.add_value_statistic(value_estimate)
+
+            cur_node.expand(priors)
+
+            # Apply an action sampled from the prior:
+            action_idx = select_randomly([i for i in range(len(actions))],
+                                         priors)
+
+            # Get resulting state distribution:
+            state_results = cur_node.get_state_results(action_idx)
+            state_dist = cur_node.get_state_result_distribution(action_idx)
+
+            # Select a state (via the random state transition dynamics)
+            # and then update the current node
+            cur_node = select_randomly(state_results, state_dist)
+
+            # We will then backpropagate this valule below!
+            # Determine if we have just gone deeper into the tree:
+            depth = cur_node.get_depth()
+            if depth > self.maxDepth:
+                self.maxDepth = depth
+                print("MCTS tree deepened to", depth)
 
     """
     Get the current simulation count from the current tree root.
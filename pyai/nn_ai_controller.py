@@ -1,7 +1,9 @@
+import sys
 from pyai.mcts import MCTS
 from pyai.mcts_strategies import VisitCountStochasticPolicyStrategy
 from pyai.nn_estimator_strategy import NeuralNetworkEstimatorStrategy
-from pyapp.game_util import select_randomly
+from pyai.nn_model import NNModel
+from pyapp.game_util import select_randomly, describe_ai_action
 import py40kl
 
 
@@ -10,25 +12,50 @@ class NeuralNetworkAIController:
     This AI controller uses MCTS guided by neural networks; in particular,
     it uses UCB1 in the tree, and uses the value and policy heads of the
     neural network to provide the prior estimates for the tree search.
+    move_time : if given, the number of seconds to search for before
+                each decision, instead of a fixed number of searches.
+    threads : if > 1, search the tree with this many threads at once,
+              running the network with the built-in inference engine.
     """
 
-    def __init__(self, model, nn_filename):
+    def __init__(self, model, nn_filename, move_time=None, threads=1):
         self.model = model
+        self.move_time = move_time
         self.filename = nn_filename
+        self.threads = threads
         self.tau = 0.5
         self.exploratoryParam = 2.0 * 2.0 ** 0.5
         self.N = 800  # number of searches before making a decision
         self.tree = None
+        self.search = None
+        self.network = None
+        if threads > 1:
+            self._load_network()
         self.on_turn_changed()  # Sets up the MCTS tree
 
+    def _load_network(self):
+        # The threads can only run the network at the same time with the
+        # built-in inference engine (which doesn't need the GIL), so the
+        # weights are exported for it once, here:
+        board_size = self.model.get_state().get_board_state().get_size()
+        nn_model = NNModel(board_size=board_size,
+                           num_epochs=0,  # dummy, we don't need this
+                           filename=self.filename)
+        self.network = nn_model.load_native_network()
+
     def on_update(self):
-        if len(self.model.get_actions()) == 1:
+        if self.search is not None:
+            self._simulate_in_parallel()
+        elif len(self.model.get_actions()) == 1:
             # If there is only one action to perform,
             # defer properly simulating until later.
             # But we still need to make the root node
             # a non-leaf, so simulate one step to set
             # up the tree:
             self.tree.simulate(1)
+        elif self.move_time is not None:
+            # Search for a fixed amount of time, for predictable latency:
+            self.tree.simulate_for(self.move_time)
         else:
             # Simulate only enough to bring us up to the sample target:
             self.tree.simulate(self.N - self.tree.get_num_samples())
@@ -38,46 +65,25 @@ class NeuralNetworkAIController:
 
         # Select and apply:
         action = select_randomly(actions, dist)
-        if action.get_type() != py40kl.CommandType.UNIT_ORDER:
-            # Log what happened
-            if len(actions) > 1:
-                print("AI decided to end turn/phase")
-            else:
-                print("AI ended turn (no other possible actions.)")
-        else:
-            # Determine target position:
-            target_pos = action.get_target_position()
-
-            # Determine source position:
-            source_pos = action.get_source_position()
-
-            # Cache board state
-            board = self.model.get_state().get_board_state()
-
-            # Log what happened:
-            unit = board.get_unit_on_square(source_pos)
-            verb, subject = "", ""
-            if self.model.get_phase() == py40kl.Phase.MOVEMENT:
-                verb = "move to"
-                subject = str((target_pos.x, target_pos.y))
-            elif self.model.get_phase() == py40kl.Phase.SHOOTING:
-                verb = "shoot"
-                target = board.get_unit_on_square(target_pos)
-                subject = target.name
-            elif self.model.get_phase() == py40kl.Phase.CHARGE:
-                verb = "charge location"
-                subject = str((target_pos.x, target_pos.y))
-            else:
-                verb = "fight"
-                target = board.get_unit_on_square(target_pos)
-                subject = target.name
-
-            print("AI decided for", unit.name, "to", verb, subject)
+
+        # Log what happened:
+        describe_ai_action(self.model, action, len(actions))
 
         # Actually apply the changes
         self.model.choose_action(action)
         self.tree.commit(self.model.get_state())
 
+    def _simulate_in_parallel(self):
+        # As above, but on every thread at once:
+        if len(self.model.get_actions()) == 1:
+            self.tree.simulate_in_parallel(self.search, self.network, 1)
+        elif self.move_time is not None:
+            self.tree.simulate_in_parallel(self.search, self.network,
+                                           sys.maxsize, self.move_time)
+        else:
+            n = max(self.N - self.tree.get_num_samples(), 0)
+            self.tree.simulate_in_parallel(self.search, self.network, n)
+
     def on_click_position(self, pos, bLeft):
         pass  # AI doesn't care about clicks
 
@@ -95,9 +101,14 @@ class NeuralNetworkAIController:
         rootState = self.model.get_state()
         treePolicy = py40kl.UCB1PolicyStrategy(self.exploratoryParam, team)
         finalPolicy = VisitCountStochasticPolicyStrategy(self.tau)
-        estStrategy = NeuralNetworkEstimatorStrategy(team,
-                                                     board_size=board_size,
-                                                     filename=self.filename)
+        if self.network is not None:
+            # The parallel search evaluates leaves itself
+            estStrategy = None
+            self.search = py40kl.TreeParallelSearch(self.exploratoryParam,
+                                                    team, self.threads)
+        else:
+            estStrategy = NeuralNetworkEstimatorStrategy(
+                team, board_size=board_size, filename=self.filename)
 
         # Create MCTS tree
         self.tree = MCTS(rootState, treePolicy, finalPolicy, estStrategy)
@@ -1,3 +1,8 @@
+import os
+import struct
+import tempfile
+import py40kl
+import numpy as np
 import tensorflow as tf
 from tensorflow.keras import Model, Input
 from tensorflow.keras.layers import (Conv2D, BatchNormalization, Dense,
@@ -8,6 +13,10 @@ from pyai.converter import NUM_FEATURES
 tf.logging.set_verbosity(tf.logging.WARN)  # don't print info logs
 
 
+# The activation function codes used by py40kl.NeuralNetwork
+ACTIVATIONS = {'linear': 0, 'relu': 1, 'tanh': 2, 'softmax': 3}
+
+
 class NNModel:
     """
     This is the neural network model for predicting game values
@@ -24,39 +33,47 @@ class NNModel:
         # the current game's phase.
         self.phase_input = Input(shape=(4,))
 
+        # The layers are kept, in the order they're applied and each with
+        # the batch normalisation following it (if any), so that they can
+        # be written out by export_weights(). They're created in the same
+        # order as always, so that existing weight files still load.
+        self.conv_layers = []
+        self.dense_layers = []
+        self.value_layers = []
+        self.policy_layers = []
+
         # main neural network body
-        x = Conv2D(256, (3, 3), activation='relu',
-                   input_shape=self.board_input.shape[1:]
-                   )(self.board_input)
-        x = BatchNormalization()(x)
-        x = Conv2D(256, (3, 3), activation='relu')(x)
-        x = BatchNormalization()(x)
-        x = Conv2D(128, (3, 3), activation='relu')(x)
-        x = BatchNormalization()(x)
-        x = Conv2D(128, (3, 3), activation='relu')(x)
-        x = BatchNormalization()(x)
-        x = Conv2D(128, (3, 3), activation='relu')(x)
-        x = BatchNormalization()(x)
+        x = self.board_input
+        for filters in (256, 256, 128, 128, 128):
+            x = self._apply(self.conv_layers, x,
+                            Conv2D(filters, (3, 3), activation='relu'),
+                            BatchNormalization())
         x = Flatten()(x)  # flatten CNN output
         x = concatenate([x, self.phase_input])  # add phase input
-        x = Dense(1024, activation='relu')(x)
-        x = BatchNormalization()(x)
-        x = Dense(1024, activation='relu')(x)
+        x = self._apply(self.dense_layers, x,
+                        Dense(1024, activation='relu'),
+                        BatchNormalization())
+        x = self._apply(self.dense_layers, x,
+                        Dense(1024, activation='relu'))
 
         # construct value head of network
-        self.value_head = Dense(512, activation='relu')(x)
-        self.value_head = Dense(128, activation='relu')(self.value_head)
-        self.value_head = Dense(1, activation='tanh',
-                                name='value_head')(self.value_head)
+        self.value_head = self._apply(self.value_layers, x,
+                                      Dense(512, activation='relu'))
+        self.value_head = self._apply(self.value_layers, self.value_head,
+                                      Dense(128, activation='relu'))
+        self.value_head = self._apply(self.value_layers, self.value_head,
+                                      Dense(1, activation='tanh',
+                                            name='value_head'))
         # value head returns +1 for estimated win and -1 for estimated
         # loss, and all values inbetween
 
         # construct policy head of network
-        self.policy_head = Dense(1024,
-                                 activation='relu')(x)
-        self.policy_head = Dense(2 * self.board_size * self.board_size + 1,
-                                 activation='softmax',
-                                 name='policy_head')(self.policy_head)
+        self.policy_head = self._apply(self.policy_layers, x,
+                                       Dense(1024, activation='relu'))
+        self.policy_head = self._apply(
+            self.policy_layers, self.policy_head,
+            Dense(2 * self.board_size * self.board_size + 1,
+                  activation='softmax', name='policy_head'))
 
         # Explanation of the policy head output:
         # the first board_size * board_size elements represent the
@@ -83,6 +100,16 @@ class NNModel:
         if filename is not None:
             self.model.load_weights(filename)
 
+    @staticmethod
+    def _apply(layers, x, layer, batch_norm=None):
+        # Apply a layer (and optionally batch normalisation) to x,
+        # recording them in the given list.
+        x = layer(x)
+        if batch_norm is not None:
+            x = batch_norm(x)
+        layers.append((layer, batch_norm))
+        return x
+
     def train(self, input_game_states, input_phases, values, policies):
         # input game states and phases: should be in array form
         # values: should be a list of scalars
@@ -116,3 +143,51 @@ class NNModel:
 
     def save(self, filename):
         self.model.save_weights(filename)
+
+    def load_native_network(self, num_threads=1):
+        """
+        Get a py40kl.NeuralNetwork with this model's weights, to run the
+        network in C++. The weights are exported to a temporary file
+        (see export_weights()), which is deleted once they are loaded.
+        """
+        with tempfile.TemporaryDirectory() as directory:
+            filename = os.path.join(directory, "network.bin")
+            self.export_weights(filename)
+            return py40kl.NeuralNetwork(filename, num_threads)
+
+    def export_weights(self, filename):
+        """
+        Write the weights in the format read by py40kl.NeuralNetwork
+        (see NeuralNetwork.h), so that the network can be run in C++.
+        """
+        sections = [self.conv_layers, self.dense_layers,
+                    self.value_layers, self.policy_layers]
+
+        with open(filename, 'wb') as f:
+            f.write(b'C40KLNET')
+            f.write(struct.pack('<6I', py40kl.NeuralNetwork.FILE_VERSION,
+                                self.board_size,
+                                *[len(layers) for layers in sections]))
+
+            for layers in sections:
+                for layer, batch_norm in layers:
+                    kernel, bias = layer.get_weights()
+                    kernel_size = kernel.shape[0] if kernel.ndim == 4 else 1
+                    activation = ACTIVATIONS[layer.activation.__name__]
+
+                    f.write(struct.pack(
+                        '<5If', kernel_size, kernel.shape[-2],
+                        kernel.shape[-1], activation,
+                        batch_norm is not None,
+                        batch_norm.epsilon if batch_norm is not None
+                        else 0.0))
+
+                    # Kernels are already (height, width, in, out), and
+                    # batch normalisation weights are gamma, beta,
+                    # moving mean and moving variance:
+                    weights = [kernel, bias]
+                    if batch_norm is not None:
+                        weights += batch_norm.get_weights()
+                    for w in weights:
+                        f.write(np.ascontiguousarray(w, dtype='<f4')
+                                .tobytes())
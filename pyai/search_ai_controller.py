@@ -0,0 +1,42 @@
+from pyapp.game_util import describe_ai_action
+import py40kl
+
+
+class SearchAIController:
+    """
+    This AI controller uses a depth-limited expectiminimax search
+    (with Star1/Star2 pruning) and a simple wound-counting heuristic
+    to pick its actions. It doesn't need a neural network, so it is
+    a cheap baseline opponent for evaluating trained models.
+    max_depth : the maximum number of actions to look ahead.
+    time_limit_ms : the time budget for each decision.
+    """
+
+    def __init__(self, model, max_depth=8, time_limit_ms=1000):
+        self.model = model
+        self.search = py40kl.ExpectiminimaxSearch(max_depth, time_limit_ms)
+
+    def on_update(self):
+        actions = self.model.get_actions()
+
+        action_idx = self.search.search(self.model.get_state())
+        action = actions[action_idx]
+
+        print("Search reached depth", self.search.get_last_depth(),
+              "after", self.search.get_last_node_count(), "states,",
+              "estimated value", self.search.get_last_value())
+
+        # Log what happened:
+        describe_ai_action(self.model, action, len(actions))
+
+        # Actually apply the changes
+        self.model.choose_action(action)
+
+    def on_click_position(self, pos, bLeft):
+        pass  # AI doesn't care about clicks
+
+    def on_return(self):
+        pass  # AI doesn't care about clicks
+
+    def on_turn_changed(self):
+        pass  # Search is done from scratch on every action
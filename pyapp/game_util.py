@@ -75,6 +75,49 @@ def select_randomly(results, probs):
     assert(False and "Should never reach here")
 
 
+def describe_ai_action(model, action, num_actions):
+    """
+    Print a human-readable description of the action
+    an AI controller has chosen to perform in the model's
+    current state (before the action is applied.)
+    """
+    if action.get_type() != py40kl.CommandType.UNIT_ORDER:
+        # Log what happened
+        if num_actions > 1:
+            print("AI decided to end turn/phase")
+        else:
+            print("AI ended turn (no other possible actions.)")
+    else:
+        # Determine target position:
+        target_pos = action.get_target_position()
+
+        # Determine source position:
+        source_pos = action.get_source_position()
+
+        # Cache board state
+        board = model.get_state().get_board_state()
+
+        # Log what happened:
+        unit = board.get_unit_on_square(source_pos)
+        verb, subject = "", ""
+        if model.get_phase() == py40kl.Phase.MOVEMENT:
+            verb = "move to"
+            subject = str((target_pos.x, target_pos.y))
+        elif model.get_phase() == py40kl.Phase.SHOOTING:
+            verb = "shoot"
+            target = board.get_unit_on_square(target_pos)
+            subject = target.name
+        elif model.get_phase() == py40kl.Phase.CHARGE:
+            verb = "charge location"
+            subject = str((target_pos.x, target_pos.y))
+        else:
+            verb = "fight"
+            target = board.get_unit_on_square(target_pos)
+            subject = target.name
+
+        print("AI decided for", unit.name, "to", verb, subject)
+
+
 def new_game_state(unit_roster, placements, board_size,
                    board_scale=1.0, turn_limit=-1):
     """